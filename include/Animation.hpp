@@ -41,6 +41,11 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return NiObject::GetHeapUsage() + HeapSizeOf(quaternionKeys, xRotations, yRotations, zRotations)
+			   + HeapSizeOf(translations, scales);
+	}
 };
 
 class NiTransformData : public NiCloneable<NiTransformData, NiKeyframeData> {
@@ -58,6 +63,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 class NiBoolData : public NiCloneableStreamable<NiBoolData, NiObject> {
@@ -68,6 +75,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 class NiFloatData : public NiCloneableStreamable<NiFloatData, NiObject> {
@@ -78,6 +87,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 class NiBSplineData : public NiCloneableStreamable<NiBSplineData, NiObject> {
@@ -89,6 +100,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return NiObject::GetHeapUsage() + HeapSizeOf(floatControlPoints, shortControlPoints);
+	}
 };
 
 class NiBSplineBasisData : public NiCloneableStreamable<NiBSplineBasisData, NiObject> {
@@ -224,6 +239,7 @@ public:
 	NiBlockRef<NiInterpolator> singleInterpolatorRef;
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiInterpolator::GetHeapUsage() + HeapSizeOf(interpItems); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -396,6 +412,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiInterpolator::GetHeapUsage() + HeapSizeOf(lookAtName); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -420,6 +437,8 @@ struct BSTreadTransform {
 	}
 
 	void GetStringRefs(std::vector<NiStringRef*>& refs) { refs.emplace_back(&name); }
+
+	size_t HeapSize() const { return HeapSizeOf(name); }
 };
 
 class BSTreadTransfInterpolator : public NiCloneableStreamable<BSTreadTransfInterpolator, NiInterpolator> {
@@ -431,6 +450,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiInterpolator::GetHeapUsage() + HeapSizeOf(treadTransforms);
+	}
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -501,6 +523,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return NiObject::GetHeapUsage() + HeapSizeOf(uTrans, vTrans, uScale, vScale);
+	}
 };
 
 class NiUVController : public NiCloneableStreamable<NiUVController, NiTimeController> {
@@ -588,6 +614,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiTimeController::GetHeapUsage() + HeapSizeOf(boneArrays); }
 	void GetPtrs(std::set<NiPtr*>& ptrs) override;
 };
 
@@ -637,6 +664,8 @@ struct Morph {
 	}
 
 	void GetStringRefs(std::vector<NiStringRef*>& refs) { refs.emplace_back(&frameName); }
+
+	size_t HeapSize() const { return HeapSizeOf(frameName, keys, vectors); }
 };
 
 class NiMorphData : public NiCloneableStreamable<NiMorphData, NiObject> {
@@ -652,7 +681,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(morphs); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
 
 	std::vector<Morph> GetMorphs() const;
 	void SetMorphs(const uint32_t numVerts, const std::vector<Morph>& m);
@@ -695,6 +726,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiInterpController::GetHeapUsage() + HeapSizeOf(interpolatorRefs, interpWeights, unknownInts);
+	}
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -768,6 +802,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiExtraDataController::GetHeapUsage() + HeapSizeOf(extraData);
+	}
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 };
 
@@ -779,6 +816,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(keys); }
 };
 
 class NiBoolInterpController : public NiSingleInterpController {};
@@ -836,6 +875,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiFloatInterpController::GetHeapUsage() + HeapSizeOf(sourceRefs);
+	}
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -991,6 +1033,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiInterpController::GetHeapUsage() + HeapSizeOf(targetRefs);
+	}
 	void GetPtrs(std::set<NiPtr*>& ptrs) override;
 };
 
@@ -999,6 +1044,9 @@ public:
 	NiStringRef modifierName;
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiSingleInterpController::GetHeapUsage() + HeapSizeOf(modifierName);
+	}
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 };
 
@@ -1145,6 +1193,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(palette); }
 };
 
 class ControllerLink {
@@ -1229,6 +1279,8 @@ public:
 		indices.push_back(blendInterpolatorRef.index);
 		indices.push_back(stringPaletteRef.index);
 	}
+
+	size_t HeapSize() const { return HeapSizeOf(targetName, nodeName, propType, ctrlType, ctrlID, interpID); }
 };
 
 class NiSequence : public NiCloneableStreamable<NiSequence, NiObject> {
@@ -1242,6 +1294,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiObject::GetHeapUsage() + HeapSizeOf(name, controlledBlocks);
+	}
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -1273,6 +1328,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(animNoteRefs); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -1301,6 +1357,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiSequence::GetHeapUsage() + HeapSizeOf(accumRootName, animNotesRefs);
+	}
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -1319,6 +1378,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiTimeController::GetHeapUsage() + HeapSizeOf(controllerSequenceRefs);
+	}
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
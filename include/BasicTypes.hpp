@@ -10,6 +10,7 @@ See the included GPLv3 LICENSE file
 #include "half.hpp"
 
 #include <algorithm>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -225,12 +226,17 @@ public:
 class NiIStream : public NiStreamBase {
 private:
 	std::istream* stream = nullptr;
+	bool keepPacked = false;
 
 public:
 	NiIStream(std::istream* s, NiHeaderBase* hdr)
 		: NiStreamBase(hdr)
 		, stream(s) {}
 
+	// Keep vertex data in its file form until first accessed (see NifLoadOptions::keepPacked)
+	void SetKeepPacked(const bool keep) { keepPacked = keep; }
+	bool GetKeepPacked() const { return keepPacked; }
+
 	void read(char* ptr, std::streamsize count) { stream->read(ptr, count); }
 	void ignore(std::streamsize count) { stream->ignore(count); }
 	void getline(char* ptr, std::streamsize maxCount) { stream->getline(ptr, maxCount); }
@@ -297,6 +303,9 @@ public:
 	void SetMode(Mode m) { mode = m; }
 	Mode GetMode() const { return mode; }
 
+	// True if reading vertex data should keep it in its file form (see NiIStream::SetKeepPacked)
+	bool KeepPacked() const { return mode == Mode::Reading && istream->GetKeepPacked(); }
+
 	template<typename T>
 	void Sync(T& t) {
 		Sync(reinterpret_cast<char*>(&t), sizeof(T));
@@ -458,6 +467,8 @@ public:
 		return std::unique_ptr<Derived>(static_cast<Derived*>(this->Clone_impl()));
 	}
 
+	size_t GetObjectSize() const override { return sizeof(Derived); }
+
 private:
 	virtual NiCloneable* Clone_impl() const override { return new Derived(asDer()); }
 
@@ -494,6 +505,8 @@ public:
 		return std::unique_ptr<Derived>(static_cast<Derived*>(this->Clone_impl()));
 	}
 
+	size_t GetObjectSize() const override { return sizeof(Derived); }
+
 	void Get(NiIStream& stream) override {
 		Base::Get(stream);
 		NiStreamReversible s(&stream, nullptr, NiStreamReversible::Mode::Reading);
@@ -513,6 +526,47 @@ private:
 	const Derived& asDer() const { return static_cast<const Derived&>(*this); }
 };
 
+// Heap memory owned by a value, not counting the size of the value itself.
+// Types owning heap data provide a "size_t HeapSize() const" member.
+template<typename T, typename = void>
+struct HasHeapSize : std::false_type {};
+
+template<typename T>
+struct HasHeapSize<T, std::void_t<decltype(std::declval<const T&>().HeapSize())>> : std::true_type {};
+
+template<typename T>
+size_t HeapSizeOf(const T& value) {
+	if constexpr (HasHeapSize<T>::value)
+		return value.HeapSize();
+	else
+		return 0;
+}
+
+inline size_t HeapSizeOf(const std::string& str) {
+	// Short strings are stored inside the string object
+	const char* strData = str.data();
+	const char* strObject = reinterpret_cast<const char*>(&str);
+	if (!std::less<const char*>()(strData, strObject) && std::less<const char*>()(strData, strObject + sizeof(str)))
+		return 0;
+
+	return str.capacity() + 1;
+}
+
+template<typename T, typename Alloc>
+size_t HeapSizeOf(const std::vector<T, Alloc>& vec) {
+	size_t size = vec.capacity() * sizeof(T);
+	if constexpr (!std::is_trivially_copyable_v<T>)
+		for (auto& e : vec)
+			size += HeapSizeOf(e);
+
+	return size;
+}
+
+template<typename T1, typename T2, typename... Ts>
+size_t HeapSizeOf(const T1& first, const T2& second, const Ts&... rest) {
+	return HeapSizeOf(first) + HeapSizeOf(second, rest...);
+}
+
 class NiString {
 private:
 	std::string str;
@@ -529,6 +583,7 @@ public:
 	const std::string& get() const { return str; }
 
 	size_t length() const { return str.length(); }
+	size_t HeapSize() const { return HeapSizeOf(str); }
 
 	void SetNullOutput(const bool wantNullOutput = true) { nullOutput = wantNullOutput; }
 	void clear() { str.clear(); }
@@ -563,6 +618,7 @@ public:
 	const std::string& get() const { return str; }
 
 	size_t length() const { return str.length(); }
+	size_t HeapSize() const { return HeapSizeOf(str); }
 
 	uint32_t GetIndex() const { return index; }
 	void SetIndex(const uint32_t id) { index = id; }
@@ -605,16 +661,260 @@ public:
 
 using NiPtr = NiRef;
 
+// Vector whose copies share their elements until one of them is modified (copy-on-write),
+// so copying blocks doesn't duplicate large arrays. Non-const access detaches the vector from
+// other copies first. It reads as a const std::vector; use Detach() where a modifiable one is needed.
+// References and iterators taken before the vector was copied still point into the shared
+// elements, so don't keep them across a copy.
+template<typename T>
+class SharedVector {
+public:
+	using Storage = std::vector<T>;
+	using value_type = T;
+	using size_type = typename Storage::size_type;
+	using iterator = typename Storage::iterator;
+	using const_iterator = typename Storage::const_iterator;
+
+	// Fills the elements on first access, e.g. by decoding them from file data
+	using Loader = std::function<void(Storage&)>;
+
+private:
+	mutable std::shared_ptr<Storage> vec;
+	mutable Loader loader;
+	bool unchanged = false;
+
+	// Runs a pending loader. Loading on a const access isn't thread safe.
+	void Load() const {
+		if (!loader)
+			return;
+
+		auto elements = std::make_shared<Storage>();
+		loader(*elements);
+		vec = std::move(elements);
+		loader = nullptr;
+	}
+
+public:
+	SharedVector() = default;
+	SharedVector(const Storage& elements)
+		: vec(std::make_shared<Storage>(elements)) {}
+	SharedVector(Storage&& elements)
+		: vec(std::make_shared<Storage>(std::move(elements))) {}
+	SharedVector(std::initializer_list<T> elements)
+		: vec(std::make_shared<Storage>(elements)) {}
+	explicit SharedVector(const size_type count, const T& value = T())
+		: vec(std::make_shared<Storage>(count, value)) {}
+
+	SharedVector& operator=(const Storage& elements) {
+		loader = nullptr;
+		unchanged = false;
+		if (vec && vec.use_count() == 1)
+			*vec = elements;
+		else
+			vec = std::make_shared<Storage>(elements);
+		return *this;
+	}
+
+	SharedVector& operator=(Storage&& elements) {
+		loader = nullptr;
+		unchanged = false;
+		vec = std::make_shared<Storage>(std::move(elements));
+		return *this;
+	}
+
+	SharedVector& operator=(std::initializer_list<T> elements) { return operator=(Storage(elements)); }
+
+	// Elements for reading, without detaching
+	const Storage& Get() const {
+		static const Storage emptyStorage;
+		Load();
+		return vec ? *vec : emptyStorage;
+	}
+
+	operator const Storage&() const { return Get(); }
+	operator Span<const T>() const { return Get(); }
+	operator Span<T>() { return Detach(); }
+
+	// Elements for changing, taking a private copy first if they are shared
+	Storage& Detach() {
+		Load();
+		unchanged = false;
+		if (!vec)
+			vec = std::make_shared<Storage>();
+		else if (vec.use_count() > 1)
+			vec = std::make_shared<Storage>(*vec);
+		return *vec;
+	}
+
+	// True if the elements are currently shared with a copy of this vector
+	bool IsShared() const { return vec && vec.use_count() > 1; }
+
+	// Replaces the elements with ones filled by "load" on first access
+	void SetLoader(Loader load) {
+		vec.reset();
+		loader = std::move(load);
+		unchanged = true;
+	}
+
+	// True if the loader hasn't run yet
+	bool IsLoaded() const { return !loader; }
+	// True if the elements came from the loader and weren't accessed for changing since
+	bool IsUnchanged() const { return unchanged; }
+
+	// Shared elements are split evenly between the vectors sharing them. Elements that aren't loaded yet
+	// aren't counted.
+	size_t HeapSize() const {
+		if (!vec)
+			return 0;
+		return (sizeof(Storage) + HeapSizeOf(*vec)) / static_cast<size_t>(vec.use_count());
+	}
+
+	size_type size() const { return Get().size(); }
+	size_type capacity() const { return Get().capacity(); }
+	bool empty() const { return Get().empty(); }
+
+	const T& operator[](const size_type i) const { return Get()[i]; }
+	T& operator[](const size_type i) { return Detach()[i]; }
+	const T& at(const size_type i) const { return Get().at(i); }
+	T& at(const size_type i) { return Detach().at(i); }
+
+	const T& front() const { return Get().front(); }
+	T& front() { return Detach().front(); }
+	const T& back() const { return Get().back(); }
+	T& back() { return Detach().back(); }
+
+	const T* data() const { return Get().data(); }
+	T* data() { return Detach().data(); }
+
+	const_iterator begin() const { return Get().begin(); }
+	const_iterator end() const { return Get().end(); }
+	const_iterator cbegin() const { return Get().begin(); }
+	const_iterator cend() const { return Get().end(); }
+	iterator begin() { return Detach().begin(); }
+	iterator end() { return Detach().end(); }
+
+	void clear() {
+		vec.reset();
+		loader = nullptr;
+		unchanged = false;
+	}
+
+	// Resizing to the current size doesn't detach
+	void resize(const size_type count) {
+		if (count != size())
+			Detach().resize(count);
+	}
+
+	void resize(const size_type count, const T& value) {
+		if (count != size())
+			Detach().resize(count, value);
+	}
+
+	void reserve(const size_type count) {
+		if (count > capacity())
+			Detach().reserve(count);
+	}
+
+	void shrink_to_fit() { Detach().shrink_to_fit(); }
+
+	void push_back(const T& value) { Detach().push_back(value); }
+	void push_back(T&& value) { Detach().push_back(std::move(value)); }
+
+	template<typename... Args>
+	T& emplace_back(Args&&... args) {
+		return Detach().emplace_back(std::forward<Args>(args)...);
+	}
+
+	void pop_back() { Detach().pop_back(); }
+
+	template<typename... Args>
+	void assign(Args&&... args) {
+		Detach().assign(std::forward<Args>(args)...);
+	}
+
+	// Positions have to come from the non-const iterators, which already detached
+	template<typename... Args>
+	iterator insert(Args&&... args) {
+		return Detach().insert(std::forward<Args>(args)...);
+	}
+
+	template<typename... Args>
+	iterator erase(Args&&... args) {
+		return Detach().erase(std::forward<Args>(args)...);
+	}
+
+	void swap(SharedVector& other) noexcept {
+		vec.swap(other.vec);
+		loader.swap(other.loader);
+		std::swap(unchanged, other.unchanged);
+	}
+
+	// Resizes to "count" and syncs the elements as plain data.
+	// Writing only reads the elements, so it doesn't detach shared ones.
+	void SyncData(NiStreamReversible& stream, const size_type count) {
+		static_assert(std::is_trivially_copyable_v<T>, "Elements must be plain data");
+
+		resize(count);
+		if (count == 0)
+			return;
+
+		T* elements = stream.GetMode() == NiStreamReversible::Mode::Writing ? const_cast<T*>(Get().data())
+																			: Detach().data();
+		stream.Sync(reinterpret_cast<char*>(elements), static_cast<std::streamsize>(count * sizeof(T)));
+	}
+
+	bool operator==(const SharedVector& other) const {
+		const Storage& elements = Get();
+		const Storage& otherElements = other.Get();
+		return &elements == &otherElements || elements == otherElements;
+	}
+	bool operator!=(const SharedVector& other) const { return !operator==(other); }
+	bool operator==(const Storage& other) const { return Get() == other; }
+	bool operator!=(const Storage& other) const { return Get() != other; }
+};
+
+template<typename T>
+bool operator==(const std::vector<T>& lhs, const SharedVector<T>& rhs) {
+	return rhs == lhs;
+}
+
+template<typename T>
+bool operator!=(const std::vector<T>& lhs, const SharedVector<T>& rhs) {
+	return rhs != lhs;
+}
+
 // Helper to reduce duplication
+// Copies share their elements until one of them is modified (see SharedVector), so cloning blocks
+// doesn't duplicate large arrays. Writing to a stream doesn't detach, but the ref and string walks
+// of NiSyncVector do, as their pointers are used to change the elements.
 template<typename ValueType, typename SizeType>
 class NiVectorBase {
 private:
-	std::vector<ValueType> vec;
+	SharedVector<ValueType> vec;
+
+	const std::vector<ValueType>& Get() const { return vec.Get(); }
 
 protected:
 	static constexpr size_t NumSize = sizeof(SizeType);
 	static constexpr SizeType MaxIndex = std::numeric_limits<SizeType>::max() - 1;
 
+	// Elements for writing to a stream, which only reads them and so doesn't need to detach
+	ValueType* WriteData() const { return const_cast<ValueType*>(Get().data()); }
+
+	// Calls "func" with each of the first "count" elements for writing them to a stream.
+	// Element Sync and Write functions aren't const, so shared elements are passed as a copy.
+	template<typename Func>
+	void ForEachWrite(const SizeType count, Func&& func) {
+		for (SizeType i = 0; i < count; i++) {
+			if (IsShared()) {
+				ValueType e = Get()[i];
+				func(e);
+			}
+			else
+				func(vec[i]);
+		}
+	}
+
 public:
 	NiVectorBase() = default;
 	NiVectorBase(const SizeType size) { resize(size); }
@@ -622,13 +922,20 @@ public:
 	SizeType size() const { return static_cast<SizeType>(vec.size()); }
 	bool empty() const { return vec.empty(); }
 
+	// True if the elements are currently shared with a copy of this vector
+	bool IsShared() const { return vec.IsShared(); }
+
+	size_t HeapSize() const { return vec.HeapSize(); }
+
 	void clear() { vec.clear(); }
 
 	auto begin() { return vec.begin(); }
-	auto cbegin() const { return vec.begin(); }
+	auto begin() const { return vec.begin(); }
+	auto cbegin() const { return vec.cbegin(); }
 
 	auto end() { return vec.end(); }
-	auto cend() const { return vec.end(); }
+	auto end() const { return vec.end(); }
+	auto cend() const { return vec.cend(); }
 
 	void resize(SizeType size) { vec.resize(size); }
 
@@ -636,6 +943,7 @@ public:
 	auto insert(SizeType index, ValueType& val) { vec.insert(vec.begin() + index, val); }
 
 	auto& operator[](SizeType i) { return vec[i]; }
+	const auto& operator[](SizeType i) const { return vec[i]; }
 
 	ValueType* data() { return vec.data(); }
 	const ValueType* data() const { return vec.data(); }
@@ -661,15 +969,7 @@ public:
 	}
 
 	SizeType SyncSize(NiStreamReversible& stream) {
-		SizeType sz = 0;
-
-		if (stream.GetMode() == NiStreamReversible::Mode::Writing) {
-			if (!Base::empty() && Base::size() - 1 > MaxIndex)
-				Base::resize(MaxIndex + 1);
-		}
-
-		sz = Base::size();
-
+		SizeType sz = Base::size();
 		stream.Sync(reinterpret_cast<char*>(&sz), NumSize);
 		return sz;
 	}
@@ -681,6 +981,13 @@ public:
 				throw std::length_error("IO: Array size is too large.");
 		}
 
+		if (stream.GetMode() == NiStreamReversible::Mode::Writing) {
+			ValueType* elements = Base::WriteData();
+			for (SizeType i = 0; i < size; i++)
+				stream.Sync(elements[i]);
+			return;
+		}
+
 		Base::resize(size);
 
 		for (auto& e : *this)
@@ -695,6 +1002,12 @@ public:
 				throw std::length_error("IO: Array size is too large.");
 		}
 
+		if (stream.GetMode() == NiStreamReversible::Mode::Writing) {
+			if (sz > 0)
+				stream.Sync(reinterpret_cast<char*>(Base::WriteData()), sz);
+			return;
+		}
+
 		Base::resize(sz);
 
 		if (sz > 0)
@@ -720,15 +1033,7 @@ public:
 	}
 
 	SizeType SyncSize(NiStreamReversible& stream) {
-		SizeType sz = 0;
-
-		if (stream.GetMode() == NiStreamReversible::Mode::Writing) {
-			if (!Base::empty() && Base::size() - 1 > MaxIndex)
-				Base::resize(MaxIndex + 1);
-		}
-
-		sz = Base::size();
-
+		SizeType sz = Base::size();
 		stream.Sync(reinterpret_cast<char*>(&sz), NumSize);
 		return sz;
 	}
@@ -739,6 +1044,11 @@ public:
 				throw std::length_error("IO: Array size is too large.");
 		}
 
+		if (stream.GetMode() == NiStreamReversible::Mode::Writing) {
+			Base::ForEachWrite(size, [&stream](ValueType& e) { e.Sync(stream); });
+			return;
+		}
+
 		Base::resize(size);
 
 		for (auto& e : *this)
@@ -793,14 +1103,10 @@ public:
 	}
 
 	void Write(NiOStream& stream) {
-		if (!Base::empty() && Base::size() - 1 > MaxIndex)
-			Base::resize(MaxIndex + 1);
-
 		SizeType sz = Base::size();
 		stream.write(reinterpret_cast<char*>(&sz), NumSize);
 
-		for (auto& e : *this)
-			e.Write(stream, stringSize);
+		Base::ForEachWrite(sz, [&stream](NiString& e) { e.Write(stream, stringSize); });
 	}
 
 	void Sync(NiStreamReversible& stream) {
@@ -838,14 +1144,10 @@ public:
 	}
 
 	void Write(NiOStream& stream) {
-		if (!Base::empty() && Base::size() - 1 > MaxIndex)
-			Base::resize(MaxIndex + 1);
-
 		SizeType sz = Base::size();
 		stream.write(reinterpret_cast<char*>(&sz), NumSize);
 
-		for (auto& e : *this)
-			e.Write(stream);
+		Base::ForEachWrite(sz, [&stream](NiStringRef& e) { e.Write(stream); });
 	}
 
 	void Sync(NiStreamReversible& stream) {
@@ -928,6 +1230,8 @@ public:
 
 	const_iterator cend() const { return refs.cend(); }
 
+	size_t HeapSize() const { return HeapSizeOf(refs); }
+
 	void Clear() {
 		refs.clear();
 		arraySize = 0;
@@ -1033,7 +1337,16 @@ public:
 	static constexpr const char* BlockName = "NiUnknown";
 	virtual const char* GetBlockName() { return BlockName; }
 
-	virtual void notifyVerticesDelete(const std::vector<uint16_t>&) {}
+	virtual void notifyVerticesDelete(const std::vector<uint32_t>&) {}
+	// vertMap maps each old vertex index to its new index
+	virtual void notifyVerticesReorder(const std::vector<int>&) {}
+
+	// Size of the block object itself
+	virtual size_t GetObjectSize() const { return sizeof(NiObject); }
+	// Heap memory owned by the block (arrays, strings). Overrides add the usage of their base class.
+	virtual size_t GetHeapUsage() const { return 0; }
+	// Total memory used by the block
+	size_t GetMemoryUsage() const { return GetObjectSize() + GetHeapUsage(); }
 
 	virtual void Get(NiIStream& stream) {
 		if (stream.GetVersion().File() >= V10_0_0_0 && stream.GetVersion().File() < V10_1_0_114)
@@ -1309,6 +1622,13 @@ public:
 	void Get(NiIStream& stream) override;
 	void Put(NiOStream& stream) override;
 
+	// Heap usage of the header data. The blocks list is owned by NifFile and isn't included.
+	size_t GetHeapUsage() const override {
+		return NiObject::GetHeapUsage()
+			   + HeapSizeOf(creator, exportInfo1, exportInfo2, exportInfo3, copyright1, copyright2, copyright3)
+			   + HeapSizeOf(embedData, blockTypes, blockTypeIndices, blockSizes, strings, groupSizes, rootRefs);
+	}
+
 	// Reads the file footer, which follows all blocks
 	void GetFooter(NiIStream& stream);
 	// Writes the file footer, which follows all blocks
@@ -1405,6 +1725,8 @@ public:
 	NiStringVector<> textureArray;
 
 	void Sync(NiStreamReversible& stream) { textureArray.Sync(stream); }
+
+	size_t HeapSize() const { return HeapSizeOf(textureArray); }
 };
 
 // Used for all unknown block types
@@ -1417,5 +1739,7 @@ public:
 	NiUnknown(const uint32_t size);
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(data); }
 };
 } // namespace nifly
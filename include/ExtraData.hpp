@@ -27,6 +27,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(name); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -40,6 +41,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 class NiFloatExtraData : public NiCloneableStreamable<NiFloatExtraData, NiExtraData> {
@@ -60,6 +63,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(floatsData); }
 };
 
 class NiStringExtraData : public NiCloneableStreamable<NiStringExtraData, NiExtraData> {
@@ -70,6 +75,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(stringData); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 };
 
@@ -81,6 +87,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(stringsData); }
 };
 
 class NiBooleanExtraData : public NiCloneableStreamable<NiBooleanExtraData, NiExtraData> {
@@ -111,6 +119,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(integersData); }
 };
 
 class NiVectorExtraData : public NiCloneableStreamable<NiVectorExtraData, NiExtraData> {
@@ -160,6 +170,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 class BSPositionData : public NiCloneableStreamable<BSPositionData, NiExtraData> {
@@ -170,6 +182,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 class BSEyeCenterExtraData : public NiCloneableStreamable<BSEyeCenterExtraData, NiExtraData> {
@@ -180,6 +194,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 struct BSPackedGeomObject {
@@ -210,6 +226,7 @@ struct BSPackedGeomData {
 	std::vector<Triangle> triangles;
 
 	void Sync(NiStreamReversible& stream);
+	size_t HeapSize() const { return HeapSizeOf(combined, vertData, triangles); }
 
 	void SetVertices(const bool enable);
 	bool HasVertices() const { return vertexDesc.HasFlag(VF_VERTEX); }
@@ -256,6 +273,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(objects, data); }
 };
 
 class BSInvMarker : public NiCloneableStreamable<BSInvMarker, NiExtraData> {
@@ -294,6 +313,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(positions); }
 };
 
 class BSFurnitureMarkerNode : public NiCloneable<BSFurnitureMarkerNode, BSFurnitureMarker> {
@@ -308,6 +329,8 @@ public:
 	NiVector<Vector3, uint16_t> normals;
 
 	void Sync(NiStreamReversible&);
+
+	size_t HeapSize() const { return HeapSizeOf(points, normals); }
 };
 
 class BSDecalPlacementVectorExtraData
@@ -319,6 +342,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return NiFloatExtraData::GetHeapUsage() + HeapSizeOf(decalVectorBlocks);
+	}
 };
 
 class BSBehaviorGraphExtraData : public NiCloneableStreamable<BSBehaviorGraphExtraData, NiExtraData> {
@@ -330,6 +357,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiExtraData::GetHeapUsage() + HeapSizeOf(behaviorGraphFile);
+	}
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 };
 
@@ -350,6 +380,7 @@ public:
 	NiStringRef boneName;
 
 	void Sync(NiStreamReversible& stream);
+	size_t HeapSize() const { return HeapSizeOf(boneName); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs);
 };
 
@@ -361,6 +392,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(boneLODs); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 };
 
@@ -372,6 +404,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(weights); }
 };
 
 class NiTextKeyExtraData : public NiCloneableStreamable<NiTextKeyExtraData, NiExtraData> {
@@ -382,6 +416,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(textKeys); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 };
 
@@ -416,6 +451,8 @@ public:
 	float scale = 1.0f;
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t HeapSize() const { return HeapSizeOf(root, variableName); }
 };
 
 class BSConnectPointParents : public NiCloneableStreamable<BSConnectPointParents, NiExtraData> {
@@ -426,6 +463,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(connectPoints); }
 };
 
 class BSConnectPointChildren : public NiCloneableStreamable<BSConnectPointChildren, NiExtraData> {
@@ -437,6 +476,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(targets); }
 };
 
 class BSExtraData : public NiCloneable<BSExtraData, NiObject> {};
@@ -452,6 +493,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return BSExtraData::GetHeapUsage() + HeapSizeOf(data); }
 
 	bool ToHKX(const std::filesystem::path& fileName);
 	bool FromHKX(const std::filesystem::path& fileName);
@@ -465,6 +507,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return BSExtraData::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 class SkinAttach : public NiCloneableStreamable<SkinAttach, NiExtraData> {
@@ -475,11 +519,15 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(bones); }
 };
 
 struct BoneTranslation {
 	NiString bone;
 	Vector3 trans;
+
+	size_t HeapSize() const { return HeapSizeOf(bone); }
 };
 
 class BoneTranslations : public NiCloneableStreamable<BoneTranslations, NiExtraData> {
@@ -491,5 +539,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(translations); }
 };
 } // namespace nifly
@@ -7,9 +7,11 @@ See the included GPLv3 LICENSE file
 #pragma once
 
 #include "BasicTypes.hpp"
+#include "MeshTopology.hpp"
 #include "Objects.hpp"
 #include "Shaders.hpp"
 #include "Skin.hpp"
+#include "TriangleBVH.hpp"
 #include "VertexData.hpp"
 
 #include <deque>
@@ -70,6 +72,8 @@ struct AdditionalDataBlock {
 			}
 		}
 	}
+
+	size_t HeapSize() const { return HeapSizeOf(blockOffsets, dataSizes, data); }
 };
 
 class AdditionalGeomData : public NiCloneable<AdditionalGeomData, NiObject> {};
@@ -84,6 +88,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return AdditionalGeomData::GetHeapUsage() + HeapSizeOf(blockInfos, blocks);
+	}
 };
 
 struct BSPackedAdditionalDataBlock {
@@ -124,6 +132,8 @@ struct BSPackedAdditionalDataBlock {
 		stream.Sync(unkInt1);
 		stream.Sync(numTotalBytesPerElement);
 	}
+
+	size_t HeapSize() const { return HeapSizeOf(blockOffsets, atomSizes, data); }
 };
 
 class BSPackedAdditionalGeometryData
@@ -137,6 +147,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return AdditionalGeomData::GetHeapUsage() + HeapSizeOf(blockInfos, blocks);
+	}
 };
 
 enum ConsistencyType : uint16_t { CT_MUTABLE = 0x0000, CT_STATIC = 0x4000, CT_VOLATILE = 0x8000 };
@@ -153,11 +167,12 @@ protected:
 	BoundingSphere bounds;
 
 public:
-	std::vector<Vector3> vertices;
-	std::vector<Vector3> normals;
-	std::vector<Vector3> tangents;
-	std::vector<Vector3> bitangents;
-	std::vector<Color4> vertexColors;
+	// Copies of the block share the data arrays until they are changed (see SharedVector)
+	SharedVector<Vector3> vertices;
+	SharedVector<Vector3> normals;
+	SharedVector<Vector3> tangents;
+	SharedVector<Vector3> bitangents;
+	SharedVector<Color4> vertexColors;
 
 	int groupID = 0;
 	uint8_t compressFlags = 0;
@@ -165,16 +180,21 @@ public:
 
 	uint8_t keepFlags = 0;
 	uint16_t dataFlags = 0;
-	std::vector<std::vector<Vector2>> uvSets;
+	SharedVector<std::vector<Vector2>> uvSets;
 
 	ConsistencyType consistencyFlags = CT_MUTABLE;
 	NiBlockRef<AdditionalGeomData> additionalDataRef;
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiObject::GetHeapUsage() + HeapSizeOf(vertices, normals, tangents, bitangents, vertexColors)
+			   + HeapSizeOf(uvSets);
+	}
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
 
 	uint16_t GetNumVertices() const;
 	void SetVertices(const bool enable);
@@ -198,23 +218,35 @@ public:
 
 	void SetBounds(const BoundingSphere& newBounds) { this->bounds = newBounds; }
 	BoundingSphere GetBounds() const { return bounds; }
-	void UpdateBounds();
+	void UpdateBounds(const BoundsMethod method = BoundsMethod::Exact);
 
+	// With parallelTangents, the tangent space is calculated on multiple threads (same results)
 	virtual void Create(NiVersion& version,
 						const std::vector<Vector3>* verts,
 						const std::vector<Triangle>* tris,
 						const std::vector<Vector2>* uvs,
-						const std::vector<Vector3>* norms);
+						const std::vector<Vector3>* norms,
+						const bool parallelTangents = false);
 	virtual void RecalcNormals(const bool smooth = true,
 							   const float smoothThres = 60.0f,
 							   std::unordered_set<uint32_t>* lockedIndices = nullptr);
-	virtual void CalcTangentSpace();
+	// Calculates tangents and bitangents, optionally on multiple threads (same results)
+	virtual void CalcTangentSpace(const bool parallel = false);
 };
 
 class NiShape : public NiCloneable<NiShape, NiAVObject> {
+protected:
+	// Runtime only, built on demand by NifFile::GetShapeBVH
+	std::shared_ptr<const TriangleBVH> bvh;
+	// Runtime only, built on demand by NifFile::GetShapeTopology
+	std::shared_ptr<const MeshTopology> topology;
+
 public:
 	virtual NiGeometryData* GetGeomData() const { return nullptr; }
 	virtual void SetGeomData(NiGeometryData*) {}
+	// Geometry data for reading only. Unlike GetGeomData, this doesn't unpack or copy the mesh data
+	// of BSGeometry shapes.
+	virtual const NiGeometryData* ReadGeomData() const { return GetGeomData(); }
 
 	virtual bool HasData() const { return false; }
 	virtual NiBlockRef<NiGeometryData>* DataRef() { return nullptr; }
@@ -258,9 +290,26 @@ public:
 
 	virtual void SetBounds(const BoundingSphere& bounds);
 	virtual BoundingSphere GetBounds() const;
-	virtual void UpdateBounds();
+	virtual void UpdateBounds(const BoundsMethod method = BoundsMethod::Exact);
 
 	int GetBoneID(const NiHeader& hdr, const std::string& boneName) const;
+
+	// BVH of the triangles cached by NifFile::GetShapeBVH (or nullptr)
+	std::shared_ptr<const TriangleBVH> GetCachedBVH() const { return bvh; }
+	void SetCachedBVH(std::shared_ptr<const TriangleBVH> newBVH) { bvh = std::move(newBVH); }
+	// Triangle adjacency cached by NifFile::GetShapeTopology (or nullptr)
+	std::shared_ptr<const MeshTopology> GetCachedTopology() const { return topology; }
+	void SetCachedTopology(std::shared_ptr<const MeshTopology> newTopology) {
+		topology = std::move(newTopology);
+	}
+	// Drops the data cached from the vertices and triangles.
+	// Called by the vertex and triangle edits of the shape and NifFile. Code that edits the vertex or
+	// triangle arrays directly (e.g. through GetGeomData) has to call it, as the caches only notice
+	// changes of the counts.
+	void InvalidateGeometryCache() {
+		bvh.reset();
+		topology.reset();
+	}
 };
 
 
@@ -276,6 +325,24 @@ protected:
 	uint32_t numTriangles = 0;
 	uint16_t numVertices = 0;
 
+	// Vertex data in its file form, kept when loading with NifLoadOptions::keepPacked
+	struct PackedVertexData {
+		VertexDesc vertexDesc;
+		bool fullPrecision = false;
+		uint16_t numVertices = 0;
+		std::vector<char> bytes;
+	};
+
+	std::shared_ptr<const PackedVertexData> packedVertData;
+
+	// Syncs a vertex in the file layout of the vertex description
+	static void SyncVertex(NiStreamReversible& stream,
+						   BSVertexData& vertex,
+						   const VertexDesc& desc,
+						   const bool fullPrecision);
+	// Size of a vertex synced by SyncVertex
+	static uint32_t GetPackedVertexSize(const VertexDesc& desc, const bool fullPrecision);
+
 public:
 	VertexDesc vertexDesc;
 
@@ -297,8 +364,10 @@ public:
 
 	std::vector<uint32_t> deletedTris; // temporary storage for BSSubIndexTriShape
 
-	std::vector<BSVertexData> vertData;
-	std::vector<Triangle> triangles;
+	// Copies of the block share the vertex and triangle data until they are changed (see SharedVector).
+	// Packed vertex data (see IsPacked) is decoded on first access.
+	SharedVector<BSVertexData> vertData;
+	SharedVector<Triangle> triangles;
 
 	BSTriShape();
 
@@ -306,7 +375,18 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	size_t GetHeapUsage() const override {
+		return NiShape::GetHeapUsage() + HeapSizeOf(vertData, triangles, particleVerts, particleNorms)
+			   + HeapSizeOf(particleTris, rawVertices, rawNormals, rawTangents, rawBitangents, rawUvs)
+			   + HeapSizeOf(rawColors, rawEyeData, deletedTris)
+			   + (packedVertData ? HeapSizeOf(packedVertData->bytes) : 0);
+	}
+
+	// True if the vertex data is still in its file form and is saved back unchanged.
+	// Non-const access to vertData ends this.
+	bool IsPacked() const { return packedVertData && vertData.IsUnchanged(); }
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 
@@ -365,7 +445,7 @@ public:
 
 	void SetBounds(const BoundingSphere& newBounds) override { bounds = newBounds; }
 	BoundingSphere GetBounds() const override { return bounds; }
-	void UpdateBounds() override;
+	void UpdateBounds(const BoundsMethod method = BoundsMethod::Exact) override;
 
 	void SetVertexData(const std::vector<BSVertexData>& bsVertData);
 
@@ -373,18 +453,20 @@ public:
 	void RecalcNormals(const bool smooth = true,
 					   const float smoothThres = 60.0f,
 					   std::unordered_set<uint32_t>* lockedIndices = nullptr);
-	void CalcTangentSpace();
+	void CalcTangentSpace(const bool parallel = false);
 	int CalcDataSizes(NiVersion& version);
 
 	void SetTangentData(const std::vector<Vector3>& in);
 	void SetBitangentData(const std::vector<Vector3>& in);
 	void SetEyeData(const std::vector<float>& in);
 
+	// With parallelTangents, the tangent space is calculated on multiple threads (same results)
 	virtual void Create(NiVersion& version,
 						const std::vector<Vector3>* verts,
 						const std::vector<Triangle>* tris,
 						const std::vector<Vector2>* uvs,
-						const std::vector<Vector3>* normals = nullptr);
+						const std::vector<Vector3>* normals = nullptr,
+						const bool parallelTangents = false);
 };
 
 
@@ -446,6 +528,8 @@ public:
 		uint32_t parentArrayIndex = 0xFFFFFFFF;
 		uint32_t numSubSegments = 0;
 		std::vector<BSSITSSubSegment> subSegments;
+
+		size_t HeapSize() const { return HeapSizeOf(subSegments); }
 	};
 
 	class BSSITSSubSegmentDataRecord {
@@ -454,6 +538,8 @@ public:
 		uint32_t material = 0xFFFFFFFF;
 		uint32_t numData = 0;
 		std::vector<float> extraData;
+
+		size_t HeapSize() const { return HeapSizeOf(extraData); }
 	};
 
 	class BSSITSSubSegmentData {
@@ -463,6 +549,8 @@ public:
 		std::vector<uint32_t> arrayIndices;
 		std::vector<BSSITSSubSegmentDataRecord> dataRecords;
 		NiString ssfFile;
+
+		size_t HeapSize() const { return HeapSizeOf(arrayIndices, dataRecords, ssfFile); }
 	};
 
 	class BSSITSSegmentation {
@@ -472,6 +560,8 @@ public:
 		uint32_t numTotalSegments = 0;
 		std::vector<BSSITSSegment> segments;
 		BSSITSSubSegmentData subSegmentData;
+
+		size_t HeapSize() const { return HeapSizeOf(segments, subSegmentData); }
 	};
 
 protected:
@@ -487,7 +577,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	size_t GetHeapUsage() const override {
+		return BSTriShape::GetHeapUsage() + HeapSizeOf(segments, segmentation);
+	}
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
 
 	std::vector<BSGeometrySegmentData> GetSegments() const;
 	void SetSegments(const std::vector<BSGeometrySegmentData>& sd);
@@ -500,7 +593,8 @@ public:
 				const std::vector<Vector3>* verts,
 				const std::vector<Triangle>* tris,
 				const std::vector<Vector2>* uvs,
-				const std::vector<Vector3>* normals = nullptr) override;
+				const std::vector<Vector3>* normals = nullptr,
+				const bool parallelTangents = false) override;
 };
 
 class BSMeshLODTriShape : public NiCloneableStreamable<BSMeshLODTriShape, BSTriShape> {
@@ -513,7 +607,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
 };
 
 class BSDynamicTriShape : public NiCloneableStreamable<BSDynamicTriShape, BSTriShape> {
@@ -527,14 +621,17 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	size_t GetHeapUsage() const override { return BSTriShape::GetHeapUsage() + HeapSizeOf(dynamicData); }
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
 	void CalcDynamicData();
 
 	void Create(NiVersion& version,
 				const std::vector<Vector3>* verts,
 				const std::vector<Triangle>* tris,
 				const std::vector<Vector2>* uvs,
-				const std::vector<Vector3>* normals = nullptr) override;
+				const std::vector<Vector3>* normals = nullptr,
+				const bool parallelTangents = false) override;
 };
 
 // BSGeometryMeshData is not a nif block object.  In order to be able to use the data as if it were a block
@@ -545,7 +642,7 @@ class BSGeometryMeshData : public NiCloneableStreamable<BSGeometryMeshData, NiGe
 private:
 	// Traditional scale based on havok to unit transform used in skyrim, fallout, etc. In Starfield mesh files are normalized to metric units,
 	// this scale makes default vertex positions closely match the older games
-	const float havokScale = 69.969f;
+	static constexpr float havokScale = 69.969f;
 	// experimentally, the below scale produced very accurate values to SSE mesh sizes (comparing markerxheading.nif)
 	// const float havokScale = 69.9866f;
 
@@ -567,6 +664,18 @@ public:
 		Vector3 expand;
 	};
 
+	// Meshlet bounds that aren't part of the file, in NIF units. A meshlet is back-facing
+	// for a viewer at p if dot(normalize(coneApex - p), coneAxis) >= coneCutoff.
+	struct MeshletBounds {
+		Vector3 center;
+		float radius = 0.0f;
+		Vector3 coneApex;
+		Vector3 coneAxis;
+		float coneCutoff = 1.0f;
+	};
+
+	// The data fields below are only valid after Unpack(). While the data is packed or shared (see IsPacked
+	// and IsShared), they are empty; read through ReadData() (or BSGeometry::GetMeshData) instead.
 	uint32_t version = 0;
 
 	uint32_t nTriIndices = 0;
@@ -595,7 +704,8 @@ public:
 	std::vector<uint8_t> tangentWs; // 2-bit W component of each tangent (bitangent sign)
 
 	uint32_t nTotalWeights = 0;
-	std::vector<std::vector<BoneWeight>> skinWeights;
+	// Flat [vertex x nWeightsPerVert] array of bone index/weight pairs
+	std::vector<BoneWeight> skinWeights;
 
 	uint32_t nLODS = 0;
 	std::vector<std::vector<Triangle>> lods;
@@ -606,13 +716,98 @@ public:
 	uint32_t nCullData = 0;
 	std::vector<CullData> cullDataList;
 
+	// Filled by the meshlet builders next to cullDataList, not stored in the file
+	std::vector<MeshletBounds> meshletBounds;
+
+	// Raw mesh bytes stored by LoadPacked. While set, Sync writes them back unchanged.
+	std::vector<char> packedData;
+
+	// Immutable data shared with other meshes (see ExternalMeshCache), not counted in the heap usage.
+	// While set, the own arrays are empty. Unpack takes a private copy before anything can change it.
+	std::shared_ptr<const BSGeometryMeshData> sharedData;
+
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiGeometryData::GetHeapUsage() + HeapSizeOf(tris, vColors, tangentWs, skinWeights, lods)
+			   + HeapSizeOf(meshletList, cullDataList, meshletBounds, packedData)
+			   + (decodedData ? decodedData->GetHeapUsage() : 0);
+	}
+
+	// Stores the remaining bytes of the stream without decoding them
+	void LoadPacked(std::istream& stream);
+	// Reads the bytes of a mesh stored inline in a NIF and stores them without decoding them
+	void ReadPacked(NiStreamReversible& stream);
+	// Decodes the packed bytes (or copies the shared data) into the data arrays and drops them.
+	// Needed before changing the data fields.
+	void Unpack();
+	bool IsPacked() const { return !packedData.empty(); }
+
+	// Binds to immutable shared data instead of own arrays
+	void Share(std::shared_ptr<const BSGeometryMeshData> data);
+	bool IsShared() const { return sharedData != nullptr; }
 
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	// Data to read from without making a copy: the shared data while bound to it, this otherwise.
+	// Packed data is decoded on the first read and kept next to the packed bytes until Unpack,
+	// so reading doesn't change what Sync writes. Decoding on first read isn't thread safe.
+	const BSGeometryMeshData& ReadData() const;
+
+	uint32_t GetNumTriangles() const override { return static_cast<uint32_t>(ReadData().tris.size()); }
+
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
+
+	void RecalcNormals(const bool smooth = true,
+					   const float smoothThresh = 60.0f,
+					   std::unordered_set<uint32_t>* lockedIndices = nullptr) override;
 
 	bool HasMeshlets() const { return !meshletList.empty(); }
 
+	// Number of vertices that have a slot of nWeightsPerVert weights
+	uint32_t GetSkinWeightVertexCount() const {
+		return nWeightsPerVert > 0 ? static_cast<uint32_t>(skinWeights.size() / nWeightsPerVert) : 0;
+	}
+
+	// Views of the whole weight array or the weights of a single vertex
+	Span<BoneWeight> GetSkinWeights() { return skinWeights; }
+	Span<const BoneWeight> GetSkinWeights() const { return skinWeights; }
+	Span<BoneWeight> GetVertexWeights(const uint32_t vertIndex) {
+		return Span<BoneWeight>(skinWeights).subspan(static_cast<size_t>(vertIndex) * nWeightsPerVert, nWeightsPerVert);
+	}
+	Span<const BoneWeight> GetVertexWeights(const uint32_t vertIndex) const {
+		return Span<const BoneWeight>(skinWeights).subspan(static_cast<size_t>(vertIndex) * nWeightsPerVert, nWeightsPerVert);
+	}
+
+	// Resizes the weight array to the vertex count and weights per vertex, zeroing all weights
+	void ResetSkinWeights(const uint32_t vertCount, const uint32_t weightsPerVert);
+
+	void ClearMeshlets();
+	// Splits the triangles into meshlets in their current order
 	void GenerateMeshlets(uint32_t maxVerts = 128, uint32_t maxPrims = 128);
+	// Reorders the triangles to grow meshlets over adjacent and nearby triangles, for tighter bounds.
+	// Reuses the topology of the triangles if given (see NifFile::GetShapeTopology). The shape's cached
+	// BVH and topology have to be invalidated afterwards (BSGeometry::GenerateMeshlets does so).
+	void GenerateSpatialMeshlets(uint32_t maxVerts = 128,
+								 uint32_t maxPrims = 128,
+								 const MeshTopology* topology = nullptr);
+
+private:
+	// Packed data decoded by ReadData (or nullptr)
+	mutable std::shared_ptr<const BSGeometryMeshData> decodedData;
+
+	// How the meshlets were last generated, to rebuild them the same way after vertex changes
+	bool spatialMeshlets = false;
+	uint32_t meshletMaxVerts = 128;
+	uint32_t meshletMaxPrims = 128;
+
+	// Rebuilds existing meshlets with the builder and limits they were generated with
+	void RegenerateMeshlets();
+
+	// Reads the mesh from the bytes of a .mesh file
+	void Decode(const std::vector<char>& data);
+
+	void AppendMeshlet(const uint32_t primOffset,
+					   Span<const Triangle> meshletTris,
+					   Span<const uint16_t> meshletVerts);
 };
 
 struct BSGeometryMesh {
@@ -629,6 +824,8 @@ struct BSGeometryMesh {
 
 	BSGeometryMeshData meshData;
 	void Sync(NiStreamReversible& stream);
+
+	size_t HeapSize() const { return HeapSizeOf(meshName) + meshData.GetHeapUsage(); }
 };
 
 class BSGeometry : public NiCloneableStreamable<BSGeometry, NiShape> {
@@ -651,10 +848,13 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiShape::GetHeapUsage() + HeapSizeOf(meshes); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 
+	// Unpacks the selected mesh (see BSGeometryMeshData::Unpack), as the returned data can be changed
 	NiGeometryData* GetGeomData() const override;
+	const NiGeometryData* ReadGeomData() const override;
 
 	bool GetTriangles(std::vector<Triangle>& tris) const override;
 	void SetTriangles(const std::vector<Triangle>& tris) override;
@@ -676,14 +876,15 @@ public:
 	uint8_t MeshCount() { return (uint8_t) meshes.size(); }
 
 	BSGeometryMesh* AddMesh() {
+		InvalidateGeometryCache();
 		meshes.emplace_back();
 		selectedMesh = static_cast<uint8_t>(meshes.size() - 1);
 		return &meshes.back();
 	}
 
 	bool HasMeshlets() const {
-		for (auto& mesh : meshes) {
-			if (mesh.meshData.HasMeshlets()) {
+		for (uint8_t i = 0; i < meshes.size(); i++) {
+			if (GetMeshData(i)->HasMeshlets()) {
 				return true;
 			}
 		}
@@ -691,14 +892,36 @@ public:
 	}
 
 	// Generate Starfield mesh-shader meshlets + cull data for every mesh slot that has triangle data.
-	void GenerateMeshlets(uint32_t maxVerts = 128, uint32_t maxPrims = 128, bool onlyIfMissing = true) {
-		for (auto& mesh : meshes) {
-			if (onlyIfMissing && mesh.meshData.HasMeshlets())
+	// With spatial set, the triangles are reordered to build spatially coherent meshlets, reusing the
+	// cached topology of the selected mesh (see NifFile::GetShapeTopology).
+	// Only the regenerated meshes are unpacked. Regenerating invalidates the cached BVH and topology.
+	void GenerateMeshlets(uint32_t maxVerts = 128,
+						  uint32_t maxPrims = 128,
+						  bool onlyIfMissing = true,
+						  bool spatial = false) {
+		const std::shared_ptr<const MeshTopology> cachedTopology = GetCachedTopology();
+		bool regenerated = false;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			BSGeometryMesh& mesh = meshes[i];
+			const BSGeometryMeshData& data = mesh.meshData.ReadData();
+			if (onlyIfMissing && data.HasMeshlets())
 				continue;
-			if (mesh.meshData.tris.empty())
+			if (data.tris.empty())
 				continue;
-			mesh.meshData.GenerateMeshlets(maxVerts, maxPrims);
+
+			mesh.meshData.Unpack();
+			if (spatial)
+				mesh.meshData.GenerateSpatialMeshlets(maxVerts,
+													  maxPrims,
+													  i == selectedMesh ? cachedTopology.get() : nullptr);
+			else
+				mesh.meshData.GenerateMeshlets(maxVerts, maxPrims);
+
+			regenerated = true;
 		}
+
+		if (regenerated)
+			InvalidateGeometryCache();
 	}
 
 	// Flag 0x200 (512) on BSGeometry controls whether mesh data is embedded inline
@@ -717,16 +940,31 @@ public:
 	// TODO: this is not thread safe.  A mutex should be set in SelectMesh and released in ReleaseMesh to
 	// avoid synchronization issues.  Alternatively, Get/Set data functions could be changed to take a
 	// selector option, but that's a significant API change.
+	// Selecting another mesh invalidates the cached BVH and topology, as they belong to the selected mesh.
 	BSGeometryMesh* SelectMesh(uint8_t whichMesh) {
 		if (whichMesh < meshes.size()) {
+			if (whichMesh != selectedMesh)
+				InvalidateGeometryCache();
+
 			selectedMesh = whichMesh;
 			return &meshes[selectedMesh];
 		}
 		return nullptr;
 	}
+	// Returns the decoded data of a mesh slot for reading (or nullptr).
+	// Like ReadGeomData, this doesn't unpack the mesh or copy data shared with other meshes.
+	const BSGeometryMeshData* GetMeshData(uint8_t whichMesh) const;
+
+	// Returns a mesh slot without selecting it, for code working on several slots at once (or nullptr)
+	BSGeometryMesh* GetMesh(uint8_t whichMesh) {
+		return whichMesh < meshes.size() ? &meshes[whichMesh] : nullptr;
+	}
 	// ReleaseMesh resets the selected mesh data to default.  This is a stand in for a mutex unlock operation
 	// so should always be called as soon after SelectMesh as possble.
 	void ReleaseMesh() {
+		if (selectedMesh != 0)
+			InvalidateGeometryCache();
+
 		selectedMesh = 0;
 		return;
 	}
@@ -753,6 +991,9 @@ public:
 	uint32_t implementation = 0;
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiShape::GetHeapUsage() + HeapSizeOf(materialNames, materialExtraData, shaderName);
+	}
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -789,19 +1030,22 @@ public:
 				const std::vector<Vector3>* verts,
 				const std::vector<Triangle>* tris,
 				const std::vector<Vector2>* uvs,
-				const std::vector<Vector3>* norms) override;
+				const std::vector<Vector3>* norms,
+				const bool parallelTangents = false) override;
 };
 
 struct MatchGroup {
 	uint16_t count = 0;
 	std::vector<uint16_t> matches;
+
+	size_t HeapSize() const { return HeapSizeOf(matches); }
 };
 
 class NiTriShapeData : public NiCloneableStreamable<NiTriShapeData, NiTriBasedGeomData> {
 protected:
 	uint32_t numTrianglePoints = 0;
 	bool hasTriangles = false;
-	std::vector<Triangle> triangles;
+	SharedVector<Triangle> triangles;
 
 	uint16_t numMatchGroups = 0;
 	std::vector<MatchGroup> matchGroups;
@@ -811,12 +1055,17 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiTriBasedGeomData::GetHeapUsage() + HeapSizeOf(triangles, matchGroups);
+	}
 	void Create(NiVersion& version,
 				const std::vector<Vector3>* verts,
 				const std::vector<Triangle>* tris,
 				const std::vector<Vector2>* uvs,
-				const std::vector<Vector3>* norms) override;
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+				const std::vector<Vector3>* norms,
+				const bool parallelTangents = false) override;
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
 
 	std::vector<MatchGroup> GetMatchGroups() const;
 	void SetMatchGroups(const std::vector<MatchGroup>& mg);
@@ -828,7 +1077,7 @@ public:
 	void RecalcNormals(const bool smooth = true,
 					   const float smoothThres = 60.0f,
 					   std::unordered_set<uint32_t>* lockedIndices = nullptr) override;
-	void CalcTangentSpace() override;
+	void CalcTangentSpace(const bool parallel = false) override;
 };
 
 class NiTriShape : public NiCloneable<NiTriShape, NiTriBasedGeom> {
@@ -850,6 +1099,8 @@ public:
 	std::vector<std::vector<uint16_t>> points;
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t HeapSize() const { return HeapSizeOf(stripLengths, points); }
 };
 
 class NiTriStripsData : public NiCloneableStreamable<NiTriStripsData, NiTriBasedGeomData> {
@@ -860,17 +1111,25 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	size_t GetHeapUsage() const override {
+		return NiTriBasedGeomData::GetHeapUsage() + HeapSizeOf(stripsInfo);
+	}
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
 
 	uint32_t GetNumTriangles() const override;
 	bool GetTriangles(std::vector<Triangle>& tris) const override;
+	// Replaces the strips with joined strips generated from the triangles (see GenerateStripsFromTriangles).
+	// The strips stay unjoined if the joined ones don't fit (see SetStrips).
 	void SetTriangles(const std::vector<Triangle>& tris) override;
+	// Returns false and keeps the current strips if they don't fit into 16 bits (see CountStripTriangles)
+	bool SetStrips(const std::vector<std::vector<uint16_t>>& strips);
 	std::vector<Triangle> StripsToTris() const;
 
 	void RecalcNormals(const bool smooth = true,
 					   const float smoothThres = 60.0f,
 					   std::unordered_set<uint32_t>* lockedIndices = nullptr) override;
-	void CalcTangentSpace() override;
+	void CalcTangentSpace(const bool parallel = false) override;
 };
 
 class NiTriStrips : public NiCloneable<NiTriStrips, NiTriBasedGeom> {
@@ -895,7 +1154,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
 };
 
 class NiLines : public NiCloneable<NiLines, NiTriBasedGeom> {
@@ -935,7 +1195,11 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	size_t GetHeapUsage() const override {
+		return NiTriShapeData::GetHeapUsage() + HeapSizeOf(polygons, polygonIndices);
+	}
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
 };
 
 class NiScreenElements : public NiCloneable<NiScreenElements, NiTriShape> {
@@ -978,6 +1242,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiTriShape::GetHeapUsage() + HeapSizeOf(segments); }
 
 	std::vector<BSGeometrySegmentData> GetSegments() const;
 	void SetSegments(const std::vector<BSGeometrySegmentData>& sd);
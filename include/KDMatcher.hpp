@@ -6,8 +6,12 @@ See the included GPLv3 LICENSE file
 
 #pragma once
 
+#include "NifUtil.hpp"
 #include "Object3d.hpp"
 #include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cstring>
 #include <memory>
 
 // A specialized KD tree that finds duplicate vertices in a point cloud.
@@ -35,7 +39,7 @@ public:
 				return;
 			}
 
-			if (d[depth % 3] > 0) {
+			if (d[static_cast<int>(depth % 3)] > 0) {
 				if (more)
 					more->add(pts, point, depth + 1);
 				else
@@ -125,6 +129,179 @@ public:
 	}
 };
 
+// SpatialHashMatcher: finds matching points like SortingMatcher,
+// but buckets the points in a hash grid with cells the size of the match
+// epsilon, so only the neighboring cells of each point are compared.
+// Runs in linear expected time and isn't limited to 16-bit indices.
+template<typename index_t = uint32_t>
+class SpatialHashMatcher {
+public:
+	std::vector<std::vector<index_t>> matches;
+
+	// Points match if they are closer than "epsilon" on each axis.
+	// A negative epsilon is derived from the overall scale of the points like SortingMatcher does.
+	// An epsilon of zero (also when derived from points that are all at the origin) matches equal points.
+	SpatialHashMatcher(const Vector3* pts, const index_t cnt, float epsilon = -1.0f) {
+		if (cnt <= 0)
+			return;
+
+		if (epsilon < 0.0f) {
+			float scale = 0.0f;
+			for (index_t i = 0; i < cnt; ++i)
+				scale = std::max(scale, std::max(std::fabs(pts[i].x), std::max(std::fabs(pts[i].y), std::fabs(pts[i].z))));
+
+			epsilon = EPSILON * 0.01f * scale;
+		}
+
+		const bool exact = !(epsilon > 0.0f);
+		const double cellScale = exact ? 0.0 : 1.0 / static_cast<double>(epsilon);
+
+		// Cell coordinate of a point coordinate. Exact matching uses the bits of the coordinate.
+		// Otherwise the cells are clamped, so that distant points share the outermost cells instead of
+		// overflowing. Points within epsilon of each other still end up in the same or neighboring cells.
+		auto cellCoord = [exact, cellScale](const float c) -> int64_t {
+			if (exact) {
+				// Adding zero turns -0 into +0, which compare equal
+				const float v = c + 0.0f;
+				uint32_t bits = 0;
+				std::memcpy(&bits, &v, sizeof(bits));
+				return bits;
+			}
+
+			constexpr double cellLimit = 4.0e18;
+			const double v = std::floor(static_cast<double>(c) * cellScale);
+			if (!(v > -cellLimit))
+				return static_cast<int64_t>(-cellLimit);
+			if (v > cellLimit)
+				return static_cast<int64_t>(cellLimit);
+
+			return static_cast<int64_t>(v);
+		};
+
+		auto cellOf = [&](const Vector3& p) {
+			return std::array<int64_t, 3>{cellCoord(p.x), cellCoord(p.y), cellCoord(p.z)};
+		};
+
+		auto isMatch = [exact, epsilon](const Vector3& a, const Vector3& b) {
+			if (exact)
+				return a.x == b.x && a.y == b.y && a.z == b.z;
+
+			return std::fabs(a.x - b.x) < epsilon && std::fabs(a.y - b.y) < epsilon
+				   && std::fabs(a.z - b.z) < epsilon;
+		};
+
+		// Power of two bucket count, at least twice the number of points
+		const size_t numPoints = static_cast<size_t>(cnt);
+		uint32_t numBuckets = 1;
+		while (numBuckets < numPoints * 2 && numBuckets < 0x80000000u)
+			numBuckets <<= 1;
+
+		const uint32_t bucketMask = numBuckets - 1;
+		auto bucketOf = [bucketMask](const int64_t x, const int64_t y, const int64_t z) {
+			const uint64_t h = (static_cast<uint64_t>(x) * 73856093u) ^ (static_cast<uint64_t>(y) * 19349663u)
+							   ^ (static_cast<uint64_t>(z) * 83492791u);
+			return static_cast<uint32_t>(h ^ (h >> 32)) & bucketMask;
+		};
+
+		// Counting sort of the points by bucket
+		std::vector<uint32_t> pointBuckets(numPoints);
+		std::vector<index_t> bucketStart(static_cast<size_t>(numBuckets) + 1, 0);
+		for (index_t i = 0; i < cnt; ++i) {
+			const auto cell = cellOf(pts[i]);
+			pointBuckets[i] = bucketOf(cell[0], cell[1], cell[2]);
+			++bucketStart[pointBuckets[i] + 1];
+		}
+
+		for (uint32_t b = 0; b < numBuckets; ++b)
+			bucketStart[b + 1] += bucketStart[b];
+
+		std::vector<index_t> bucketPoints(numPoints);
+		std::vector<index_t> bucketFill(bucketStart.begin(), bucketStart.end() - 1);
+		for (index_t i = 0; i < cnt; ++i)
+			bucketPoints[bucketFill[pointBuckets[i]]++] = i;
+
+		// Exactly equal points are always in the same cell
+		const int64_t reach = exact ? 0 : 1;
+
+		std::vector<bool> used(numPoints, false);
+		for (index_t si = 0; si < cnt; ++si) {
+			if (used[si])
+				continue;
+
+			const Vector3& sp = pts[si];
+			const auto cell = cellOf(sp);
+			bool matched = false;
+
+			for (int64_t dx = -reach; dx <= reach; ++dx) {
+				for (int64_t dy = -reach; dy <= reach; ++dy) {
+					for (int64_t dz = -reach; dz <= reach; ++dz) {
+						const uint32_t b = bucketOf(cell[0] + dx, cell[1] + dy, cell[2] + dz);
+						for (index_t bi = bucketStart[b]; bi < bucketStart[b + 1]; ++bi) {
+							const index_t mi = bucketPoints[bi];
+							if (mi <= si || used[mi] || !isMatch(pts[mi], sp))
+								continue;
+
+							if (!matched)
+								matches.emplace_back(std::vector<index_t>(1, si));
+
+							matched = true;
+							matches.back().push_back(mi);
+							used[mi] = true;
+						}
+					}
+				}
+			}
+
+			if (matched)
+				std::sort(matches.back().begin(), matches.back().end());
+		}
+	}
+};
+
+// Welds vertices that are closer than "epsilon" on each axis (see SpatialHashMatcher) into the first
+// vertex of their match set. An epsilon of zero welds exact duplicates only.
+// Removes the other vertices from "verts" and the per-vertex "attributes"
+// arrays, remaps the triangles and removes triangles that became degenerate.
+// Returns the number of removed vertices.
+template<typename... AttributeVectors>
+size_t WeldVertices(std::vector<Vector3>& verts,
+					std::vector<Triangle>& tris,
+					const float epsilon,
+					AttributeVectors&... attributes) {
+	const SpatialHashMatcher<uint32_t> matcher(verts.data(), static_cast<uint32_t>(verts.size()), epsilon);
+	if (matcher.matches.empty())
+		return 0;
+
+	std::vector<uint32_t> weldTarget(verts.size());
+	for (uint32_t i = 0; i < static_cast<uint32_t>(weldTarget.size()); i++)
+		weldTarget[i] = i;
+
+	std::vector<uint32_t> removedVerts;
+	for (auto& matchset : matcher.matches) {
+		for (size_t m = 1; m < matchset.size(); m++) {
+			weldTarget[matchset[m]] = matchset[0];
+			removedVerts.push_back(matchset[m]);
+		}
+	}
+
+	std::sort(removedVerts.begin(), removedVerts.end());
+
+	std::vector<int> indexMap = GenerateIndexCollapseMap(removedVerts, verts.size());
+	for (uint32_t i = 0; i < static_cast<uint32_t>(indexMap.size()); i++)
+		indexMap[i] = indexMap[weldTarget[i]];
+
+	ApplyMapToTriangles(tris, indexMap);
+	tris.erase(std::remove_if(tris.begin(),
+							  tris.end(),
+							  [](const Triangle& t) { return t.p1 == t.p2 || t.p2 == t.p3 || t.p3 == t.p1; }),
+			   tris.end());
+
+	EraseVectorIndices(verts, removedVerts);
+	(EraseVectorIndices(attributes, removedVerts), ...);
+
+	return removedVerts.size();
+}
+
 template<typename index_t>
 class kd_query_result {
 public:
@@ -299,4 +476,231 @@ public:
 		return static_cast<index_t>(queryResult.size());
 	}
 };
+
+// Balanced KD tree stored in flat arrays. The points aren't modified; an array of point indices
+// is partitioned by median instead, so the node of a range is its middle index and its children
+// are the halves to either side.
+// Queries don't recurse or allocate and can be run in batches across threads.
+// The tree keeps a pointer to the points, which must stay valid while it is used.
+template<typename index_t>
+class kd_flat_tree {
+public:
+	kd_flat_tree(const Vector3* points, const index_t count)
+		: pts(points) {
+		if (count <= 0)
+			return;
+
+		order.resize(static_cast<size_t>(count));
+		for (index_t i = 0; i < count; i++)
+			order[static_cast<size_t>(i)] = i;
+
+		axes.resize(order.size());
+		build(0, order.size());
+	}
+
+	size_t size() const { return order.size(); }
+
+	// Finds the "k" nearest points to "querypoint", closest first, into "queryResult".
+	// Returns the number of points found (less than k if the tree has fewer points).
+	index_t kd_knn(const Vector3& querypoint,
+				   const uint32_t k,
+				   std::vector<kd_query_result<index_t>>& queryResult) const {
+		queryResult.resize(k);
+		const uint32_t found = find_nearest(querypoint, k, queryResult.data());
+		queryResult.resize(found);
+		return static_cast<index_t>(found);
+	}
+
+	// Finds all points within "radius" of "querypoint", closest first, into "queryResult".
+	// Returns the number of points found.
+	index_t kd_radius(const Vector3& querypoint,
+					  const float radius,
+					  std::vector<kd_query_result<index_t>>& queryResult) const {
+		queryResult.clear();
+		find_radius(querypoint, radius, queryResult);
+		return static_cast<index_t>(queryResult.size());
+	}
+
+	// k nearest points of each query point. The results of query q are stored in
+	// queryResults[q * k] to queryResults[q * k + k - 1], closest first. If the tree
+	// has fewer than k points, the remaining results have a null point pointer.
+	void kd_knn_batch(const Vector3* querypoints,
+					  const size_t count,
+					  const uint32_t k,
+					  std::vector<kd_query_result<index_t>>& queryResults,
+					  const bool parallel = true) const {
+		queryResults.resize(count * k);
+		auto queryRange = [&](const size_t begin, const size_t end) {
+			for (size_t q = begin; q < end; q++) {
+				kd_query_result<index_t>* result = queryResults.data() + q * k;
+				for (uint32_t i = find_nearest(querypoints[q], k, result); i < k; i++)
+					result[i] = kd_query_result<index_t>{nullptr, 0, FLT_MAX};
+			}
+		};
+
+		if (parallel)
+			ParallelFor(count, 256, queryRange);
+		else
+			queryRange(0, count);
+	}
+
+	// All points within "radius" of each query point, closest first, into queryResults[q].
+	void kd_radius_batch(const Vector3* querypoints,
+						 const size_t count,
+						 const float radius,
+						 std::vector<std::vector<kd_query_result<index_t>>>& queryResults,
+						 const bool parallel = true) const {
+		queryResults.resize(count);
+		auto queryRange = [&](const size_t begin, const size_t end) {
+			for (size_t q = begin; q < end; q++) {
+				queryResults[q].clear();
+				find_radius(querypoints[q], radius, queryResults[q]);
+			}
+		};
+
+		if (parallel)
+			ParallelFor(count, 256, queryRange);
+		else
+			queryRange(0, count);
+	}
+
+private:
+	struct node_range {
+		size_t begin;
+		size_t end;
+		float boundSq; // Squared distance from the query point to the region of the range
+	};
+
+	// Depth of the balanced tree is at most 64, each level leaves one pending range on the stack
+	static constexpr size_t maxStackSize = 128;
+
+	const Vector3* pts = nullptr;
+	std::vector<index_t> order;
+	std::vector<uint8_t> axes;
+
+	const Vector3& point_at(const size_t i) const { return pts[static_cast<size_t>(order[i])]; }
+
+	void build(const size_t begin, const size_t end) {
+		if (end - begin <= 1) {
+			if (begin < end)
+				axes[begin] = 0;
+			return;
+		}
+
+		// Split along the axis with the largest extent
+		Vector3 minPt = point_at(begin);
+		Vector3 maxPt = minPt;
+		for (size_t i = begin + 1; i < end; i++) {
+			const Vector3& p = point_at(i);
+			minPt.x = std::min(minPt.x, p.x);
+			minPt.y = std::min(minPt.y, p.y);
+			minPt.z = std::min(minPt.z, p.z);
+			maxPt.x = std::max(maxPt.x, p.x);
+			maxPt.y = std::max(maxPt.y, p.y);
+			maxPt.z = std::max(maxPt.z, p.z);
+		}
+
+		const Vector3 extent = maxPt - minPt;
+		uint8_t axis = 0;
+		if (extent.y > extent.x && extent.y >= extent.z)
+			axis = 1;
+		else if (extent.z > extent.x && extent.z > extent.y)
+			axis = 2;
+
+		const size_t mid = begin + (end - begin) / 2;
+		std::nth_element(order.begin() + static_cast<std::ptrdiff_t>(begin),
+						 order.begin() + static_cast<std::ptrdiff_t>(mid),
+						 order.begin() + static_cast<std::ptrdiff_t>(end),
+						 [this, axis](const index_t a, const index_t b) {
+							 return pts[static_cast<size_t>(a)][axis] < pts[static_cast<size_t>(b)][axis];
+						 });
+
+		axes[mid] = axis;
+		build(begin, mid);
+		build(mid + 1, end);
+	}
+
+	// Walks the tree nearest branch first, skipping ranges farther away than "maxDistSq()".
+	// "visit" is called with each point index and its squared distance.
+	template<typename MaxDistSq, typename Visit>
+	void traverse(const Vector3& querypoint, MaxDistSq&& maxDistSq, Visit&& visit) const {
+		std::array<node_range, maxStackSize> stack;
+		size_t stackSize = 0;
+		if (!order.empty())
+			stack[stackSize++] = node_range{0, order.size(), 0.0f};
+
+		while (stackSize > 0) {
+			const node_range range = stack[--stackSize];
+			if (range.begin >= range.end || range.boundSq > maxDistSq())
+				continue;
+
+			const size_t mid = range.begin + (range.end - range.begin) / 2;
+			const Vector3& p = point_at(mid);
+			visit(mid, querypoint.DistanceSquaredTo(p));
+
+			const int axis = axes[mid];
+			const float diff = querypoint[axis] - p[axis];
+			const node_range lower{range.begin, mid, range.boundSq};
+			const node_range upper{mid + 1, range.end, range.boundSq};
+
+			// Push the far side first so that the near side is searched first
+			const float farBoundSq = std::max(range.boundSq, diff * diff);
+			if (diff < 0.0f) {
+				stack[stackSize++] = node_range{upper.begin, upper.end, farBoundSq};
+				stack[stackSize++] = lower;
+			}
+			else {
+				stack[stackSize++] = node_range{lower.begin, lower.end, farBoundSq};
+				stack[stackSize++] = upper;
+			}
+		}
+	}
+
+	uint32_t find_nearest(const Vector3& querypoint, const uint32_t k, kd_query_result<index_t>* result) const {
+		if (k == 0)
+			return 0;
+
+		// Max heap of the closest points found so far, by squared distance
+		auto further = [](const kd_query_result<index_t>& a, const kd_query_result<index_t>& b) {
+			return a.distance < b.distance;
+		};
+
+		uint32_t found = 0;
+		traverse(
+			querypoint,
+			[&]() { return found < k ? FLT_MAX : result[0].distance; },
+			[&](const size_t i, const float distSq) {
+				if (found < k) {
+					result[found++] = kd_query_result<index_t>{&point_at(i), order[i], distSq};
+					std::push_heap(result, result + found, further);
+				}
+				else if (distSq < result[0].distance) {
+					std::pop_heap(result, result + found, further);
+					result[found - 1] = kd_query_result<index_t>{&point_at(i), order[i], distSq};
+					std::push_heap(result, result + found, further);
+				}
+			});
+
+		std::sort_heap(result, result + found, further);
+		for (uint32_t i = 0; i < found; i++)
+			result[i].distance = std::sqrt(result[i].distance);
+
+		return found;
+	}
+
+	void find_radius(const Vector3& querypoint,
+					 const float radius,
+					 std::vector<kd_query_result<index_t>>& queryResult) const {
+		const float radiusSq = radius * radius;
+		traverse(
+			querypoint,
+			[radiusSq]() { return radiusSq; },
+			[&](const size_t i, const float distSq) {
+				if (distSq <= radiusSq)
+					queryResult.push_back(kd_query_result<index_t>{&point_at(i), order[i], std::sqrt(distSq)});
+			});
+
+		std::sort(queryResult.begin(), queryResult.end());
+	}
+};
 } // namespace nifly
@@ -20,6 +20,8 @@ public:
 	}
 
 	void GetStringRefs(std::vector<NiStringRef*>& refs) { refs.emplace_back(&value); }
+
+	size_t HeapSize() const { return HeapSizeOf(value); }
 };
 
 enum NiKeyType : uint32_t { NO_INTERP, LINEAR_KEY, QUADRATIC_KEY, TBC_KEY, XYZ_ROTATION_KEY, CONST_KEY };
@@ -56,51 +58,176 @@ public:
 	}
 };
 
+// Key group with an interpolation-aware structure of arrays layout.
+// Times and values are always stored, tangents only for QUADRATIC_KEY and TBC parameters only for TBC_KEY.
+// The file format is the same as an array of NiAnimationKey<T> with the group's interpolation type.
 template<typename T>
 class NiAnimationKeyGroup {
 private:
 	uint32_t numKeys = 0;
 	NiKeyType interpolation = NO_INTERP;
-	std::vector<NiAnimationKey<T>> keys;
+
+	std::vector<float> times;
+	std::vector<T> values;
+	std::vector<T> forwards;  // QUADRATIC_KEY only
+	std::vector<T> backwards; // QUADRATIC_KEY only
+	std::vector<TBC> tbcs;	  // TBC_KEY only
+
+	static bool HasTangents(const NiKeyType interp) { return interp == QUADRATIC_KEY; }
+	static bool HasTBC(const NiKeyType interp) { return interp == TBC_KEY; }
+
+	// Resizes all arrays to the key count, dropping the ones the interpolation type doesn't use
+	void ResizeArrays() {
+		times.resize(numKeys);
+		values.resize(numKeys);
+
+		if (HasTangents(interpolation)) {
+			forwards.resize(numKeys);
+			backwards.resize(numKeys);
+		}
+		else {
+			forwards = std::vector<T>();
+			backwards = std::vector<T>();
+		}
+
+		if (HasTBC(interpolation))
+			tbcs.resize(numKeys);
+		else
+			tbcs = std::vector<TBC>();
+	}
 
 public:
 	void Sync(NiStreamReversible& stream) {
 		stream.Sync(numKeys);
-		keys.resize(numKeys);
 
-		if (numKeys > 0) {
+		if (numKeys > NIF_ARRAY_SIZE_LIMIT)
+			throw std::length_error("IO: Array size is too large.");
+
+		if (numKeys > 0)
 			stream.Sync(interpolation);
 
-			for (uint32_t i = 0; i < numKeys; i++) {
-				auto& key = keys[i];
-				key.type = interpolation;
-				key.Sync(stream);
+		ResizeArrays();
+
+		for (uint32_t i = 0; i < numKeys; i++) {
+			stream.Sync(times[i]);
+			stream.Sync(values[i]);
+
+			switch (interpolation) {
+				case NiKeyType::QUADRATIC_KEY:
+					stream.Sync(forwards[i]);
+					stream.Sync(backwards[i]);
+					break;
+				case NiKeyType::TBC_KEY: stream.Sync(tbcs[i]); break;
+				default: break;
 			}
 		}
 	}
 
 	NiKeyType GetInterpolationType() const { return interpolation; }
 
-	void SetInterpolationType(const NiKeyType interp) { interpolation = interp; }
+	// Changing the type drops tangent or TBC data that the new type doesn't use
+	void SetInterpolationType(const NiKeyType interp) {
+		interpolation = interp;
+		ResizeArrays();
+	}
 
 	uint32_t GetNumKeys() const { return numKeys; }
 
-	NiAnimationKey<T> GetKey(const int id) const { return keys[id]; }
+	size_t HeapSize() const { return HeapSizeOf(times, values, forwards, backwards, tbcs); }
 
-	void SetKey(const int id, const NiAnimationKey<T>& key) { keys[id] = key; }
+	// Reserves storage for the specified amount of keys
+	void Reserve(const uint32_t count) {
+		times.reserve(count);
+		values.reserve(count);
+
+		if (HasTangents(interpolation)) {
+			forwards.reserve(count);
+			backwards.reserve(count);
+		}
+
+		if (HasTBC(interpolation))
+			tbcs.reserve(count);
+	}
+
+	// Views of the key arrays. Tangent and TBC views are empty if the interpolation type doesn't use them.
+	Span<float> GetTimes() { return times; }
+	Span<const float> GetTimes() const { return times; }
+	Span<T> GetValues() { return values; }
+	Span<const T> GetValues() const { return values; }
+	Span<T> GetForwardTangents() { return forwards; }
+	Span<const T> GetForwardTangents() const { return forwards; }
+	Span<T> GetBackwardTangents() { return backwards; }
+	Span<const T> GetBackwardTangents() const { return backwards; }
+	Span<TBC> GetTBCs() { return tbcs; }
+	Span<const TBC> GetTBCs() const { return tbcs; }
+
+	// Assembles a single key from the arrays
+	NiAnimationKey<T> GetKey(const uint32_t id) const {
+		NiAnimationKey<T> key;
+		key.type = interpolation;
+		key.time = times[id];
+		key.value = values[id];
+
+		if (HasTangents(interpolation)) {
+			key.forward = forwards[id];
+			key.backward = backwards[id];
+		}
+
+		if (HasTBC(interpolation))
+			key.tbc = tbcs[id];
+
+		return key;
+	}
+
+	void SetKey(const uint32_t id, const NiAnimationKey<T>& key) {
+		times[id] = key.time;
+		values[id] = key.value;
+
+		if (HasTangents(interpolation)) {
+			forwards[id] = key.forward;
+			backwards[id] = key.backward;
+		}
+
+		if (HasTBC(interpolation))
+			tbcs[id] = key.tbc;
+	}
 
 	void AddKey(const NiAnimationKey<T>& key) {
-		keys.push_back(key);
+		times.push_back(key.time);
+		values.push_back(key.value);
+
+		if (HasTangents(interpolation)) {
+			forwards.push_back(key.forward);
+			backwards.push_back(key.backward);
+		}
+
+		if (HasTBC(interpolation))
+			tbcs.push_back(key.tbc);
+
 		numKeys++;
 	}
 
-	void RemoveKey(const int id) {
-		keys.erase(keys.begin() + id);
+	void RemoveKey(const uint32_t id) {
+		times.erase(times.begin() + id);
+		values.erase(values.begin() + id);
+
+		if (HasTangents(interpolation)) {
+			forwards.erase(forwards.begin() + id);
+			backwards.erase(backwards.begin() + id);
+		}
+
+		if (HasTBC(interpolation))
+			tbcs.erase(tbcs.begin() + id);
+
 		numKeys--;
 	}
 
 	void ClearKeys() {
-		keys.clear();
+		times.clear();
+		values.clear();
+		forwards.clear();
+		backwards.clear();
+		tbcs.clear();
 		numKeys = 0;
 	}
 };
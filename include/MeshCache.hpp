@@ -0,0 +1,73 @@
+/*
+nifly
+C++ NIF library for the Gamebryo/NetImmerse File Format
+See the included GPLv3 LICENSE file
+*/
+
+#pragma once
+
+#include "Geometry.hpp"
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace nifly {
+// Thread-safe cache of decoded external mesh data (.mesh files), shared between NifFile instances.
+// Cached data is immutable; mesh slots bound to it take a private copy on their first non-const access.
+// Once the total size exceeds the capacity, the least recently used entries are dropped from the cache.
+// Mesh slots still bound to dropped data keep it alive.
+class ExternalMeshCache {
+public:
+	using DataPtr = std::shared_ptr<const BSGeometryMeshData>;
+	using Loader = std::function<DataPtr()>;
+
+	explicit ExternalMeshCache(const size_t capacityBytes = 1024 * 1024 * 1024)
+		: capacity(capacityBytes) {}
+
+	// Process-wide instance
+	static ExternalMeshCache& Global();
+
+	// Returns the cached data of the key (or nullptr) and marks it as recently used
+	DataPtr Find(const std::string& key);
+
+	// Adds the data unless the key is already cached. Returns the data that is cached for the key.
+	DataPtr Insert(const std::string& key, DataPtr data);
+
+	// Returns the cached data of the key or calls the loader and caches its result (unless nullptr).
+	// The loader runs without locking the cache, so it may run more than once for a key at the same time.
+	DataPtr FindOrLoad(const std::string& key, const Loader& loader);
+
+	void Remove(const std::string& key);
+	void Clear();
+
+	// Capacity and current size in bytes of heap memory used by the cached data
+	void SetCapacity(const size_t capacityBytes);
+	size_t GetCapacity() const;
+	size_t GetSize() const;
+	size_t GetCount() const;
+
+	uint64_t GetHits() const;
+	uint64_t GetMisses() const;
+
+private:
+	struct Entry {
+		std::string key;
+		DataPtr data;
+		size_t size = 0;
+	};
+
+	mutable std::mutex mutex;
+	std::list<Entry> entries; // Most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+	size_t capacity = 0;
+	size_t size = 0;
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+	// Drops the least recently used entries until the size fits the capacity, but always keeps the most
+	// recently used one. Expects a locked mutex.
+	void Trim();
+};
+} // namespace nifly
@@ -0,0 +1,59 @@
+/*
+nifly
+C++ NIF library for the Gamebryo/NetImmerse File Format
+See the included GPLv3 LICENSE file
+*/
+
+#pragma once
+
+#include "MeshTopology.hpp"
+#include "Object3d.hpp"
+
+#include <cfloat>
+#include <vector>
+
+namespace nifly {
+// Per-vertex attributes that make collapsing vertices with different values more expensive
+struct SimplifyAttributes {
+	// Value of a sparse attribute, like the weight of one bone
+	struct SparseValue {
+		uint32_t id = 0;
+		float value = 0.0f;
+	};
+
+	// One value per vertex for each attribute
+	std::vector<std::vector<float>> columns;
+	// Cost weight of each attribute
+	std::vector<float> weights;
+
+	// Sparse values of vertex v are sparseValues[sparseStart[v]] up to sparseValues[sparseStart[v + 1]],
+	// sorted by id. Ids without a value count as zero.
+	std::vector<uint32_t> sparseStart;
+	std::vector<SparseValue> sparseValues;
+	// Cost weight of the sparse values
+	float sparseWeight = 0.0f;
+
+	void Add(std::vector<float> vertValues, const float weight) {
+		columns.push_back(std::move(vertValues));
+		weights.push_back(weight);
+	}
+
+	// Replaces the sparse values with the list of each vertex
+	void SetSparse(std::vector<std::vector<SparseValue>> vertValues, const float weight);
+};
+
+// Simplifies the triangles with quadric error edge collapses until targetCount triangles are left
+// or the next collapse would exceed maxError. The error is a distance relative to the size of the mesh.
+// Vertices only collapse onto their neighbors, so the result uses a subset of the same vertices.
+// Vertices sharing a position (UV or normal seams) collapse together, each onto its neighbor on the same
+// side of the seam. Seams and open borders only collapse along themselves. outError receives the largest
+// error of the collapses. A topology of the triangles (see NifFile::GetShapeTopology) saves building the
+// initial edge table.
+std::vector<Triangle> SimplifyTriangles(const std::vector<Vector3>& verts,
+										const std::vector<Triangle>& tris,
+										const uint32_t targetCount,
+										const float maxError = FLT_MAX,
+										const SimplifyAttributes* attributes = nullptr,
+										float* outError = nullptr,
+										const MeshTopology* topology = nullptr);
+} // namespace nifly
@@ -0,0 +1,83 @@
+/*
+nifly
+C++ NIF library for the Gamebryo/NetImmerse File Format
+See the included GPLv3 LICENSE file
+*/
+
+#pragma once
+
+#include "Object3d.hpp"
+
+#include <array>
+#include <vector>
+
+namespace nifly {
+// Adjacency of a triangle list, stored in flat arrays (CSR layout).
+// Provides the triangles and edges of each vertex, the triangles of each edge, the boundary edges and the
+// connected components. Triangles with out of range indices are left out of all tables.
+// Read-only after construction, so it can be shared and queried from multiple threads.
+class MeshTopology {
+public:
+	static constexpr uint32_t npos = static_cast<uint32_t>(-1);
+
+	MeshTopology() = default;
+	MeshTopology(const size_t numVertices, Span<const Triangle> tris);
+
+	size_t GetNumVertices() const { return vertTriStart.empty() ? 0 : vertTriStart.size() - 1; }
+	// Number of triangles in the list the topology was built from (including skipped invalid ones)
+	size_t GetNumTriangles() const { return triEdges.size(); }
+	size_t GetNumEdges() const { return edges.size(); }
+	size_t GetNumComponents() const { return compTriStart.empty() ? 0 : compTriStart.size() - 1; }
+
+	// Triangles using the vertex, in ascending order
+	Span<const uint32_t> GetVertexTriangles(const uint32_t vertex) const;
+	// Edges using the vertex, in ascending order
+	Span<const uint32_t> GetVertexEdges(const uint32_t vertex) const;
+
+	// Vertices of the edge (p1 < p2)
+	const Edge& GetEdge(const uint32_t edge) const { return edges[edge]; }
+	// Triangles using the edge, in ascending order
+	Span<const uint32_t> GetEdgeTriangles(const uint32_t edge) const;
+	// Edges p1-p2, p2-p3 and p3-p1 of the triangle (npos for invalid triangles and collapsed edges)
+	const std::array<uint32_t, 3>& GetTriangleEdges(const uint32_t tri) const { return triEdges[tri]; }
+	// Edge between the two vertices in either order, or npos
+	uint32_t FindEdge(const uint16_t p1, const uint16_t p2) const;
+
+	// Edges used by exactly one triangle, in ascending order
+	const std::vector<uint32_t>& GetBoundaryEdges() const { return boundaryEdges; }
+	bool IsBoundaryEdge(const uint32_t edge) const { return GetEdgeTriangles(edge).size() == 1; }
+	bool IsBoundaryVertex(const uint32_t vertex) const { return boundaryVerts[vertex]; }
+	// Edges used by more than two triangles, in ascending order
+	const std::vector<uint32_t>& GetNonManifoldEdges() const { return nonManifoldEdges; }
+
+	// Connected components: triangles sharing a vertex are in the same component.
+	// Components are numbered in the order of their first triangle.
+	// Returns npos for invalid triangles.
+	uint32_t GetTriangleComponent(const uint32_t tri) const { return triComps[tri]; }
+	// Triangles of the component, in ascending order
+	Span<const uint32_t> GetComponentTriangles(const uint32_t component) const;
+
+private:
+	// The triangles of vertex v are vertTris[vertTriStart[v]] to vertTris[vertTriStart[v + 1] - 1].
+	// The other tables use the same layout.
+	std::vector<uint32_t> vertTriStart;
+	std::vector<uint32_t> vertTris;
+	std::vector<uint32_t> vertEdgeStart;
+	std::vector<uint32_t> vertEdges;
+
+	// Edges are sorted by p1, then p2. The edges with p1 == v start at edgeStart[v].
+	std::vector<Edge> edges;
+	std::vector<uint32_t> edgeStart;
+	std::vector<uint32_t> edgeTriStart;
+	std::vector<uint32_t> edgeTris;
+	std::vector<std::array<uint32_t, 3>> triEdges;
+
+	std::vector<uint32_t> boundaryEdges;
+	std::vector<uint32_t> nonManifoldEdges;
+	std::vector<bool> boundaryVerts;
+
+	std::vector<uint32_t> triComps;
+	std::vector<uint32_t> compTriStart;
+	std::vector<uint32_t> compTris;
+};
+} // namespace nifly
@@ -8,8 +8,12 @@ See the included GPLv3 LICENSE file
 
 #include "Factory.hpp"
 #include "Geometry.hpp"
+#include "MeshCache.hpp"
+#include "MeshSimplify.hpp"
 #include "Nodes.hpp"
 
+#include <functional>
+
 #if __has_include(<filesystem>)
 
 #include <filesystem>
@@ -26,12 +30,19 @@ namespace std::filesystem {
 namespace nifly {
 // OptimizeFor function options
 struct OptOptions {
-	NiVersion targetVersion;	// NiVersion target for the optimization process
-	bool headParts = false;		// Use mesh formats required for head parts (use ONLY for head parts!)
-	bool removeParallax = true; // Remove parallax shader flags and texture paths
-	bool calcBounds = true;		// Recalculate bounding spheres for unskinned meshes
-	bool fixBSXFlags = true;	// Fix BSX flag values based on file contents
-	bool fixShaderFlags = true;	// Fix shader flag values based on file contents
+	NiVersion targetVersion;	   // NiVersion target for the optimization process
+	bool headParts = false;		   // Use mesh formats required for head parts (use ONLY for head parts!)
+	bool removeParallax = true;	   // Remove parallax shader flags and texture paths
+	bool calcBounds = true;		   // Recalculate bounding spheres for unskinned meshes
+	bool fixBSXFlags = true;	   // Fix BSX flag values based on file contents
+	bool fixShaderFlags = true;	   // Fix shader flag values based on file contents
+	bool parallelTangents = false; // Calculate tangents on multiple threads (same results)
+	bool vertexCacheOrder = false; // Reorder triangles and vertices of all shapes for the vertex cache
+	bool splitShapes = false;	   // Split shapes over the vertex/triangle limits of the target version
+	bool stripify = false;		   // Convert shapes to triangle strips (Morrowind/Oblivion to same version)
+
+	// Algorithm of bounding spheres recalculated for skinned meshes (see calcBounds)
+	BoundsMethod boundsMethod = BoundsMethod::Exact;
 };
 
 // OptimizeFor function result
@@ -43,6 +54,8 @@ struct OptResult {
 	std::vector<std::string> shapesPartTriangulated; // Names of shapes that had their partitions triangulated
 	std::vector<std::string> shapesTangentsAdded; // Names of shapes that received missing tangents/bitangents
 	std::vector<std::string> shapesParallaxRemoved; // Names of shapes that had their parallax settings
+	std::vector<std::string> shapesSplit;			// Names of shapes that were split into multiple shapes
+	std::vector<std::string> shapesStripified;		// Names of shapes that were converted to strips
 };
 
 // Sort function for bone weights with indices
@@ -53,12 +66,49 @@ struct BoneWeightsSort {
 // NifFile load options
 struct NifLoadOptions {
 	bool isTerrain = false; // Load as terrain file. Affects texture path cleanup and shape names.
+
+	// Keep the vertex data of BSTriShape and internal BSGeometry meshes in its file form and decode it on
+	// first access. Data that isn't changed is saved back byte for byte.
+	bool keepPacked = false;
 };
 
 // NifFile save options
 struct NifSaveOptions {
 	bool optimize = true;	// Update bounds and delete unreferenced blocks (see NifFile::Optimize)
 	bool sortBlocks = true; // Sorts all blocks in a logical order (see NifFile::PrettySortBlocks)
+
+	// Algorithm of bounding spheres updated by optimize
+	BoundsMethod boundsMethod = BoundsMethod::Exact;
+};
+
+// External mesh that couldn't be loaded (see NifFile::LoadAllExternalShapeData)
+struct ExternalMeshError {
+	NiShape* shape = nullptr;	 // Shape of the mesh slot
+	uint8_t meshIndex = 0;		 // Mesh slot (LOD) of the shape
+	std::string meshName;		 // Name of the mesh as stored in the shape
+	std::filesystem::path path; // Resolved file path (empty if it couldn't be resolved)
+	std::string message;		 // Reason of the failure
+};
+
+// Resolves the name of an external mesh (see NifFile::GetExternalGeometryPathRefs) to a file path.
+// Returning an empty path marks the mesh as not found.
+using ExternalMeshResolver = std::function<std::filesystem::path(const std::string& meshName)>;
+
+// Sparse differences of one or more targets in CSR layout (see NifFile::CalcShapeDiffs).
+// The differences of target t are at [offsets[t], offsets[t + 1]) of indices and diffs,
+// in ascending index order.
+struct SparseDiffData {
+	std::vector<uint32_t> offsets{0};
+	std::vector<uint32_t> indices;
+	std::vector<Vector3> diffs;
+
+	size_t GetTargetCount() const { return offsets.size() - 1; }
+
+	void Clear() {
+		offsets.assign(1, 0);
+		indices.clear();
+		diffs.clear();
+	}
 };
 
 class NifFile {
@@ -95,7 +145,11 @@ public:
 	int Save(std::ostream& file, const NifSaveOptions& options = NifSaveOptions());
 
 	// Update geometry bounds and delete unreferenced blocks
-	void Optimize();
+	void Optimize(const BoundsMethod boundsMethod = BoundsMethod::Exact);
+
+	// Recalculates the multi bound data (AABB, OBB or sphere) of all BSMultiBoundNode blocks
+	// from the global vertex positions of the shapes below them. Returns the number of bounds updated.
+	uint32_t UpdateMultiBounds();
 
 	// Optimizes/converts the file using OptOptions and returns OptResult.
 	// For use with LE and SE files only.
@@ -148,6 +202,10 @@ public:
 	// FO4 and later:           4294967295 (uint32_t)
 	size_t GetTriangleLimit() const;
 
+	// Returns the memory used by the header and all blocks, including heap data owned by them.
+	// If "usageByType" is provided, it receives the memory used by the blocks per block type.
+	size_t GetMemoryUsage(std::map<std::string, size_t>* usageByType = nullptr) const;
+
 	NiNode* AddNode(const std::string& nodeName, const MatTransform& xformToParent, NiNode* parent = nullptr);
 	void DeleteNode(const std::string& nodeName);
 	static bool CanDeleteNode(NiNode* node);
@@ -263,15 +321,42 @@ public:
 	// Returns a mutable gometry data structure for manipulating geometry data. If
 	// geometry data cannot be found, nullptr is returned
 	NiGeometryData* GetGeometryData(NiShape* shape) const;
+	// Returns the geometry data of the shape for reading (or nullptr).
+	// Shared or packed mesh data is read in place instead of taking a private copy.
+	const NiGeometryData* ReadGeometryData(NiShape* shape) const;
 
 	// Returns a list of mesh names useful for locating external mesh data eg data/geometry/<meshname>
 	std::vector<std::reference_wrapper<std::string>> GetExternalGeometryPathRefs(NiShape* shape) const;
 
-	// Loads external shape data from the provided istream, storing data in the provided shape
-	bool LoadExternalShapeData(NiShape* shape, std::istream& stream, uint8_t shapeIndex);
+	// Loads external shape data from the provided istream, storing data in the provided shape.
+	// With "keepPacked", the data stays in its file form until first accessed and is saved back unchanged if untouched.
+	bool LoadExternalShapeData(NiShape* shape, std::istream& stream, uint8_t shapeIndex, bool keepPacked = false);
 	// Saves external shape data from the provided shape, storing data in the provided ostream
 	bool SaveExternalShapeData(NiShape* shape, std::ostream& outfile, uint8_t shapeIndex);
 
+	// Binds a mesh slot of the shape to shared, immutable and decoded mesh data (e.g. from a mesh cache).
+	// Reading the shape keeps it bound. The slot takes a private copy when it's edited
+	// (see BSGeometryMeshData::Unpack).
+	bool BindExternalShapeData(NiShape* shape,
+							   uint8_t shapeIndex,
+							   std::shared_ptr<const BSGeometryMeshData> data);
+
+	// Loads the external data of all mesh slots of the shapes (or of all shapes, if none are given),
+	// reading each file at once and spreading them across threads. With a root directory, mesh names
+	// are resolved to "<rootDir>/<meshName>.mesh", so it's usually the geometry folder of the data directory.
+	// With a cache, mesh slots are bound to the cached data of the resolved paths (keepPacked is ignored).
+	// Failed meshes don't stop the others from loading; their errors are returned.
+	std::vector<ExternalMeshError> LoadAllExternalShapeData(const std::filesystem::path& rootDir,
+															const std::vector<NiShape*>& shapes = {},
+															const bool keepPacked = false,
+															const bool parallel = true,
+															ExternalMeshCache* cache = nullptr);
+	std::vector<ExternalMeshError> LoadAllExternalShapeData(const ExternalMeshResolver& resolver,
+															const std::vector<NiShape*>& shapes = {},
+															const bool keepPacked = false,
+															const bool parallel = true,
+															ExternalMeshCache* cache = nullptr);
+
 	// Returns references to all texture path strings of the shape
 	std::vector<std::reference_wrapper<std::string>> GetTexturePathRefs(NiShape* shape) const;
 
@@ -298,6 +383,23 @@ public:
 	// Source block can be located in a different file (see "srcNif" parameter).
 	NiShape* CloneShape(NiShape* srcShape, const std::string& destShapeName, NifFile* srcNif = nullptr);
 
+	// Merges compatible shapes of the list (default: all shapes) to reduce draw calls and returns the shapes
+	// that others were merged into. Shapes are compatible if they have the same block type, flags, vertex
+	// attributes and skin space, and shader, texture set, alpha and other properties with equal content.
+	// The other shapes of a group are transformed into the space of its first shape, their vertices and
+	// triangles appended (identical vertices are welded), their bone weights and partitions remapped,
+	// and they are deleted afterwards. Groups are split to stay within the vertex and triangle limits.
+	// Only NiTriShape and BSTriShape blocks without controllers, collision or extra data are merged.
+	std::vector<NiShape*> MergeShapes(const std::vector<NiShape*>& shapes = {});
+
+	// Splits the shape into parts with at most "maxVertices" vertices and "maxTriangles" triangles each
+	// (0 for the limits of the file version) and returns all parts, starting with the shape itself.
+	// Triangles are divided at the median of their centers along the longest axis until all parts fit,
+	// so parts are spatially coherent. The other parts are copies of the shape (shader, skinning,
+	// partitions/segments and extra data) named "<name>_<n>" that keep only their own triangles and vertices.
+	// NiTriStrips, BSGeometry and shapes with particle data aren't split.
+	std::vector<NiShape*> SplitShape(NiShape* shape, size_t maxVertices = 0, size_t maxTriangles = 0);
+
 	// Finds and clones the first NiNode with the specified name and returns its index (or NIF_NPOS).
 	// Source block can be located in a different file (see "srcNif" parameter).
 	uint32_t CloneNamedNode(const std::string& nodeName, NifFile* srcNif = nullptr);
@@ -326,6 +428,13 @@ public:
 	// Converts the shape from a NiTriStrips to a NiTriShape block
 	void TriangulateShape(NiShape* shape);
 
+	// Converts the shape from a NiTriShape to a NiTriStrips block and the triangles of its skin partitions
+	// to strips (see GenerateStripsFromTriangles). Each strip is drawn separately, so they are joined by
+	// default. Strips that don't fit into the 16-bit counts of the file stay unjoined.
+	// The shape block is replaced, so "shape" is invalid after.
+	// Returns false if the shape isn't a NiTriShape with triangles or its strips don't fit.
+	bool StripifyShape(NiShape* shape, const bool joinStrips = true);
+
 	// Get direct children of a node of the given block type. Use template type "NiObject" for all block types.
 	// Optionally, return extra data references as well.
 	template<class T>
@@ -351,6 +460,9 @@ public:
 	// by composing transforms up the node tree to the root node.
 	bool GetNodeTransformToGlobal(const std::string& nodeName, MatTransform& outTransform) const;
 
+	// Gets the transform from the shape's vertices to global space, including the shape's own transform
+	MatTransform GetShapeTransformToGlobal(NiShape* shape) const;
+
 	// GetAbsoluteNodeTransform is deprecated. Use GetNodeTransformToGlobal instead.
 	bool GetAbsoluteNodeTransform(const std::string& nodeName, MatTransform& outTransform) const {
 		return GetNodeTransformToGlobal(nodeName, outTransform);
@@ -493,6 +605,10 @@ public:
 	// Reorder triangles of the shape to the order of triangle indices in the list
 	static bool ReorderTriangles(NiShape* shape, const std::vector<uint32_t>& triangleIndices);
 
+	// Reorder triangles of the shape for better use of the post-transform vertex cache.
+	// Segments, LOD levels and skin partitions keep the same triangles.
+	bool OptimizeVertexCache(NiShape* shape, const uint32_t cacheSize = 32);
+
 	// Gets pointer to vertex positions of the shape (can be nullptr or empty)
 	const std::vector<Vector3>* GetVertsForShape(NiShape* shape);
 	// Gets pointer to vertex normals of the shape (can be nullptr or empty)
@@ -572,7 +688,7 @@ public:
 
 	// Recalculates (or adds) new tangents and bitangents for the shape.
 	// Requires normals and UVs to be set beforehand.
-	void CalcTangentsForShape(NiShape* shape);
+	void CalcTangentsForShape(NiShape* shape, const bool parallel = false);
 
 	// Apply normals from a different file to a shape with the same name and vertex count.
 	int ApplyNormalsFromFile(NifFile& srcNif, const std::string& shapeName);
@@ -583,18 +699,38 @@ public:
 	// Moves a single vertex to the specified position
 	void MoveVertex(NiShape* shape, const Vector3& pos, const int id);
 
+	// Applies the transform to the vertices of the shape and, if enabled, to its normals and tangents.
+	// Weights (one per vertex, missing ones count as 1) blend between the original and transformed vertex.
+	void TransformShape(NiShape* shape,
+						const Matrix4& transform,
+						Span<const float> weights = {},
+						const bool transformNormals = true);
+
+	// Applies the same transform to all of the shapes, optionally spread across threads
+	void TransformShapes(const std::vector<NiShape*>& shapes,
+						 const Matrix4& transform,
+						 const bool transformNormals = true,
+						 const bool parallel = true);
+
 	// Moves the entire shape by the specified offset. Respects the specified masking map.
+	// The nullptr_t overloads keep calls with a literal nullptr mask unambiguous.
 	void OffsetShape(NiShape* shape,
 					 const Vector3& offset,
-					 std::unordered_map<uint16_t, float>* mask = nullptr);
+					 std::unordered_map<uint32_t, float>* mask = nullptr);
+	void OffsetShape(NiShape* shape, const Vector3& offset, std::unordered_map<uint16_t, float>* mask);
+	void OffsetShape(NiShape* shape, const Vector3& offset, std::nullptr_t) { OffsetShape(shape, offset); }
 
 	// Scales the entire shape from the scene root by the specified factors. Respects the specified masking map.
-	void ScaleShape(NiShape* shape, const Vector3& scale, std::unordered_map<uint16_t, float>* mask = nullptr);
+	void ScaleShape(NiShape* shape, const Vector3& scale, std::unordered_map<uint32_t, float>* mask = nullptr);
+	void ScaleShape(NiShape* shape, const Vector3& scale, std::unordered_map<uint16_t, float>* mask);
+	void ScaleShape(NiShape* shape, const Vector3& scale, std::nullptr_t) { ScaleShape(shape, scale); }
 
 	// Rotates the entire shape from the scene root by the specified angles in degrees. Respects the specified masking map.
 	void RotateShape(NiShape* shape,
 					 const Vector3& angle,
-					 std::unordered_map<uint16_t, float>* mask = nullptr);
+					 std::unordered_map<uint32_t, float>* mask = nullptr);
+	void RotateShape(NiShape* shape, const Vector3& angle, std::unordered_map<uint16_t, float>* mask);
+	void RotateShape(NiShape* shape, const Vector3& angle, std::nullptr_t) { RotateShape(shape, angle); }
 
 	// Returns alpha property of the shape (or nullptr)
 	NiAlphaProperty* GetAlphaProperty(NiShape* shape) const;
@@ -620,21 +756,96 @@ public:
 
 	// Deletes the specified vertex indices from the shape and notifies all blocks.
 	// Skinning and partitions/segments are corrected accordingly.
+	// Indices must be sorted in ascending order.
+	bool DeleteVertsForShape(NiShape* shape, const std::vector<uint32_t>& indices);
 	bool DeleteVertsForShape(NiShape* shape, const std::vector<uint16_t>& indices);
+	// Keeps calls with a braced list of indices unambiguous
+	bool DeleteVertsForShape(NiShape* shape, std::initializer_list<uint32_t> indices) {
+		return DeleteVertsForShape(shape, std::vector<uint32_t>(indices));
+	}
+
+	// Renumbers the vertices of the shape with vertMap (old index to new index, a permutation)
+	// in all vertex data, triangles, skinning, morphs and LOCKEDNORM extra data.
+	bool ReorderVertices(NiShape* shape, const std::vector<int>& vertMap);
+	// Reorders the vertices of the shape to the order in which its triangles first use them
+	bool OptimizeVertexFetch(NiShape* shape);
+
+	// Gets a BVH of the shape's triangles for closest point, ray and overlap queries. The vertices are
+	// transformed by "transform" first, e.g. GetShapeTransformToGlobal(shape) for global space.
+	// The BVH is cached on the shape and rebuilt if the transform or the vertex or triangle count differ.
+	// Vertex and triangle edits through NifFile or the shape invalidate it.
+	std::shared_ptr<const TriangleBVH> GetShapeBVH(NiShape* shape,
+												   const MatTransform& transform = MatTransform());
+
+	// Gets the triangle adjacency of the shape (see MeshTopology).
+	// The topology is cached on the shape and rebuilt if the vertex or triangle count differ.
+	// Vertex and triangle edits through NifFile or the shape invalidate it.
+	std::shared_ptr<const MeshTopology> GetShapeTopology(NiShape* shape);
+
+	// Gathers texture coordinates, vertex colors and bone weights of the shape as simplification attributes
+	SimplifyAttributes GetSimplifyAttributes(NiShape* shape) const;
+	// Simplifies the triangles of the shape once per ratio (of the full triangle count), each level
+	// based on the previous one. A level keeps more triangles if maxError (relative to the mesh size)
+	// would be exceeded otherwise.
+	std::vector<std::vector<Triangle>> GenerateLODTriangles(NiShape* shape,
+															 const std::vector<float>& ratios,
+															 const float maxError = 1.0f) const;
+	// Generates LOD levels for the LOD lists of the selected BSGeometry meshes.
+	// The shapes are simplified in parallel.
+	// Returns the number of shapes that received LOD levels.
+	uint32_t GenerateLODsForShapes(const std::vector<NiShape*>& shapes,
+								   const std::vector<float>& ratios,
+								   const float maxError = 1.0f);
 
 	// Calculates the difference between the shape's vertex positions and the specified target data (with a scale).
 	// Vertices that match up are not returned in the diff data map.
+	int CalcShapeDiff(NiShape* shape,
+					  const std::vector<Vector3>* targetData,
+					  std::unordered_map<uint32_t, Vector3>& outDiffData,
+					  float scale = 1.0f);
 	int CalcShapeDiff(NiShape* shape,
 					  const std::vector<Vector3>* targetData,
 					  std::unordered_map<uint16_t, Vector3>& outDiffData,
 					  float scale = 1.0f);
+	// Dense form with a difference for each vertex (zero for vertices that match up)
+	int CalcShapeDiff(NiShape* shape,
+					  const std::vector<Vector3>* targetData,
+					  std::vector<Vector3>& outDiffData,
+					  float scale = 1.0f);
+	int CalcShapeDiff(NiShape* shape,
+					  const std::vector<Vector3>* targetData,
+					  SparseDiffData& outDiffData,
+					  float scale = 1.0f);
+	// Calculates the differences to all targets (one row each) in one pass over the vertex positions.
+	int CalcShapeDiffs(NiShape* shape,
+					   const std::vector<const std::vector<Vector3>*>& targetData,
+					   SparseDiffData& outDiffData,
+					   float scale = 1.0f);
 
 	// Calculates the difference between the shape's texture coordinates and the specified target data (with a scale).
 	// Texture coordinates that match up are not returned in the diff data map.
+	int CalcUVDiff(NiShape* shape,
+				   const std::vector<Vector2>* targetData,
+				   std::unordered_map<uint32_t, Vector3>& outDiffData,
+				   float scale = 1.0f);
 	int CalcUVDiff(NiShape* shape,
 				   const std::vector<Vector2>* targetData,
 				   std::unordered_map<uint16_t, Vector3>& outDiffData,
 				   float scale = 1.0f);
+	// Dense form with a difference for each texture coordinate (zero for texture coordinates that match up)
+	int CalcUVDiff(NiShape* shape,
+				   const std::vector<Vector2>* targetData,
+				   std::vector<Vector3>& outDiffData,
+				   float scale = 1.0f);
+	int CalcUVDiff(NiShape* shape,
+				   const std::vector<Vector2>* targetData,
+				   SparseDiffData& outDiffData,
+				   float scale = 1.0f);
+	// Calculates the differences to all targets (one row each) in one pass over the texture coordinates.
+	int CalcUVDiffs(NiShape* shape,
+					const std::vector<const std::vector<Vector2>*>& targetData,
+					SparseDiffData& outDiffData,
+					float scale = 1.0f);
 
 	// Create all blocks and flags required for skinning, if they don't already exist
 	// Blocks: BSDismemberSkinInstance, NiSkinData, NiSkinPartition, BSSkin::Instance, BSSkin::BoneData
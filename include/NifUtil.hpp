@@ -8,9 +8,13 @@ See the included GPLv3 LICENSE file
 
 #include "Object3d.hpp"
 
+#include <exception>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <streambuf>
 #include <string_view>
+#include <thread>
 
 namespace nifly {
 // Applies a vertex index renumbering map to p1, p2, and p3 of a vector of triangles.
@@ -23,7 +27,7 @@ void ApplyMapToTriangles(std::vector<Triangle>& tris,
 	const size_t mapsz = map.size();
 	size_t di = 0;
 	for (IndexType2 si = 0; si < static_cast<IndexType2>(tris.size()); ++si) {
-		const Triangle& stri = tris[si];
+		const Triangle& stri = tris[static_cast<size_t>(si)];
 		// Triangle's indices are unsigned, but IndexType might be signed.
 		if (stri.p1 >= mapsz || stri.p2 >= mapsz || stri.p3 >= mapsz || map[stri.p1] < 0 || map[stri.p2] < 0
 			|| map[stri.p3] < 0) {
@@ -55,6 +59,29 @@ inline uint16_t CalcMaxTriangleIndex(const std::vector<Triangle>& v) {
 	return maxind;
 }
 
+// Generates a drawing order for the triangles that makes better use of the post-transform vertex cache
+// (Forsyth's linear-speed algorithm). The result holds the indices of the triangles in their new order.
+std::vector<uint32_t> GenerateVertexCacheOrder(Span<const Triangle> tris, const uint32_t cacheSize = 32);
+
+// Generates a vertex index map (old index to new index) that numbers the vertices in the order
+// the triangles first use them. Vertices without triangles are moved to the end in their old order.
+std::vector<int> GenerateVertexFetchMap(Span<const Triangle> tris, const uint32_t numVerts);
+
+// Average number of vertex transforms per triangle (ACMR) when drawing with a FIFO cache of cacheSize
+float CalcCacheMissRatio(Span<const Triangle> tris, const uint32_t cacheSize = 32);
+
+// Generates triangle strips with the same triangles and winding (the reverse of GenerateTrianglesFromStrips).
+// Strips start at the triangles in vertex cache order and grow across shared edges from the corner that
+// gives the longest strip, so they need no swaps. Degenerate triangles are left out.
+// With joinStrips, the strips are joined into as few strips as possible using degenerate triangles.
+std::vector<std::vector<uint16_t>> GenerateStripsFromTriangles(Span<const Triangle> tris,
+															   const bool joinStrips = false,
+															   const uint32_t cacheSize = 16);
+
+// Counts the triangles of the strips like game files do, including the degenerate triangles joining strips.
+// Returns false if the number of strips, points of a strip or triangles doesn't fit into 16 bits.
+bool CountStripTriangles(const std::vector<std::vector<uint16_t>>& strips, uint16_t& outNumTriangles);
+
 // 'indices' must be in sorted ascending order beforehand.
 template<typename VectorType, typename IndexType>
 void EraseVectorIndices(VectorType& v, const std::vector<IndexType>& indices) {
@@ -129,6 +156,20 @@ std::vector<int> GenerateIndexExpandMap(const std::vector<IndexType1>& indices,
 	return map;
 }
 
+// Moves element i of v to position indexMap[i].
+// indexMap must be a permutation of the indices of v.
+template<typename VectorType>
+void ApplyIndexMapToVector(VectorType& v, const std::vector<int>& indexMap) {
+	if (indexMap.size() != v.size())
+		return;
+
+	VectorType copy(v.size());
+	for (size_t i = 0; i < indexMap.size(); ++i)
+		copy[static_cast<size_t>(indexMap[i])] = std::move(v[i]);
+
+	v = std::move(copy);
+}
+
 // MapType is something like std::unordered_map<int, Data> or std::map<int, Data>.
 // If a MapType-key k is in the indexMap, it is deleted if indexMap[k]
 // is negative, or changed to indexMap[k] otherwise.
@@ -198,6 +239,18 @@ void trim_whitespace(std::string& str);
 std::unique_ptr<std::istream> GetBinaryInputFileStream(const std::filesystem::path& path);
 std::unique_ptr<std::ostream> GetBinaryOutputFileStream(const std::filesystem::path& path);
 
+// Reads the whole file into "outData" at once. Returns false if the file can't be read.
+bool ReadBinaryFile(const std::filesystem::path& path, std::vector<char>& outData);
+
+// Read-only stream buffer over existing memory, avoids copying data into a string stream
+struct MemoryStreamBuf : std::streambuf {
+	MemoryStreamBuf(const char* data, size_t size) {
+		// The get area is never written to
+		char* begin = const_cast<char*>(data);
+		setg(begin, begin, begin + size);
+	}
+};
+
 // Convenience wrapper for std::find
 template<typename Container, typename Value = typename Container::value>
 auto find(Container& cont, Value&& val) {
@@ -228,6 +281,68 @@ bool contains(const Container& cont, Value&& val) {
 	return find(cont, std::forward<Value>(val)) != std::end(cont);
 }
 
+// Calls func(begin, end) for consecutive ranges that together cover [0, count), spread across
+// the available hardware threads. Each thread gets at least "minPerThread" items, so small counts
+// run on the calling thread only. If threads can't be started, their ranges run on the calling thread.
+// All threads are joined before returning. The first exception thrown by func is then rethrown.
+template<typename Func>
+void ParallelFor(const size_t count, const size_t minPerThread, Func&& func) {
+	const size_t hardwareThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+	const size_t numThreads = std::min(hardwareThreads, count / std::max<size_t>(1, minPerThread));
+	if (numThreads <= 1) {
+		if (count > 0)
+			func(size_t(0), count);
+		return;
+	}
+
+	const size_t chunkSize = (count + numThreads - 1) / numThreads;
+
+	std::exception_ptr error;
+	std::mutex errorMutex;
+	auto runRange = [&func, &error, &errorMutex](const size_t begin, const size_t end) {
+		try {
+			func(begin, end);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error)
+				error = std::current_exception();
+		}
+	};
+
+	// Joins the started threads on every way out, as destroying a joinable thread terminates
+	struct ThreadJoiner {
+		std::vector<std::thread> threads;
+		~ThreadJoiner() {
+			for (auto& thread : threads)
+				if (thread.joinable())
+					thread.join();
+		}
+	} joiner;
+
+	size_t begin = chunkSize;
+	try {
+		joiner.threads.reserve(numThreads - 1);
+		for (; begin < count; begin += chunkSize) {
+			const size_t end = std::min(count, begin + chunkSize);
+			joiner.threads.emplace_back([&runRange, begin, end]() { runRange(begin, end); });
+		}
+	}
+	catch (...) {
+		// Out of threads or memory, the remaining ranges run below
+	}
+
+	runRange(size_t(0), chunkSize);
+	for (; begin < count; begin += chunkSize)
+		runRange(begin, std::min(count, begin + chunkSize));
+
+	for (auto& thread : joiner.threads)
+		thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
 // Return new unique pointer and raw pointer to the same object as part of a pair.
 // This way, the object can still be accessed using the raw pointer after moving the smart pointer.
 // Usage: auto [triShapeS, triShape] = make_unique<NiTriShape>();
@@ -19,6 +19,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiAVObject::GetHeapUsage() + HeapSizeOf(childRefs, effectRefs);
+	}
 
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -90,6 +93,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiNode::GetHeapUsage() + HeapSizeOf(bones1, bones2); }
 
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -114,6 +118,13 @@ public:
 	Vector3 size;
 	Matrix3 rotation;
 
+	// Size is the half extent of the box
+	void SetBounds(const OrientedBoundingBox& box) {
+		center = box.center;
+		size = box.halfExtent;
+		rotation = box.rotation;
+	}
+
 	static constexpr const char* BlockName = "BSMultiBoundOBB";
 	const char* GetBlockName() override { return BlockName; }
 
@@ -125,6 +136,11 @@ public:
 	Vector3 center;
 	Vector3 halfExtent;
 
+	void SetBounds(const BoundingBox& box) {
+		center = box.Center();
+		halfExtent = box.HalfExtent();
+	}
+
 	static constexpr const char* BlockName = "BSMultiBoundAABB";
 	const char* GetBlockName() override { return BlockName; }
 
@@ -136,6 +152,11 @@ public:
 	Vector3 center;
 	float radius = 0.0f;
 
+	void SetBounds(const BoundingSphere& sphere) {
+		center = sphere.center;
+		radius = sphere.radius;
+	}
+
 	static constexpr const char* BlockName = "BSMultiBoundSphere";
 	const char* GetBlockName() override { return BlockName; }
 
@@ -200,6 +221,8 @@ struct BSDistantObjectInstance {
 		unknownData.Sync(stream);
 		transforms.Sync(stream);
 	}
+
+	size_t HeapSize() const { return HeapSizeOf(unknownData, transforms); }
 };
 
 struct BSShaderTextureArray {
@@ -210,6 +233,8 @@ struct BSShaderTextureArray {
 		stream.Sync(unknownByte);
 		textureArrays.Sync(stream);
 	}
+
+	size_t HeapSize() const { return HeapSizeOf(textureArrays); }
 };
 
 class BSDistantObjectInstancedNode : public NiCloneableStreamable<BSDistantObjectInstancedNode, BSMultiBoundNode> {
@@ -221,6 +246,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return BSMultiBoundNode::GetHeapUsage() + HeapSizeOf(instances, textureArrays);
+	}
 };
 
 class BSRangeNode : public NiCloneableStreamable<BSRangeNode, NiNode> {
@@ -260,6 +289,8 @@ struct UnkMaterialStruct {
 	std::string mat; // mat\0
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t HeapSize() const { return HeapSizeOf(mat); }
 };
 
 struct BSWaterReferenceStruct {
@@ -282,6 +313,8 @@ struct BSWeakReference {
 	std::vector<UnkMaterialStruct> unkMaterials;
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t HeapSize() const { return HeapSizeOf(transforms, unkMaterials); }
 };
 
 class BSWeakReferenceNode : public NiCloneableStreamable<BSWeakReferenceNode, NiNode> {
@@ -297,6 +330,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiNode::GetHeapUsage() + HeapSizeOf(weakRefs, waterRefs); }
 };
 
 class BSFaceGenNiNode : public NiCloneableStreamable<BSFaceGenNiNode, NiNode> {
@@ -358,6 +393,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiLODData::GetHeapUsage() + HeapSizeOf(lodLevels); }
 };
 
 class NiScreenLODData : public NiCloneableStreamable<NiScreenLODData, NiLODData> {
@@ -372,6 +409,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiLODData::GetHeapUsage() + HeapSizeOf(proportionLevels); }
 };
 
 class NiLODNode : public NiCloneableStreamable<NiLODNode, NiSwitchNode> {
@@ -6,10 +6,12 @@ See the included GPLv3 LICENSE file
 
 #pragma once
 
+#include <cfloat>
 #include <cstdint>
 #include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <type_traits>
 #include <vector>
 
 namespace nifly {
@@ -25,6 +27,47 @@ inline bool FloatsAreNearlyEqual(float a, float b) {
 
 float CalcMedianOfFloats(const std::vector<float>& data);
 
+// Non-owning view of contiguous elements (pointer and count), like std::span in C++20.
+// The view is invalidated by anything that reallocates the underlying storage.
+template<typename T>
+class Span {
+private:
+	T* ptr = nullptr;
+	size_t count = 0;
+
+public:
+	constexpr Span() = default;
+	constexpr Span(T* data, size_t size)
+		: ptr(data)
+		, count(size) {}
+
+	template<typename U, typename = std::enable_if_t<std::is_convertible_v<U (*)[], T (*)[]>>>
+	constexpr Span(const Span<U>& other)
+		: ptr(other.data())
+		, count(other.size()) {}
+
+	template<typename U, typename A, typename = std::enable_if_t<std::is_convertible_v<U (*)[], T (*)[]>>>
+	Span(std::vector<U, A>& vec)
+		: ptr(vec.data())
+		, count(vec.size()) {}
+
+	template<typename U, typename A, typename = std::enable_if_t<std::is_convertible_v<const U (*)[], T (*)[]>>>
+	Span(const std::vector<U, A>& vec)
+		: ptr(vec.data())
+		, count(vec.size()) {}
+
+	constexpr T* data() const { return ptr; }
+	constexpr size_t size() const { return count; }
+	constexpr bool empty() const { return count == 0; }
+
+	constexpr T* begin() const { return ptr; }
+	constexpr T* end() const { return ptr + count; }
+
+	constexpr T& operator[](size_t i) const { return ptr[i]; }
+
+	constexpr Span subspan(size_t offset, size_t size) const { return Span(ptr + offset, size); }
+};
+
 // Vector with 2 float components (uv)
 struct Vector2 {
 	float u = 0.0f;
@@ -956,6 +999,12 @@ public:
 };
 
 
+// Algorithm used to calculate bounding spheres
+enum class BoundsMethod {
+	Exact, // Smallest enclosing sphere (Miniball algorithm)
+	Fast   // Extremal points along the axes, grown by Ritter's algorithm. Up to ~10-20% larger.
+};
+
 struct BoundingSphere {
 	Vector3 center;
 	float radius = 0.0f;
@@ -967,7 +1016,48 @@ struct BoundingSphere {
 		, radius(radius_) {}
 
 	// Miniball algorithm
-	BoundingSphere(const std::vector<Vector3>& vertices);
+	BoundingSphere(const std::vector<Vector3>& vertices)
+		: BoundingSphere(Span<const Vector3>(vertices)) {}
+
+	// Reads the points in place, without copying them
+	BoundingSphere(Span<const Vector3> points, const BoundsMethod method = BoundsMethod::Exact);
+};
+
+// Axis-aligned bounding box
+struct BoundingBox {
+	Vector3 min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vector3 max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	constexpr BoundingBox() {}
+	BoundingBox(Span<const Vector3> points);
+
+	// False if no points were added
+	constexpr bool IsValid() const { return min.x <= max.x; }
+
+	constexpr void Add(const Vector3& p) {
+		min.x = p.x < min.x ? p.x : min.x;
+		min.y = p.y < min.y ? p.y : min.y;
+		min.z = p.z < min.z ? p.z : min.z;
+		max.x = p.x > max.x ? p.x : max.x;
+		max.y = p.y > max.y ? p.y : max.y;
+		max.z = p.z > max.z ? p.z : max.z;
+	}
+
+	constexpr Vector3 Center() const { return (min + max) * 0.5f; }
+	constexpr Vector3 HalfExtent() const { return (max - min) * 0.5f; }
+};
+
+// Bounding box with the box axes in the columns of "rotation", so that a point in the box is
+// center + rotation * (x, y, z) with each coordinate within +- halfExtent.
+struct OrientedBoundingBox {
+	Vector3 center;
+	Vector3 halfExtent;
+	Matrix3 rotation;
+
+	constexpr OrientedBoundingBox() {}
+
+	// Fits the box to the principal axes of the points. Uses the axis-aligned box if that is smaller.
+	OrientedBoundingBox(Span<const Vector3> points);
 };
 
 
@@ -1135,6 +1225,14 @@ struct MatTransform {
 MatTransform CalcAverageMatTransform(const std::vector<MatTransform>& ts);
 MatTransform CalcMedianMatTransform(const std::vector<MatTransform>& ts);
 
+// Transforms the points in place. With weights (one per point, missing ones count as 1),
+// each point only moves that fraction of the way from its original (0) to its transformed (1) position.
+void TransformPoints(Span<Vector3> points, const Matrix4& transform, Span<const float> weights = {});
+
+// Transforms the directions (normals, tangents) in place by "transform" and normalizes them.
+// Weights blend between the original and transformed direction like for TransformPoints.
+void TransformDirections(Span<Vector3> dirs, const Matrix3& transform, Span<const float> weights = {});
+
 
 // Edge with uint16_t point indices
 struct Edge {
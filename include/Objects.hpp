@@ -26,6 +26,9 @@ public:
 	NiBlockRefArray<NiExtraData> extraDataRefs;
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiObject::GetHeapUsage() + HeapSizeOf(name, extraDataRefs);
+	}
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -54,6 +57,7 @@ public:
 	NiBlockRef<NiCollisionObject> collisionRef;
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiObjectNET::GetHeapUsage() + HeapSizeOf(propertyRefs); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 
@@ -72,6 +76,8 @@ public:
 	}
 
 	void GetPtrs(std::set<NiPtr*>& ptrs) { ptrs.insert(&objectRef); }
+
+	size_t HeapSize() const { return HeapSizeOf(name); }
 };
 
 class NiAVObjectPalette : public NiCloneable<NiAVObjectPalette, NiObject> {};
@@ -85,6 +91,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiAVObjectPalette::GetHeapUsage() + HeapSizeOf(objects); }
 	void GetPtrs(std::set<NiPtr*>& ptrs) override;
 };
 
@@ -131,6 +138,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(palette); }
 };
 
 enum PixelFormat : uint32_t {
@@ -215,6 +224,7 @@ public:
 	uint32_t bytesPerPixel = 0;
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(mipmaps); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -235,6 +245,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return TextureRenderData::GetHeapUsage() + HeapSizeOf(pixelData); }
 };
 
 class NiPixelData : public NiCloneableStreamable<NiPixelData, TextureRenderData> {
@@ -248,6 +260,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return TextureRenderData::GetHeapUsage() + HeapSizeOf(pixelData); }
 };
 
 enum PixelLayout : uint32_t {
@@ -297,6 +311,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiTexture::GetHeapUsage() + HeapSizeOf(fileName); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -343,6 +358,9 @@ public:
 	NiVector<uint32_t> affectedNodePointers;
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiAVObject::GetHeapUsage() + HeapSizeOf(affectedNodes, affectedNodePointers);
+	}
 	void GetPtrs(std::set<NiPtr*>& ptrs) override;
 };
 
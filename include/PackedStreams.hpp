@@ -0,0 +1,39 @@
+/*
+nifly
+C++ NIF library for the Gamebryo/NetImmerse File Format
+See the included GPLv3 LICENSE file
+*/
+
+#pragma once
+
+#include "Object3d.hpp"
+
+namespace nifly {
+// Bulk conversions between the packed vertex streams of external mesh data (Starfield) and floats.
+// They work on whole arrays and give the same bits as converting each value through NiStreamReversible.
+// Output spans must be at least as large as the input requires.
+
+// Signed 16-bit positions, three per vertex. Negative values are normalized by 32768, others by 32767,
+// then multiplied by "scale" and "posScale".
+void UnpackPositions(Span<const int16_t> packed,
+					 const float scale,
+					 const float posScale,
+					 Span<Vector3> outVerts);
+void PackPositions(Span<const Vector3> verts,
+				   const float scale,
+				   const float posScale,
+				   Span<int16_t> outPacked);
+
+// Unsigned 10:10:10:2 normals and tangents in the -1 to 1 range, with the 2-bit W in the top bits.
+// Without W values to pack, W is written as 1.
+void UnpackUDEC3(Span<const uint32_t> packed, Span<Vector3> outVecs, Span<uint8_t> outW = {});
+void PackUDEC3(Span<const Vector3> vecs, Span<const uint8_t> w, Span<uint32_t> outPacked);
+
+// Half precision floats (IEEE 754 binary16), rounded to nearest even when packing
+void UnpackHalfs(Span<const uint16_t> packed, Span<float> outValues);
+void PackHalfs(Span<const float> values, Span<uint16_t> outPacked);
+
+// Half precision UVs, two per vertex
+void UnpackHalfUVs(Span<const uint16_t> packed, Span<Vector2> outUVs);
+void PackHalfUVs(Span<const Vector2> uvs, Span<uint16_t> outPacked);
+} // namespace nifly
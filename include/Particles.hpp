@@ -75,6 +75,11 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return NiGeometryData::GetHeapUsage() + HeapSizeOf(radii, sizes, rotations, rotationAngles)
+			   + HeapSizeOf(rotationAxes, subtexOffsets);
+	}
 };
 
 class NiAutoNormalParticlesData : public NiCloneable<NiAutoNormalParticlesData, NiParticlesData> {
@@ -93,6 +98,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiParticlesData::GetHeapUsage() + HeapSizeOf(rotations2); }
 };
 
 class NiParticleMeshesData : public NiCloneableStreamable<NiParticleMeshesData, NiRotatingParticlesData> {
@@ -227,6 +234,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiParticleModifier::GetHeapUsage() + HeapSizeOf(particleMeshRefs);
+	}
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -321,6 +331,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiTimeController::GetHeapUsage() + HeapSizeOf(particles); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 	void GetPtrs(std::set<NiPtr*>& ptrs) override;
@@ -351,6 +362,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return NiRotatingParticlesData::GetHeapUsage() + HeapSizeOf(particleInfo, rotationSpeeds);
+	}
 };
 
 class NiMeshPSysData : public NiCloneableStreamable<NiMeshPSysData, NiPSysData> {
@@ -365,6 +380,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiPSysData::GetHeapUsage() + HeapSizeOf(generationPoolSize);
+	}
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -391,6 +409,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return NiObject::GetHeapUsage() + HeapSizeOf(floatKeys, visibilityKeys);
+	}
 };
 
 class NiPSysEmitterCtlr : public NiCloneableStreamable<NiPSysEmitterCtlr, NiPSysModifierCtlr> {
@@ -431,6 +453,7 @@ public:
 	bool isActive = false;
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(name); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetPtrs(std::set<NiPtr*>& ptrs) override;
 };
@@ -533,6 +556,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiPSysModifier::GetHeapUsage() + HeapSizeOf(floats); }
 };
 
 enum ForceType : uint32_t { FORCE_PLANAR, FORCE_SPHERICAL, FORCE_UNKNOWN };
@@ -641,6 +666,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 class NiPSysColorModifier : public NiCloneableStreamable<NiPSysColorModifier, NiPSysModifier> {
@@ -677,6 +704,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiPSysModifier::GetHeapUsage() + HeapSizeOf(meshRefs); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -797,6 +825,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiPSysModifier::GetHeapUsage() + HeapSizeOf(nodeRefs); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -820,6 +849,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiNode::GetHeapUsage() + HeapSizeOf(particleSysRefs); }
 
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -868,6 +898,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return NiAVObject::GetHeapUsage() + HeapSizeOf(shaderName, materialNames, materialExtraData)
+			   + HeapSizeOf(modifierRefs);
+	}
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -1023,6 +1057,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiPSysEmitter::GetHeapUsage() + HeapSizeOf(meshRefs); }
 	void GetPtrs(std::set<NiPtr*>& ptrs) override;
 };
 } // namespace nifly
@@ -404,6 +404,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiProperty::GetHeapUsage() + HeapSizeOf(shaderTex); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -485,6 +486,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(textures); }
 };
 
 class NiShader : public NiCloneable<NiShader, NiProperty> {
@@ -566,6 +569,7 @@ public:
 	Vector2 uvScale = Vector2(1.0f, 1.0f);
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiShadeProperty::GetHeapUsage() + HeapSizeOf(SF1, SF2); }
 
 	uint32_t GetShaderType() const override;
 	void SetShaderType(const uint32_t type) override;
@@ -626,6 +630,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return BSShaderProperty::GetHeapUsage() + HeapSizeOf(fileName); }
 };
 
 class VolumetricFogShaderProperty : public NiCloneable<VolumetricFogShaderProperty, BSShaderProperty> {
@@ -712,6 +718,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return BSShaderProperty::GetHeapUsage() + HeapSizeOf(rootMaterialName, textureArrays);
+	}
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
@@ -786,6 +795,11 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return BSShaderProperty::GetHeapUsage() + HeapSizeOf(sourceTexture, greyscaleTexture, envMapTexture)
+			   + HeapSizeOf(normalTexture, envMaskTexture, reflectanceTexture, lightingTexture)
+			   + HeapSizeOf(emitGradientTexture);
+	}
 
 	float GetEnvironmentMapScale() const override;
 	Color4 GetEmissiveColor() const override;
@@ -813,6 +827,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return BSShaderProperty::GetHeapUsage() + HeapSizeOf(baseTexture);
+	}
 };
 
 class BSShaderLightingProperty : public NiCloneableStreamable<BSShaderLightingProperty, BSShaderProperty> {
@@ -840,6 +858,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return BSShaderLightingProperty::GetHeapUsage() + HeapSizeOf(fileName);
+	}
 };
 
 class TileShaderProperty : public NiCloneableStreamable<TileShaderProperty, BSShaderLightingProperty> {
@@ -850,6 +872,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return BSShaderLightingProperty::GetHeapUsage() + HeapSizeOf(fileName);
+	}
 };
 
 class BSShaderNoLightingProperty
@@ -865,6 +891,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return BSShaderLightingProperty::GetHeapUsage() + HeapSizeOf(baseTexture);
+	}
 
 	bool IsSkinned() const override;
 	void SetSkinned(const bool enable) override;
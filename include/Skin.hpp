@@ -46,6 +46,8 @@ public:
 		BoundingSphere bounds;
 		uint16_t numVertices = 0;
 		std::vector<SkinWeight> vertexWeights;
+
+		size_t HeapSize() const { return HeapSizeOf(vertexWeights); }
 	};
 
 	// skinTransform transforms from the global CS to the skin CS.
@@ -63,9 +65,11 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(bones); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
 };
 
 class NiSkinPartition : public NiCloneableStreamable<NiSkinPartition, NiObject> {
@@ -96,9 +100,15 @@ public:
 		std::vector<Triangle> trueTriangles; // User Version >= 12, User Version 2 == 100
 
 		bool ConvertStripsToTriangles();
+		bool ConvertTrianglesToStrips(const bool joinStrips = true);
 		void GenerateTrueTrianglesFromMappedTriangles();
 		void GenerateMappedTrianglesFromTrueTrianglesAndVertexMap();
 		void GenerateVertexMapFromTrueTriangles();
+
+		size_t HeapSize() const {
+			return HeapSizeOf(bones, vertexMap, vertexWeights, stripLengths, strips, triangles, boneIndices)
+				   + HeapSizeOf(trueTriangles);
+		}
 	};
 
 	uint32_t numPartitions = 0;
@@ -106,9 +116,10 @@ public:
 	uint32_t vertexSize = 0; // User Version >= 12, User Version 2 == 100
 	VertexDesc vertexDesc;	 // User Version >= 12, User Version 2 == 100
 
-	uint32_t numVertices = 0;			// Not in file
-	std::vector<BSVertexData> vertData; // User Version >= 12, User Version 2 == 100
-	std::vector<PartitionBlock> partitions;
+	// Copies of the block share the vertex data and partitions until they are changed (see SharedVector)
+	uint32_t numVertices = 0;			 // Not in file
+	SharedVector<BSVertexData> vertData; // User Version >= 12, User Version 2 == 100
+	SharedVector<PartitionBlock> partitions;
 
 	// bMappedIndices is not in the file; it is calculated from
 	// the file version.  If true, the vertex indices in triangles
@@ -137,7 +148,11 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
-	void notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) override;
+	size_t GetHeapUsage() const override {
+		return NiObject::GetHeapUsage() + HeapSizeOf(vertData, partitions, triParts);
+	}
+	void notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) override;
+	void notifyVerticesReorder(const std::vector<int>& vertMap) override;
 	// DeletePartitions: partInds must be in sorted ascending order
 	void DeletePartitions(const std::vector<uint32_t>& partInds);
 	uint32_t RemoveEmptyPartitions(std::vector<uint32_t>& outDeletedIndices);
@@ -145,6 +160,11 @@ public:
 	// actually performed.  After calling this function, all of the
 	// strips will be empty.
 	bool ConvertStripsToTriangles();
+	// ConvertTrianglesToStrips generates strips from the triangles of
+	// the partitions that don't have strips yet (see
+	// GenerateStripsFromTriangles).  Returns true if any partition was
+	// converted.  The triangle lists are kept.
+	bool ConvertTrianglesToStrips(const bool joinStrips = true);
 	// PrepareTrueTriangles: ensures each partition's trueTriangles has
 	// valid data, if necessary by generating it from "triangles" or "strips".
 	void PrepareTrueTriangles();
@@ -174,6 +194,8 @@ class NiNode;
 class NiBoneContainer : public NiCloneable<NiBoneContainer, NiObject> {
 public:
 	NiBlockPtrArray<NiNode> boneRefs;
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(boneRefs); }
 };
 
 class NiSkinInstance : public NiCloneableStreamable<NiSkinInstance, NiBoneContainer> {
@@ -207,6 +229,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiSkinInstance::GetHeapUsage() + HeapSizeOf(partitions); }
 
 	// DeletePartitions: partInds must be in sorted ascending order.
 	void DeletePartitions(const std::vector<uint32_t>& partInds);
@@ -233,6 +256,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(boneXforms); }
 };
 
 class NiAVObject;
@@ -247,6 +272,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiBoneContainer::GetHeapUsage() + HeapSizeOf(scales); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 	void GetPtrs(std::set<NiRef*>& ptrs) override;
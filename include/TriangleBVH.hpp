@@ -0,0 +1,108 @@
+/*
+nifly
+C++ NIF library for the Gamebryo/NetImmerse File Format
+See the included GPLv3 LICENSE file
+*/
+
+#pragma once
+
+#include "Object3d.hpp"
+
+#include <cfloat>
+#include <vector>
+
+namespace nifly {
+// Result of a closest point or ray query
+struct BVHHit {
+	static constexpr uint32_t npos = static_cast<uint32_t>(-1);
+
+	uint32_t triangle = npos; // Index of the triangle in the list the tree was built from
+	float distance = FLT_MAX; // Distance to the point or along the ray
+	Vector3 point;			  // Point on the triangle
+	float u = 0.0f;			  // Barycentric weight of p2 (p1 has 1 - u - v)
+	float v = 0.0f;			  // Barycentric weight of p3
+
+	bool IsValid() const { return triangle != npos; }
+};
+
+// Bounding volume hierarchy over a list of triangles, split by the surface area heuristic.
+// The tree keeps its own copy of the (transformed) vertices, so it stays valid if the shape changes.
+// Queries don't allocate (except for the overlap results) and can be run from multiple threads.
+class TriangleBVH {
+public:
+	TriangleBVH() = default;
+	// Builds the tree for the triangles, with the vertices transformed by "transform" first
+	TriangleBVH(const std::vector<Vector3>& verts,
+				const std::vector<Triangle>& tris,
+				const MatTransform& transform = MatTransform());
+
+	// Number of triangles in the list the tree was built from (including skipped invalid ones)
+	size_t GetNumTriangles() const { return numTriangles; }
+	size_t GetNumVertices() const { return verts.size(); }
+	size_t GetNumNodes() const { return nodes.size(); }
+	const MatTransform& GetTransform() const { return transform; }
+
+	// Finds the closest point on any triangle within maxDistance of "point".
+	// Returns false if there is none.
+	bool ClosestPoint(const Vector3& point, BVHHit& hit, const float maxDistance = FLT_MAX) const;
+
+	// Finds the closest intersection of the ray with any triangle (both sides) within maxDistance.
+	// The direction doesn't need to be normalized, distances are in units of its length.
+	bool Raycast(const Vector3& origin,
+				 const Vector3& direction,
+				 BVHHit& hit,
+				 const float maxDistance = FLT_MAX) const;
+
+	// Checks if the segment from "start" to "end" intersects any triangle
+	bool IntersectsSegment(const Vector3& start, const Vector3& end) const;
+
+	// Gets the indices of all triangles within "radius" of "center", in ascending order
+	void OverlapSphere(const Vector3& center, const float radius, std::vector<uint32_t>& outTris) const;
+
+	// Batched versions of the queries above, optionally spread across threads
+	void ClosestPoints(const std::vector<Vector3>& points,
+					   std::vector<BVHHit>& hits,
+					   const float maxDistance = FLT_MAX,
+					   const bool parallel = true) const;
+	void Raycasts(const std::vector<Vector3>& origins,
+				  const std::vector<Vector3>& directions,
+				  std::vector<BVHHit>& hits,
+				  const float maxDistance = FLT_MAX,
+				  const bool parallel = true) const;
+	void OverlapSpheres(const std::vector<Vector3>& centers,
+						const float radius,
+						std::vector<std::vector<uint32_t>>& outTris,
+						const bool parallel = true) const;
+
+private:
+	// Inner nodes have their first child directly after them and the second child at "index".
+	// Leaves have "count" triangles starting at "index" in "tris".
+	struct Node {
+		Vector3 min;
+		Vector3 max;
+		uint32_t index = 0;
+		uint32_t count = 0;
+	};
+
+	// Nodes are split by SAH up to depth 48 and in halves below that (at most 32 more levels)
+	static constexpr size_t maxStackSize = 96;
+
+	std::vector<Vector3> verts;
+	std::vector<Triangle> tris;
+	std::vector<uint32_t> triIndices; // Original index of each triangle in "tris"
+	std::vector<Node> nodes;
+	MatTransform transform;
+	size_t numTriangles = 0;
+
+	// Bounds and centroids of the source triangles
+	struct BuildInput;
+
+	uint32_t Build(const BuildInput& input, const uint32_t begin, const uint32_t end, uint32_t depth);
+	void ClosestPointOnTriangle(const Vector3& point, const uint32_t tri, BVHHit& hit) const;
+	bool IntersectTriangle(const Vector3& origin,
+						   const Vector3& direction,
+						   const uint32_t tri,
+						   const float maxDistance,
+						   BVHHit& hit) const;
+};
+} // namespace nifly
@@ -58,7 +58,7 @@ public:
 	bool HasFlag(VertexFlags flag) const { return ((desc >> 44) & flag) != 0; }
 
 	// Gets the size of just the main vertex data (position, extra data, bitangentX)
-	uint32_t GetVertexMainSize() {
+	uint32_t GetVertexMainSize() const {
 		return ((desc & 0xFF00) >> 8) * 4;
 	}
 
@@ -96,6 +96,9 @@ public:
 
 	void Sync(NiStreamReversible& stream) { stream.Sync(desc); }
 
+	bool operator==(const VertexDesc& other) const { return desc == other.desc; }
+	bool operator!=(const VertexDesc& other) const { return desc != other.desc; }
+
 private:
 	uint64_t Convert(VertexFlags flag) { return static_cast<uint64_t>(flag) << 44; }
 };
@@ -118,5 +121,7 @@ struct BSVertexData {
 
 	float eyeData = 0.0f;
 	std::vector<float> extra; // Variable length extra float data for vertex. Aligned before bitangentX in file.
+
+	size_t HeapSize() const { return HeapSizeOf(extra); }
 };
 } // namespace nifly
@@ -335,6 +335,8 @@ public:
 		strips.Sync(stream);
 		weldingInfo.Sync(stream);
 	}
+
+	size_t HeapSize() const { return HeapSizeOf(verts, indices, strips, weldingInfo); }
 };
 
 class NiAVObject;
@@ -436,6 +438,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return BSExtraData::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 class bhkRagdollSystem : public NiCloneableStreamable<bhkRagdollSystem, BSExtraData> {
@@ -448,6 +452,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return BSExtraData::GetHeapUsage() + HeapSizeOf(data); }
 };
 
 class bhkBlendController : public NiCloneableStreamable<bhkBlendController, NiTimeController> {
@@ -522,6 +528,8 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override { return bhkSphereRepShape::GetHeapUsage() + HeapSizeOf(spheres); }
 };
 
 class bhkConvexListShape : public NiCloneableStreamable<bhkConvexListShape, bhkShape> {
@@ -539,6 +547,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return bhkShape::GetHeapUsage() + HeapSizeOf(shapeRefs); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -555,6 +564,10 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return bhkConvexShape::GetHeapUsage() + HeapSizeOf(verts, normals);
+	}
 };
 
 class bhkBoxShape : public NiCloneableStreamable<bhkBoxShape, bhkConvexShape> {
@@ -650,6 +663,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return bhkBvTreeShape::GetHeapUsage() + HeapSizeOf(data); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -677,6 +691,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return bhkShape::GetHeapUsage() + HeapSizeOf(partRefs, filters); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 
@@ -700,6 +715,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return bhkShapeCollection::GetHeapUsage() + HeapSizeOf(subShapeRefs, filters);
+	}
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 
@@ -740,6 +758,11 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return bhkShapeCollection::GetHeapUsage() + HeapSizeOf(triData, triNormData, compressedVertData)
+			   + HeapSizeOf(subPartData);
+	}
 };
 
 class bhkPackedNiTriStripsShape
@@ -762,6 +785,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return bhkShapeCollection::GetHeapUsage() + HeapSizeOf(subPartData);
+	}
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -900,6 +926,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return bhkEntity::GetHeapUsage() + HeapSizeOf(constraintRefs); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -916,6 +943,7 @@ public:
 	uint32_t priority = 0;
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return bhkSerializable::GetHeapUsage() + HeapSizeOf(entityRefs); }
 	void GetPtrs(std::set<NiPtr*>& ptrs) override;
 };
 
@@ -957,6 +985,7 @@ public:
 	float strength = 0.0f;
 
 	void Sync(NiStreamReversible& stream);
+	size_t HeapSize() const { return HeapSizeOf(entityRefs); }
 	void GetPtrs(std::set<NiPtr*>& ptrs);
 };
 
@@ -1043,6 +1072,9 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override {
+		return bhkSerializable::GetHeapUsage() + HeapSizeOf(pivots, chainedEntityRefs);
+	}
 	void GetPtrs(std::set<NiPtr*>& ptrs) override;
 };
 
@@ -1078,6 +1110,11 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+
+	size_t GetHeapUsage() const override {
+		return bhkRefObject::GetHeapUsage() + HeapSizeOf(mat32, mat16, mat8, materials, transforms, bigVerts)
+			   + HeapSizeOf(bigTris, chunks);
+	}
 };
 
 class bhkCompressedMeshShape : public NiCloneableStreamable<bhkCompressedMeshShape, bhkShape> {
@@ -1111,6 +1148,8 @@ public:
 	NiVector<BoneMatrix> matrices;
 
 	void Sync(NiStreamReversible& stream) { matrices.Sync(stream); }
+
+	size_t HeapSize() const { return HeapSizeOf(matrices); }
 };
 
 class bhkPoseArray : public NiCloneableStreamable<bhkPoseArray, NiObject> {
@@ -1122,6 +1161,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(bones, poses); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 };
 
@@ -1133,6 +1173,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiExtraData::GetHeapUsage() + HeapSizeOf(boneRefs); }
 	void GetChildRefs(std::set<NiRef*>& refs) override;
 	void GetChildIndices(std::vector<uint32_t>& indices) override;
 };
@@ -1151,6 +1192,7 @@ public:
 	const char* GetBlockName() override { return BlockName; }
 
 	void Sync(NiStreamReversible& stream);
+	size_t GetHeapUsage() const override { return NiObject::GetHeapUsage() + HeapSizeOf(name, constraints); }
 	void GetStringRefs(std::vector<NiStringRef*>& refs) override;
 };
 } // namespace nifly
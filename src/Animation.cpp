@@ -5,6 +5,7 @@ See the included GPLv3 LICENSE file
 */
 
 #include "Animation.hpp"
+#include "NifUtil.hpp"
 
 using namespace nifly;
 
@@ -281,6 +282,11 @@ void NiMorphData::GetStringRefs(std::vector<NiStringRef*>& refs) {
 		m.GetStringRefs(refs);
 }
 
+void NiMorphData::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	for (auto& m : morphs)
+		ApplyIndexMapToVector(m.vectors, vertMap);
+}
+
 std::vector<Morph> NiMorphData::GetMorphs() const {
 	return morphs;
 }
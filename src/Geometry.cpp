@@ -10,10 +10,13 @@ See the included GPLv3 LICENSE file
 
 #include "KDMatcher.hpp"
 #include "NifUtil.hpp"
+#include "PackedStreams.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cfloat>
 #include <cmath>
+#include <cstring>
 
 using namespace nifly;
 
@@ -46,11 +49,8 @@ void NiGeometryData::Sync(NiStreamReversible& stream) {
 
 	hasVertices.Sync(stream);
 
-	if (hasVertices && (!isPSys || stream.GetVersion().File() < V20_2_0_7)) {
-		vertices.resize(numVertices);
-		for (uint16_t i = 0; i < numVertices; i++)
-			stream.Sync(vertices[i]);
-	}
+	if (hasVertices && (!isPSys || stream.GetVersion().File() < V20_2_0_7))
+		vertices.SyncData(stream, numVertices);
 
 	// Disable tangent flag for OB
 	if (stream.GetVersion().IsOB())
@@ -66,31 +66,19 @@ void NiGeometryData::Sync(NiStreamReversible& stream) {
 
 	hasNormals.Sync(stream);
 	if (hasNormals && (!isPSys || stream.GetVersion().File() < V20_2_0_7)) {
-		normals.resize(numVertices);
-
-		for (uint16_t i = 0; i < numVertices; i++)
-			stream.Sync(normals[i]);
+		normals.SyncData(stream, numVertices);
 
 		if (nbtMethod && stream.GetVersion().File() >= NiFileVersion::V10_1_0_0) {
-			tangents.resize(numVertices);
-			bitangents.resize(numVertices);
-
-			for (uint16_t i = 0; i < numVertices; i++)
-				stream.Sync(tangents[i]);
-
-			for (uint16_t i = 0; i < numVertices; i++)
-				stream.Sync(bitangents[i]);
+			tangents.SyncData(stream, numVertices);
+			bitangents.SyncData(stream, numVertices);
 		}
 	}
 
 	stream.Sync(bounds);
 
 	hasVertexColors.Sync(stream);
-	if (hasVertexColors && (!isPSys || stream.GetVersion().File() < V20_2_0_7)) {
-		vertexColors.resize(numVertices);
-		for (uint16_t i = 0; i < numVertices; i++)
-			stream.Sync(vertexColors[i]);
-	}
+	if (hasVertexColors && (!isPSys || stream.GetVersion().File() < V20_2_0_7))
+		vertexColors.SyncData(stream, numVertices);
 
 	// Old file versions store the data flags behind the vertex colors
 	if (stream.GetVersion().File() <= NiFileVersion::V4_2_2_0)
@@ -106,9 +94,15 @@ void NiGeometryData::Sync(NiStreamReversible& stream) {
 	if (numTextureSets > 0 && (!isPSys || stream.GetVersion().File() < V20_2_0_7)) {
 		uvSets.resize(numTextureSets);
 		for (uint32_t i = 0; i < numTextureSets; i++) {
-			uvSets[i].resize(numVertices);
+			if (uvSets.Get()[i].size() != numVertices)
+				uvSets[i].resize(numVertices);
+
+			// Writing only reads the coordinates, so it doesn't detach shared ones
+			auto& uvs = stream.GetMode() == NiStreamReversible::Mode::Writing
+							? const_cast<std::vector<Vector2>&>(uvSets.Get()[i])
+							: uvSets[i];
 			for (uint16_t j = 0; j < numVertices; j++)
-				stream.Sync(uvSets[i][j]);
+				stream.Sync(uvs[j]);
 		}
 	}
 
@@ -202,15 +196,16 @@ bool NiGeometryData::GetTriangles(std::vector<Triangle>&) const {
 }
 void NiGeometryData::SetTriangles(const std::vector<Triangle>&) {};
 
-void NiGeometryData::UpdateBounds() {
-	bounds = BoundingSphere(vertices);
+void NiGeometryData::UpdateBounds(const BoundsMethod method) {
+	bounds = BoundingSphere(vertices, method);
 }
 
 void NiGeometryData::Create(NiVersion&,
 							const std::vector<Vector3>* verts,
 							const std::vector<Triangle>*,
 							const std::vector<Vector2>* uvs,
-							const std::vector<Vector3>* norms) {
+							const std::vector<Vector3>* norms,
+							const bool parallelTangents) {
 	size_t vertCount = verts->size();
 	constexpr uint16_t maxIndex = std::numeric_limits<uint16_t>::max();
 
@@ -223,7 +218,7 @@ void NiGeometryData::Create(NiVersion&,
 	for (uint16_t v = 0; v < numVertices; v++)
 		vertices[v] = (*verts)[v];
 
-	bounds = BoundingSphere(vertices);
+	bounds = BoundingSphere(vertices.Get());
 
 	if (uvs) {
 		size_t uvCount = uvs->size();
@@ -244,7 +239,7 @@ void NiGeometryData::Create(NiVersion&,
 	if (norms && norms->size() == numVertices) {
 		SetNormals(true);
 		normals = (*norms);
-		CalcTangentSpace();
+		CalcTangentSpace(parallelTangents);
 	}
 	else {
 		SetNormals(false);
@@ -252,7 +247,7 @@ void NiGeometryData::Create(NiVersion&,
 	}
 }
 
-void NiGeometryData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void NiGeometryData::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	EraseVectorIndices(vertices, vertIndices);
 	numVertices = static_cast<uint16_t>(vertices.size());
 	if (!normals.empty())
@@ -267,17 +262,27 @@ void NiGeometryData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndic
 		EraseVectorIndices(uvSet, vertIndices);
 }
 
+void NiGeometryData::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	ApplyIndexMapToVector(vertices, vertMap);
+	ApplyIndexMapToVector(normals, vertMap);
+	ApplyIndexMapToVector(tangents, vertMap);
+	ApplyIndexMapToVector(bitangents, vertMap);
+	ApplyIndexMapToVector(vertexColors, vertMap);
+	for (auto& uvSet : uvSets)
+		ApplyIndexMapToVector(uvSet, vertMap);
+}
+
 void NiGeometryData::RecalcNormals(const bool, const float, std::unordered_set<uint32_t>*) {
 	SetNormals(true);
 }
 
-void NiGeometryData::CalcTangentSpace() {
+void NiGeometryData::CalcTangentSpace(const bool) {
 	SetTangents(true);
 }
 
 
 uint16_t NiShape::GetNumVertices() const {
-	auto geomData = GetGeomData();
+	auto geomData = ReadGeomData();
 	if (geomData)
 		return geomData->GetNumVertices();
 
@@ -291,7 +296,7 @@ void NiShape::SetVertices(const bool enable) {
 };
 
 bool NiShape::HasVertices() const {
-	auto geomData = GetGeomData();
+	auto geomData = ReadGeomData();
 	if (geomData)
 		return geomData->HasVertices();
 
@@ -305,7 +310,7 @@ void NiShape::SetUVs(const bool enable) {
 };
 
 bool NiShape::HasUVs() const {
-	auto geomData = GetGeomData();
+	auto geomData = ReadGeomData();
 	if (geomData)
 		return geomData->HasUVs();
 
@@ -319,7 +324,7 @@ void NiShape::SetNormals(const bool enable) {
 };
 
 bool NiShape::HasNormals() const {
-	auto geomData = GetGeomData();
+	auto geomData = ReadGeomData();
 	if (geomData)
 		return geomData->HasNormals();
 
@@ -333,7 +338,7 @@ void NiShape::SetTangents(const bool enable) {
 };
 
 bool NiShape::HasTangents() const {
-	auto geomData = GetGeomData();
+	auto geomData = ReadGeomData();
 	if (geomData)
 		return geomData->HasTangents();
 
@@ -347,7 +352,7 @@ void NiShape::SetVertexColors(const bool enable) {
 };
 
 bool NiShape::HasVertexColors() const {
-	auto geomData = GetGeomData();
+	auto geomData = ReadGeomData();
 	if (geomData)
 		return geomData->HasVertexColors();
 
@@ -360,7 +365,7 @@ bool NiShape::IsSkinned() const {
 };
 
 uint32_t NiShape::GetNumTriangles() const {
-	auto geomData = GetGeomData();
+	auto geomData = ReadGeomData();
 	if (geomData)
 		return geomData->GetNumTriangles();
 
@@ -368,7 +373,7 @@ uint32_t NiShape::GetNumTriangles() const {
 }
 
 bool NiShape::GetTriangles(std::vector<Triangle>& tris) const {
-	auto geomData = GetGeomData();
+	auto geomData = ReadGeomData();
 	if (geomData)
 		return geomData->GetTriangles(tris);
 
@@ -376,6 +381,8 @@ bool NiShape::GetTriangles(std::vector<Triangle>& tris) const {
 };
 
 void NiShape::SetTriangles(const std::vector<Triangle>& tris) {
+	InvalidateGeometryCache();
+
 	auto geomData = GetGeomData();
 	if (geomData)
 		geomData->SetTriangles(tris);
@@ -388,17 +395,17 @@ void NiShape::SetBounds(const BoundingSphere& bounds) {
 }
 
 BoundingSphere NiShape::GetBounds() const {
-	auto geomData = GetGeomData();
+	auto geomData = ReadGeomData();
 	if (geomData)
 		return geomData->GetBounds();
 
 	return BoundingSphere();
 }
 
-void NiShape::UpdateBounds() {
+void NiShape::UpdateBounds(const BoundsMethod method) {
 	auto geomData = GetGeomData();
 	if (geomData)
-		geomData->UpdateBounds();
+		geomData->UpdateBounds(method);
 }
 
 int NiShape::GetBoneID(const NiHeader& hdr, const std::string& boneName) const {
@@ -446,6 +453,105 @@ BSTriShape::BSTriShape() {
 	vertexDesc.SetFlag(VF_SKINNED);
 }
 
+void BSTriShape::SyncVertex(NiStreamReversible& stream,
+							BSVertexData& vertex,
+							const VertexDesc& desc,
+							const bool fullPrecision) {
+	uint32_t vertexMainSize = desc.GetVertexMainSize();
+
+	if (desc.HasFlag(VF_VERTEX) && vertexMainSize <= 16) {
+		if (fullPrecision) {
+			// Full precision (vert + bitangentX = 16 bytes)
+			stream.Sync((char*) &vertex.vert, sizeof(vertex.vert) + sizeof(vertex.bitangentX));
+		}
+		else {
+			// Half precision (vert + bitangentX = 8 bytes)
+			stream.SyncHalf(vertex.vert.x);
+			stream.SyncHalf(vertex.vert.y);
+			stream.SyncHalf(vertex.vert.z);
+
+			stream.SyncHalf(vertex.bitangentX);
+		}
+	}
+	else if (vertexMainSize > 16) {
+		// Full precision (vert = 12 bytes)
+		stream.Sync((char*) &vertex.vert, sizeof(vertex.vert));
+
+		// Variable length extra float elements
+		uint32_t vertexExtraCount = (vertexMainSize - 16) / 4;
+		if (vertexExtraCount > 0) {
+			vertex.extra.resize(vertexExtraCount);
+			for (uint32_t e = 0; e < vertexExtraCount; e++)
+				stream.Sync(vertex.extra[e]);
+		}
+
+		// BitangentX after extra floats (bitangentX = 4 bytes)
+		stream.Sync(vertex.bitangentX);
+	}
+
+	if (desc.HasFlag(VF_UV)) {
+		stream.SyncHalf(vertex.uv.u);
+		stream.SyncHalf(vertex.uv.v);
+	}
+
+	if (desc.HasFlag(VF_NORMAL)) {
+		// 3 normals + bitangentY = 4 bytes
+		stream.Sync((char*) &vertex.normal, sizeof(vertex.normal) + sizeof(vertex.bitangentY));
+
+		if (desc.HasFlag(VF_TANGENT)) {
+			// 3 tangents + bitangentZ = 4 bytes
+			stream.Sync((char*) &vertex.tangent, sizeof(vertex.tangent) + sizeof(vertex.bitangentZ));
+		}
+	}
+
+	if (desc.HasFlag(VF_COLORS)) {
+		// 4 vertex colors = 4 bytes
+		stream.Sync((char*) &vertex.colorData, sizeof(vertex.colorData));
+	}
+
+	if (desc.HasFlag(VF_SKINNED)) {
+		// 4 weights = 8 bytes
+		for (float& weight : vertex.weights)
+			stream.SyncHalf(weight);
+
+		// 4 bones = 4 bytes
+		stream.Sync((char*) &vertex.weightBones, sizeof(vertex.weightBones));
+	}
+
+	if (desc.HasFlag(VF_EYEDATA))
+		stream.Sync(vertex.eyeData);
+}
+
+uint32_t BSTriShape::GetPackedVertexSize(const VertexDesc& desc, const bool fullPrecision) {
+	const uint32_t vertexMainSize = desc.GetVertexMainSize();
+
+	uint32_t size = 0;
+	if (desc.HasFlag(VF_VERTEX) && vertexMainSize <= 16)
+		size += fullPrecision ? 16 : 8;
+	else if (vertexMainSize > 16)
+		size += vertexMainSize;
+
+	if (desc.HasFlag(VF_UV))
+		size += 4;
+
+	if (desc.HasFlag(VF_NORMAL)) {
+		size += 4;
+		if (desc.HasFlag(VF_TANGENT))
+			size += 4;
+	}
+
+	if (desc.HasFlag(VF_COLORS))
+		size += 4;
+
+	if (desc.HasFlag(VF_SKINNED))
+		size += 12;
+
+	if (desc.HasFlag(VF_EYEDATA))
+		size += 4;
+
+	return size;
+}
+
 void BSTriShape::Sync(NiStreamReversible& stream) {
 	stream.Sync(flags);
 	stream.Sync(transform.translation);
@@ -506,83 +612,66 @@ void BSTriShape::Sync(NiStreamReversible& stream) {
 		stream.Sync(numVertices);
 		stream.Sync(dataSize);
 
-		vertData.resize(numVertices);
-
-		if (dataSize > 0) {
-			uint32_t vertexMainSize = vertexDesc.GetVertexMainSize();
-
-			for (uint16_t i = 0; i < numVertices; i++) {
-				auto& vertex = vertData[i];
-				if (HasVertices() && vertexMainSize <= 16) {
-					if (IsFullPrecision() || stream.GetVersion().Stream() == 100) {
-						// Full precision (vert + bitangentX = 16 bytes)
-						stream.Sync((char*) &vertex.vert, sizeof(vertex.vert) + sizeof(vertex.bitangentX));
-					}
-					else {
-						// Half precision (vert + bitangentX = 8 bytes)
-						stream.SyncHalf(vertex.vert.x);
-						stream.SyncHalf(vertex.vert.y);
-						stream.SyncHalf(vertex.vert.z);
-
-						stream.SyncHalf(vertex.bitangentX);
-					}
-				}
-				else if (vertexMainSize > 16) {
-					// Full precision (vert = 12 bytes)
-					stream.Sync((char*) &vertex.vert, sizeof(vertex.vert));
-
-					// Variable length extra float elements
-					uint32_t vertexExtraCount = (vertexMainSize - 16) / 4;
-					if (vertexExtraCount > 0) {
-						vertex.extra.resize(vertexExtraCount);
-						for (uint32_t e = 0; e < vertexExtraCount; e++)
-							stream.Sync(vertex.extra[e]);
-					}
-
-					// BitangentX after extra floats (bitangentX = 4 bytes)
-					stream.Sync(vertex.bitangentX);
-				}
-
-				if (HasUVs()) {
-					stream.SyncHalf(vertex.uv.u);
-					stream.SyncHalf(vertex.uv.v);
-				}
-
-				if (HasNormals()) {
-					// 3 normals + bitangentY = 4 bytes
-					stream.Sync((char*) &vertex.normal, sizeof(vertex.normal) + sizeof(vertex.bitangentY));
-
-					if (HasTangents()) {
-						// 3 tangents + bitangentZ = 4 bytes
-						stream.Sync((char*) &vertex.tangent,
-									sizeof(vertex.tangent) + sizeof(vertex.bitangentZ));
-					}
-				}
+		const bool writing = stream.GetMode() == NiStreamReversible::Mode::Writing;
+		const bool fullPrecision = IsFullPrecision() || stream.GetVersion().Stream() == 100;
+		if (!writing)
+			packedVertData.reset();
 
-				if (HasVertexColors()) {
-					// 4 vertex colors = 4 bytes
-					stream.Sync((char*) &vertex.colorData, sizeof(vertex.colorData));
-				}
+		if (dataSize == 0) {
+			vertData.resize(numVertices);
+			triangles.resize(numTriangles);
+		}
+		else if (stream.KeepPacked()) {
+			auto packed = std::make_shared<PackedVertexData>();
+			packed->vertexDesc = vertexDesc;
+			packed->fullPrecision = fullPrecision;
+			packed->numVertices = numVertices;
+			const uint32_t vertexBytes = GetPackedVertexSize(vertexDesc, fullPrecision);
+			packed->bytes.resize(static_cast<size_t>(numVertices) * vertexBytes);
+			stream.Sync(packed->bytes.data(), static_cast<std::streamsize>(packed->bytes.size()));
+
+			// The vertices are decoded from the packed bytes on first access
+			vertData.SetLoader([packed](std::vector<BSVertexData>& vertices) {
+				MemoryStreamBuf buf(packed->bytes.data(), packed->bytes.size());
+				std::istream packedStream(&buf);
+
+				NiIStream vertexStream(&packedStream, nullptr);
+				NiStreamReversible s(&vertexStream, nullptr, NiStreamReversible::Mode::Reading);
+
+				vertices.resize(packed->numVertices);
+				for (auto& vertex : vertices)
+					SyncVertex(s, vertex, packed->vertexDesc, packed->fullPrecision);
+			});
+			packedVertData = std::move(packed);
+
+			triangles.SyncData(stream, numTriangles);
+		}
+		else if (writing && IsPacked() && packedVertData->vertexDesc == vertexDesc
+				 && packedVertData->numVertices == numVertices
+				 && packedVertData->fullPrecision == fullPrecision) {
+			// Untouched vertex data is written back byte for byte
+			auto& bytes = packedVertData->bytes;
+			stream.Sync(const_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+
+			triangles.SyncData(stream, numTriangles);
+		}
+		else {
+			vertData.resize(numVertices);
 
-				if (IsSkinned()) {
-					// 4 weights = 8 bytes
-					for (float& weight : vertex.weights)
-						stream.SyncHalf(weight);
+			// Writing only reads the vertices, so shared ones are written from a copy instead of detaching
+			const bool writeCopies = writing && vertData.IsShared();
+			BSVertexData vertexCopy;
 
-					// 4 bones = 4 bytes
-					stream.Sync((char*) &vertex.weightBones, sizeof(vertex.weightBones));
+			for (uint16_t i = 0; i < numVertices; i++) {
+				if (writeCopies) {
+					vertexCopy = vertData.Get()[i];
+					SyncVertex(stream, vertexCopy, vertexDesc, fullPrecision);
 				}
-
-				if (HasEyeData())
-					stream.Sync(vertex.eyeData);
+				else
+					SyncVertex(stream, vertData[i], vertexDesc, fullPrecision);
 			}
-		}
 
-		triangles.resize(numTriangles);
-
-		if (dataSize > 0) {
-			for (uint32_t i = 0; i < numTriangles; i++)
-				stream.Sync(triangles[i]);
+			triangles.SyncData(stream, numTriangles);
 		}
 	}
 
@@ -612,7 +701,8 @@ void BSTriShape::Sync(NiStreamReversible& stream) {
 	}
 }
 
-void BSTriShape::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void BSTriShape::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
+	InvalidateGeometryCache();
 	deletedTris.clear();
 
 	std::vector<int> indexCollapse = GenerateIndexCollapseMap(vertIndices, vertData.size());
@@ -620,12 +710,18 @@ void BSTriShape::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices)
 	EraseVectorIndices(vertData, vertIndices);
 	numVertices = static_cast<uint16_t>(vertData.size());
 
-	ApplyMapToTriangles(triangles, indexCollapse, &deletedTris);
+	ApplyMapToTriangles(triangles.Detach(), indexCollapse, &deletedTris);
 	numTriangles = static_cast<uint32_t>(triangles.size());
 
 	std::sort(deletedTris.begin(), deletedTris.end(), std::greater<>());
 }
 
+void BSTriShape::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	InvalidateGeometryCache();
+	ApplyIndexMapToVector(vertData, vertMap);
+	ApplyMapToTriangles(triangles.Detach(), vertMap);
+}
+
 void BSTriShape::GetChildRefs(std::set<NiRef*>& refs) {
 	NiAVObject::GetChildRefs(refs);
 
@@ -644,9 +740,10 @@ void BSTriShape::GetChildIndices(std::vector<uint32_t>& indices) {
 
 std::vector<Vector3>& BSTriShape::UpdateRawVertices() {
 	rawVertices.resize(numVertices);
+	const auto& verts = vertData.Get();
 
 	for (uint16_t i = 0; i < numVertices; i++)
-		rawVertices[i] = vertData[i].vert;
+		rawVertices[i] = verts[i].vert;
 
 	return rawVertices;
 }
@@ -658,11 +755,12 @@ std::vector<Vector3>& BSTriShape::UpdateRawNormals() {
 	}
 
 	rawNormals.resize(numVertices);
+	const auto& verts = vertData.Get();
 
 	for (uint16_t i = 0; i < numVertices; i++) {
-		rawNormals[i].x = ((static_cast<float>(vertData[i].normal[0])) / 255.0f) * 2.0f - 1.0f;
-		rawNormals[i].y = ((static_cast<float>(vertData[i].normal[1])) / 255.0f) * 2.0f - 1.0f;
-		rawNormals[i].z = ((static_cast<float>(vertData[i].normal[2])) / 255.0f) * 2.0f - 1.0f;
+		rawNormals[i].x = ((static_cast<float>(verts[i].normal[0])) / 255.0f) * 2.0f - 1.0f;
+		rawNormals[i].y = ((static_cast<float>(verts[i].normal[1])) / 255.0f) * 2.0f - 1.0f;
+		rawNormals[i].z = ((static_cast<float>(verts[i].normal[2])) / 255.0f) * 2.0f - 1.0f;
 	}
 
 	return rawNormals;
@@ -675,10 +773,11 @@ std::vector<Vector3>& BSTriShape::UpdateRawTangents() {
 	}
 
 	rawTangents.resize(numVertices);
+	const auto& verts = vertData.Get();
 	for (uint16_t i = 0; i < numVertices; i++) {
-		rawTangents[i].x = ((static_cast<float>(vertData[i].tangent[0])) / 255.0f) * 2.0f - 1.0f;
-		rawTangents[i].y = ((static_cast<float>(vertData[i].tangent[1])) / 255.0f) * 2.0f - 1.0f;
-		rawTangents[i].z = ((static_cast<float>(vertData[i].tangent[2])) / 255.0f) * 2.0f - 1.0f;
+		rawTangents[i].x = ((static_cast<float>(verts[i].tangent[0])) / 255.0f) * 2.0f - 1.0f;
+		rawTangents[i].y = ((static_cast<float>(verts[i].tangent[1])) / 255.0f) * 2.0f - 1.0f;
+		rawTangents[i].z = ((static_cast<float>(verts[i].tangent[2])) / 255.0f) * 2.0f - 1.0f;
 	}
 
 	return rawTangents;
@@ -691,10 +790,11 @@ std::vector<Vector3>& BSTriShape::UpdateRawBitangents() {
 	}
 
 	rawBitangents.resize(numVertices);
+	const auto& verts = vertData.Get();
 	for (uint16_t i = 0; i < numVertices; i++) {
-		rawBitangents[i].x = vertData[i].bitangentX;
-		rawBitangents[i].y = ((static_cast<float>(vertData[i].bitangentY)) / 255.0f) * 2.0f - 1.0f;
-		rawBitangents[i].z = ((static_cast<float>(vertData[i].bitangentZ)) / 255.0f) * 2.0f - 1.0f;
+		rawBitangents[i].x = verts[i].bitangentX;
+		rawBitangents[i].y = ((static_cast<float>(verts[i].bitangentY)) / 255.0f) * 2.0f - 1.0f;
+		rawBitangents[i].z = ((static_cast<float>(verts[i].bitangentZ)) / 255.0f) * 2.0f - 1.0f;
 	}
 
 	return rawBitangents;
@@ -707,9 +807,10 @@ std::vector<Vector2>& BSTriShape::UpdateRawUvs() {
 	}
 
 	rawUvs.resize(numVertices);
+	const auto& verts = vertData.Get();
 
 	for (uint16_t i = 0; i < numVertices; i++)
-		rawUvs[i] = vertData[i].uv;
+		rawUvs[i] = verts[i].uv;
 
 	return rawUvs;
 }
@@ -721,12 +822,13 @@ std::vector<Color4>& BSTriShape::UpdateRawColors() {
 	}
 
 	rawColors.resize(numVertices);
+	const auto& verts = vertData.Get();
 
 	for (uint16_t i = 0; i < numVertices; i++) {
-		rawColors[i].r = vertData[i].colorData[0] / 255.0f;
-		rawColors[i].g = vertData[i].colorData[1] / 255.0f;
-		rawColors[i].b = vertData[i].colorData[2] / 255.0f;
-		rawColors[i].a = vertData[i].colorData[3] / 255.0f;
+		rawColors[i].r = verts[i].colorData[0] / 255.0f;
+		rawColors[i].g = verts[i].colorData[1] / 255.0f;
+		rawColors[i].b = verts[i].colorData[2] / 255.0f;
+		rawColors[i].a = verts[i].colorData[3] / 255.0f;
 	}
 
 	return rawColors;
@@ -739,9 +841,10 @@ std::vector<float>& BSTriShape::UpdateRawEyeData() {
 	}
 
 	rawEyeData.resize(numVertices);
+	const auto& verts = vertData.Get();
 
 	for (uint16_t i = 0; i < numVertices; ++i)
-		rawEyeData[i] = vertData[i].eyeData;
+		rawEyeData[i] = verts[i].eyeData;
 
 	return rawEyeData;
 }
@@ -847,16 +950,32 @@ bool BSTriShape::GetTriangles(std::vector<Triangle>& tris) const {
 }
 
 void BSTriShape::SetTriangles(const std::vector<Triangle>& tris) {
+	InvalidateGeometryCache();
 	triangles = tris;
 	numTriangles = static_cast<uint32_t>(triangles.size());
 }
 
-void BSTriShape::UpdateBounds() {
+void BSTriShape::UpdateBounds(const BoundsMethod method) {
 	UpdateRawVertices();
-	bounds = BoundingSphere(rawVertices);
+	bounds = BoundingSphere(rawVertices, method);
+
+	// Center and half extent of the axis-aligned box.
+	// Taking the center as min + half extent keeps it at +0 for flat boxes, as in the game's files.
+	const BoundingBox box(rawVertices);
+	if (box.IsValid()) {
+		const Vector3 halfExtent = box.HalfExtent();
+		const Vector3 boxCenter = box.min + halfExtent;
+		boundMinMax[0] = boxCenter.x;
+		boundMinMax[1] = boxCenter.y;
+		boundMinMax[2] = boxCenter.z;
+		boundMinMax[3] = halfExtent.x;
+		boundMinMax[4] = halfExtent.y;
+		boundMinMax[5] = halfExtent.z;
+	}
 }
 
 void BSTriShape::SetVertexData(const std::vector<BSVertexData>& bsVertData) {
+	InvalidateGeometryCache();
 	vertData = bsVertData;
 	numVertices = static_cast<uint16_t>(vertData.size());
 }
@@ -900,54 +1019,106 @@ void BSTriShape::SetEyeData(const std::vector<float>& in) {
 		vertData[i].eyeData = in[i];
 }
 
+// Builds a table of the triangles using each vertex, in ascending triangle order.
+// The triangles of vertex v are vertTris[vertTriStart[v]] to vertTris[vertTriStart[v + 1] - 1].
+// Triangles with out of range indices are left out.
+static void BuildVertexTriangleMap(const size_t numVerts,
+								   Span<const Triangle> tris,
+								   std::vector<uint32_t>& vertTriStart,
+								   std::vector<uint32_t>& vertTris) {
+	auto isValidTri = [numVerts](const Triangle& t) {
+		return t.p1 < numVerts && t.p2 < numVerts && t.p3 < numVerts;
+	};
+
+	vertTriStart.assign(numVerts + 1, 0);
+	for (const Triangle& t : tris) {
+		if (!isValidTri(t))
+			continue;
+
+		vertTriStart[t.p1 + 1u]++;
+		vertTriStart[t.p2 + 1u]++;
+		vertTriStart[t.p3 + 1u]++;
+	}
+
+	for (size_t v = 0; v < numVerts; v++)
+		vertTriStart[v + 1] += vertTriStart[v];
+
+	vertTris.resize(vertTriStart.back());
+	std::vector<uint32_t> vertTriFill(vertTriStart.begin(), vertTriStart.end() - 1);
+	for (uint32_t i = 0; i < static_cast<uint32_t>(tris.size()); i++) {
+		const Triangle& t = tris[i];
+		if (!isValidTri(t))
+			continue;
+
+		vertTris[vertTriFill[t.p1]++] = i;
+		vertTris[vertTriFill[t.p2]++] = i;
+		vertTris[vertTriFill[t.p3]++] = i;
+	}
+}
+
 static void CalculateNormals(const std::vector<Vector3>& verts,
 							 const std::vector<Triangle>& tris,
 							 std::vector<Vector3>& outNorms,
 							 const bool smooth,
-							 float smoothThresh,
+							 const float smoothThresh,
 							 std::unordered_set<uint32_t>* lockedIndices = nullptr) {
-	std::vector<Vector3> norms;
-	norms.resize(verts.size());
+	const size_t numVerts = verts.size();
+	const size_t numTris = tris.size();
 
 	// Face normals
-	const size_t numVerts = verts.size();
-	for (const Triangle& t : tris) {
-		if (t.p1 >= numVerts || t.p2 >= numVerts || t.p3 >= numVerts)
-			continue;
+	std::vector<Vector3> faceNorms(numTris);
+	ParallelFor(numTris, 4096, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; i++)
+			if (tris[i].p1 < numVerts && tris[i].p2 < numVerts && tris[i].p3 < numVerts)
+				faceNorms[i] = tris[i].trinormal(verts);
+	});
 
-		Vector3 tn = t.trinormal(verts);
-		norms[t.p1] += tn;
-		norms[t.p2] += tn;
-		norms[t.p3] += tn;
-	}
+	// Gathering the face normals per vertex sums them up in the same order as a serial pass
+	std::vector<uint32_t> vertTriStart;
+	std::vector<uint32_t> vertTris;
+	BuildVertexTriangleMap(numVerts, tris, vertTriStart, vertTris);
 
-	for (Vector3& n : norms)
-		n.Normalize();
+	std::vector<Vector3> norms(numVerts);
+	ParallelFor(numVerts, 4096, [&](const size_t begin, const size_t end) {
+		for (size_t v = begin; v < end; v++) {
+			Vector3& n = norms[v];
+			for (uint32_t ti = vertTriStart[v]; ti < vertTriStart[v + 1]; ti++)
+				n += faceNorms[vertTris[ti]];
+
+			n.Normalize();
+		}
+	});
 
 	// Smooth normals
 	if (smooth) {
-		smoothThresh *= DEG2RAD;
-		std::vector<Vector3> seamNorms;
-		SortingMatcher matcher(verts.data(), static_cast<uint16_t>(verts.size()));
-		for (const auto& matchset : matcher.matches) {
-			seamNorms.resize(matchset.size());
-			for (size_t j = 0; j < matchset.size(); ++j) {
-				const Vector3& n = norms[matchset[j]];
-				Vector3 sn = n;
-				for (size_t k = 0; k < matchset.size(); ++k) {
-					if (j == k)
-						continue;
-					const Vector3& mn = norms[matchset[k]];
-					if (n.angle(mn) >= smoothThresh)
-						continue;
-					sn += mn;
+		// Normals are unit length (or zero), so comparing the dot product with the
+		// cosine of the threshold is the same as comparing their angle.
+		const float cosThresh = std::cos(smoothThresh * DEG2RAD);
+
+		SpatialHashMatcher<uint32_t> matcher(verts.data(), static_cast<uint32_t>(numVerts));
+		ParallelFor(matcher.matches.size(), 1024, [&](const size_t begin, const size_t end) {
+			std::vector<Vector3> seamNorms;
+			for (size_t m = begin; m < end; m++) {
+				const auto& matchset = matcher.matches[m];
+				seamNorms.resize(matchset.size());
+				for (size_t j = 0; j < matchset.size(); ++j) {
+					const Vector3& n = norms[matchset[j]];
+					Vector3 sn = n;
+					for (size_t k = 0; k < matchset.size(); ++k) {
+						if (j == k)
+							continue;
+						const Vector3& mn = norms[matchset[k]];
+						if (n.dot(mn) <= cosThresh)
+							continue;
+						sn += mn;
+					}
+					sn.Normalize();
+					seamNorms[j] = sn;
 				}
-				sn.Normalize();
-				seamNorms[j] = sn;
+				for (size_t j = 0; j < matchset.size(); ++j)
+					norms[matchset[j]] = seamNorms[j];
 			}
-			for (size_t j = 0; j < matchset.size(); ++j)
-				norms[matchset[j]] = seamNorms[j];
-		}
+		});
 	}
 
 	if (lockedIndices) {
@@ -963,6 +1134,141 @@ static void CalculateNormals(const std::vector<Vector3>& verts,
 		outNorms = std::move(norms);
 }
 
+// Normalized texture space directions (sdir = u, tdir = v) of a triangle
+static void CalculateTriangleTangents(const std::vector<Vector3>& verts,
+									  const std::vector<Vector2>& uvs,
+									  const Triangle& t,
+									  Vector3& sdir,
+									  Vector3& tdir) {
+	const Vector3& v1 = verts[t.p1];
+	const Vector3& v2 = verts[t.p2];
+	const Vector3& v3 = verts[t.p3];
+
+	const Vector2& w1 = uvs[t.p1];
+	const Vector2& w2 = uvs[t.p2];
+	const Vector2& w3 = uvs[t.p3];
+
+	float x1 = v2.x - v1.x;
+	float x2 = v3.x - v1.x;
+	float y1 = v2.y - v1.y;
+	float y2 = v3.y - v1.y;
+	float z1 = v2.z - v1.z;
+	float z2 = v3.z - v1.z;
+
+	float s1 = w2.u - w1.u;
+	float s2 = w3.u - w1.u;
+	float t1 = w2.v - w1.v;
+	float t2 = w3.v - w1.v;
+
+	float r = (s1 * t2 - s2 * t1);
+	r = (r >= 0.0f ? +1.0f : -1.0f);
+
+	sdir = Vector3((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
+	tdir = Vector3((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
+
+	sdir.Normalize();
+	tdir.Normalize();
+}
+
+// Orthogonalizes the accumulated directions of vertices [begin, end) against their normals.
+// Vertices without usable directions get an arbitrary basis perpendicular to the normal.
+static void OrthogonalizeTangents(const std::vector<Vector3>& norms,
+								  std::vector<Vector3>& tangents,
+								  std::vector<Vector3>& bitangents,
+								  const size_t begin,
+								  const size_t end) {
+	for (size_t i = begin; i < end; i++) {
+		const Vector3& n = norms[i];
+		Vector3& t = tangents[i];
+		Vector3& b = bitangents[i];
+
+		if (t.IsZero() || b.IsZero()) {
+			t.x = n.y;
+			t.y = n.z;
+			t.z = n.x;
+			b = n.cross(t);
+		}
+		else {
+			t.Normalize();
+			t = (t - n * n.dot(t));
+			t.Normalize();
+
+			b.Normalize();
+
+			b = (b - n * n.dot(b));
+			b = (b - t * t.dot(b));
+
+			b.Normalize();
+		}
+	}
+}
+
+// Calculates per-vertex tangents (v direction) and bitangents (u direction) from the texture coordinates.
+// With "parallel" set, triangles and vertices are processed on multiple threads. The directions are
+// then gathered per vertex in triangle order, so the results are identical to the serial pass.
+static void CalculateTangents(const std::vector<Vector3>& verts,
+							  const std::vector<Vector2>& uvs,
+							  const std::vector<Vector3>& norms,
+							  Span<const Triangle> tris,
+							  std::vector<Vector3>& outTangents,
+							  std::vector<Vector3>& outBitangents,
+							  const bool parallel) {
+	const size_t numVerts = verts.size();
+	outTangents.assign(numVerts, Vector3());
+	outBitangents.assign(numVerts, Vector3());
+
+	auto isValidTri = [numVerts](const Triangle& t) {
+		return t.p1 < numVerts && t.p2 < numVerts && t.p3 < numVerts;
+	};
+
+	if (!parallel) {
+		for (const Triangle& t : tris) {
+			if (!isValidTri(t))
+				continue;
+
+			Vector3 sdir;
+			Vector3 tdir;
+			CalculateTriangleTangents(verts, uvs, t, sdir, tdir);
+
+			outTangents[t.p1] += tdir;
+			outTangents[t.p2] += tdir;
+			outTangents[t.p3] += tdir;
+
+			outBitangents[t.p1] += sdir;
+			outBitangents[t.p2] += sdir;
+			outBitangents[t.p3] += sdir;
+		}
+
+		OrthogonalizeTangents(norms, outTangents, outBitangents, 0, numVerts);
+		return;
+	}
+
+	std::vector<Vector3> faceSDirs(tris.size());
+	std::vector<Vector3> faceTDirs(tris.size());
+	ParallelFor(tris.size(), 4096, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const Triangle& t = tris[i];
+			if (isValidTri(t))
+				CalculateTriangleTangents(verts, uvs, t, faceSDirs[i], faceTDirs[i]);
+		}
+	});
+
+	std::vector<uint32_t> vertTriStart;
+	std::vector<uint32_t> vertTris;
+	BuildVertexTriangleMap(numVerts, tris, vertTriStart, vertTris);
+
+	ParallelFor(numVerts, 4096, [&](const size_t begin, const size_t end) {
+		for (size_t v = begin; v < end; v++) {
+			for (uint32_t ti = vertTriStart[v]; ti < vertTriStart[v + 1]; ti++) {
+				outTangents[v] += faceTDirs[vertTris[ti]];
+				outBitangents[v] += faceSDirs[vertTris[ti]];
+			}
+		}
+
+		OrthogonalizeTangents(norms, outTangents, outBitangents, begin, end);
+	});
+}
+
 void BSTriShape::RecalcNormals(const bool smooth,
 							   const float smoothThresh,
 							   std::unordered_set<uint32_t>* lockedIndices) {
@@ -984,90 +1290,18 @@ void BSTriShape::RecalcNormals(const bool smooth,
 	}
 }
 
-void BSTriShape::CalcTangentSpace() {
+void BSTriShape::CalcTangentSpace(const bool parallel) {
 	if (!HasNormals() || !HasUVs())
 		return;
 
+	UpdateRawVertices();
 	UpdateRawNormals();
+	UpdateRawUvs();
 	SetTangents(true);
 
-	std::vector<Vector3> tan1;
-	std::vector<Vector3> tan2;
-	tan1.resize(numVertices);
-	tan2.resize(numVertices);
-
-	for (auto& triangle : triangles) {
-		int i1 = triangle.p1;
-		int i2 = triangle.p2;
-		int i3 = triangle.p3;
-
-		if (i1 >= numVertices || i2 >= numVertices || i3 >= numVertices)
-			continue;
-
-		Vector3 v1 = vertData[i1].vert;
-		Vector3 v2 = vertData[i2].vert;
-		Vector3 v3 = vertData[i3].vert;
-
-		Vector2 w1 = vertData[i1].uv;
-		Vector2 w2 = vertData[i2].uv;
-		Vector2 w3 = vertData[i3].uv;
-
-		float x1 = v2.x - v1.x;
-		float x2 = v3.x - v1.x;
-		float y1 = v2.y - v1.y;
-		float y2 = v3.y - v1.y;
-		float z1 = v2.z - v1.z;
-		float z2 = v3.z - v1.z;
-
-		float s1 = w2.u - w1.u;
-		float s2 = w3.u - w1.u;
-		float t1 = w2.v - w1.v;
-		float t2 = w3.v - w1.v;
-
-		float r = (s1 * t2 - s2 * t1);
-		r = (r >= 0.0f ? +1.0f : -1.0f);
-
-		Vector3 sdir = Vector3((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
-		Vector3 tdir = Vector3((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
-
-		sdir.Normalize();
-		tdir.Normalize();
-
-		tan1[i1] += tdir;
-		tan1[i2] += tdir;
-		tan1[i3] += tdir;
-
-		tan2[i1] += sdir;
-		tan2[i2] += sdir;
-		tan2[i3] += sdir;
-	}
-
-	rawBitangents.resize(numVertices);
-	rawTangents.resize(numVertices);
+	CalculateTangents(rawVertices, rawUvs, rawNormals, triangles, rawTangents, rawBitangents, parallel);
 
 	for (uint16_t i = 0; i < numVertices; i++) {
-		rawTangents[i] = tan1[i];
-		rawBitangents[i] = tan2[i];
-
-		if (rawTangents[i].IsZero() || rawBitangents[i].IsZero()) {
-			rawTangents[i].x = rawNormals[i].y;
-			rawTangents[i].y = rawNormals[i].z;
-			rawTangents[i].z = rawNormals[i].x;
-			rawBitangents[i] = rawNormals[i].cross(rawTangents[i]);
-		}
-		else {
-			rawTangents[i].Normalize();
-			rawTangents[i] = (rawTangents[i] - rawNormals[i] * rawNormals[i].dot(rawTangents[i]));
-			rawTangents[i].Normalize();
-
-			rawBitangents[i].Normalize();
-
-			rawBitangents[i] = (rawBitangents[i] - rawNormals[i] * rawNormals[i].dot(rawBitangents[i]));
-			rawBitangents[i] = (rawBitangents[i] - rawTangents[i] * rawTangents[i].dot(rawBitangents[i]));
-
-			rawBitangents[i].Normalize();
-		}
-
 		vertData[i].tangent[0] = static_cast<uint8_t>(
 			std::round((((rawTangents[i].x + 1.0f) / 2.0f) * 255.0f)));
 		vertData[i].tangent[1] = static_cast<uint8_t>(
@@ -1098,12 +1332,18 @@ int BSTriShape::CalcDataSizes(NiVersion& version) {
 			attributeSizes[VA_POSITION] = 2;
 	}
 
-	if (!vertData.empty() && !vertData.front().extra.empty()) {
-		// Add extra float elements to vertex size
-		uint8_t extraCount = static_cast<uint8_t>(vertData.front().extra.size());
-		if (extraCount > 0)
-			attributeSizes[VA_POSITION] += extraCount;
+	// Packed vertices have the extra elements of the description they were read with, without decoding them
+	size_t extraCount = 0;
+	if (IsPacked()) {
+		const uint32_t vertexMainSize = packedVertData->vertexDesc.GetVertexMainSize();
+		if (numVertices > 0 && vertexMainSize > 16)
+			extraCount = (vertexMainSize - 16) / 4;
 	}
+	else if (!vertData.empty())
+		extraCount = vertData.Get().front().extra.size();
+
+	// Add extra float elements to vertex size
+	attributeSizes[VA_POSITION] += static_cast<uint32_t>(extraCount);
 
 	if (HasUVs())
 		attributeSizes[VA_TEXCOORD0] = 1;
@@ -1149,7 +1389,8 @@ void BSTriShape::Create(NiVersion& version,
 						const std::vector<Vector3>* verts,
 						const std::vector<Triangle>* tris,
 						const std::vector<Vector2>* uvs,
-						const std::vector<Vector3>* normals) {
+						const std::vector<Vector3>* normals,
+						const bool parallelTangents) {
 	constexpr uint16_t maxVertIndex = std::numeric_limits<uint16_t>::max();
 	size_t vertCount = verts->size();
 	if (vertCount > static_cast<size_t>(maxVertIndex))
@@ -1200,7 +1441,7 @@ void BSTriShape::Create(NiVersion& version,
 
 	if (normals && normals->size() == numVertices) {
 		SetNormals(*normals);
-		CalcTangentSpace();
+		CalcTangentSpace(parallelTangents);
 	}
 	else {
 		SetNormals(false);
@@ -1262,7 +1503,7 @@ void BSSubIndexTriShape::Sync(NiStreamReversible& stream) {
 	}
 }
 
-void BSSubIndexTriShape::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void BSSubIndexTriShape::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	BSTriShape::notifyVerticesDelete(vertIndices);
 
 	//Remove triangles from segments and re-fit lists
@@ -1361,8 +1602,9 @@ void BSSubIndexTriShape::Create(NiVersion& version,
 								const std::vector<Vector3>* verts,
 								const std::vector<Triangle>* tris,
 								const std::vector<Vector2>* uvs,
-								const std::vector<Vector3>* normals) {
-	BSTriShape::Create(version, verts, tris, uvs, normals);
+								const std::vector<Vector3>* normals,
+								const bool parallelTangents) {
+	BSTriShape::Create(version, verts, tris, uvs, normals, parallelTangents);
 
 	// Skinned most of the time
 	SetSkinned(true);
@@ -1540,7 +1782,7 @@ void BSMeshLODTriShape::Sync(NiStreamReversible& stream) {
 	stream.Sync(lodSize2);
 }
 
-void BSMeshLODTriShape::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void BSMeshLODTriShape::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	BSTriShape::notifyVerticesDelete(vertIndices);
 
 	// Force full LOD (workaround)
@@ -1565,13 +1807,19 @@ void BSDynamicTriShape::Sync(NiStreamReversible& stream) {
 		stream.Sync(dynamicData[i]);
 }
 
-void BSDynamicTriShape::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void BSDynamicTriShape::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	BSTriShape::notifyVerticesDelete(vertIndices);
 
 	EraseVectorIndices(dynamicData, vertIndices);
 	dynamicDataSize = static_cast<uint32_t>(dynamicData.size());
 }
 
+void BSDynamicTriShape::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	BSTriShape::notifyVerticesReorder(vertMap);
+
+	ApplyIndexMapToVector(dynamicData, vertMap);
+}
+
 void BSDynamicTriShape::CalcDynamicData() {
 	dynamicDataSize = numVertices * 16;
 
@@ -1594,8 +1842,9 @@ void BSDynamicTriShape::Create(NiVersion& version,
 							   const std::vector<Vector3>* verts,
 							   const std::vector<Triangle>* tris,
 							   const std::vector<Vector2>* uvs,
-							   const std::vector<Vector3>* normals) {
-	BSTriShape::Create(version, verts, tris, uvs, normals);
+							   const std::vector<Vector3>* normals,
+							   const bool parallelTangents) {
+	BSTriShape::Create(version, verts, tris, uvs, normals, parallelTangents);
 
 	constexpr uint32_t maxIndex = std::numeric_limits<uint32_t>::max();
 	size_t vertCount = verts->size();
@@ -1614,6 +1863,23 @@ void BSDynamicTriShape::Create(NiVersion& version,
 }
 
 void BSGeometryMeshData::Sync(NiStreamReversible& stream) {
+	if (stream.GetMode() == NiStreamReversible::Mode::Reading) {
+		packedData.clear();
+		sharedData.reset();
+		decodedData.reset();
+	}
+	else if (IsShared()) {
+		// Writes a temporary copy, so that saving doesn't detach from the shared data
+		BSGeometryMeshData copy = sharedData->ReadData();
+		copy.Sync(stream);
+		return;
+	}
+	else if (IsPacked()) {
+		// Untouched data is written back byte for byte
+		stream.Sync(packedData.data(), static_cast<std::streamsize>(packedData.size()));
+		return;
+	}
+
 	// verts, normals, vertcolors are always present, though it's possible the counts are 0
 	SetVertices(true);
 	SetNormals(true);
@@ -1630,9 +1896,7 @@ void BSGeometryMeshData::Sync(NiStreamReversible& stream) {
 		nColors = static_cast<uint32_t>(vColors.size());
 		nNormals = static_cast<uint32_t>(normals.size());
 		nTangents = static_cast<uint32_t>(tangents.size());
-		nTotalWeights = 0;
-		for (auto& vw : skinWeights)
-			nTotalWeights += static_cast<uint32_t>(vw.size());
+		nTotalWeights = static_cast<uint32_t>(skinWeights.size());
 		nLODS = static_cast<uint32_t>(lods.size());
 		nMeshlets = static_cast<uint32_t>(meshletList.size());
 		nCullData = static_cast<uint32_t>(cullDataList.size());
@@ -1659,36 +1923,30 @@ void BSGeometryMeshData::Sync(NiStreamReversible& stream) {
 	else
 		numVertices = static_cast<uint16_t>(std::min(nVertices, static_cast<uint32_t>(0xFFFF)));
 	vertices.resize(nVertices);
-	for (uint32_t v = 0; v < nVertices; v++) {
-		if (stream.GetMode() == NiStreamReversible::Mode::Reading) {
-			auto unpack = [&](const float posScale) -> float {
-				int16_t val;
-				stream.Sync(val);
-				if (val < 0)
-					return static_cast<float>((val / 32768.0) * scale * posScale);
-				else
-					return static_cast<float>((val / 32767.0) * scale * posScale);
-			};
 
-			vertices[v].x = unpack(havokScale);
-			vertices[v].y = unpack(havokScale);
-			vertices[v].z = unpack(havokScale);
-		}
-		else {
-			auto pack = [&](float component, float posScale) {
-				int16_t val;
-				if (component < 0)
-					val = static_cast<int16_t>(std::round((component / (scale * posScale)) * 32768.0f));
-				else
-					val = static_cast<int16_t>(std::round((component / (scale * posScale)) * 32767.0f));
-				stream.Sync(val);
-			};
+	// The quantized streams are read or written as a whole and converted in bulk
+	const bool reading = stream.GetMode() == NiStreamReversible::Mode::Reading;
+	auto syncArray = [&stream](auto& packed) {
+		if (!packed.empty())
+			stream.Sync(reinterpret_cast<char*>(packed.data()),
+						static_cast<std::streamsize>(packed.size() * sizeof(packed[0])));
+	};
 
-			pack(vertices[v].x, havokScale);
-			pack(vertices[v].y, havokScale);
-			pack(vertices[v].z, havokScale);
-		}
-	}
+	std::vector<int16_t> packedVerts(vertices.size() * 3);
+	if (!reading)
+		PackPositions(vertices, scale, havokScale, packedVerts);
+	syncArray(packedVerts);
+	if (reading)
+		UnpackPositions(packedVerts, scale, havokScale, vertices);
+
+	auto syncUVs = [&](std::vector<Vector2>& uvs) {
+		std::vector<uint16_t> packedUVs(uvs.size() * 2);
+		if (!reading)
+			PackHalfUVs(uvs, packedUVs);
+		syncArray(packedUVs);
+		if (reading)
+			UnpackHalfUVs(packedUVs, uvs);
+	};
 
 	stream.Sync(nUV1);
 	if (nUV1 > 0)
@@ -1697,17 +1955,11 @@ void BSGeometryMeshData::Sync(NiStreamReversible& stream) {
 	uvSets.resize(2);
 
 	uvSets[0].resize(nUV1);
-	for (uint32_t uv = 0; uv < nUV1; uv++) {
-		stream.SyncHalf(uvSets[0][uv].u);
-		stream.SyncHalf(uvSets[0][uv].v);
-	}
+	syncUVs(uvSets[0]);
 
 	stream.Sync(nUV2);
 	uvSets[1].resize(nUV2);
-	for (uint32_t uv = 0; uv < nUV2; uv++) {
-		stream.SyncHalf(uvSets[1][uv].u);
-		stream.SyncHalf(uvSets[1][uv].v);
-	}
+	syncUVs(uvSets[1]);
 
 	stream.Sync(nColors);
 	vColors.resize(nColors);
@@ -1716,15 +1968,24 @@ void BSGeometryMeshData::Sync(NiStreamReversible& stream) {
 
 	stream.Sync(nNormals);
 	normals.resize(nNormals);
-	for (uint32_t n = 0; n < nNormals; n++)
-		stream.SyncUDEC3(normals[n]);
+
+	std::vector<uint32_t> packedNormals(normals.size());
+	if (!reading)
+		PackUDEC3(normals, {}, packedNormals);
+	syncArray(packedNormals);
+	if (reading)
+		UnpackUDEC3(packedNormals, normals);
 
 	stream.Sync(nTangents);
 	tangents.resize(nTangents);
 	tangentWs.resize(nTangents, 1);
-	for (uint32_t t = 0; t < nTangents; t++) {
-		stream.SyncUDEC3(tangents[t], tangentWs[t]);
-	}
+
+	std::vector<uint32_t> packedTangents(tangents.size());
+	if (!reading)
+		PackUDEC3(tangents, tangentWs, packedTangents);
+	syncArray(packedTangents);
+	if (reading)
+		UnpackUDEC3(packedTangents, tangents, tangentWs);
 
 	/*
 	FIXME: Normal and tangent data is in a 10:10:10:2 bits packed X,Y,Z,W format.
@@ -1734,15 +1995,20 @@ void BSGeometryMeshData::Sync(NiStreamReversible& stream) {
 	*/
 
 	stream.Sync(nTotalWeights);
-	if (nWeightsPerVert > 0)
-		skinWeights.resize(nTotalWeights / nWeightsPerVert);
-
-	for (auto& vw : skinWeights) {
-		vw.resize(nWeightsPerVert);
-		for (auto& bw : vw)
-			stream.Sync(bw);
+	if (stream.GetMode() == NiStreamReversible::Mode::Reading) {
+		// Only whole vertex slots are kept
+		if (nWeightsPerVert > 0)
+			skinWeights.resize(nTotalWeights / nWeightsPerVert * nWeightsPerVert);
+		else
+			skinWeights.clear();
 	}
 
+	// Bone index/weight pairs are tightly packed, sync them in one go
+	static_assert(sizeof(BoneWeight) == 4, "BoneWeight must match the file layout");
+	if (!skinWeights.empty())
+		stream.Sync(reinterpret_cast<char*>(skinWeights.data()),
+					static_cast<std::streamsize>(skinWeights.size() * sizeof(BoneWeight)));
+
 	stream.Sync(nLODS);
 	lods.resize(nLODS);
 	for (auto& lod : lods) {
@@ -1771,7 +2037,18 @@ void BSGeometryMeshData::Sync(NiStreamReversible& stream) {
 	}
 }
 
-void BSGeometryMeshData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void BSGeometryMeshData::RecalcNormals(const bool smooth,
+									   const float smoothThresh,
+									   std::unordered_set<uint32_t>* lockedIndices) {
+	// Vertex count isn't limited to 16 bits, so don't size the normals by numVertices
+	hasNormals = true;
+	normals.resize(vertices.size());
+
+	CalculateNormals(vertices, tris, normals.Detach(), smooth, smoothThresh, lockedIndices);
+	nNormals = static_cast<uint32_t>(normals.size());
+}
+
+void BSGeometryMeshData::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	if (vertIndices.empty()) {
 		return;
 	}
@@ -1792,11 +2069,23 @@ void BSGeometryMeshData::notifyVerticesDelete(const std::vector<uint16_t>& vertI
 
 	EraseVectorIndices(tangentWs, vertIndices);
 
-	EraseVectorIndices(skinWeights, vertIndices);
-	nTotalWeights = 0;
-	for (auto& vw : skinWeights) {
-		nTotalWeights += static_cast<uint32_t>(vw.size());
+	// Compact the weight slots of the remaining vertices
+	if (nWeightsPerVert > 0 && !skinWeights.empty()) {
+		const size_t weightVertCount = skinWeights.size() / nWeightsPerVert;
+		size_t writeVert = 0;
+		for (size_t readVert = 0; readVert < weightVertCount; readVert++) {
+			if (readVert < indexCollapse.size() && indexCollapse[readVert] == -1)
+				continue;
+
+			if (writeVert != readVert)
+				std::copy_n(skinWeights.begin() + static_cast<std::ptrdiff_t>(readVert * nWeightsPerVert),
+							nWeightsPerVert,
+							skinWeights.begin() + static_cast<std::ptrdiff_t>(writeVert * nWeightsPerVert));
+			writeVert++;
+		}
+		skinWeights.resize(writeVert * nWeightsPerVert);
 	}
+	nTotalWeights = static_cast<uint32_t>(skinWeights.size());
 
 	// Remap the main triangle list with the index collapse map
 	ApplyMapToTriangles(tris, indexCollapse);
@@ -1808,22 +2097,272 @@ void BSGeometryMeshData::notifyVerticesDelete(const std::vector<uint16_t>& vertI
 	}
 
 	// Need to rebuild Meshlets and cull data (if had any)
-	bool hadMeshlets = !meshletList.empty();
+	RegenerateMeshlets();
+}
+
+void BSGeometryMeshData::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	// Base handles vertices, normals, tangents and uvSets
+	NiGeometryData::notifyVerticesReorder(vertMap);
+
+	ApplyIndexMapToVector(vColors, vertMap);
+	ApplyIndexMapToVector(tangentWs, vertMap);
+
+	// Move the weight slots along with their vertices
+	if (nWeightsPerVert > 0 && skinWeights.size() == vertMap.size() * nWeightsPerVert) {
+		std::vector<BoneWeight> weights(skinWeights.size());
+		for (size_t i = 0; i < vertMap.size(); i++) {
+			const size_t newIndex = static_cast<size_t>(vertMap[i]);
+			std::copy_n(skinWeights.begin() + static_cast<std::ptrdiff_t>(i * nWeightsPerVert),
+						nWeightsPerVert,
+						weights.begin() + static_cast<std::ptrdiff_t>(newIndex * nWeightsPerVert));
+		}
+
+		skinWeights = std::move(weights);
+	}
+
+	ApplyMapToTriangles(tris, vertMap);
+	for (auto& lod : lods)
+		ApplyMapToTriangles(lod, vertMap);
+
+	// Meshlets reference vertices in order, so they need to be rebuilt
+	RegenerateMeshlets();
+}
+
+void BSGeometryMeshData::LoadPacked(std::istream& stream) {
+	sharedData.reset();
+	decodedData.reset();
+	packedData.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+void BSGeometryMeshData::ReadPacked(NiStreamReversible& stream) {
+	sharedData.reset();
+	decodedData.reset();
+	packedData.clear();
+
+	// Appends the next bytes of the stream to the packed data and returns their offset.
+	// Only the counts are looked at, in the same order as Sync reads them.
+	auto readBytes = [&](const size_t count) {
+		const size_t offset = packedData.size();
+		packedData.resize(offset + count);
+		if (count > 0)
+			stream.Sync(packedData.data() + offset, static_cast<std::streamsize>(count));
+		return offset;
+	};
+
+	auto readCount = [&]() {
+		uint32_t count = 0;
+		const size_t offset = readBytes(sizeof(count));
+		std::memcpy(&count, packedData.data() + offset, sizeof(count));
+		return count;
+	};
+
+	if (readCount() > 2)
+		return;
+
+	readBytes(readCount() / 3 * sizeof(Triangle));
+
+	float meshScale = 0.0f;
+	const size_t scaleOffset = readBytes(sizeof(meshScale));
+	std::memcpy(&meshScale, packedData.data() + scaleOffset, sizeof(meshScale));
+	if (meshScale <= 0.0f)
+		return;
+
+	const uint32_t weightsPerVert = readCount();
+
+	readBytes(static_cast<size_t>(readCount()) * 3 * sizeof(int16_t)); // Positions
+	readBytes(static_cast<size_t>(readCount()) * 2 * sizeof(uint16_t)); // UV1
+	readBytes(static_cast<size_t>(readCount()) * 2 * sizeof(uint16_t)); // UV2
+	readBytes(static_cast<size_t>(readCount()) * sizeof(ByteColor4));
+	readBytes(static_cast<size_t>(readCount()) * sizeof(uint32_t)); // Normals
+	readBytes(static_cast<size_t>(readCount()) * sizeof(uint32_t)); // Tangents
+
+	// Only whole vertex slots of weights are read
+	const uint32_t totalWeights = readCount();
+	if (weightsPerVert > 0)
+		readBytes(static_cast<size_t>(totalWeights / weightsPerVert * weightsPerVert) * sizeof(BoneWeight));
+
+	const uint32_t lodCount = readCount();
+	for (uint32_t l = 0; l < lodCount; l++)
+		readBytes(readCount() / 3 * sizeof(Triangle));
+
+	readBytes(static_cast<size_t>(readCount()) * sizeof(Meshlet));
+	readBytes(static_cast<size_t>(readCount()) * sizeof(CullData));
+}
+
+void BSGeometryMeshData::Share(std::shared_ptr<const BSGeometryMeshData> data) {
+	*this = BSGeometryMeshData();
+	sharedData = std::move(data);
+}
+
+void BSGeometryMeshData::Unpack() {
+	if (sharedData) {
+		// Copy on write, the shared data may be used by other meshes
+		auto source = std::move(sharedData);
+		*this = source->ReadData();
+		Unpack();
+		return;
+	}
+
+	if (!IsPacked())
+		return;
+
+	if (decodedData) {
+		// Already decoded by a read, the copy has no packed data
+		auto source = std::move(decodedData);
+		*this = *source;
+		return;
+	}
+
+	// Reading through Sync clears the packed data
+	std::vector<char> data = std::move(packedData);
+	Decode(data);
+}
+
+const BSGeometryMeshData& BSGeometryMeshData::ReadData() const {
+	if (sharedData)
+		return *sharedData;
+
+	if (IsPacked()) {
+		if (!decodedData) {
+			auto data = std::make_shared<BSGeometryMeshData>();
+			data->Decode(packedData);
+			decodedData = std::move(data);
+		}
+		return *decodedData;
+	}
+
+	return *this;
+}
+
+void BSGeometryMeshData::Decode(const std::vector<char>& data) {
+	MemoryStreamBuf buf(data.data(), data.size());
+	std::istream packedStream(&buf);
+
+	NiIStream meshStream(&packedStream, nullptr);
+	NiStreamReversible s(&meshStream, nullptr, NiStreamReversible::Mode::Reading);
+	Sync(s);
+}
+
+void BSGeometryMeshData::ResetSkinWeights(const uint32_t vertCount, const uint32_t weightsPerVert) {
+	nWeightsPerVert = weightsPerVert;
+	skinWeights.assign(static_cast<size_t>(vertCount) * weightsPerVert, BoneWeight{});
+	nTotalWeights = static_cast<uint32_t>(skinWeights.size());
+}
+
+// Number of distinct vertices of the triangle that aren't marked as part of the meshlet yet
+static uint32_t CountNewMeshletVerts(const Triangle& tri,
+									 const std::vector<uint32_t>& vertMeshlet,
+									 const uint32_t meshletIndex) {
+	uint32_t add = 0;
+	if (vertMeshlet[tri.p1] != meshletIndex)
+		add++;
+	if (vertMeshlet[tri.p2] != meshletIndex && tri.p2 != tri.p1)
+		add++;
+	if (vertMeshlet[tri.p3] != meshletIndex && tri.p3 != tri.p1 && tri.p3 != tri.p2)
+		add++;
+
+	return add;
+}
+
+// Spreads the lower 10 bits of the value to every third bit for a Morton code
+static uint32_t SpreadMortonBits(uint32_t v) {
+	v &= 0x3FF;
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+void BSGeometryMeshData::ClearMeshlets() {
 	meshletList.clear();
 	cullDataList.clear();
+	meshletBounds.clear();
 	nMeshlets = 0;
 	nCullData = 0;
+}
+
+void BSGeometryMeshData::RegenerateMeshlets() {
+	if (meshletList.empty())
+		return;
+
+	if (spatialMeshlets)
+		GenerateSpatialMeshlets(meshletMaxVerts, meshletMaxPrims);
+	else
+		GenerateMeshlets(meshletMaxVerts, meshletMaxPrims);
+}
+
+void BSGeometryMeshData::AppendMeshlet(const uint32_t primOffset,
+									   Span<const Triangle> meshletTris,
+									   Span<const uint16_t> meshletVerts) {
+	Meshlet m;
+	m.vertCount = static_cast<uint32_t>(meshletVerts.size());
+	m.vertOffset = meshletList.empty() ? 0 : meshletList.back().vertOffset + meshletList.back().vertCount;
+	m.primCount = static_cast<uint32_t>(meshletTris.size());
+	m.primOffset = primOffset; // primOffset is in TRIANGLE units (matches vanilla SF meshlets)
+	meshletList.push_back(m);
+
+	// Per-meshlet AABB over the meshlet's vertices. Stored in metric units (NIF units divided by havokScale), matching how the game decodes positions for culling.
+	BoundingBox box;
+	for (uint16_t vi : meshletVerts)
+		box.Add(vertices[vi]);
+
+	CullData cd;
+	cd.center = box.Center() / havokScale;
+	cd.expand = box.HalfExtent() / havokScale;
+	cullDataList.push_back(cd);
+
+	MeshletBounds bounds;
+	bounds.center = box.Center();
+	for (uint16_t vi : meshletVerts)
+		bounds.radius = std::max(bounds.radius, bounds.center.DistanceTo(vertices[vi]));
+
+	// Normal cone from the average of the unit triangle normals
+	std::vector<Vector3> triNormals;
+	triNormals.reserve(meshletTris.size());
+	for (const Triangle& tri : meshletTris) {
+		Vector3 n = tri.trinormal(vertices);
+		if (n.IsZero())
+			continue;
+
+		n.Normalize();
+		triNormals.push_back(n);
+		bounds.coneAxis += n;
+	}
 
-	if (hadMeshlets) {
-		GenerateMeshlets();
+	bounds.coneAxis.Normalize();
+	bounds.coneApex = bounds.center;
+
+	float minDot = 1.0f;
+	for (const Vector3& n : triNormals)
+		minDot = std::min(minDot, bounds.coneAxis.dot(n));
+
+	// Cones wider than ~84 degrees aren't worth testing, the cutoff of 1 disables them
+	if (!triNormals.empty() && minDot > 0.1f) {
+		// Move the apex back along the axis until it's behind every triangle plane
+		float maxT = 0.0f;
+		for (size_t i = 0; i < meshletTris.size(); i++) {
+			Vector3 n = meshletTris[i].trinormal(vertices);
+			if (n.IsZero())
+				continue;
+
+			n.Normalize();
+			const float dc = (bounds.center - vertices[meshletTris[i].p1]).dot(n);
+			maxT = std::max(maxT, dc / bounds.coneAxis.dot(n));
+		}
+
+		bounds.coneApex = bounds.center - bounds.coneAxis * maxT;
+		bounds.coneCutoff = std::sqrt(1.0f - minDot * minDot);
 	}
+
+	meshletBounds.push_back(bounds);
 }
 
 void BSGeometryMeshData::GenerateMeshlets(uint32_t maxVerts, uint32_t maxPrims) {
-	meshletList.clear();
-	cullDataList.clear();
-	nMeshlets = 0;
-	nCullData = 0;
+	ClearMeshlets();
+	spatialMeshlets = false;
+	meshletMaxVerts = maxVerts;
+	meshletMaxPrims = maxPrims;
 
 	if (tris.empty() || vertices.empty()) {
 		return;
@@ -1835,73 +2374,184 @@ void BSGeometryMeshData::GenerateMeshlets(uint32_t maxVerts, uint32_t maxPrims)
 	if (maxPrims < 1)
 		maxPrims = 1;
 
-	uint32_t startTri = 0;			  // first triangle of the meshlet being built
-	uint32_t vertOffsetAccum = 0;	  // running sum of emitted vertCounts (= vertOffset)
-	std::unordered_set<uint16_t> cur; // distinct vertices in the meshlet being built
+	// Index of the meshlet each vertex was last added to, instead of a set per meshlet
+	std::vector<uint32_t> vertMeshlet(static_cast<size_t>(CalcMaxTriangleIndex(tris)) + 1, NIF_NPOS);
+	std::vector<uint16_t> meshletVerts; // distinct vertices in the meshlet being built
+	uint32_t meshletIndex = 0;
+	uint32_t startTri = 0; // first triangle of the meshlet being built
 
 	auto flush = [&](uint32_t endTri) {
 		if (endTri <= startTri)
 			return;
 
-		Meshlet m;
-		m.vertCount = static_cast<uint32_t>(cur.size());
-		m.vertOffset = vertOffsetAccum;
-		m.primCount = endTri - startTri;
-		m.primOffset = startTri; // primOffset is in TRIANGLE units (matches vanilla SF meshlets)
-		meshletList.push_back(m);
-		vertOffsetAccum += m.vertCount;
-
-		// Per-meshlet AABB over the meshlet's vertices. Stored in metric units (NIF units divided by havokScale), matching how the game decodes positions for culling.
-		Vector3 mn(FLT_MAX, FLT_MAX, FLT_MAX);
-		Vector3 mx(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-		for (uint16_t vi : cur) {
-			const Vector3& p = vertices[vi];
-			mn.x = std::min(mn.x, p.x);
-			mn.y = std::min(mn.y, p.y);
-			mn.z = std::min(mn.z, p.z);
-			mx.x = std::max(mx.x, p.x);
-			mx.y = std::max(mx.y, p.y);
-			mx.z = std::max(mx.z, p.z);
+		const uint32_t primCount = endTri - startTri;
+		AppendMeshlet(startTri, Span<const Triangle>(tris).subspan(startTri, primCount), meshletVerts);
+		startTri = endTri;
+		meshletVerts.clear();
+		meshletIndex++;
+	};
+
+	for (uint32_t t = 0; t < static_cast<uint32_t>(tris.size()); t++) {
+		const Triangle& tri = tris[t];
+
+		uint32_t curPrims = t - startTri;
+		if (curPrims > 0
+			&& (meshletVerts.size() + CountNewMeshletVerts(tri, vertMeshlet, meshletIndex) > maxVerts
+				|| curPrims + 1 > maxPrims))
+			flush(t);
+
+		for (const uint16_t v : {tri.p1, tri.p2, tri.p3}) {
+			if (vertMeshlet[v] != meshletIndex) {
+				vertMeshlet[v] = meshletIndex;
+				meshletVerts.push_back(v);
+			}
 		}
+	}
+	flush(static_cast<uint32_t>(tris.size()));
+
+	nMeshlets = static_cast<uint32_t>(meshletList.size());
+	nCullData = static_cast<uint32_t>(cullDataList.size());
+	version = 2;
+}
+
+void BSGeometryMeshData::GenerateSpatialMeshlets(uint32_t maxVerts,
+												 uint32_t maxPrims,
+												 const MeshTopology* topology) {
+	ClearMeshlets();
+	spatialMeshlets = true;
+	meshletMaxVerts = maxVerts;
+	meshletMaxPrims = maxPrims;
+
+	if (tris.empty() || vertices.empty()) {
+		return;
+	}
+
+	if (maxVerts < 3)
+		maxVerts = 3;
+	if (maxPrims < 1)
+		maxPrims = 1;
 
-		CullData cd;
-		cd.center = Vector3((mn.x + mx.x) * 0.5f, (mn.y + mx.y) * 0.5f, (mn.z + mx.z) * 0.5f) / havokScale;
-		cd.expand = Vector3((mx.x - mn.x) * 0.5f, (mx.y - mn.y) * 0.5f, (mx.z - mn.z) * 0.5f) / havokScale;
-		cullDataList.push_back(cd);
+	const uint32_t numTris = static_cast<uint32_t>(tris.size());
+	const size_t numVerts = static_cast<size_t>(CalcMaxTriangleIndex(tris)) + 1;
 
+	// The given topology is only used if it was built from these triangles
+	MeshTopology localTopology;
+	if (!topology || topology->GetNumTriangles() != numTris || topology->GetNumVertices() < numVerts) {
+		localTopology = MeshTopology(numVerts, tris);
+		topology = &localTopology;
+	}
+
+	// Triangle centers sorted along a Morton curve, used to continue with a nearby
+	// triangle when the meshlet has no adjacent triangles left
+	std::vector<Vector3> centers(numTris);
+	Vector3 mn(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vector3 mx(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (uint32_t t = 0; t < numTris; t++) {
+		const Triangle& tri = tris[t];
+		centers[t] = (vertices[tri.p1] + vertices[tri.p2] + vertices[tri.p3]) / 3.0f;
+		mn.x = std::min(mn.x, centers[t].x);
+		mn.y = std::min(mn.y, centers[t].y);
+		mn.z = std::min(mn.z, centers[t].z);
+		mx.x = std::max(mx.x, centers[t].x);
+		mx.y = std::max(mx.y, centers[t].y);
+		mx.z = std::max(mx.z, centers[t].z);
+	}
+
+	const float extent = std::max({mx.x - mn.x, mx.y - mn.y, mx.z - mn.z, FLT_EPSILON});
+	std::vector<uint32_t> mortonCodes(numTris);
+	for (uint32_t t = 0; t < numTris; t++) {
+		const Vector3 q = (centers[t] - mn) * (1023.0f / extent);
+		mortonCodes[t] = SpreadMortonBits(static_cast<uint32_t>(q.x))
+						 | (SpreadMortonBits(static_cast<uint32_t>(q.y)) << 1)
+						 | (SpreadMortonBits(static_cast<uint32_t>(q.z)) << 2);
+	}
+
+	std::vector<uint32_t> mortonOrder(numTris);
+	for (uint32_t t = 0; t < numTris; t++)
+		mortonOrder[t] = t;
+
+	std::stable_sort(mortonOrder.begin(), mortonOrder.end(), [&mortonCodes](uint32_t a, uint32_t b) {
+		return mortonCodes[a] < mortonCodes[b];
+	});
+
+	std::vector<Triangle> meshletTris;
+	meshletTris.reserve(numTris);
+	std::vector<bool> emitted(numTris, false);
+	std::vector<uint32_t> vertMeshlet(numVerts, NIF_NPOS);
+	std::vector<uint16_t> meshletVerts;
+	uint32_t meshletIndex = 0;
+	uint32_t startTri = 0;
+	uint32_t nextMorton = 0;
+	Vector3 centerSum;
+
+	auto flush = [&]() {
+		const auto endTri = static_cast<uint32_t>(meshletTris.size());
+		const uint32_t primCount = endTri - startTri;
+		AppendMeshlet(startTri, Span<const Triangle>(meshletTris).subspan(startTri, primCount), meshletVerts);
 		startTri = endTri;
-		cur.clear();
+		meshletVerts.clear();
+		meshletIndex++;
+		centerSum = Vector3();
 	};
 
-	for (uint32_t t = 0; t < static_cast<uint32_t>(tris.size()); t++) {
-		const Triangle& tri = tris[t];
-		const uint16_t tv[3] = {tri.p1, tri.p2, tri.p3};
+	while (meshletTris.size() < numTris) {
+		uint32_t curPrims = static_cast<uint32_t>(meshletTris.size()) - startTri;
+		if (curPrims >= maxPrims) {
+			flush();
+			curPrims = 0;
+		}
 
-		// Count how many distinct vertices this triangle would add to the current meshlet, ignoring vertices already present and degenerate repeats within the triangle.
-		uint32_t add = 0;
-		for (int a = 0; a < 3; a++) {
-			if (cur.count(tv[a]))
-				continue;
-			bool seenEarlier = false;
-			for (int b = 0; b < a; b++) {
-				if (tv[b] == tv[a]) {
-					seenEarlier = true;
-					break;
+		// Prefer the adjacent triangle adding the fewest vertices, then the one closest to the meshlet center
+		uint32_t best = NIF_NPOS;
+		uint32_t bestAdd = 0;
+		float bestDist = FLT_MAX;
+		if (curPrims > 0) {
+			const Vector3 center = centerSum / static_cast<float>(curPrims);
+			for (uint16_t v : meshletVerts) {
+				for (const uint32_t t : topology->GetVertexTriangles(v)) {
+					if (emitted[t])
+						continue;
+
+					const uint32_t add = CountNewMeshletVerts(tris[t], vertMeshlet, meshletIndex);
+					if (meshletVerts.size() + add > maxVerts)
+						continue;
+
+					const float dist = centers[t].DistanceSquaredTo(center);
+					if (best == NIF_NPOS || add < bestAdd || (add == bestAdd && dist < bestDist)) {
+						best = t;
+						bestAdd = add;
+						bestDist = dist;
+					}
 				}
 			}
-			if (!seenEarlier)
-				add++;
 		}
 
-		uint32_t curPrims = t - startTri;
-		if (curPrims > 0 && (cur.size() + add > maxVerts || curPrims + 1 > maxPrims))
-			flush(t);
+		// Otherwise continue with the next triangle along the curve, starting a new meshlet if it doesn't fit
+		if (best == NIF_NPOS) {
+			while (emitted[mortonOrder[nextMorton]])
+				nextMorton++;
 
-		cur.insert(tri.p1);
-		cur.insert(tri.p2);
-		cur.insert(tri.p3);
+			best = mortonOrder[nextMorton];
+			const uint32_t add = CountNewMeshletVerts(tris[best], vertMeshlet, meshletIndex);
+			if (curPrims > 0 && meshletVerts.size() + add > maxVerts)
+				flush();
+		}
+
+		const Triangle& tri = tris[best];
+		emitted[best] = true;
+		meshletTris.push_back(tri);
+		centerSum += centers[best];
+
+		for (const uint16_t v : {tri.p1, tri.p2, tri.p3}) {
+			if (vertMeshlet[v] != meshletIndex) {
+				vertMeshlet[v] = meshletIndex;
+				meshletVerts.push_back(v);
+			}
+		}
 	}
-	flush(static_cast<uint32_t>(tris.size()));
+	flush();
+
+	tris = std::move(meshletTris);
 
 	nMeshlets = static_cast<uint32_t>(meshletList.size());
 	nCullData = static_cast<uint32_t>(cullDataList.size());
@@ -1915,7 +2565,10 @@ void BSGeometryMesh::Sync(NiStreamReversible& stream) {
 
 	if (internalGeom) {
 		// Mesh data is embedded inline in the NIF (flag 0x200 on BSGeometry)
-		meshData.Sync(stream);
+		if (stream.KeepPacked())
+			meshData.ReadPacked(stream);
+		else
+			meshData.Sync(stream);
 	}
 	else {
 		// External .mesh file path reference
@@ -1974,19 +2627,32 @@ void BSGeometry::GetChildIndices(std::vector<uint32_t>& indices) {
 }
 
 
+const BSGeometryMeshData* BSGeometry::GetMeshData(uint8_t whichMesh) const {
+	if (whichMesh >= meshes.size())
+		return nullptr;
+
+	return &meshes[whichMesh].meshData.ReadData();
+}
+
 NiGeometryData* BSGeometry::GetGeomData() const {
 	if (meshes.size() > selectedMesh) {
 		// Breaking const correctness here to cast to the desired level of the class heirarchy.
 		//   Perhaps NiShape GetGeomData should return a const* or it shouldn't be a const function?
-		return dynamic_cast<NiGeometryData*>(const_cast<BSGeometryMeshData*>(&meshes[selectedMesh].meshData));
+		auto meshData = const_cast<BSGeometryMeshData*>(&meshes[selectedMesh].meshData);
+		meshData->Unpack();
+		return meshData;
 	}
 	return nullptr;
 }
 
+const NiGeometryData* BSGeometry::ReadGeomData() const {
+	return GetMeshData(selectedMesh);
+}
+
 
 bool BSGeometry::GetTriangles(std::vector<Triangle>& tris) const {
 	if (meshes.size() > selectedMesh) {
-		tris = meshes[selectedMesh].meshData.tris;
+		tris = meshes[selectedMesh].meshData.ReadData().tris;
 		return true;
 	}
 
@@ -1994,8 +2660,11 @@ bool BSGeometry::GetTriangles(std::vector<Triangle>& tris) const {
 }
 
 void BSGeometry::SetTriangles(const std::vector<Triangle>& tris) {
+	InvalidateGeometryCache();
+
 	if (meshes.size() > selectedMesh) {
 		auto& meshData = meshes[selectedMesh].meshData;
+		meshData.Unpack();
 
 		// Detect whether the triangle topology actually changes.
 		bool changed = meshData.tris.size() != tris.size();
@@ -2008,8 +2677,7 @@ void BSGeometry::SetTriangles(const std::vector<Triangle>& tris) {
 
 		//If triangles changed, we want to drop the meshlets so export re-generates them. (only want to strip on invalidation, not if no changes occured)
 		if (changed) {
-			meshData.meshletList.clear();
-			meshData.cullDataList.clear();
+			meshData.ClearMeshlets();
 		}
 	}
 }
@@ -2083,8 +2751,9 @@ void NiTriBasedGeomData::Create(NiVersion& version,
 								const std::vector<Vector3>* verts,
 								const std::vector<Triangle>* inTris,
 								const std::vector<Vector2>* uvs,
-								const std::vector<Vector3>* norms) {
-	NiGeometryData::Create(version, verts, inTris, uvs, norms);
+								const std::vector<Vector3>* norms,
+								const bool parallelTangents) {
+	NiGeometryData::Create(version, verts, inTris, uvs, norms, parallelTangents);
 
 	if (inTris) {
 		constexpr uint16_t maxIndex = std::numeric_limits<uint16_t>::max();
@@ -2108,11 +2777,8 @@ void NiTriShapeData::Sync(NiStreamReversible& stream) {
 	else
 		hasTriangles = true; // Triangle data is always present before that version
 
-	if (hasTriangles) {
-		triangles.resize(numTriangles);
-		for (uint32_t i = 0; i < numTriangles; i++)
-			stream.Sync(triangles[i]);
-	}
+	if (hasTriangles)
+		triangles.SyncData(stream, numTriangles);
 
 	if (stream.GetMode() == NiStreamReversible::Mode::Writing)
 		numMatchGroups = static_cast<uint16_t>(matchGroups.size());
@@ -2135,8 +2801,9 @@ void NiTriShapeData::Create(NiVersion& version,
 							const std::vector<Vector3>* verts,
 							const std::vector<Triangle>* inTris,
 							const std::vector<Vector2>* uvs,
-							const std::vector<Vector3>* norms) {
-	NiTriBasedGeomData::Create(version, verts, inTris, uvs, norms);
+							const std::vector<Vector3>* norms,
+							const bool parallelTangents) {
+	NiTriBasedGeomData::Create(version, verts, inTris, uvs, norms, parallelTangents);
 
 	if (numTriangles > 0) {
 		numTrianglePoints = numTriangles * 3;
@@ -2156,12 +2823,12 @@ void NiTriShapeData::Create(NiVersion& version,
 	numMatchGroups = 0;
 
 	// Calculate again, now with triangles
-	CalcTangentSpace();
+	CalcTangentSpace(parallelTangents);
 }
 
-void NiTriShapeData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void NiTriShapeData::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	std::vector<int> indexCollapse = GenerateIndexCollapseMap(vertIndices, vertices.size());
-	ApplyMapToTriangles(triangles, indexCollapse);
+	ApplyMapToTriangles(triangles.Detach(), indexCollapse);
 	numTriangles = static_cast<uint16_t>(triangles.size());
 	numTrianglePoints = 3 * numTriangles;
 
@@ -2172,6 +2839,17 @@ void NiTriShapeData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndic
 	NiTriBasedGeomData::notifyVerticesDelete(vertIndices);
 }
 
+void NiTriShapeData::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	ApplyMapToTriangles(triangles.Detach(), vertMap);
+
+	for (auto& mg : matchGroups)
+		for (uint16_t& match : mg.matches)
+			if (match < vertMap.size())
+				match = static_cast<uint16_t>(vertMap[match]);
+
+	NiTriBasedGeomData::notifyVerticesReorder(vertMap);
+}
+
 std::vector<MatchGroup> NiTriShapeData::GetMatchGroups() const {
 	return matchGroups;
 }
@@ -2205,89 +2883,23 @@ void NiTriShapeData::RecalcNormals(const bool smooth,
 
 	NiTriBasedGeomData::RecalcNormals();
 
-	CalculateNormals(vertices, triangles, normals, smooth, smoothThresh, lockedIndices);
+	CalculateNormals(vertices, triangles, normals.Detach(), smooth, smoothThresh, lockedIndices);
 }
 
-void NiTriShapeData::CalcTangentSpace() {
+void NiTriShapeData::CalcTangentSpace(const bool parallel) {
 	if (!HasNormals() || !HasUVs())
 		return;
 
-	NiTriBasedGeomData::CalcTangentSpace();
-
-	std::vector<Vector3> tan1;
-	std::vector<Vector3> tan2;
-	tan1.resize(numVertices);
-	tan2.resize(numVertices);
-
-	for (uint32_t i = 0; i < numTriangles; i++) {
-		int i1 = triangles[i].p1;
-		int i2 = triangles[i].p2;
-		int i3 = triangles[i].p3;
-
-		if (i1 >= numVertices || i2 >= numVertices || i3 >= numVertices)
-			continue;
-
-		Vector3 v1 = vertices[i1];
-		Vector3 v2 = vertices[i2];
-		Vector3 v3 = vertices[i3];
-
-		Vector2 w1 = uvSets[0][i1];
-		Vector2 w2 = uvSets[0][i2];
-		Vector2 w3 = uvSets[0][i3];
-
-		float x1 = v2.x - v1.x;
-		float x2 = v3.x - v1.x;
-		float y1 = v2.y - v1.y;
-		float y2 = v3.y - v1.y;
-		float z1 = v2.z - v1.z;
-		float z2 = v3.z - v1.z;
-
-		float s1 = w2.u - w1.u;
-		float s2 = w3.u - w1.u;
-		float t1 = w2.v - w1.v;
-		float t2 = w3.v - w1.v;
-
-		float r = (s1 * t2 - s2 * t1);
-		r = (r >= 0.0f ? +1.0f : -1.0f);
-
-		Vector3 sdir = Vector3((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
-		Vector3 tdir = Vector3((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
-
-		sdir.Normalize();
-		tdir.Normalize();
-
-		tan1[i1] += sdir;
-		tan1[i2] += sdir;
-		tan1[i3] += sdir;
-
-		tan2[i1] += tdir;
-		tan2[i2] += tdir;
-		tan2[i3] += tdir;
-	}
-
-	for (uint16_t i = 0; i < numVertices; i++) {
-		bitangents[i] = tan1[i];
-		tangents[i] = tan2[i];
-
-		if (tangents[i].IsZero() || bitangents[i].IsZero()) {
-			tangents[i].x = normals[i].y;
-			tangents[i].y = normals[i].z;
-			tangents[i].z = normals[i].x;
-			bitangents[i] = normals[i].cross(tangents[i]);
-		}
-		else {
-			tangents[i].Normalize();
-			tangents[i] = (tangents[i] - normals[i] * normals[i].dot(tangents[i]));
-			tangents[i].Normalize();
-
-			bitangents[i].Normalize();
+	NiTriBasedGeomData::CalcTangentSpace(parallel);
 
-			bitangents[i] = (bitangents[i] - normals[i] * normals[i].dot(bitangents[i]));
-			bitangents[i] = (bitangents[i] - tangents[i] * tangents[i].dot(bitangents[i]));
-
-			bitangents[i].Normalize();
-		}
-	}
+	const size_t numTris = std::min<size_t>(numTriangles, triangles.size());
+	CalculateTangents(vertices,
+					  uvSets.Get()[0],
+					  normals,
+					  Span<const Triangle>(triangles.Get().data(), numTris),
+					  tangents.Detach(),
+					  bitangents.Detach(),
+					  parallel);
 }
 
 
@@ -2325,7 +2937,7 @@ void NiTriStripsData::Sync(NiStreamReversible& stream) {
 	stripsInfo.Sync(stream);
 }
 
-void NiTriStripsData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void NiTriStripsData::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	std::vector<int> indexCollapse = GenerateIndexCollapseMap(vertIndices, vertices.size());
 
 	NiTriBasedGeomData::notifyVerticesDelete(vertIndices);
@@ -2350,6 +2962,15 @@ void NiTriStripsData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndi
 			numTriangles += len - 2;
 }
 
+void NiTriStripsData::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	NiTriBasedGeomData::notifyVerticesReorder(vertMap);
+
+	for (auto& strip : stripsInfo.points)
+		for (uint16_t& p : strip)
+			if (p < vertMap.size())
+				p = static_cast<uint16_t>(vertMap[p]);
+}
+
 uint32_t NiTriStripsData::GetNumTriangles() const {
 	return static_cast<uint32_t>(StripsToTris().size());
 }
@@ -2359,8 +2980,25 @@ bool NiTriStripsData::GetTriangles(std::vector<Triangle>& tris) const {
 	return stripsInfo.hasPoints;
 }
 
-void NiTriStripsData::SetTriangles(const std::vector<Triangle>& /*tris*/) {
-	// Not implemented, stripify here
+void NiTriStripsData::SetTriangles(const std::vector<Triangle>& tris) {
+	// The degenerate triangles joining strips count too and can go over the limit
+	if (!SetStrips(GenerateStripsFromTriangles(tris, true)))
+		SetStrips(GenerateStripsFromTriangles(tris));
+}
+
+bool NiTriStripsData::SetStrips(const std::vector<std::vector<uint16_t>>& strips) {
+	uint16_t numStripTriangles = 0;
+	if (!CountStripTriangles(strips, numStripTriangles))
+		return false;
+
+	stripsInfo.hasPoints = true;
+	stripsInfo.points = strips;
+	stripsInfo.stripLengths.resize(static_cast<uint16_t>(strips.size()));
+	for (uint16_t i = 0; i < stripsInfo.stripLengths.size(); i++)
+		stripsInfo.stripLengths[i] = static_cast<uint16_t>(strips[i].size());
+
+	numTriangles = numStripTriangles;
+	return true;
 }
 
 std::vector<Triangle> NiTriStripsData::StripsToTris() const {
@@ -2377,91 +3015,23 @@ void NiTriStripsData::RecalcNormals(const bool smooth,
 
 	std::vector<Triangle> tris = StripsToTris();
 
-	CalculateNormals(vertices, tris, normals, smooth, smoothThresh, lockedIndices);
+	CalculateNormals(vertices, tris, normals.Detach(), smooth, smoothThresh, lockedIndices);
 }
 
-void NiTriStripsData::CalcTangentSpace() {
+void NiTriStripsData::CalcTangentSpace(const bool parallel) {
 	if (!HasNormals() || !HasUVs())
 		return;
 
-	NiTriBasedGeomData::CalcTangentSpace();
-
-	std::vector<Vector3> tan1;
-	std::vector<Vector3> tan2;
-	tan1.resize(numVertices);
-	tan2.resize(numVertices);
+	NiTriBasedGeomData::CalcTangentSpace(parallel);
 
 	std::vector<Triangle> tris = StripsToTris();
-
-	for (auto& tri : tris) {
-		int i1 = tri.p1;
-		int i2 = tri.p2;
-		int i3 = tri.p3;
-
-		if (i1 >= numVertices || i2 >= numVertices || i3 >= numVertices)
-			continue;
-
-		Vector3 v1 = vertices[i1];
-		Vector3 v2 = vertices[i2];
-		Vector3 v3 = vertices[i3];
-
-		Vector2 w1 = uvSets[0][i1];
-		Vector2 w2 = uvSets[0][i2];
-		Vector2 w3 = uvSets[0][i3];
-
-		float x1 = v2.x - v1.x;
-		float x2 = v3.x - v1.x;
-		float y1 = v2.y - v1.y;
-		float y2 = v3.y - v1.y;
-		float z1 = v2.z - v1.z;
-		float z2 = v3.z - v1.z;
-
-		float s1 = w2.u - w1.u;
-		float s2 = w3.u - w1.u;
-		float t1 = w2.v - w1.v;
-		float t2 = w3.v - w1.v;
-
-		float r = (s1 * t2 - s2 * t1);
-		r = (r >= 0.0f ? +1.0f : -1.0f);
-
-		Vector3 sdir = Vector3((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
-		Vector3 tdir = Vector3((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
-
-		sdir.Normalize();
-		tdir.Normalize();
-
-		tan1[i1] += sdir;
-		tan1[i2] += sdir;
-		tan1[i3] += sdir;
-
-		tan2[i1] += tdir;
-		tan2[i2] += tdir;
-		tan2[i3] += tdir;
-	}
-
-	for (uint16_t i = 0; i < numVertices; i++) {
-		bitangents[i] = tan1[i];
-		tangents[i] = tan2[i];
-
-		if (tangents[i].IsZero() || bitangents[i].IsZero()) {
-			tangents[i].x = normals[i].y;
-			tangents[i].y = normals[i].z;
-			tangents[i].z = normals[i].x;
-			bitangents[i] = normals[i].cross(tangents[i]);
-		}
-		else {
-			tangents[i].Normalize();
-			tangents[i] = (tangents[i] - normals[i] * normals[i].dot(tangents[i]));
-			tangents[i].Normalize();
-
-			bitangents[i].Normalize();
-
-			bitangents[i] = (bitangents[i] - normals[i] * normals[i].dot(bitangents[i]));
-			bitangents[i] = (bitangents[i] - tangents[i] * tangents[i].dot(bitangents[i]));
-
-			bitangents[i].Normalize();
-		}
-	}
+	CalculateTangents(vertices,
+					  uvSets.Get()[0],
+					  normals,
+					  tris,
+					  tangents.Detach(),
+					  bitangents.Detach(),
+					  parallel);
 }
 
 
@@ -2482,12 +3052,18 @@ void NiLinesData::Sync(NiStreamReversible& stream) {
 		lineFlags[i].Sync(stream);
 }
 
-void NiLinesData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void NiLinesData::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	NiGeometryData::notifyVerticesDelete(vertIndices);
 
 	EraseVectorIndices(lineFlags, vertIndices);
 }
 
+void NiLinesData::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	NiGeometryData::notifyVerticesReorder(vertMap);
+
+	ApplyIndexMapToVector(lineFlags, vertMap);
+}
+
 
 NiGeometryData* NiLines::GetGeomData() const {
 	return linesData;
@@ -2518,7 +3094,7 @@ void NiScreenElementsData::Sync(NiStreamReversible& stream) {
 	stream.Sync(indicesGrowBy);
 }
 
-void NiScreenElementsData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void NiScreenElementsData::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	NiTriShapeData::notifyVerticesDelete(vertIndices);
 
 	// Clearing as workaround
@@ -2530,6 +3106,18 @@ void NiScreenElementsData::notifyVerticesDelete(const std::vector<uint16_t>& ver
 	maxIndices = 0;
 }
 
+void NiScreenElementsData::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	NiTriShapeData::notifyVerticesReorder(vertMap);
+
+	// Polygons are vertex ranges, clearing as workaround
+	maxPolygons = 0;
+	polygons.clear();
+	polygonIndices.clear();
+	numPolygons = 0;
+	maxVertices = 0;
+	maxIndices = 0;
+}
+
 
 NiGeometryData* NiScreenElements::GetGeomData() const {
 	return elemData;
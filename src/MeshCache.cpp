@@ -0,0 +1,125 @@
+/*
+nifly
+C++ NIF library for the Gamebryo/NetImmerse File Format
+See the included GPLv3 LICENSE file
+*/
+
+#include "MeshCache.hpp"
+
+namespace nifly {
+
+ExternalMeshCache& ExternalMeshCache::Global() {
+	static ExternalMeshCache cache;
+	return cache;
+}
+
+ExternalMeshCache::DataPtr ExternalMeshCache::Find(const std::string& key) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = index.find(key);
+	if (it == index.end()) {
+		misses++;
+		return nullptr;
+	}
+
+	hits++;
+	entries.splice(entries.begin(), entries, it->second);
+	return it->second->data;
+}
+
+ExternalMeshCache::DataPtr ExternalMeshCache::Insert(const std::string& key, DataPtr data) {
+	if (!data)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = index.find(key);
+	if (it != index.end()) {
+		entries.splice(entries.begin(), entries, it->second);
+		return it->second->data;
+	}
+
+	Entry entry;
+	entry.key = key;
+	entry.size = sizeof(BSGeometryMeshData) + data->GetHeapUsage();
+	entry.data = std::move(data);
+
+	size += entry.size;
+	entries.push_front(std::move(entry));
+	index[key] = entries.begin();
+
+	auto result = entries.front().data;
+	Trim();
+	return result;
+}
+
+ExternalMeshCache::DataPtr ExternalMeshCache::FindOrLoad(const std::string& key, const Loader& loader) {
+	if (auto data = Find(key))
+		return data;
+
+	auto data = loader();
+	if (!data)
+		return nullptr;
+
+	return Insert(key, std::move(data));
+}
+
+void ExternalMeshCache::Remove(const std::string& key) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = index.find(key);
+	if (it == index.end())
+		return;
+
+	size -= it->second->size;
+	entries.erase(it->second);
+	index.erase(it);
+}
+
+void ExternalMeshCache::Clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+	index.clear();
+	size = 0;
+}
+
+void ExternalMeshCache::SetCapacity(const size_t capacityBytes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	capacity = capacityBytes;
+	Trim();
+}
+
+size_t ExternalMeshCache::GetCapacity() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return capacity;
+}
+
+size_t ExternalMeshCache::GetSize() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return size;
+}
+
+size_t ExternalMeshCache::GetCount() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.size();
+}
+
+uint64_t ExternalMeshCache::GetHits() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return hits;
+}
+
+uint64_t ExternalMeshCache::GetMisses() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return misses;
+}
+
+void ExternalMeshCache::Trim() {
+	while (size > capacity && entries.size() > 1) {
+		auto& entry = entries.back();
+		size -= entry.size;
+		index.erase(entry.key);
+		entries.pop_back();
+	}
+}
+} // namespace nifly
@@ -0,0 +1,566 @@
+/*
+nifly
+C++ NIF library for the Gamebryo/NetImmerse File Format
+See the included GPLv3 LICENSE file
+*/
+
+#include "MeshSimplify.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace nifly {
+
+namespace {
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes
+struct Quadric {
+	double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+	double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+	double c = 0.0;
+	double weight = 0.0;
+
+	void AddPlane(const Vector3& n, const float d, const double w) {
+		a00 += w * n.x * n.x;
+		a01 += w * n.x * n.y;
+		a02 += w * n.x * n.z;
+		a11 += w * n.y * n.y;
+		a12 += w * n.y * n.z;
+		a22 += w * n.z * n.z;
+		b0 += w * n.x * d;
+		b1 += w * n.y * d;
+		b2 += w * n.z * d;
+		c += w * d * d;
+		weight += w;
+	}
+
+	Quadric& operator+=(const Quadric& other) {
+		a00 += other.a00;
+		a01 += other.a01;
+		a02 += other.a02;
+		a11 += other.a11;
+		a12 += other.a12;
+		a22 += other.a22;
+		b0 += other.b0;
+		b1 += other.b1;
+		b2 += other.b2;
+		c += other.c;
+		weight += other.weight;
+		return *this;
+	}
+
+	// Weighted average of the squared distances of p to the planes
+	double Error(const Vector3& p) const {
+		if (weight <= 0.0)
+			return 0.0;
+
+		const double x = p.x, y = p.y, z = p.z;
+		const double e = a00 * x * x + a11 * y * y + a22 * z * z
+						 + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+						 + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+		return std::max(e, 0.0) / weight;
+	}
+};
+
+struct Collapse {
+	uint32_t from = 0;
+	uint32_t to = 0;
+	float cost = 0.0f;
+};
+
+// Border and seam edges are planes perpendicular to their triangle, weighted strongly to keep the outline
+constexpr float borderWeight = 10.0f;
+
+struct PositionHash {
+	std::size_t operator()(const Vector3& v) const {
+		// Adding zero turns -0 into +0, which compare equal
+		const float coords[3] = {v.x + 0.0f, v.y + 0.0f, v.z + 0.0f};
+		uint32_t bits[3];
+		std::memcpy(bits, coords, sizeof(bits));
+		return (static_cast<size_t>(bits[0]) * 73856093u) ^ (static_cast<size_t>(bits[1]) * 19349663u)
+			   ^ (static_cast<size_t>(bits[2]) * 83492791u);
+	}
+};
+
+uint64_t EdgeKey(uint32_t a, uint32_t b) {
+	if (a > b)
+		std::swap(a, b);
+
+	return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+// Edges between positions of the current triangles
+struct PositionEdges {
+	struct Info {
+		uint32_t count = 0;
+		// A UV or normal seam: two triangles at this position edge that don't share its vertices
+		bool seam = false;
+	};
+
+	std::unordered_map<uint64_t, Info> edges;
+	std::vector<uint8_t> borderCounts;
+	std::vector<uint8_t> seamCounts;
+	std::vector<bool> locked;
+
+	// The triangle counts of the vertex edges are taken from the topology if given
+	void Build(const std::vector<Triangle>& tris,
+			   const std::vector<uint32_t>& posGroup,
+			   const uint32_t numGroups,
+			   const MeshTopology* topology = nullptr) {
+		edges.clear();
+		edges.reserve(tris.size() * 3);
+		std::unordered_map<uint64_t, uint32_t> vertEdgeCounts;
+		if (!topology)
+			vertEdgeCounts.reserve(tris.size() * 3);
+
+		for (const Triangle& t : tris) {
+			for (int i = 0; i < 3; i++) {
+				const uint16_t a = t[i];
+				const uint16_t b = t[(i + 1) % 3];
+				edges[EdgeKey(posGroup[a], posGroup[b])].count++;
+				if (!topology)
+					vertEdgeCounts[EdgeKey(a, b)]++;
+			}
+		}
+
+		auto vertEdgeCount = [&](const uint16_t a, const uint16_t b) {
+			if (topology)
+				return static_cast<uint32_t>(topology->GetEdgeTriangles(topology->FindEdge(a, b)).size());
+
+			return vertEdgeCounts[EdgeKey(a, b)];
+		};
+
+		for (const Triangle& t : tris) {
+			for (int i = 0; i < 3; i++) {
+				const uint16_t a = t[i];
+				const uint16_t b = t[(i + 1) % 3];
+				Info& info = edges[EdgeKey(posGroup[a], posGroup[b])];
+				if (info.count == 2 && vertEdgeCount(a, b) == 1)
+					info.seam = true;
+			}
+		}
+
+		borderCounts.assign(numGroups, 0);
+		seamCounts.assign(numGroups, 0);
+		locked.assign(numGroups, false);
+
+		auto increment = [](uint8_t& count) { count = static_cast<uint8_t>(std::min(count + 1, 255)); };
+		for (auto& [key, info] : edges) {
+			const auto a = static_cast<uint32_t>(key >> 32);
+			const auto b = static_cast<uint32_t>(key & 0xFFFFFFFF);
+			if (info.count > 2) {
+				// Non-manifold edge
+				locked[a] = true;
+				locked[b] = true;
+			}
+			else if (info.count == 1) {
+				increment(borderCounts[a]);
+				increment(borderCounts[b]);
+			}
+			else if (info.seam) {
+				increment(seamCounts[a]);
+				increment(seamCounts[b]);
+			}
+		}
+
+		// More than two border or seam edges at a position means the border touches itself or seams meet.
+		// Seams ending at a border stay in place as well.
+		for (uint32_t g = 0; g < numGroups; g++)
+			if (borderCounts[g] > 2 || seamCounts[g] > 2 || (borderCounts[g] > 0 && seamCounts[g] > 0))
+				locked[g] = true;
+	}
+
+	const Info* Find(const uint32_t a, const uint32_t b) const {
+		auto it = edges.find(EdgeKey(a, b));
+		return it != edges.end() ? &it->second : nullptr;
+	}
+};
+} // namespace
+
+void SimplifyAttributes::SetSparse(std::vector<std::vector<SparseValue>> vertValues, const float weight) {
+	sparseStart.assign(1, 0);
+	sparseValues.clear();
+	for (auto& values : vertValues) {
+		std::sort(values.begin(), values.end(), [](const SparseValue& l, const SparseValue& r) {
+			return l.id < r.id;
+		});
+
+		sparseValues.insert(sparseValues.end(), values.begin(), values.end());
+		sparseStart.push_back(static_cast<uint32_t>(sparseValues.size()));
+	}
+
+	sparseWeight = weight;
+}
+
+std::vector<Triangle> SimplifyTriangles(const std::vector<Vector3>& verts,
+										const std::vector<Triangle>& tris,
+										const uint32_t targetCount,
+										const float maxError,
+										const SimplifyAttributes* attributes,
+										float* outError,
+										const MeshTopology* topology) {
+	const auto numVerts = static_cast<uint32_t>(verts.size());
+
+	std::vector<Triangle> result;
+	result.reserve(tris.size());
+	for (const Triangle& t : tris)
+		if (t.p1 < numVerts && t.p2 < numVerts && t.p3 < numVerts)
+			result.push_back(t);
+
+	if (outError)
+		*outError = 0.0f;
+
+	if (result.size() <= targetCount)
+		return result;
+
+	// Positions scaled to a unit box, so that errors are relative to the mesh size
+	Vector3 mn(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vector3 mx(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const Vector3& v : verts) {
+		mn.x = std::min(mn.x, v.x);
+		mn.y = std::min(mn.y, v.y);
+		mn.z = std::min(mn.z, v.z);
+		mx.x = std::max(mx.x, v.x);
+		mx.y = std::max(mx.y, v.y);
+		mx.z = std::max(mx.z, v.z);
+	}
+
+	const float extent = std::max({mx.x - mn.x, mx.y - mn.y, mx.z - mn.z, FLT_EPSILON});
+	std::vector<Vector3> pos(numVerts);
+	for (uint32_t v = 0; v < numVerts; v++)
+		pos[v] = (verts[v] - mn) / extent;
+
+	// Vertices sharing a position form a group that collapses as a whole
+	std::vector<uint32_t> posGroup(numVerts);
+	std::vector<Vector3> groupPos;
+	{
+		std::unordered_map<Vector3, uint32_t, PositionHash> groupAtPos;
+		groupAtPos.reserve(numVerts);
+		for (uint32_t v = 0; v < numVerts; v++) {
+			auto [it, inserted] = groupAtPos.emplace(verts[v], static_cast<uint32_t>(groupPos.size()));
+			if (inserted)
+				groupPos.push_back(pos[v]);
+
+			posGroup[v] = it->second;
+		}
+	}
+
+	const auto numGroups = static_cast<uint32_t>(groupPos.size());
+
+	// Attribute values per vertex, premultiplied with the square root of their weight
+	uint32_t attrCount = 0;
+	std::vector<float> attrs;
+	const SimplifyAttributes::SparseValue* sparseValues = nullptr;
+	const uint32_t* sparseStart = nullptr;
+	double sparseWeight = 0.0;
+	if (attributes) {
+		std::vector<uint32_t> usedColumns;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(attributes->columns.size()); i++)
+			if (attributes->columns[i].size() == numVerts && i < attributes->weights.size()
+				&& attributes->weights[i] > 0.0f)
+				usedColumns.push_back(i);
+
+		attrCount = static_cast<uint32_t>(usedColumns.size());
+		attrs.resize(static_cast<size_t>(numVerts) * attrCount);
+		for (uint32_t k = 0; k < attrCount; k++) {
+			const auto& column = attributes->columns[usedColumns[k]];
+			const float scale = std::sqrt(attributes->weights[usedColumns[k]]);
+			for (uint32_t v = 0; v < numVerts; v++)
+				attrs[static_cast<size_t>(v) * attrCount + k] = column[v] * scale;
+		}
+
+		if (attributes->sparseWeight > 0.0f && attributes->sparseStart.size() == numVerts + size_t(1)
+			&& attributes->sparseStart.back() == attributes->sparseValues.size()) {
+			sparseValues = attributes->sparseValues.data();
+			sparseStart = attributes->sparseStart.data();
+			sparseWeight = static_cast<double>(attributes->sparseWeight);
+		}
+	}
+
+	auto attributeCost = [&](const uint32_t a, const uint32_t b) {
+		double cost = 0.0;
+		const float* fa = attrs.data() + static_cast<size_t>(a) * attrCount;
+		const float* fb = attrs.data() + static_cast<size_t>(b) * attrCount;
+		for (uint32_t k = 0; k < attrCount; k++)
+			cost += static_cast<double>((fa[k] - fb[k]) * (fa[k] - fb[k]));
+
+		if (sparseValues) {
+			// Merge the id sorted values of both vertices
+			double sparseCost = 0.0;
+			uint32_t i = sparseStart[a];
+			uint32_t j = sparseStart[b];
+			const uint32_t endA = sparseStart[a + 1];
+			const uint32_t endB = sparseStart[b + 1];
+			while (i < endA || j < endB) {
+				float diff = 0.0f;
+				if (j >= endB || (i < endA && sparseValues[i].id < sparseValues[j].id))
+					diff = sparseValues[i++].value;
+				else if (i >= endA || sparseValues[j].id < sparseValues[i].id)
+					diff = sparseValues[j++].value;
+				else
+					diff = sparseValues[i++].value - sparseValues[j++].value;
+
+				sparseCost += static_cast<double>(diff * diff);
+			}
+
+			cost += sparseCost * sparseWeight;
+		}
+
+		return cost;
+	};
+
+	// The topology is only used if it was built from these triangles
+	if (topology && (topology->GetNumVertices() != numVerts || topology->GetNumTriangles() != tris.size()))
+		topology = nullptr;
+
+	PositionEdges posEdges;
+	posEdges.Build(result, posGroup, numGroups, topology);
+
+	std::vector<Quadric> quadrics(numGroups);
+	for (const Triangle& t : result) {
+		Vector3 n = (pos[t.p2] - pos[t.p1]).cross(pos[t.p3] - pos[t.p1]);
+		const float area = n.length() * 0.5f;
+		if (area <= 0.0f)
+			continue;
+
+		n /= area * 2.0f;
+		const float d = -n.dot(pos[t.p1]);
+		for (int i = 0; i < 3; i++)
+			quadrics[posGroup[t[i]]].AddPlane(n, d, area);
+
+		// Border and seam edges keep their line
+		for (int i = 0; i < 3; i++) {
+			const uint32_t a = posGroup[t[i]];
+			const uint32_t b = posGroup[t[(i + 1) % 3]];
+			const PositionEdges::Info* info = posEdges.Find(a, b);
+			if (info->count != 1 && !info->seam)
+				continue;
+
+			const Vector3 edge = groupPos[b] - groupPos[a];
+			Vector3 edgeNormal = edge.cross(n);
+			edgeNormal.Normalize();
+			const float edgeD = -edgeNormal.dot(groupPos[a]);
+			const double w = static_cast<double>(edge.length2()) * borderWeight;
+			quadrics[a].AddPlane(edgeNormal, edgeD, w);
+			quadrics[b].AddPlane(edgeNormal, edgeD, w);
+		}
+	}
+
+	auto canCollapse = [&](const uint32_t from, const uint32_t to) {
+		if (posEdges.locked[from] || from == to)
+			return false;
+
+		// Border and seam vertices only move along their border or seam
+		const PositionEdges::Info* info = posEdges.Find(from, to);
+		if (posEdges.borderCounts[from] > 0 && info->count != 1)
+			return false;
+
+		return posEdges.seamCounts[from] == 0 || info->seam;
+	};
+
+	const double maxCost = static_cast<double>(maxError) * static_cast<double>(maxError);
+	float resultCost = 0.0f;
+
+	std::vector<uint32_t> groupTriStart;
+	std::vector<uint32_t> groupTris;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> targets;
+	std::vector<std::pair<uint16_t, uint16_t>> vertMap;
+	std::vector<bool> touched;
+	std::vector<bool> removed;
+
+	auto forEachGroupTri = [&](const uint32_t group, auto&& func) {
+		for (uint32_t i = groupTriStart[group]; i < groupTriStart[group + 1]; i++)
+			func(groupTris[i]);
+	};
+
+	auto containsGroup = [&](const Triangle& t, const uint32_t group) {
+		return posGroup[t.p1] == group || posGroup[t.p2] == group || posGroup[t.p3] == group;
+	};
+
+	// Maps each vertex of the "from" group to the single vertex of the "to" group that it shares a
+	// triangle with, so that both sides of a seam stay apart. Fails if a vertex has none or several.
+	auto mapVertices = [&](const uint32_t from, const uint32_t to) {
+		vertMap.clear();
+		bool valid = true;
+		forEachGroupTri(from, [&](const uint32_t ti) {
+			const Triangle& t = result[ti];
+			for (int i = 0; i < 3 && valid; i++) {
+				if (posGroup[t[i]] != from)
+					continue;
+
+				for (int j = 0; j < 3 && valid; j++) {
+					if (posGroup[t[j]] != to)
+						continue;
+
+					const uint16_t v = t[i];
+					auto it = std::find_if(vertMap.begin(), vertMap.end(), [v](const auto& m) {
+						return m.first == v;
+					});
+					if (it == vertMap.end())
+						vertMap.emplace_back(v, t[j]);
+					else if (it->second != t[j])
+						valid = false;
+				}
+			}
+		});
+
+		if (!valid || vertMap.empty())
+			return false;
+
+		forEachGroupTri(from, [&](const uint32_t ti) {
+			const Triangle& t = result[ti];
+			for (int i = 0; i < 3; i++)
+				if (posGroup[t[i]] == from
+					&& std::none_of(vertMap.begin(), vertMap.end(), [&](auto& m) { return m.first == t[i]; }))
+					valid = false;
+		});
+
+		return valid;
+	};
+
+	auto mappedVertex = [&](const uint16_t v) {
+		for (auto& m : vertMap)
+			if (m.first == v)
+				return m.second;
+		return v;
+	};
+
+	while (result.size() > targetCount) {
+		const auto numTris = static_cast<uint32_t>(result.size());
+
+		// Triangles at each position, listed once per group
+		groupTriStart.assign(numGroups + 1, 0);
+		auto forEachDistinctGroup = [&](const Triangle& t, auto&& func) {
+			const uint32_t g1 = posGroup[t.p1];
+			const uint32_t g2 = posGroup[t.p2];
+			const uint32_t g3 = posGroup[t.p3];
+			func(g1);
+			if (g2 != g1)
+				func(g2);
+			if (g3 != g1 && g3 != g2)
+				func(g3);
+		};
+
+		for (const Triangle& t : result)
+			forEachDistinctGroup(t, [&](const uint32_t g) { groupTriStart[g + 1]++; });
+
+		for (uint32_t g = 0; g < numGroups; g++)
+			groupTriStart[g + 1] += groupTriStart[g];
+
+		groupTris.resize(groupTriStart[numGroups]);
+		std::vector<uint32_t> fill(groupTriStart.begin(), groupTriStart.end() - 1);
+		for (uint32_t i = 0; i < numTris; i++)
+			forEachDistinctGroup(result[i], [&](const uint32_t g) { groupTris[fill[g]++] = i; });
+
+		collapses.clear();
+		for (uint32_t from = 0; from < numGroups; from++) {
+			targets.clear();
+			forEachGroupTri(from, [&](const uint32_t ti) {
+				for (int i = 0; i < 3; i++) {
+					const uint32_t to = posGroup[result[ti][i]];
+					if (std::find(targets.begin(), targets.end(), to) == targets.end())
+						targets.push_back(to);
+				}
+			});
+
+			for (const uint32_t to : targets) {
+				if (!canCollapse(from, to) || !mapVertices(from, to))
+					continue;
+
+				double cost = quadrics[from].Error(groupPos[to]);
+				for (auto& m : vertMap)
+					cost += attributeCost(m.first, m.second);
+
+				collapses.push_back({from, to, static_cast<float>(cost)});
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) {
+			if (l.cost != r.cost)
+				return l.cost < r.cost;
+			return l.from < r.from || (l.from == r.from && l.to < r.to);
+		});
+
+		// Collapses of one pass are independent: a position next to a collapsed one waits for the next pass
+		touched.assign(numGroups, false);
+		removed.assign(numTris, false);
+		uint32_t triCount = numTris;
+		bool collapsed = false;
+
+		for (const Collapse& col : collapses) {
+			if (triCount <= targetCount || static_cast<double>(col.cost) > maxCost)
+				break;
+
+			if (touched[col.from])
+				continue;
+
+			mapVertices(col.from, col.to);
+
+			// Reject collapses that flip or strongly rotate the remaining triangles
+			bool flips = false;
+			uint32_t removedCount = 0;
+			forEachGroupTri(col.from, [&](const uint32_t ti) {
+				const Triangle& t = result[ti];
+				if (flips)
+					return;
+
+				if (containsGroup(t, col.to)) {
+					removedCount++;
+					return;
+				}
+
+				auto corner = [&](const uint16_t v, const bool moved) {
+					return posGroup[v] == col.from && moved ? groupPos[col.to] : pos[v];
+				};
+
+				const Vector3 oldNormal = (corner(t.p2, false) - corner(t.p1, false))
+											  .cross(corner(t.p3, false) - corner(t.p1, false));
+				const Vector3 newNormal = (corner(t.p2, true) - corner(t.p1, true))
+											  .cross(corner(t.p3, true) - corner(t.p1, true));
+				if (oldNormal.dot(newNormal) < 0.25f * oldNormal.length() * newNormal.length())
+					flips = true;
+			});
+
+			if (flips || removedCount == 0)
+				continue;
+
+			forEachGroupTri(col.from, [&](const uint32_t ti) {
+				Triangle& t = result[ti];
+				for (int i = 0; i < 3; i++)
+					touched[posGroup[t[i]]] = true;
+
+				if (containsGroup(t, col.to)) {
+					removed[ti] = true;
+					return;
+				}
+
+				t.set(mappedVertex(t.p1), mappedVertex(t.p2), mappedVertex(t.p3));
+			});
+
+			quadrics[col.to] += quadrics[col.from];
+			triCount -= removedCount;
+			resultCost = std::max(resultCost, col.cost);
+			collapsed = true;
+		}
+
+		if (!collapsed)
+			break;
+
+		size_t di = 0;
+		for (uint32_t i = 0; i < numTris; i++)
+			if (!removed[i])
+				result[di++] = result[i];
+
+		result.resize(di);
+		posEdges.Build(result, posGroup, numGroups);
+	}
+
+	if (outError)
+		*outError = std::sqrt(resultCost);
+
+	return result;
+}
+
+} // namespace nifly
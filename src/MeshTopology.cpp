@@ -0,0 +1,246 @@
+/*
+nifly
+C++ NIF library for the Gamebryo/NetImmerse File Format
+See the included GPLv3 LICENSE file
+*/
+
+#include "MeshTopology.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace nifly {
+
+namespace {
+// Edge of a triangle, stored with its lower vertex
+struct HalfEdge {
+	uint16_t p2 = 0;
+	uint8_t corner = 0;
+	uint32_t tri = 0;
+};
+
+// Turns counts at [v + 1] into start offsets
+void CountsToOffsets(std::vector<uint32_t>& start) {
+	for (size_t i = 1; i < start.size(); i++)
+		start[i] += start[i - 1];
+}
+
+uint32_t FindRoot(std::vector<uint32_t>& parent, uint32_t v) {
+	while (parent[v] != v) {
+		parent[v] = parent[parent[v]];
+		v = parent[v];
+	}
+	return v;
+}
+} // namespace
+
+MeshTopology::MeshTopology(const size_t numVertices, Span<const Triangle> tris) {
+	const uint32_t numTris = static_cast<uint32_t>(tris.size());
+
+	auto isValidTri = [numVertices](const Triangle& t) {
+		return t.p1 < numVertices && t.p2 < numVertices && t.p3 < numVertices;
+	};
+
+	// Vertex to triangles, with each triangle listed once per distinct vertex
+	auto forEachDistinctVertex = [](const Triangle& t, auto&& func) {
+		func(t.p1);
+		if (t.p2 != t.p1)
+			func(t.p2);
+		if (t.p3 != t.p1 && t.p3 != t.p2)
+			func(t.p3);
+	};
+
+	vertTriStart.assign(numVertices + 1, 0);
+	for (const Triangle& t : tris)
+		if (isValidTri(t))
+			forEachDistinctVertex(t, [&](const uint16_t v) { vertTriStart[v + 1u]++; });
+
+	CountsToOffsets(vertTriStart);
+
+	vertTris.resize(vertTriStart.back());
+	std::vector<uint32_t> fill(vertTriStart.begin(), vertTriStart.end() - 1);
+	for (uint32_t i = 0; i < numTris; i++)
+		if (isValidTri(tris[i]))
+			forEachDistinctVertex(tris[i], [&](const uint16_t v) { vertTris[fill[v]++] = i; });
+
+	// Triangle edges grouped by their lower vertex, in ascending triangle order
+	std::vector<uint32_t> halfStart(numVertices + 1, 0);
+	auto forEachEdge = [](const Triangle& t, auto&& func) {
+		for (uint8_t c = 0; c < 3; c++) {
+			const uint16_t a = t[c];
+			const uint16_t b = t[(c + 1) % 3];
+			if (a != b)
+				func(std::min(a, b), std::max(a, b), c);
+		}
+	};
+
+	for (const Triangle& t : tris)
+		if (isValidTri(t))
+			forEachEdge(t, [&](const uint16_t a, const uint16_t, const uint8_t) { halfStart[a + 1u]++; });
+
+	CountsToOffsets(halfStart);
+
+	std::vector<HalfEdge> halfEdges(halfStart.back());
+	fill.assign(halfStart.begin(), halfStart.end() - 1);
+	for (uint32_t i = 0; i < numTris; i++) {
+		if (!isValidTri(tris[i]))
+			continue;
+
+		forEachEdge(tris[i], [&](const uint16_t a, const uint16_t b, const uint8_t c) {
+			HalfEdge& he = halfEdges[fill[a]++];
+			he.p2 = b;
+			he.corner = c;
+			he.tri = i;
+		});
+	}
+
+	// Unique edges and their triangles
+	triEdges.assign(numTris, {npos, npos, npos});
+	edgeStart.assign(numVertices + 1, 0);
+	edgeTriStart.assign(1, 0);
+	edges.reserve(halfEdges.size() / 2);
+	edgeTris.reserve(halfEdges.size());
+
+	for (size_t v = 0; v < numVertices; v++) {
+		edgeStart[v] = static_cast<uint32_t>(edges.size());
+
+		auto begin = halfEdges.begin() + halfStart[v];
+		auto end = halfEdges.begin() + halfStart[v + 1];
+		std::sort(begin, end, [](const HalfEdge& l, const HalfEdge& r) {
+			return l.p2 != r.p2 ? l.p2 < r.p2 : l.tri < r.tri;
+		});
+
+		for (auto it = begin; it != end; ++it) {
+			if (edges.empty() || edges.back().p1 != v || edges.back().p2 != it->p2) {
+				edges.emplace_back(static_cast<uint16_t>(v), it->p2);
+				edgeTriStart.push_back(edgeTriStart.back());
+			}
+
+			const uint32_t e = static_cast<uint32_t>(edges.size() - 1);
+			triEdges[it->tri][it->corner] = e;
+
+			// A degenerate triangle can use the same edge twice
+			if (edgeTris.size() == edgeTriStart[e] || edgeTris.back() != it->tri) {
+				edgeTris.push_back(it->tri);
+				edgeTriStart.back()++;
+			}
+		}
+	}
+	edgeStart[numVertices] = static_cast<uint32_t>(edges.size());
+
+	// Vertex to edges
+	vertEdgeStart.assign(numVertices + 1, 0);
+	for (const Edge& e : edges) {
+		vertEdgeStart[e.p1 + 1u]++;
+		vertEdgeStart[e.p2 + 1u]++;
+	}
+
+	CountsToOffsets(vertEdgeStart);
+
+	vertEdges.resize(vertEdgeStart.back());
+	fill.assign(vertEdgeStart.begin(), vertEdgeStart.end() - 1);
+	for (uint32_t e = 0; e < static_cast<uint32_t>(edges.size()); e++) {
+		vertEdges[fill[edges[e].p1]++] = e;
+		vertEdges[fill[edges[e].p2]++] = e;
+	}
+
+	// Boundary and non-manifold edges
+	boundaryVerts.assign(numVertices, false);
+	for (uint32_t e = 0; e < static_cast<uint32_t>(edges.size()); e++) {
+		const uint32_t count = edgeTriStart[e + 1] - edgeTriStart[e];
+		if (count == 1) {
+			boundaryEdges.push_back(e);
+			boundaryVerts[edges[e].p1] = true;
+			boundaryVerts[edges[e].p2] = true;
+		}
+		else if (count > 2)
+			nonManifoldEdges.push_back(e);
+	}
+
+	// Connected components by union-find over the vertices
+	std::vector<uint32_t> parent(numVertices);
+	std::iota(parent.begin(), parent.end(), 0);
+	for (const Triangle& t : tris) {
+		if (!isValidTri(t))
+			continue;
+
+		const uint32_t r1 = FindRoot(parent, t.p1);
+		const uint32_t r2 = FindRoot(parent, t.p2);
+		const uint32_t r3 = FindRoot(parent, t.p3);
+		parent[r2] = r1;
+		parent[r3] = r1;
+	}
+
+	triComps.assign(numTris, npos);
+	std::vector<uint32_t> rootComps(numVertices, npos);
+	compTriStart.assign(1, 0);
+	for (uint32_t i = 0; i < numTris; i++) {
+		if (!isValidTri(tris[i]))
+			continue;
+
+		uint32_t& comp = rootComps[FindRoot(parent, tris[i].p1)];
+		if (comp == npos) {
+			comp = static_cast<uint32_t>(compTriStart.size() - 1);
+			compTriStart.push_back(0);
+		}
+
+		triComps[i] = comp;
+		compTriStart[comp + 1]++;
+	}
+
+	CountsToOffsets(compTriStart);
+
+	compTris.resize(compTriStart.back());
+	fill.assign(compTriStart.begin(), compTriStart.end() - 1);
+	for (uint32_t i = 0; i < numTris; i++)
+		if (triComps[i] != npos)
+			compTris[fill[triComps[i]]++] = i;
+}
+
+Span<const uint32_t> MeshTopology::GetVertexTriangles(const uint32_t vertex) const {
+	if (vertex >= GetNumVertices())
+		return {};
+
+	return Span<const uint32_t>(vertTris.data() + vertTriStart[vertex],
+								vertTriStart[vertex + 1] - vertTriStart[vertex]);
+}
+
+Span<const uint32_t> MeshTopology::GetVertexEdges(const uint32_t vertex) const {
+	if (vertex >= GetNumVertices())
+		return {};
+
+	return Span<const uint32_t>(vertEdges.data() + vertEdgeStart[vertex],
+								vertEdgeStart[vertex + 1] - vertEdgeStart[vertex]);
+}
+
+Span<const uint32_t> MeshTopology::GetEdgeTriangles(const uint32_t edge) const {
+	if (edge >= GetNumEdges())
+		return {};
+
+	return Span<const uint32_t>(edgeTris.data() + edgeTriStart[edge],
+								edgeTriStart[edge + 1] - edgeTriStart[edge]);
+}
+
+Span<const uint32_t> MeshTopology::GetComponentTriangles(const uint32_t component) const {
+	if (component >= GetNumComponents())
+		return {};
+
+	return Span<const uint32_t>(compTris.data() + compTriStart[component],
+								compTriStart[component + 1] - compTriStart[component]);
+}
+
+uint32_t MeshTopology::FindEdge(const uint16_t p1, const uint16_t p2) const {
+	const uint16_t a = std::min(p1, p2);
+	const uint16_t b = std::max(p1, p2);
+	if (a == b || b >= GetNumVertices())
+		return npos;
+
+	auto begin = edges.begin() + edgeStart[a];
+	auto end = edges.begin() + edgeStart[a + 1u];
+	auto it = std::lower_bound(begin, end, b, [](const Edge& e, const uint16_t p) { return e.p2 < p; });
+	if (it == end || it->p2 != b)
+		return npos;
+
+	return static_cast<uint32_t>(it - edges.begin());
+}
+} // namespace nifly
@@ -9,8 +9,10 @@ See the included GPLv3 LICENSE file
 #include "NifUtil.hpp"
 
 #include <fstream>
+#include <numeric>
 #include <regex>
 #include <set>
+#include <sstream>
 #include <unordered_set>
 #include <queue>
 
@@ -131,14 +133,15 @@ void NifFile::RemoveInvalidTris() const {
 		std::vector<Triangle> tris;
 		if (shape->GetTriangles(tris)) {
 			uint16_t numVerts = shape->GetNumVertices();
-			tris.erase(std::remove_if(tris.begin(),
-									  tris.end(),
-									  [&](auto& t) {
-										  return t.p1 >= numVerts || t.p2 >= numVerts || t.p3 >= numVerts;
-									  }),
-					   tris.end());
-
-			shape->SetTriangles(tris);
+			auto validEnd = std::remove_if(tris.begin(), tris.end(), [&](auto& t) {
+				return t.p1 >= numVerts || t.p2 >= numVerts || t.p3 >= numVerts;
+			});
+
+			// Strips are only regenerated if triangles were removed
+			if (validEnd != tris.end()) {
+				tris.erase(validEnd, tris.end());
+				shape->SetTriangles(tris);
+			}
 		}
 	}
 }
@@ -156,6 +159,20 @@ size_t NifFile::GetTriangleLimit() const {
 	return maxTriIndex;
 }
 
+size_t NifFile::GetMemoryUsage(std::map<std::string, size_t>* usageByType) const {
+	size_t usage = sizeof(NifFile) + hdr.GetHeapUsage() + HeapSizeOf(blocks);
+
+	for (auto& block : blocks) {
+		const size_t blockUsage = block->GetMemoryUsage();
+		usage += blockUsage;
+
+		if (usageByType)
+			(*usageByType)[block->GetBlockName()] += blockUsage;
+	}
+
+	return usage;
+}
+
 void NifFile::Create(const NiVersion& version) {
 	Clear();
 	hdr.SetVersion(version);
@@ -189,6 +206,7 @@ int NifFile::Load(std::istream& file, const NifLoadOptions& options) {
 
 	if (file) {
 		NiIStream stream(&file, &hdr);
+		stream.SetKeepPacked(options.keepPacked);
 		hdr.Get(stream);
 
 		if (!hdr.IsValid()) {
@@ -916,6 +934,16 @@ NiGeometryData* NifFile::GetGeometryData(NiShape* shape) const {
 	return nullptr;
 }
 
+const NiGeometryData* NifFile::ReadGeometryData(NiShape* shape) const {
+	if (shape->HasType<NiTriBasedGeom>()) {
+		return hdr.GetBlock<NiGeometryData>(shape->DataRef());
+	}
+	else if (shape->HasType<BSGeometry>()) {
+		return static_cast<const BSGeometry*>(shape)->ReadGeomData();
+	}
+	return nullptr;
+}
+
 std::vector<std::reference_wrapper<std::string>> NifFile::GetExternalGeometryPathRefs(NiShape* shape) const {
 	std::vector<std::reference_wrapper<std::string>> meshPaths;
 	auto bsgeo = dynamic_cast<BSGeometry*>(shape);
@@ -929,13 +957,18 @@ std::vector<std::reference_wrapper<std::string>> NifFile::GetExternalGeometryPat
 	return meshPaths;
 }
 
-bool NifFile::LoadExternalShapeData(NiShape* shape, std::istream& infile, uint8_t shapeIndex) {
+bool NifFile::LoadExternalShapeData(NiShape* shape, std::istream& infile, uint8_t shapeIndex, bool keepPacked) {
 	auto bsgeo = dynamic_cast<BSGeometry*>(shape);
 	if (bsgeo && (shapeIndex < bsgeo->MeshCount())) {
-		NiIStream meshStream(&infile, nullptr);
-		NiStreamReversible s(&meshStream, nullptr, NiStreamReversible::Mode::Reading);
 		auto mesh = bsgeo->SelectMesh(shapeIndex);
-		mesh->meshData.Sync(s);
+		if (keepPacked) {
+			mesh->meshData.LoadPacked(infile);
+		}
+		else {
+			NiIStream meshStream(&infile, nullptr);
+			NiStreamReversible s(&meshStream, nullptr, NiStreamReversible::Mode::Reading);
+			mesh->meshData.Sync(s);
+		}
 		bsgeo->ReleaseMesh();
 	}
 	return true;
@@ -953,6 +986,161 @@ bool NifFile::SaveExternalShapeData(NiShape* shape, std::ostream& outfile, uint8
 	return true;
 }
 
+// Reads and decodes (unless keepPacked) a whole .mesh file. On failure, the data is left empty.
+static bool ReadExternalMeshFile(const std::filesystem::path& path,
+								 BSGeometryMeshData& outData,
+								 const bool keepPacked,
+								 std::string& outError) {
+	std::vector<char> data;
+	if (!ReadBinaryFile(path, data)) {
+		outError = "Mesh file couldn't be read";
+		return false;
+	}
+
+	if (keepPacked) {
+		outData.sharedData.reset();
+		outData.packedData = std::move(data);
+		return true;
+	}
+
+	try {
+		MemoryStreamBuf buf(data.data(), data.size());
+		std::istream meshFile(&buf);
+		NiIStream meshStream(&meshFile, nullptr);
+		NiStreamReversible s(&meshStream, nullptr, NiStreamReversible::Mode::Reading);
+		outData.Sync(s);
+
+		if (!meshFile)
+			outError = "Mesh file is truncated";
+	}
+	catch (const std::exception& e) {
+		outError = e.what();
+	}
+
+	// Don't leave partially read data behind
+	if (!outError.empty()) {
+		outData = BSGeometryMeshData();
+		return false;
+	}
+
+	return true;
+}
+
+bool NifFile::BindExternalShapeData(NiShape* shape,
+									uint8_t shapeIndex,
+									std::shared_ptr<const BSGeometryMeshData> data) {
+	auto bsgeo = dynamic_cast<BSGeometry*>(shape);
+	if (!bsgeo || !data || data->IsPacked() || shapeIndex >= bsgeo->MeshCount())
+		return false;
+
+	bsgeo->InvalidateGeometryCache();
+	bsgeo->GetMesh(shapeIndex)->meshData.Share(std::move(data));
+	return true;
+}
+
+std::vector<ExternalMeshError> NifFile::LoadAllExternalShapeData(const std::filesystem::path& rootDir,
+																 const std::vector<NiShape*>& shapes,
+																 const bool keepPacked,
+																 const bool parallel,
+																 ExternalMeshCache* cache) {
+	auto resolver = [&rootDir](const std::string& meshName) {
+		// Mesh names use backslashes between the folder and file name
+		std::string relative = meshName;
+		std::replace(relative.begin(), relative.end(), '\\', '/');
+		return rootDir / std::filesystem::u8path(relative + ".mesh");
+	};
+
+	return LoadAllExternalShapeData(resolver, shapes, keepPacked, parallel, cache);
+}
+
+std::vector<ExternalMeshError> NifFile::LoadAllExternalShapeData(const ExternalMeshResolver& resolver,
+																 const std::vector<NiShape*>& shapes,
+																 const bool keepPacked,
+																 const bool parallel,
+																 ExternalMeshCache* cache) {
+	struct MeshTask {
+		BSGeometryMesh* mesh = nullptr;
+		ExternalMeshError info;
+		bool failed = false;
+	};
+
+	// Collect and resolve all mesh slots first, the loading itself doesn't touch any shared state
+	std::vector<MeshTask> tasks;
+	for (auto& shape : shapes.empty() ? GetShapes() : shapes) {
+		auto bsgeo = dynamic_cast<BSGeometry*>(shape);
+		if (!bsgeo || bsgeo->HasInternalGeomData())
+			continue;
+
+		bsgeo->InvalidateGeometryCache();
+
+		for (uint8_t i = 0; i < bsgeo->MeshCount(); i++) {
+			MeshTask task;
+			task.mesh = bsgeo->GetMesh(i);
+			task.info.shape = shape;
+			task.info.meshIndex = i;
+			task.info.meshName = task.mesh->meshName.get();
+
+			if (task.info.meshName.empty())
+				continue;
+
+			try {
+				task.info.path = resolver(task.info.meshName);
+			}
+			catch (const std::exception& e) {
+				task.info.message = e.what();
+			}
+
+			if (task.info.path.empty()) {
+				task.failed = true;
+				if (task.info.message.empty())
+					task.info.message = "Mesh path couldn't be resolved";
+			}
+
+			tasks.push_back(std::move(task));
+		}
+	}
+
+	auto loadMesh = [keepPacked, cache](MeshTask& task) {
+		auto& meshData = task.mesh->meshData;
+		if (!cache) {
+			task.failed = !ReadExternalMeshFile(task.info.path, meshData, keepPacked, task.info.message);
+			return;
+		}
+
+		// Cached data is always decoded and bound to the mesh slot instead of copied
+		const std::string key = task.info.path.lexically_normal().generic_u8string();
+		auto data = cache->FindOrLoad(key, [&task]() -> ExternalMeshCache::DataPtr {
+			auto loaded = std::make_shared<BSGeometryMeshData>();
+			if (!ReadExternalMeshFile(task.info.path, *loaded, false, task.info.message))
+				return nullptr;
+			return loaded;
+		});
+
+		if (data)
+			meshData.Share(std::move(data));
+		else
+			task.failed = true;
+	};
+
+	auto loadRange = [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; i++)
+			if (!tasks[i].failed)
+				loadMesh(tasks[i]);
+	};
+
+	if (parallel)
+		ParallelFor(tasks.size(), 1, loadRange);
+	else
+		loadRange(0, tasks.size());
+
+	std::vector<ExternalMeshError> errors;
+	for (auto& task : tasks)
+		if (task.failed)
+			errors.push_back(std::move(task.info));
+
+	return errors;
+}
+
 
 std::vector<std::reference_wrapper<std::string>> NifFile::GetTexturePathRefs(NiShape* shape) const {
 	std::vector<std::reference_wrapper<std::string>> texturePaths;
@@ -1463,180 +1651,958 @@ NiShape* NifFile::CloneShape(NiShape* srcShape, const std::string& destShapeName
 	return destShape;
 }
 
-uint32_t NifFile::CloneNamedNode(const std::string& nodeName, NifFile* srcNif) {
-	if (!srcNif)
-		srcNif = this;
+// Content of a block for comparisons: its serialized data, with strings by value instead of header index
+// and referenced blocks (e.g. texture sets) by content instead of block index.
+static std::string GetBlockContentKey(NiHeader& hdr, NiObject* block, std::set<NiObject*>& path) {
+	if (!block || !path.insert(block).second)
+		return {};
 
-	auto srcNode = srcNif->FindBlockByName<NiNode>(nodeName);
-	if (!srcNode)
-		return NIF_NPOS;
+	auto clone = block->Clone();
+	std::string key = clone->GetBlockName();
+	key.push_back('\0');
 
-	auto destNode = srcNode->Clone();
-	destNode->name.get() = nodeName;
-	destNode->collisionRef.Clear();
-	destNode->controllerRef.Clear();
-	destNode->childRefs.Clear();
-	destNode->effectRefs.Clear();
+	std::set<NiRef*> childRefs;
+	clone->GetChildRefs(childRefs);
+	for (auto& ref : childRefs)
+		ref->index = NIF_NPOS;
 
-	return hdr.AddBlock(std::move(destNode));
+	std::vector<NiStringRef*> stringRefs;
+	clone->GetStringRefs(stringRefs);
+	for (auto& stringRef : stringRefs) {
+		key += stringRef->get();
+		key.push_back('\0');
+		stringRef->SetIndex(NIF_NPOS);
+	}
+
+	std::ostringstream data;
+	NiOStream stream(&data, &hdr);
+	clone->Put(stream);
+	key += data.str();
+
+	std::vector<uint32_t> childIndices;
+	block->GetChildIndices(childIndices);
+	for (auto& index : childIndices) {
+		key.push_back('\0');
+		key += GetBlockContentKey(hdr, hdr.GetBlock<NiObject>(index), path);
+	}
+
+	path.erase(block);
+	return key;
 }
 
-int NifFile::Save(const std::filesystem::path& fileName, const NifSaveOptions& options) {
-	std::ofstream file(fileName, std::ios::out | std::ios::binary);
-	return Save(file, options);
+static std::string GetBlockContentKey(NiHeader& hdr, NiObject* block) {
+	std::set<NiObject*> path;
+	return GetBlockContentKey(hdr, block, path);
 }
 
-int NifFile::Save(std::ostream& file, const NifSaveOptions& options) {
-	if (file) {
-		NiOStream stream(&file, &hdr);
-		FinalizeData();
+template<typename T>
+static void AppendBytes(std::string& key, const T& value) {
+	key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
 
-		if (options.optimize)
-			Optimize();
+std::vector<NiShape*> NifFile::MergeShapes(const std::vector<NiShape*>& shapes) {
+	std::vector<NiShape*> merged;
+	std::vector<NiShape*> candidates = shapes.empty() ? GetShapes() : shapes;
 
-		if (options.sortBlocks)
-			PrettySortBlocks();
+	// Geometry data used by more than one shape is left alone
+	std::unordered_map<uint32_t, int> refCounts;
+	for (auto& block : blocks) {
+		std::set<NiRef*> refs;
+		block->GetChildRefs(refs);
+		for (auto& ref : refs)
+			if (ref->index != NIF_NPOS)
+				refCounts[ref->index]++;
+	}
 
-		hdr.UpdateHeaderStrings(hasUnknown);
+	auto isMergeable = [&](NiShape* shape) {
+		if (!shape || !GetParentNode(shape))
+			return false;
 
-		hdr.Put(stream);
+		const std::string blockName = shape->GetBlockName();
+		if (blockName != BSTriShape::BlockName && blockName != NiTriShape::BlockName)
+			return false;
 
-		// Retrieve block sizes from NiStream while writing
-		std::vector<std::streamsize> blockSizes(hdr.GetNumBlocks());
-		for (uint32_t i = 0; i < hdr.GetNumBlocks(); i++) {
-			// Old file versions store the block type in front of each block instead of the header
-			if (hdr.HasInlineBlockTypes())
-				hdr.WriteBlockType(stream, i);
+		if (!shape->controllerRef.IsEmpty() || !shape->collisionRef.IsEmpty())
+			return false;
 
-			stream.InitBlockSize();
-			blocks[i]->Put(stream);
-			blockSizes[i] = stream.GetBlockSize();
-		}
+		if (!shape->extraDataRef.IsEmpty() || shape->extraDataRefs.GetSize() > 0)
+			return false;
 
-		hdr.PutFooter(stream);
+		if (shape->GetNumVertices() == 0 || shape->GetNumTriangles() == 0)
+			return false;
 
-		// Get previous stream pos of block size array and overwrite
-		std::streampos blockSizePos = hdr.GetBlockSizeStreamPos();
-		if (blockSizePos != std::streampos()) {
-			file.seekp(blockSizePos);
+		if (auto bsTriShape = dynamic_cast<BSTriShape*>(shape)) {
+			if (bsTriShape->particleDataSize > 0 || bsTriShape->vertData.size() != shape->GetNumVertices())
+				return false;
+		}
+		else {
+			auto geomData = hdr.GetBlock<NiTriShapeData>(shape->DataRef());
+			if (!geomData || refCounts[GetBlockID(geomData)] > 1 || !geomData->additionalDataRef.IsEmpty())
+				return false;
+		}
 
-			for (uint32_t i = 0; i < hdr.GetNumBlocks(); i++)
-				stream << static_cast<uint32_t>(blockSizes[i]);
+		if (shape->IsSkinned()) {
+			auto boneCont = hdr.GetBlock<NiBoneContainer>(shape->SkinInstanceRef());
+			if (!boneCont)
+				return false;
 
-			hdr.ResetBlockSizeStreamPos();
+			for (auto& bone : boneCont->boneRefs)
+				if (bone.IsEmpty())
+					return false;
 		}
-	}
-	else
-		return 1;
 
-	return 0;
-}
+		return true;
+	};
 
-void NifFile::Optimize() {
-	for (auto& s : GetShapes())
-		s->UpdateBounds();
+	// Everything that has to match for shapes to be drawn as one
+	auto getMergeKey = [&](NiShape* shape) {
+		std::string key = shape->GetBlockName();
+		key.push_back('\0');
+		AppendBytes(key, shape->flags);
+		AppendBytes(key, shape->IsSkinned());
 
-	DeleteUnreferencedBlocks();
-}
+		if (auto bsTriShape = dynamic_cast<BSTriShape*>(shape)) {
+			AppendBytes(key, bsTriShape->vertexDesc.GetFlags());
+		}
+		else if (auto geomData = ReadGeometryData(shape)) {
+			AppendBytes(key, geomData->dataFlags);
+			AppendBytes(key, geomData->consistencyFlags);
+			AppendBytes(key, geomData->HasNormals());
+			AppendBytes(key, geomData->HasVertexColors());
+			AppendBytes(key, geomData->uvSets.size());
+			AppendBytes(key, geomData->tangents.empty());
+		}
 
-OptResult NifFile::OptimizeFor(OptOptions& options) {
-	OptResult result;
+		if (auto skinInst = hdr.GetBlock(shape->SkinInstanceRef()))
+			key += skinInst->GetBlockName();
 
-	const bool toSSE = options.targetVersion.IsSSE() && hdr.GetVersion().IsSK();
-	const bool toLE = options.targetVersion.IsSK() && hdr.GetVersion().IsSSE();
+		key.push_back('\0');
+		key += GetBlockContentKey(hdr, hdr.GetBlock(shape->ShaderPropertyRef()));
+		key.push_back('\0');
+		key += GetBlockContentKey(hdr, hdr.GetBlock(shape->AlphaPropertyRef()));
 
-	if (!toSSE && !toLE) {
-		result.versionMismatch = true;
-		return result;
-	}
+		for (auto& propRef : shape->propertyRefs) {
+			key.push_back('\0');
+			key += GetBlockContentKey(hdr, hdr.GetBlock(propRef));
+		}
 
-	if (!isTerrain)
-		result.dupesRenamed = RenameDuplicateShapes();
+		return key;
+	};
 
-	hdr.SetVersion(options.targetVersion);
+	struct MergeGroup {
+		NiShape* target = nullptr;
+		MatTransform targetToGlobal;
+		std::vector<NiShape*> sources;
+		std::vector<MatTransform> sourceToTarget;
+		size_t numVertices = 0;
+		size_t numTriangles = 0;
+
+		// Skinning
+		bool hasGlobalToSkin = false;
+		MatTransform globalToSkin;
+		std::vector<int> boneIDs;
+		std::vector<MatTransform> skinToBone;
+		std::vector<BoundingSphere> boneBounds;
+	};
 
-	auto shapes = GetShapes();
-	if (toSSE) {
-		for (auto* shape : shapes) {
-			std::string shapeName = shape->name.get();
+	auto addBones = [&](MergeGroup& group, NiShape* shape, const bool checkOnly) {
+		std::vector<int> boneIDs;
+		GetShapeBoneIDList(shape, boneIDs);
 
-			auto geomData = hdr.GetBlock<NiGeometryData>(shape->DataRef());
+		size_t numBones = group.boneIDs.size();
+		for (uint32_t i = 0; i < boneIDs.size(); i++) {
+			MatTransform skinToBone;
+			GetShapeTransformSkinToBone(shape, i, skinToBone);
 
-			if (!geomData)
-				continue;
+			auto it = std::find(group.boneIDs.begin(), group.boneIDs.end(), boneIDs[i]);
+			if (it != group.boneIDs.end()) {
+				// Shared bones need the same bind pose
+				if (!group.skinToBone[it - group.boneIDs.begin()].IsNearlyEqualTo(skinToBone))
+					return false;
+			}
+			else if (checkOnly) {
+				numBones++;
+			}
+			else {
+				BoundingSphere bounds;
+				GetShapeBoneBounds(shape, i, bounds);
+				group.boneIDs.push_back(boneIDs[i]);
+				group.skinToBone.push_back(skinToBone);
+				group.boneBounds.push_back(bounds);
+			}
+		}
 
-			bool removeVertexColors = true;
-			bool hasTangents = geomData->HasTangents();
-			std::vector<Vector3>* vertices = &geomData->vertices;
-			std::vector<Vector3>* normals = &geomData->normals;
-			const std::vector<Color4>& colors = geomData->vertexColors;
-			std::vector<Vector2>* uvs = nullptr;
-			if (!geomData->uvSets.empty())
-				uvs = &geomData->uvSets[0];
+		// Bone indices of BSTriShape vertices are single bytes
+		return !shape->HasType<BSTriShape>() || numBones <= 256;
+	};
 
-			std::vector<Triangle> triangles;
-			geomData->GetTriangles(triangles);
+	auto tryAddToGroup = [&](MergeGroup& group, NiShape* shape, const MatTransform& shapeToGlobal) {
+		if (group.numVertices + shape->GetNumVertices() > GetVertexLimit()
+			|| group.numTriangles + shape->GetNumTriangles() > GetTriangleLimit())
+			return false;
 
-			if (!options.removeParallax)
-				removeVertexColors = false;
+		MatTransform shapeToTarget = group.targetToGlobal.InverseTransform().ComposeTransforms(shapeToGlobal);
 
-			// Only remove vertex colors if all are 0xFFFFFFFF
-			if (removeVertexColors) {
-				Color4 white(1.0f, 1.0f, 1.0f, 1.0f);
-				for (auto& c : colors) {
-					if (white != c) {
-						removeVertexColors = false;
-						break;
-					}
-				}
-			}
+		if (shape->IsSkinned()) {
+			// Skinned vertices are in skin space and aren't transformed
+			if (!shapeToTarget.IsNearlyEqualTo(MatTransform()))
+				return false;
 
-			bool headPartEyes = false;
-			NiShader* shader = GetShader(shape);
-			if (shader) {
-				auto bslsp = dynamic_cast<BSLightingShaderProperty*>(shader);
-				if (bslsp) {
-					// Remember eyes flag for later
-					if (bslsp->GetShaderType() == BSLSP_EYE || (bslsp->shaderFlags1 & (1 << 17)) != 0)
-						headPartEyes = true;
+			MatTransform globalToSkin;
+			const bool hasGlobalToSkin = CalcShapeTransformGlobalToSkin(shape, globalToSkin);
+			if (hasGlobalToSkin != group.hasGlobalToSkin
+				|| (hasGlobalToSkin && !globalToSkin.IsNearlyEqualTo(group.globalToSkin)))
+				return false;
 
-					// No normals and tangents with model space maps
-					if (bslsp->IsModelSpace()) {
-						if (!normals->empty())
-							result.shapesNormalsRemoved.push_back(shapeName);
+			if (!addBones(group, shape, true))
+				return false;
 
-						normals = nullptr;
-					}
+			addBones(group, shape, false);
+		}
+		else {
+			// Normal maps in model space can't be rotated
+			NiShader* shader = GetShader(shape);
+			if (shader && shader->IsModelSpace() && !shapeToTarget.rotation.IsNearlyEqualTo(Matrix3()))
+				return false;
+		}
 
-					// Check tree anim flag
-					if ((bslsp->shaderFlags2 & (1 << 29)) != 0)
-						removeVertexColors = false;
+		group.sources.push_back(shape);
+		group.sourceToTarget.push_back(shapeToTarget);
+		group.numVertices += shape->GetNumVertices();
+		group.numTriangles += shape->GetNumTriangles();
+		return true;
+	};
 
-					// Disable flags if vertex colors were removed
-					if (removeVertexColors) {
-						bslsp->SetVertexColors(false);
-						bslsp->SetVertexAlpha(false);
-					}
+	// Shapes are grouped in order. A new group is started once a shape doesn't fit into the last one.
+	std::vector<MergeGroup> groups;
+	std::unordered_map<std::string, size_t> lastGroups;
+	for (auto& shape : candidates) {
+		if (!isMergeable(shape))
+			continue;
 
-					if (options.removeParallax) {
-						if (bslsp->GetShaderType() == BSLSP_PARALLAX) {
-							// Change type from parallax to default
-							bslsp->SetShaderType(BSLSP_DEFAULT);
+		const std::string key = getMergeKey(shape);
+		const MatTransform shapeToGlobal = GetShapeTransformToGlobal(shape);
 
-							// Remove parallax flag
-							bslsp->shaderFlags1 &= ~(1 << 11);
+		auto it = lastGroups.find(key);
+		if (it != lastGroups.end() && tryAddToGroup(groups[it->second], shape, shapeToGlobal))
+			continue;
 
-							// Remove parallax texture from set
-							auto textureSet = hdr.GetBlock(shader->TextureSetRef());
-							if (textureSet && textureSet->textures.size() >= 4)
-								textureSet->textures[3].clear();
+		MergeGroup group;
+		group.target = shape;
+		group.targetToGlobal = shapeToGlobal;
+		group.numVertices = shape->GetNumVertices();
+		group.numTriangles = shape->GetNumTriangles();
 
-							result.shapesParallaxRemoved.push_back(shapeName);
-						}
-					}
-				}
+		if (shape->IsSkinned()) {
+			group.hasGlobalToSkin = CalcShapeTransformGlobalToSkin(shape, group.globalToSkin);
+			addBones(group, shape, false);
+		}
 
-				auto bsesp = dynamic_cast<BSEffectShaderProperty*>(shader);
+		lastGroups[key] = groups.size();
+		groups.push_back(std::move(group));
+	}
+
+	for (auto& group : groups) {
+		if (group.sources.empty())
+			continue;
+
+		NiShape* target = group.target;
+		auto bsTriShape = dynamic_cast<BSTriShape*>(target);
+		auto geomData = GetGeometryData(target);
+		const bool skinned = target->IsSkinned();
+
+		// Bake the transforms of the other shapes into their vertices.
+		// Packed normals and tangents are only touched if they rotate, so that identical vertices still weld.
+		if (!skinned) {
+			for (size_t i = 0; i < group.sources.size(); i++) {
+				const MatTransform& sourceToTarget = group.sourceToTarget[i];
+				const bool rotates = !(sourceToTarget.rotation == Matrix3());
+				TransformShape(group.sources[i], sourceToTarget.ToMatrix(), {}, rotates);
+			}
+		}
+
+		std::vector<NiShape*> groupShapes{target};
+		groupShapes.insert(groupShapes.end(), group.sources.begin(), group.sources.end());
+
+		// Concatenate vertex data, triangles, bone weights and partitions
+		std::vector<BSVertexData> vertData;
+		std::vector<Vector3> vertices;
+		std::vector<Vector3> normals;
+		std::vector<Vector3> tangents;
+		std::vector<Vector3> bitangents;
+		std::vector<Color4> colors;
+		std::vector<std::vector<Vector2>> uvSets(geomData ? geomData->uvSets.size() : 0);
+		std::vector<std::vector<SkinWeight>> vertWeights;
+		std::vector<Triangle> tris;
+
+		NiVector<BSDismemberSkinInstance::PartitionInfo> partInfos;
+		std::vector<int> triParts;
+		std::vector<int> shapeTriParts;
+		const bool hasPartitions = skinned && GetShapePartitions(target, partInfos, shapeTriParts);
+		partInfos.clear();
+
+		for (auto& shape : groupShapes) {
+			const auto offset = static_cast<uint16_t>(bsTriShape ? vertData.size() : vertices.size());
+			const uint16_t numVerts = shape->GetNumVertices();
+
+			std::vector<int> boneIDs;
+			GetShapeBoneIDList(shape, boneIDs);
+
+			std::vector<uint16_t> boneMap(boneIDs.size());
+			for (size_t i = 0; i < boneIDs.size(); i++) {
+				auto it = std::find(group.boneIDs.begin(), group.boneIDs.end(), boneIDs[i]);
+				boneMap[i] = static_cast<uint16_t>(it - group.boneIDs.begin());
+			}
+
+			if (auto shapeBSTri = dynamic_cast<BSTriShape*>(shape)) {
+				for (auto vertex : shapeBSTri->vertData) {
+					for (auto& bone : vertex.weightBones)
+						if (bone < boneMap.size())
+							bone = static_cast<uint8_t>(boneMap[bone]);
+
+					vertData.push_back(std::move(vertex));
+				}
+			}
+			else if (auto shapeData = GetGeometryData(shape)) {
+				auto append = [numVerts](auto& dest, const auto& src) {
+					if (src.size() == static_cast<size_t>(numVerts))
+						dest.insert(dest.end(), src.begin(), src.end());
+				};
+
+				append(vertices, shapeData->vertices);
+				append(normals, shapeData->normals);
+				append(tangents, shapeData->tangents);
+				append(bitangents, shapeData->bitangents);
+				append(colors, shapeData->vertexColors);
+				for (size_t i = 0; i < uvSets.size() && i < shapeData->uvSets.size(); i++)
+					append(uvSets[i], shapeData->uvSets[i]);
+			}
+
+			if (skinned) {
+				vertWeights.resize(static_cast<size_t>(offset) + numVerts);
+
+				std::unordered_map<uint16_t, float> weights;
+				for (uint32_t i = 0; i < boneMap.size(); i++) {
+					GetShapeBoneWeights(shape, i, weights);
+					for (auto& w : weights)
+						if (w.first < numVerts)
+							vertWeights[offset + w.first].emplace_back(boneMap[i], w.second);
+				}
+			}
+
+			std::vector<Triangle> shapeTris;
+			shape->GetTriangles(shapeTris);
+			for (auto& t : shapeTris)
+				tris.emplace_back(static_cast<uint16_t>(t.p1 + offset),
+								  static_cast<uint16_t>(t.p2 + offset),
+								  static_cast<uint16_t>(t.p3 + offset));
+
+			if (hasPartitions) {
+				NiVector<BSDismemberSkinInstance::PartitionInfo> shapePartInfos;
+				shapeTriParts.clear();
+				GetShapePartitions(shape, shapePartInfos, shapeTriParts);
+
+				// Partitions with the same slot are merged
+				std::vector<int> partMap(shapePartInfos.size());
+				for (size_t i = 0; i < shapePartInfos.size(); i++) {
+					auto it = std::find_if(partInfos.begin(), partInfos.end(), [&](const auto& pi) {
+						return pi.partID == shapePartInfos[i].partID;
+					});
+
+					partMap[i] = static_cast<int>(it - partInfos.begin());
+					if (it == partInfos.end())
+						partInfos.push_back(shapePartInfos[i]);
+				}
+
+				shapeTriParts.resize(shapeTris.size(), -1);
+				for (auto& p : shapeTriParts)
+					triParts.push_back(p >= 0 && p < static_cast<int>(partMap.size()) ? partMap[p] : -1);
+			}
+		}
+
+		for (auto& weights : vertWeights)
+			std::sort(weights.begin(), weights.end(), [](const SkinWeight& a, const SkinWeight& b) {
+				return a.index < b.index;
+			});
+
+		// Weld vertices that are identical in all of their data
+		const size_t numVertsBefore = bsTriShape ? vertData.size() : vertices.size();
+		std::vector<uint16_t> vertMap(numVertsBefore);
+		std::vector<size_t> keptVerts;
+		std::unordered_map<std::string, uint16_t> uniqueVerts;
+		uniqueVerts.reserve(numVertsBefore);
+
+		for (size_t i = 0; i < numVertsBefore; i++) {
+			std::string key;
+			if (bsTriShape) {
+				const BSVertexData& v = vertData[i];
+				AppendBytes(key, v.vert);
+				AppendBytes(key, v.bitangentX);
+				AppendBytes(key, v.uv);
+				AppendBytes(key, v.normal);
+				AppendBytes(key, v.bitangentY);
+				AppendBytes(key, v.tangent);
+				AppendBytes(key, v.bitangentZ);
+				AppendBytes(key, v.colorData);
+				AppendBytes(key, v.weights);
+				AppendBytes(key, v.weightBones);
+				AppendBytes(key, v.eyeData);
+				for (auto& e : v.extra)
+					AppendBytes(key, e);
+			}
+			else {
+				AppendBytes(key, vertices[i]);
+				if (i < normals.size())
+					AppendBytes(key, normals[i]);
+				if (i < tangents.size())
+					AppendBytes(key, tangents[i]);
+				if (i < bitangents.size())
+					AppendBytes(key, bitangents[i]);
+				if (i < colors.size())
+					AppendBytes(key, colors[i]);
+				for (auto& uvSet : uvSets)
+					if (i < uvSet.size())
+						AppendBytes(key, uvSet[i]);
+			}
+
+			if (skinned) {
+				for (auto& w : vertWeights[i]) {
+					AppendBytes(key, w.index);
+					AppendBytes(key, w.weight);
+				}
+			}
+
+			auto inserted = uniqueVerts.emplace(std::move(key), static_cast<uint16_t>(keptVerts.size()));
+			if (inserted.second)
+				keptVerts.push_back(i);
+
+			vertMap[i] = inserted.first->second;
+		}
+
+		auto compact = [&keptVerts](auto& data) {
+			if (data.empty())
+				return;
+
+			for (size_t i = 0; i < keptVerts.size(); i++)
+				data[i] = data[keptVerts[i]];
+
+			data.resize(keptVerts.size());
+		};
+
+		compact(vertData);
+		compact(vertices);
+		compact(normals);
+		compact(tangents);
+		compact(bitangents);
+		compact(colors);
+		compact(vertWeights);
+		for (auto& uvSet : uvSets)
+			compact(uvSet);
+
+		for (auto& t : tris)
+			t.set(vertMap[t.p1], vertMap[t.p2], vertMap[t.p3]);
+
+		// Replace the geometry of the target shape
+		if (bsTriShape) {
+			bsTriShape->SetVertexData(vertData);
+			bsTriShape->SetTriangles(tris);
+
+			vertices.resize(vertData.size());
+			for (size_t i = 0; i < vertData.size(); i++)
+				vertices[i] = vertData[i].vert;
+		}
+		else if (geomData) {
+			const uint16_t dataFlags = geomData->dataFlags;
+			const bool hasNormals = geomData->HasNormals();
+			const bool hasColors = geomData->HasVertexColors();
+			const bool hasUVs = !uvSets.empty();
+
+			geomData->Create(hdr.GetVersion(), &vertices, &tris, nullptr, nullptr);
+
+			geomData->SetNormals(hasNormals);
+			if (hasNormals)
+				geomData->normals = normals;
+
+			geomData->SetVertexColors(hasColors);
+			if (hasColors)
+				geomData->vertexColors = colors;
+
+			geomData->SetUVs(hasUVs);
+			if (hasUVs)
+				geomData->uvSets = uvSets;
+
+			geomData->dataFlags = dataFlags;
+			geomData->tangents = tangents;
+			geomData->bitangents = bitangents;
+		}
+
+		target->UpdateBounds();
+		target->InvalidateGeometryCache();
+
+		if (skinned) {
+			SetShapeBoneIDList(target, group.boneIDs);
+
+			NiSkinData* skinData = nullptr;
+			if (auto skinInst = hdr.GetBlock<NiSkinInstance>(target->SkinInstanceRef()))
+				skinData = hdr.GetBlock(skinInst->dataRef);
+
+			BSSkinBoneData* boneData = nullptr;
+			if (auto bsSkinInst = hdr.GetBlock<BSSkinInstance>(target->SkinInstanceRef()))
+				boneData = hdr.GetBlock(bsSkinInst->dataRef);
+
+			std::vector<std::vector<SkinWeight>> boneWeights(group.boneIDs.size());
+			for (size_t i = 0; i < vertWeights.size(); i++)
+				for (auto& w : vertWeights[i])
+					boneWeights[w.index].emplace_back(static_cast<uint16_t>(i), w.weight);
+
+			std::vector<Vector3> bonePoints;
+			for (uint32_t b = 0; b < group.boneIDs.size(); b++) {
+				SetShapeTransformSkinToBone(target, b, group.skinToBone[b]);
+
+				// Bone bounds are recalculated in bone space from the weighted vertices
+				bonePoints.clear();
+				for (auto& w : boneWeights[b])
+					bonePoints.push_back(group.skinToBone[b].ApplyTransform(vertices[w.index]));
+
+				BoundingSphere bounds = group.boneBounds[b];
+				if (!bonePoints.empty())
+					bounds = BoundingSphere(bonePoints);
+
+				if (skinData && b < skinData->bones.size()) {
+					auto& bone = skinData->bones[b];
+					bone.bounds = bounds;
+					bone.vertexWeights = boneWeights[b];
+					bone.numVertices = static_cast<uint16_t>(bone.vertexWeights.size());
+				}
+
+				if (boneData && b < boneData->boneXforms.size())
+					boneData->boneXforms[b].bounds = bounds;
+			}
+
+			if (hasPartitions)
+				SetShapePartitions(target, partInfos, triParts, false);
+
+			UpdateSkinPartitions(target);
+		}
+
+		// Blocks that are still used by other shapes (e.g. a shared shader) are kept
+		for (auto& source : group.sources) {
+			auto shaderRef = source->ShaderPropertyRef();
+			if (shaderRef && hdr.GetBlockRefCount(shaderRef->index, false) > 1)
+				shaderRef->Clear();
+
+			auto alphaRef = source->AlphaPropertyRef();
+			if (alphaRef && hdr.GetBlockRefCount(alphaRef->index, false) > 1)
+				alphaRef->Clear();
+
+			for (int i = source->propertyRefs.GetSize() - 1; i >= 0; --i)
+				if (hdr.GetBlockRefCount(source->propertyRefs.GetBlockRef(i), false) > 1)
+					source->propertyRefs.RemoveBlockRef(i);
+
+			DeleteShape(source);
+		}
+
+		merged.push_back(target);
+	}
+
+	return merged;
+}
+
+std::vector<NiShape*> NifFile::SplitShape(NiShape* shape, size_t maxVertices, size_t maxTriangles) {
+	std::vector<NiShape*> parts;
+	if (!shape)
+		return parts;
+
+	parts.push_back(shape);
+
+	if (shape->HasType<NiTriStrips>() || shape->HasType<BSGeometry>())
+		return parts;
+
+	auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
+	if (bsTriShape && bsTriShape->particleDataSize > 0)
+		return parts;
+
+	if (maxVertices == 0)
+		maxVertices = GetVertexLimit();
+	if (maxTriangles == 0)
+		maxTriangles = GetTriangleLimit();
+
+	// A single triangle has to fit
+	maxVertices = std::max<size_t>(maxVertices, 3);
+	maxTriangles = std::max<size_t>(maxTriangles, 1);
+
+	// Reduces the shape to the listed triangles and the vertices they use
+	auto keepTriangles = [&](NiShape* part, const std::vector<uint32_t>& triIndices) {
+		std::vector<Triangle> tris;
+		part->GetTriangles(tris);
+
+		NiVector<BSDismemberSkinInstance::PartitionInfo> partInfo;
+		std::vector<int> triParts;
+		const bool hasPartitions = GetShapePartitions(part, partInfo, triParts);
+
+		NifSegmentationInfo segInfo;
+		std::vector<int> triSegs;
+		const bool hasSegments = GetShapeSegments(part, segInfo, triSegs);
+
+		std::vector<Triangle> keptTris;
+		std::vector<int> keptParts;
+		std::vector<int> keptSegs;
+		keptTris.reserve(triIndices.size());
+
+		for (auto& t : triIndices) {
+			keptTris.push_back(tris[t]);
+			if (hasPartitions)
+				keptParts.push_back(t < triParts.size() ? triParts[t] : -1);
+			if (hasSegments)
+				keptSegs.push_back(t < triSegs.size() ? triSegs[t] : -1);
+		}
+
+		part->SetTriangles(keptTris);
+
+		if (hasSegments)
+			SetShapeSegments(part, segInfo, keptSegs);
+
+		if (hasPartitions) {
+			SetShapePartitions(part, partInfo, keptParts, false);
+			UpdateSkinPartitions(part);
+		}
+
+		std::vector<bool> used(part->GetNumVertices(), false);
+		for (auto& t : keptTris)
+			for (uint32_t i = 0; i < 3; i++)
+				if (t[i] < used.size())
+					used[t[i]] = true;
+
+		std::vector<uint32_t> unusedVerts;
+		for (uint32_t i = 0; i < used.size(); i++)
+			if (!used[i])
+				unusedVerts.push_back(i);
+
+		DeleteVertsForShape(part, unusedVerts);
+
+		if (hasPartitions)
+			RemoveEmptyPartitions(part);
+
+		part->UpdateBounds();
+	};
+
+	const std::string baseName = shape->name.get();
+	uint32_t partCount = 0;
+
+	// Parts are split in half until they fit, which divides all triangles in O(n log n)
+	std::vector<NiShape*> pending{shape};
+	while (!pending.empty()) {
+		NiShape* part = pending.back();
+		pending.pop_back();
+
+		std::vector<Triangle> tris;
+		part->GetTriangles(tris);
+
+		std::vector<Vector3> verts;
+		GetVertsForShape(part, verts);
+
+		std::vector<bool> used(verts.size(), false);
+		size_t numUsed = 0;
+		for (auto& t : tris) {
+			for (uint32_t i = 0; i < 3; i++) {
+				if (t[i] < used.size() && !used[t[i]]) {
+					used[t[i]] = true;
+					numUsed++;
+				}
+			}
+		}
+
+		if ((tris.size() <= maxTriangles && numUsed <= maxVertices) || tris.size() < 2)
+			continue;
+
+		// Median of the triangle centers along the longest axis of their bounds
+		std::vector<Vector3> centers(tris.size());
+		BoundingBox box;
+		for (size_t i = 0; i < tris.size(); i++) {
+			const Triangle& t = tris[i];
+			if (t.p1 < verts.size() && t.p2 < verts.size() && t.p3 < verts.size())
+				centers[i] = (verts[t.p1] + verts[t.p2] + verts[t.p3]) / 3.0f;
+
+			box.Add(centers[i]);
+		}
+
+		const Vector3 extent = box.max - box.min;
+		int axis = 0;
+		if (extent.y > extent.x && extent.y >= extent.z)
+			axis = 1;
+		else if (extent.z > extent.x && extent.z > extent.y)
+			axis = 2;
+
+		auto coord = [axis](const Vector3& v) { return axis == 0 ? v.x : (axis == 1 ? v.y : v.z); };
+
+		std::vector<uint32_t> order(tris.size());
+		std::iota(order.begin(), order.end(), 0);
+
+		auto mid = order.begin() + static_cast<std::ptrdiff_t>(order.size() / 2);
+		std::nth_element(order.begin(), mid, order.end(), [&](const uint32_t a, const uint32_t b) {
+			return coord(centers[a]) < coord(centers[b]);
+		});
+
+		// Both halves keep the original order of their triangles
+		std::vector<uint32_t> first(order.begin(), mid);
+		std::vector<uint32_t> second(mid, order.end());
+		std::sort(first.begin(), first.end());
+		std::sort(second.begin(), second.end());
+
+		NiShape* clone = CloneShape(part, baseName + "_" + std::to_string(++partCount));
+		if (!clone)
+			continue;
+
+		keepTriangles(part, first);
+		keepTriangles(clone, second);
+
+		parts.push_back(clone);
+		pending.push_back(part);
+		pending.push_back(clone);
+	}
+
+	return parts;
+}
+
+uint32_t NifFile::CloneNamedNode(const std::string& nodeName, NifFile* srcNif) {
+	if (!srcNif)
+		srcNif = this;
+
+	auto srcNode = srcNif->FindBlockByName<NiNode>(nodeName);
+	if (!srcNode)
+		return NIF_NPOS;
+
+	auto destNode = srcNode->Clone();
+	destNode->name.get() = nodeName;
+	destNode->collisionRef.Clear();
+	destNode->controllerRef.Clear();
+	destNode->childRefs.Clear();
+	destNode->effectRefs.Clear();
+
+	return hdr.AddBlock(std::move(destNode));
+}
+
+int NifFile::Save(const std::filesystem::path& fileName, const NifSaveOptions& options) {
+	std::ofstream file(fileName, std::ios::out | std::ios::binary);
+	return Save(file, options);
+}
+
+int NifFile::Save(std::ostream& file, const NifSaveOptions& options) {
+	if (file) {
+		NiOStream stream(&file, &hdr);
+		FinalizeData();
+
+		if (options.optimize)
+			Optimize(options.boundsMethod);
+
+		if (options.sortBlocks)
+			PrettySortBlocks();
+
+		hdr.UpdateHeaderStrings(hasUnknown);
+
+		hdr.Put(stream);
+
+		// Retrieve block sizes from NiStream while writing
+		std::vector<std::streamsize> blockSizes(hdr.GetNumBlocks());
+		for (uint32_t i = 0; i < hdr.GetNumBlocks(); i++) {
+			// Old file versions store the block type in front of each block instead of the header
+			if (hdr.HasInlineBlockTypes())
+				hdr.WriteBlockType(stream, i);
+
+			stream.InitBlockSize();
+			blocks[i]->Put(stream);
+			blockSizes[i] = stream.GetBlockSize();
+		}
+
+		hdr.PutFooter(stream);
+
+		// Get previous stream pos of block size array and overwrite
+		std::streampos blockSizePos = hdr.GetBlockSizeStreamPos();
+		if (blockSizePos != std::streampos()) {
+			file.seekp(blockSizePos);
+
+			for (uint32_t i = 0; i < hdr.GetNumBlocks(); i++)
+				stream << static_cast<uint32_t>(blockSizes[i]);
+
+			hdr.ResetBlockSizeStreamPos();
+		}
+	}
+	else
+		return 1;
+
+	return 0;
+}
+
+void NifFile::Optimize(const BoundsMethod boundsMethod) {
+	for (auto& s : GetShapes())
+		s->UpdateBounds(boundsMethod);
+
+	DeleteUnreferencedBlocks();
+}
+
+uint32_t NifFile::UpdateMultiBounds() {
+	uint32_t count = 0;
+	const auto shapes = GetShapes();
+
+	for (auto& block : blocks) {
+		auto multiBoundNode = dynamic_cast<BSMultiBoundNode*>(block.get());
+		if (!multiBoundNode)
+			continue;
+
+		auto multiBound = hdr.GetBlock(multiBoundNode->multiBoundRef);
+		if (!multiBound)
+			continue;
+
+		auto multiBoundData = hdr.GetBlock(multiBound->dataRef);
+		if (!multiBoundData)
+			continue;
+
+		std::vector<Vector3> points;
+		for (auto shape : shapes) {
+			NiNode* parent = GetParentNode(shape);
+			while (parent && parent != multiBoundNode)
+				parent = GetParentNode(parent);
+
+			auto verts = parent ? GetVertsForShape(shape) : nullptr;
+			if (!verts)
+				continue;
+
+			const MatTransform toGlobal = GetShapeTransformToGlobal(shape);
+			for (auto& v : *verts)
+				points.push_back(toGlobal.ApplyTransform(v));
+		}
+
+		if (points.empty())
+			continue;
+
+		if (auto aabb = dynamic_cast<BSMultiBoundAABB*>(multiBoundData))
+			aabb->SetBounds(BoundingBox(points));
+		else if (auto obb = dynamic_cast<BSMultiBoundOBB*>(multiBoundData))
+			obb->SetBounds(OrientedBoundingBox(points));
+		else if (auto sphere = dynamic_cast<BSMultiBoundSphere*>(multiBoundData))
+			sphere->SetBounds(BoundingSphere(points));
+		else
+			continue;
+
+		count++;
+	}
+
+	return count;
+}
+
+OptResult NifFile::OptimizeFor(OptOptions& options) {
+	OptResult result;
+
+	const bool toSSE = options.targetVersion.IsSSE() && hdr.GetVersion().IsSK();
+	const bool toLE = options.targetVersion.IsSK() && hdr.GetVersion().IsSSE();
+
+	// Morrowind and Oblivion files can't be converted, but can get strips for their own version
+	const bool toLegacy = options.stripify
+						  && ((options.targetVersion.IsMW() && hdr.GetVersion().IsMW())
+							  || (options.targetVersion.IsOB() && hdr.GetVersion().IsOB()));
+
+	if (toLegacy) {
+		for (auto& shape : GetShapes()) {
+			const std::string shapeName = shape->name.get();
+			if (StripifyShape(shape))
+				result.shapesStripified.push_back(shapeName);
+		}
+
+		return result;
+	}
+
+	if (!toSSE && !toLE) {
+		result.versionMismatch = true;
+		return result;
+	}
+
+	if (!isTerrain)
+		result.dupesRenamed = RenameDuplicateShapes();
+
+	hdr.SetVersion(options.targetVersion);
+
+	auto shapes = GetShapes();
+	if (toSSE) {
+		for (auto* shape : shapes) {
+			std::string shapeName = shape->name.get();
+
+			auto geomData = hdr.GetBlock<NiGeometryData>(shape->DataRef());
+
+			if (!geomData)
+				continue;
+
+			bool removeVertexColors = true;
+			bool hasTangents = geomData->HasTangents();
+			const std::vector<Vector3>* vertices = &geomData->vertices.Get();
+			const std::vector<Vector3>* normals = &geomData->normals.Get();
+			const std::vector<Color4>& colors = geomData->vertexColors;
+			const std::vector<Vector2>* uvs = nullptr;
+			if (!geomData->uvSets.empty())
+				uvs = &geomData->uvSets.Get()[0];
+
+			std::vector<Triangle> triangles;
+			geomData->GetTriangles(triangles);
+
+			if (!options.removeParallax)
+				removeVertexColors = false;
+
+			// Only remove vertex colors if all are 0xFFFFFFFF
+			if (removeVertexColors) {
+				Color4 white(1.0f, 1.0f, 1.0f, 1.0f);
+				for (auto& c : colors) {
+					if (white != c) {
+						removeVertexColors = false;
+						break;
+					}
+				}
+			}
+
+			bool headPartEyes = false;
+			NiShader* shader = GetShader(shape);
+			if (shader) {
+				auto bslsp = dynamic_cast<BSLightingShaderProperty*>(shader);
+				if (bslsp) {
+					// Remember eyes flag for later
+					if (bslsp->GetShaderType() == BSLSP_EYE || (bslsp->shaderFlags1 & (1 << 17)) != 0)
+						headPartEyes = true;
+
+					// No normals and tangents with model space maps
+					if (bslsp->IsModelSpace()) {
+						if (!normals->empty())
+							result.shapesNormalsRemoved.push_back(shapeName);
+
+						normals = nullptr;
+					}
+
+					// Check tree anim flag
+					if ((bslsp->shaderFlags2 & (1 << 29)) != 0)
+						removeVertexColors = false;
+
+					// Disable flags if vertex colors were removed
+					if (removeVertexColors) {
+						bslsp->SetVertexColors(false);
+						bslsp->SetVertexAlpha(false);
+					}
+
+					if (options.removeParallax) {
+						if (bslsp->GetShaderType() == BSLSP_PARALLAX) {
+							// Change type from parallax to default
+							bslsp->SetShaderType(BSLSP_DEFAULT);
+
+							// Remove parallax flag
+							bslsp->shaderFlags1 &= ~(1 << 11);
+
+							// Remove parallax texture from set
+							auto textureSet = hdr.GetBlock(shader->TextureSetRef());
+							if (textureSet && textureSet->textures.size() >= 4)
+								textureSet->textures[3].clear();
+
+							result.shapesParallaxRemoved.push_back(shapeName);
+						}
+					}
+				}
+
+				auto bsesp = dynamic_cast<BSEffectShaderProperty*>(shader);
 				if (bsesp) {
 					// Remember eyes flag for later
 					if ((bsesp->shaderFlags1 & (1 << 17)) != 0)
@@ -1688,7 +2654,13 @@ OptResult NifFile::OptimizeFor(OptOptions& options) {
 
 			bsOptShape->SetTransformToParent(shape->GetTransformToParent());
 
-			bsOptShape->Create(hdr.GetVersion(), vertices, &triangles, uvs, normals);
+			bsOptShape->Create(hdr.GetVersion(),
+							   vertices,
+							   &triangles,
+							   uvs,
+							   normals,
+							   options.parallelTangents);
+
 			bsOptShape->flags = shape->flags;
 
 			// Move segments to new shape
@@ -1697,9 +2669,12 @@ OptResult NifFile::OptimizeFor(OptOptions& options) {
 				bsSITS->SetSegments(bsSegmentShape->GetSegments());
 			}
 
-			// Restore old bounds for static meshes or when calc bounds is off
+			// Restore old bounds for static meshes or when calc bounds is off.
+			// Create already calculated exact bounds otherwise.
 			if (!shape->IsSkinned() || !options.calcBounds)
 				bsOptShape->SetBounds(geomData->GetBounds());
+			else if (options.boundsMethod != BoundsMethod::Exact)
+				bsOptShape->UpdateBounds(options.boundsMethod);
 
 			// Vertex Colors
 			if (bsOptShape->GetNumVertices() > 0) {
@@ -1934,7 +2909,8 @@ OptResult NifFile::OptimizeFor(OptOptions& options) {
 								   &vertices,
 								   &triangles,
 								   &uvs,
-								   !removeNormals ? &normals : nullptr);
+								   !removeNormals ? &normals : nullptr,
+								   options.parallelTangents);
 
 			bsOptShape->name.get() = shape->name.get();
 
@@ -1961,9 +2937,12 @@ OptResult NifFile::OptimizeFor(OptOptions& options) {
 				bsSegmentShape->SetSegments(bsSITS->GetSegments());
 			}
 
-			// Restore old bounds for static meshes or when calc bounds is off
+			// Restore old bounds for static meshes or when calc bounds is off.
+			// Create already calculated exact bounds otherwise.
 			if (!shape->IsSkinned() || !options.calcBounds)
 				bsOptShape->SetBounds(bsTriShape->GetBounds());
+			else if (options.boundsMethod != BoundsMethod::Exact)
+				bsOptShape->UpdateBounds(options.boundsMethod);
 
 			// Vertex Colors
 			if (bsOptShape->GetNumVertices() > 0) {
@@ -2011,6 +2990,29 @@ OptResult NifFile::OptimizeFor(OptOptions& options) {
 		PrettySortBlocks();
 	}
 
+	if (options.splitShapes) {
+		const size_t maxVerts = GetVertexLimit();
+		const size_t maxTris = GetTriangleLimit();
+
+		for (auto& shape : GetShapes()) {
+			std::vector<Vector3> verts;
+			GetVertsForShape(shape, verts);
+			if (verts.size() <= maxVerts && shape->GetNumTriangles() <= maxTris)
+				continue;
+
+			const std::string shapeName = shape->name.get();
+			if (SplitShape(shape, maxVerts, maxTris).size() > 1)
+				result.shapesSplit.push_back(shapeName);
+		}
+	}
+
+	if (options.vertexCacheOrder) {
+		for (auto& shape : GetShapes()) {
+			OptimizeVertexCache(shape);
+			OptimizeVertexFetch(shape);
+		}
+	}
+
 	if (options.fixBSXFlags)
 		FixBSXFlags();
 
@@ -2112,12 +3114,16 @@ void NifFile::FinalizeData() {
 		auto bsgeo = dynamic_cast<BSGeometry*>(shape);
 		if (bsgeo) {
 			for (uint8_t i = 0; i < bsgeo->MeshCount(); i++) {
-				auto mesh = bsgeo->SelectMesh(i);
-				if (mesh && !mesh->meshData.vertices.empty()) {
-					mesh->triSize = static_cast<uint32_t>(mesh->meshData.tris.size()) * 3;
-					mesh->numVerts = static_cast<uint32_t>(mesh->meshData.vertices.size());
+				// Packed data is unchanged and so are its counts
+				auto mesh = bsgeo->GetMesh(i);
+				if (!mesh || mesh->meshData.IsPacked())
+					continue;
+
+				auto& meshData = mesh->meshData.ReadData();
+				if (!meshData.vertices.empty()) {
+					mesh->triSize = static_cast<uint32_t>(meshData.tris.size()) * 3;
+					mesh->numVerts = static_cast<uint32_t>(meshData.vertices.size());
 				}
-				bsgeo->ReleaseMesh();
 			}
 		}
 
@@ -2394,6 +3400,42 @@ void NifFile::TriangulateShape(NiShape* shape) {
 	}
 }
 
+bool NifFile::StripifyShape(NiShape* shape, const bool joinStrips) {
+	if (!shape || shape->GetBlockName() != std::string(NiTriShape::BlockName))
+		return false;
+
+	auto shapeData = hdr.GetBlock<NiTriShapeData>(shape->DataRef());
+	if (!shapeData)
+		return false;
+
+	std::vector<Triangle> tris;
+	shapeData->GetTriangles(tris);
+	if (tris.empty())
+		return false;
+
+	// The degenerate triangles joining strips count too and can go over the limit
+	auto [stripsDataS, stripsData] = make_unique<NiTriStripsData>();
+	*static_cast<NiTriBasedGeomData*>(stripsData) = *static_cast<NiTriBasedGeomData*>(shapeData);
+	if (!stripsData->SetStrips(GenerateStripsFromTriangles(tris, joinStrips))
+		&& (!joinStrips || !stripsData->SetStrips(GenerateStripsFromTriangles(tris))))
+		return false;
+
+	auto skinInst = hdr.GetBlock<NiSkinInstance>(shape->SkinInstanceRef());
+	if (skinInst) {
+		auto skinPart = hdr.GetBlock(skinInst->skinPartitionRef);
+		if (skinPart)
+			skinPart->ConvertTrianglesToStrips(joinStrips);
+	}
+
+	auto [triStripsS, triStrips] = make_unique<NiTriStrips>();
+	*static_cast<NiTriBasedGeom*>(triStrips) = *static_cast<NiTriBasedGeom*>(shape);
+	hdr.ReplaceBlock(GetBlockID(shape), std::move(triStripsS));
+
+	hdr.ReplaceBlock(GetBlockID(shapeData), std::move(stripsDataS));
+	triStrips->SetGeomData(stripsData);
+	return true;
+}
+
 NiNode* NifFile::GetRootNode() const {
 	// Check if block at index 0 is a node
 	auto root = hdr.GetBlock<NiNode>(0u);
@@ -2459,6 +3501,20 @@ bool NifFile::GetNodeTransformToGlobal(const std::string& nodeName, MatTransform
 	return false;
 }
 
+MatTransform NifFile::GetShapeTransformToGlobal(NiShape* shape) const {
+	if (!shape)
+		return MatTransform();
+
+	MatTransform xform = shape->GetTransformToParent();
+	NiNode* parent = GetParentNode(shape);
+	while (parent) {
+		xform = parent->GetTransformToParent().ComposeTransforms(xform);
+		parent = GetParentNode(parent);
+	}
+
+	return xform;
+}
+
 bool NifFile::SetNodeTransformToParent(const std::string& nodeName,
 									   const MatTransform& inTransform,
 									   const bool rootChildrenOnly) {
@@ -2614,7 +3670,7 @@ uint32_t NifFile::GetShapeBoneWeights(NiShape* shape,
 
 	auto bsGeom = dynamic_cast<BSGeometry*>(shape);
 	if (bsGeom) {
-		auto* geomData = dynamic_cast<BSGeometryMeshData*>(bsGeom->GetGeomData());
+		auto* geomData = dynamic_cast<const BSGeometryMeshData*>(bsGeom->ReadGeomData());
 		if (geomData && !geomData->skinWeights.empty()) {
 			// outWeights is keyed by uint16_t, so vertex indices are capped at
 			// 0xFFFF; iterate with a wide index to avoid overflowing the loop
@@ -2622,10 +3678,10 @@ uint32_t NifFile::GetShapeBoneWeights(NiShape* shape,
 			constexpr size_t maxVerts = static_cast<size_t>(std::numeric_limits<uint16_t>::max()) + 1;
 			constexpr float maxWeightValue = static_cast<float>(std::numeric_limits<uint16_t>::max());
 
-			size_t vertCount = std::min(geomData->skinWeights.size(), maxVerts);
+			size_t vertCount = std::min(static_cast<size_t>(geomData->GetSkinWeightVertexCount()), maxVerts);
 			outWeights.reserve(vertCount);
 			for (size_t vid = 0; vid < vertCount; vid++) {
-				for (auto& bw : geomData->skinWeights[vid]) {
+				for (auto& bw : geomData->GetVertexWeights(static_cast<uint32_t>(vid))) {
 					if (bw.boneIndex == boneIndex && bw.weight != 0) {
 						outWeights.emplace(static_cast<uint16_t>(vid), bw.weight / maxWeightValue);
 					}
@@ -2944,11 +4000,11 @@ void NifFile::SetShapeVertWeights(const std::string& shapeName,
 	// boneids index into shapes BSSkin::Instance boneRefs
 	if(auto* bsGeom = dynamic_cast<BSGeometry*>(shape)) {
 		auto* geomData = dynamic_cast<BSGeometryMeshData*>(bsGeom->GetGeomData());
-		if(!geomData || vertIndex >= geomData->skinWeights.size()) {
+		if(!geomData || vertIndex >= geomData->GetSkinWeightVertexCount()) {
 			return;
 		}
 
-		uint32_t wpv = geomData->nWeightsPerVert ? geomData->nWeightsPerVert : 4;
+		uint32_t wpv = geomData->nWeightsPerVert;
 
 		float sum = 0.0f;
 		for(auto weight : weights) {
@@ -2958,8 +4014,8 @@ void NifFile::SetShapeVertWeights(const std::string& shapeName,
 			sum = 1.f;
 		}
 
-		auto& vw = geomData->skinWeights[vertIndex];
-		vw.assign(wpv, BSGeometryMeshData::BoneWeight{});
+		auto vw = geomData->GetVertexWeights(vertIndex);
+		std::fill(vw.begin(), vw.end(), BSGeometryMeshData::BoneWeight{});
 		uint32_t num = std::min<uint32_t>(static_cast<uint32_t>(weights.size()), wpv);
 		num = std::min(num, static_cast<uint32_t>(boneids.size()));
 		for(uint32_t i = 0; i< num; i++) {
@@ -3004,16 +4060,14 @@ void NifFile::ClearShapeVertWeights(const std::string& shapeName) const {
 		return;
 
 
-	// For Starfield BSGeometry: reset skinWeights to one zeroed nWeightsPerVert-slot entry per vertex, SetShapeVertWeights will fill them and the .mesh writer writes good weights
+	// For Starfield BSGeometry: reset skinWeights to one zeroed nWeightsPerVert slot per vertex, SetShapeVertWeights will fill them and the .mesh writer writes good weights
 	if (auto* bsGeom = dynamic_cast<BSGeometry*>(shape)) {
 		auto* geomData = dynamic_cast<BSGeometryMeshData*>(bsGeom->GetGeomData());
 		if (!geomData) {
 			return;
 		}
-		if (geomData->nWeightsPerVert == 0) {
-			geomData->nWeightsPerVert = 4;
-		}
-		geomData->skinWeights.assign(geomData->vertices.size(), std::vector<BSGeometryMeshData::BoneWeight>(geomData->nWeightsPerVert));
+		uint32_t wpv = geomData->nWeightsPerVert ? geomData->nWeightsPerVert : 4;
+		geomData->ResetSkinWeights(static_cast<uint32_t>(geomData->vertices.size()), wpv);
 		return;
 	}
 
@@ -3234,13 +4288,143 @@ bool NifFile::ReorderTriangles(NiShape* shape, const std::vector<uint32_t>& tria
 	return shape->ReorderTriangles(triangleIndices);
 }
 
+bool NifFile::OptimizeVertexCache(NiShape* shape, const uint32_t cacheSize) {
+	if (!shape || shape->HasType<NiTriStrips>())
+		return false;
+
+	std::vector<Triangle> tris;
+	if (!shape->GetTriangles(tris) || tris.empty())
+		return false;
+
+	const uint32_t numTris = static_cast<uint32_t>(tris.size());
+
+	NiSkinPartition* skinPart = nullptr;
+	if (auto skinInst = hdr.GetBlock<NiSkinInstance>(shape->SkinInstanceRef()))
+		skinPart = hdr.GetBlock(skinInst->skinPartitionRef);
+
+	if (skinPart) {
+		skinPart->PrepareTriParts(tris);
+		if (skinPart->triParts.size() != numTris)
+			skinPart = nullptr;
+	}
+
+	// Triangles are only reordered within runs of the same group, so that
+	// segments, LOD levels and skin partitions keep their triangles.
+	std::vector<int> triGroups(numTris, 0);
+	auto setGroupRange = [&triGroups, numTris](uint32_t start, uint32_t count, int group) {
+		start = std::min(start, numTris);
+		count = std::min(count, numTris - start);
+		std::fill_n(triGroups.begin() + start, count, group);
+	};
+
+	std::vector<uint32_t> triInds(numTris);
+	std::iota(triInds.begin(), triInds.end(), 0);
+
+	if (auto bssits = dynamic_cast<BSSubIndexTriShape*>(shape)) {
+		NifSegmentationInfo inf;
+		bssits->GetSegmentation(inf, triGroups);
+	}
+	else if (auto bsSegShape = dynamic_cast<BSSegmentedTriShape*>(shape)) {
+		int group = 1;
+		for (auto& segment : bsSegShape->GetSegments())
+			setGroupRange(segment.index / 3, segment.numTris, group++);
+	}
+	else if (auto bsMeshLODShape = dynamic_cast<BSMeshLODTriShape*>(shape)) {
+		setGroupRange(0, bsMeshLODShape->lodSize0, 1);
+		setGroupRange(bsMeshLODShape->lodSize0, bsMeshLODShape->lodSize1, 2);
+		setGroupRange(bsMeshLODShape->lodSize0 + bsMeshLODShape->lodSize1, bsMeshLODShape->lodSize2, 3);
+	}
+	else if (auto bsLODShape = dynamic_cast<BSLODTriShape*>(shape)) {
+		setGroupRange(0, bsLODShape->level0, 1);
+		setGroupRange(bsLODShape->level0, bsLODShape->level1, 2);
+		setGroupRange(bsLODShape->level0 + bsLODShape->level1, bsLODShape->level2, 3);
+	}
+	else if (skinPart) {
+		// Partitions are drawn separately, so keep their triangles together
+		triGroups = skinPart->triParts;
+		std::stable_sort(triInds.begin(), triInds.end(), [&triGroups](uint32_t i, uint32_t j) {
+			return triGroups[i] < triGroups[j];
+		});
+	}
+
+	std::vector<uint32_t> order;
+	order.reserve(numTris);
+
+	std::vector<Triangle> runTris;
+	for (uint32_t runStart = 0; runStart < numTris;) {
+		const int group = triGroups[triInds[runStart]];
+		uint32_t runEnd = runStart + 1;
+		while (runEnd < numTris && triGroups[triInds[runEnd]] == group)
+			++runEnd;
+
+		runTris.clear();
+		for (uint32_t i = runStart; i < runEnd; ++i)
+			runTris.push_back(tris[triInds[i]]);
+
+		for (uint32_t runIndex : GenerateVertexCacheOrder(runTris, cacheSize))
+			order.push_back(triInds[runStart + runIndex]);
+
+		runStart = runEnd;
+	}
+
+	if (!shape->ReorderTriangles(order))
+		return false;
+
+	if (skinPart) {
+		std::vector<int> triParts(numTris);
+		for (uint32_t i = 0; i < numTris; ++i)
+			triParts[i] = skinPart->triParts[order[i]];
+
+		skinPart->triParts = std::move(triParts);
+
+		// Partition triangle lists follow the new order of the shape's triangles.
+		// Vertex maps and weights don't depend on the triangle order.
+		const int numParts = static_cast<int>(skinPart->partitions.size());
+		for (auto& part : skinPart->partitions)
+			if (part.numStrips == 0)
+				part.trueTriangles.clear();
+
+		for (uint32_t i = 0; i < numTris; ++i) {
+			const int partInd = skinPart->triParts[i];
+			if (partInd >= 0 && partInd < numParts && skinPart->partitions[partInd].numStrips == 0)
+				skinPart->partitions[partInd].trueTriangles.push_back(tris[order[i]]);
+		}
+
+		for (auto& part : skinPart->partitions) {
+			if (part.numStrips != 0)
+				continue;
+
+			if (skinPart->bMappedIndices && !part.vertexMap.empty())
+				part.GenerateMappedTrianglesFromTrueTrianglesAndVertexMap();
+			else
+				part.triangles = part.trueTriangles;
+
+			part.numTriangles = static_cast<uint16_t>(part.trueTriangles.size());
+		}
+	}
+
+	// Starfield meshes store their LOD levels as separate triangle lists
+	if (auto meshData = dynamic_cast<BSGeometryMeshData*>(shape->GetGeomData())) {
+		for (auto& lod : meshData->lods) {
+			std::vector<Triangle> lodTris;
+			lodTris.reserve(lod.size());
+			for (uint32_t lodIndex : GenerateVertexCacheOrder(lod, cacheSize))
+				lodTris.push_back(lod[lodIndex]);
+
+			lod = std::move(lodTris);
+		}
+	}
+
+	return true;
+}
+
 const std::vector<Vector3>* NifFile::GetVertsForShape(NiShape* shape) {
 	if (!shape)
 		return nullptr;
 
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData)
-			return &geomData->vertices;
+			return &geomData->vertices.Get();
 	}
 	else if (shape->HasType<BSTriShape>()) {
 		auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
@@ -3254,9 +4438,9 @@ const std::vector<Vector3>* NifFile::GetNormalsForShape(NiShape* shape) {
 	if (!shape || !shape->HasNormals())
 		return nullptr;
 
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData)
-			return &geomData->normals;
+			return &geomData->normals.Get();
 	}
 	else if (shape->HasType<BSTriShape>()) {
 		auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
@@ -3271,7 +4455,7 @@ const std::vector<Vector2>* NifFile::GetUvsForShape(NiShape* shape) {
 	if (!shape)
 		return nullptr;
 
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData && !geomData->uvSets.empty())
 			return &geomData->uvSets[0];
 	}
@@ -3293,9 +4477,9 @@ const std::vector<Color4>* NifFile::GetColorsForShape(NiShape* shape) {
 	if (!shape)
 		return nullptr;
 
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData)
-			return &geomData->vertexColors;
+			return &geomData->vertexColors.Get();
 	}
 	else if (shape->HasType<BSTriShape>()) {
 		auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
@@ -3310,9 +4494,9 @@ const std::vector<Vector3>* NifFile::GetTangentsForShape(NiShape* shape) {
 	if (!shape || !shape->HasTangents())
 		return nullptr;
 
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData)
-			return &geomData->tangents;
+			return &geomData->tangents.Get();
 	}
 	else if (shape->HasType<BSTriShape>()) {
 		auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
@@ -3327,9 +4511,9 @@ const std::vector<Vector3>* NifFile::GetBitangentsForShape(NiShape* shape) {
 	if (!shape || !shape->HasTangents())
 		return nullptr;
 
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData)
-			return &geomData->bitangents;
+			return &geomData->bitangents.Get();
 	}
 	else if (shape->HasType<BSTriShape>()) {
 		auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
@@ -3357,7 +4541,7 @@ bool NifFile::GetVertsForShape(NiShape* shape, std::vector<Vector3>& outVerts) c
 		return false;
 	}
 
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData && geomData->HasVertices()) {
 			outVerts = geomData->vertices;
 			return true;
@@ -3380,7 +4564,7 @@ bool NifFile::GetVertsForShape(NiShape* shape, std::vector<Vector3>& outVerts) c
 }
 
 bool NifFile::GetUvsForShape(NiShape* shape, std::vector<Vector2>& outUvs) const {
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData && geomData->HasUVs() && !geomData->uvSets.empty()) {
 			outUvs = geomData->uvSets[0];
 			return true;
@@ -3402,7 +4586,7 @@ bool NifFile::GetUvsForShape(NiShape* shape, std::vector<Vector2>& outUvs) const
 }
 
 bool NifFile::GetColorsForShape(NiShape* shape, std::vector<Color4>& outColors) const {
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData && geomData->HasVertexColors()) {
 			outColors = geomData->vertexColors;
 			return true;
@@ -3428,7 +4612,7 @@ bool NifFile::GetColorsForShape(NiShape* shape, std::vector<Color4>& outColors)
 }
 
 bool NifFile::GetTangentsForShape(NiShape* shape, std::vector<Vector3>& outTang) const {
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData && geomData->HasTangents()) {
 			outTang = geomData->tangents;
 			return true;
@@ -3456,7 +4640,7 @@ bool NifFile::GetTangentsForShape(NiShape* shape, std::vector<Vector3>& outTang)
 }
 
 bool NifFile::GetBitangentsForShape(NiShape* shape, std::vector<Vector3>& outBitang) const {
-	if (auto geomData = GetGeometryData(shape)) {
+	if (auto geomData = ReadGeometryData(shape)) {
 		if (geomData && geomData->HasTangents()) {
 			outBitang = geomData->bitangents;
 			return true;
@@ -3500,6 +4684,8 @@ void NifFile::SetVertsForShape(NiShape* shape, const std::vector<Vector3>& verts
 	if (!shape)
 		return;
 
+	shape->InvalidateGeometryCache();
+
 	if (auto geomData = GetGeometryData(shape)) {
 		if (geomData) {
 			if (verts.size() != geomData->GetNumVertices())
@@ -3879,18 +5065,18 @@ void NifFile::CalcNormalsForShape(NiShape* shape,
 	}
 }
 
-void NifFile::CalcTangentsForShape(NiShape* shape) {
+void NifFile::CalcTangentsForShape(NiShape* shape, const bool parallel) {
 	if (!shape)
 		return;
 
 	if (auto geomData = GetGeometryData(shape)) {
 		if (geomData)
-			geomData->CalcTangentSpace();
+			geomData->CalcTangentSpace(parallel);
 	}
 	else if (shape->HasType<BSTriShape>()) {
 		auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
 		if (bsTriShape)
-			bsTriShape->CalcTangentSpace();
+			bsTriShape->CalcTangentSpace(parallel);
 	}
 }
 
@@ -3969,6 +5155,8 @@ void NifFile::MoveVertex(NiShape* shape, const Vector3& pos, const int id) {
 	if (!shape)
 		return;
 
+	shape->InvalidateGeometryCache();
+
 	if (auto geomData = GetGeometryData(shape)) {
 		if (geomData && geomData->GetNumVertices() > id)
 			geomData->vertices[id] = pos;
@@ -3980,161 +5168,186 @@ void NifFile::MoveVertex(NiShape* shape, const Vector3& pos, const int id) {
 	}
 }
 
-void NifFile::OffsetShape(NiShape* shape, const Vector3& offset, std::unordered_map<uint16_t, float>* mask) {
+// Converts a masking map with 16 or 32-bit vertex indices to dense weights (1 - mask value).
+// Vertices past the last masked one aren't in the list and count as unmasked.
+template<typename IndexType>
+static std::vector<float> MaskToWeights(const std::unordered_map<IndexType, float>* mask) {
+	std::vector<float> weights;
+	if (!mask || mask->empty())
+		return weights;
+
+	IndexType maxIndex = 0;
+	for (auto& m : *mask)
+		maxIndex = std::max(maxIndex, m.first);
+
+	weights.resize(static_cast<size_t>(maxIndex) + 1, 1.0f);
+	for (auto& m : *mask)
+		weights[m.first] = 1.0f - m.second;
+
+	return weights;
+}
+
+void NifFile::TransformShape(NiShape* shape,
+							 const Matrix4& transform,
+							 Span<const float> weights,
+							 const bool transformNormals) {
 	if (!shape)
 		return;
 
+	shape->InvalidateGeometryCache();
+
+	// Tangents follow the linear part of the transform, normals its inverse transpose
+	const Matrix3 linear(Vector3(transform[0], transform[1], transform[2]),
+						 Vector3(transform[4], transform[5], transform[6]),
+						 Vector3(transform[8], transform[9], transform[10]));
+	Matrix3 normalTransform = linear;
+	Matrix3 inverse;
+	if (linear.Invert(&inverse))
+		normalTransform = inverse.Transpose();
+
 	if (auto geomData = GetGeometryData(shape)) {
-		if (geomData) {
-			for (uint16_t i = 0; i < geomData->GetNumVertices(); i++) {
-				if (mask) {
-					float maskFactor = 1.0f;
-					Vector3 diff = offset;
-					if (mask->find(i) != mask->end()) {
-						maskFactor = 1.0f - (*mask)[i];
-						diff *= maskFactor;
-					}
-					geomData->vertices[i] += diff;
-				}
-				else
-					geomData->vertices[i] += offset;
-			}
+		TransformPoints(geomData->vertices, transform, weights);
+
+		if (transformNormals) {
+			TransformDirections(geomData->normals, normalTransform, weights);
+			TransformDirections(geomData->tangents, linear, weights);
+			TransformDirections(geomData->bitangents, linear, weights);
 		}
 	}
-	else if (shape->HasType<BSTriShape>()) {
-		auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
-		if (bsTriShape) {
-			for (uint16_t i = 0; i < bsTriShape->GetNumVertices(); i++) {
-				if (mask) {
-					float maskFactor = 1.0f;
-					Vector3 diff = offset;
-					if (mask->find(i) != mask->end()) {
-						maskFactor = 1.0f - (*mask)[i];
-						diff *= maskFactor;
-					}
-					bsTriShape->vertData[i].vert += diff;
-				}
-				else
-					bsTriShape->vertData[i].vert += offset;
+	else if (auto bsTriShape = dynamic_cast<BSTriShape*>(shape)) {
+		// Positions are interleaved with the packed vertex data, so they are gathered and written back
+		std::vector<Vector3> verts = bsTriShape->UpdateRawVertices();
+		TransformPoints(verts, transform, weights);
+		for (uint16_t i = 0; i < bsTriShape->GetNumVertices(); i++)
+			bsTriShape->vertData[i].vert = verts[i];
+
+		if (transformNormals && bsTriShape->HasNormals()) {
+			std::vector<Vector3> normals = bsTriShape->UpdateRawNormals();
+			TransformDirections(normals, normalTransform, weights);
+			bsTriShape->SetNormals(normals);
+
+			if (bsTriShape->HasTangents()) {
+				std::vector<Vector3> tangents = bsTriShape->UpdateRawTangents();
+				std::vector<Vector3> bitangents = bsTriShape->UpdateRawBitangents();
+				TransformDirections(tangents, linear, weights);
+				TransformDirections(bitangents, linear, weights);
+				bsTriShape->SetTangentData(tangents);
+				bsTriShape->SetBitangentData(bitangents);
 			}
 		}
 	}
 }
 
-void NifFile::ScaleShape(NiShape* shape, const Vector3& scale, std::unordered_map<uint16_t, float>* mask) {
-	if (!shape)
+void NifFile::TransformShapes(const std::vector<NiShape*>& shapes,
+							  const Matrix4& transform,
+							  const bool transformNormals,
+							  const bool parallel) {
+	// Shapes sharing their geometry data are only transformed once
+	std::vector<NiShape*> uniqueShapes;
+	std::unordered_set<NiObject*> seenData;
+	for (auto& shape : shapes) {
+		if (!shape)
+			continue;
+
+		NiObject* data = GetGeometryData(shape);
+		if (!data)
+			data = shape;
+
+		if (seenData.insert(data).second)
+			uniqueShapes.push_back(shape);
+		else
+			shape->InvalidateGeometryCache();
+	}
+
+	auto transformRange = [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; i++)
+			TransformShape(uniqueShapes[i], transform, {}, transformNormals);
+	};
+
+	if (parallel)
+		ParallelFor(uniqueShapes.size(), 1, transformRange);
+	else
+		transformRange(0, uniqueShapes.size());
+}
+
+// Transforms of OffsetShape, ScaleShape and RotateShape
+static Matrix4 OffsetMatrix(const Vector3& offset) {
+	Matrix4 mat;
+	mat[3] = offset.x;
+	mat[7] = offset.y;
+	mat[11] = offset.z;
+	return mat;
+}
+
+static Matrix4 ScaleMatrix(const Vector3& scale) {
+	Matrix4 mat;
+	mat[0] = scale.x;
+	mat[5] = scale.y;
+	mat[10] = scale.z;
+	return mat;
+}
+
+static Matrix4 RotationMatrix(const Vector3& angle) {
+	Matrix4 mat;
+	mat.Rotate(angle.x * DEG2RAD, Vector3(1.0f, 0.0f, 0.0f));
+	mat.Rotate(angle.y * DEG2RAD, Vector3(0.0f, 1.0f, 0.0f));
+	mat.Rotate(angle.z * DEG2RAD, Vector3(0.0f, 0.0f, 1.0f));
+	return mat;
+}
+
+// Scales or rotates the vertices relative to the root, without moving them back by its translation.
+// Masked vertices aren't blended but end up at "v - root + (v - target) * (1 - mask)".
+template<typename IndexType>
+static void TransformShapeFromRoot(NifFile& nif,
+								   NiShape* shape,
+								   const Matrix4& transform,
+								   const std::unordered_map<IndexType, float>* mask) {
+	std::vector<Vector3> verts;
+	if (!nif.GetVertsForShape(shape, verts))
 		return;
 
 	Vector3 root;
-	GetRootTranslation(root);
+	nif.GetRootTranslation(root);
 
-	if (auto geomData = GetGeometryData(shape)) {
-		if (!geomData)
-			return;
+	std::vector<Vector3> targets = verts;
+	TransformPoints(targets, OffsetMatrix(Vector3(-root.x, -root.y, -root.z)));
+	TransformPoints(targets, transform);
 
-		std::unordered_map<uint16_t, Vector3> diff;
-		for (uint16_t i = 0; i < geomData->GetNumVertices(); i++) {
-			Vector3 target = geomData->vertices[i] - root;
-			target.x *= scale.x;
-			target.y *= scale.y;
-			target.z *= scale.z;
-			diff[i] = geomData->vertices[i] - target;
-
-			if (mask) {
-				float maskFactor = 1.0f;
-				if (mask->find(i) != mask->end()) {
-					maskFactor = 1.0f - (*mask)[i];
-					diff[i] *= maskFactor;
-					target = geomData->vertices[i] - root + diff[i];
-				}
-			}
-			geomData->vertices[i] = target;
-		}
-	}
-	else if (shape->HasType<BSTriShape>()) {
-		auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
-		if (!bsTriShape)
-			return;
+	if (mask) {
+		for (auto& m : *mask) {
+			if (m.first >= verts.size())
+				continue;
 
-		std::unordered_map<uint16_t, Vector3> diff;
-		for (uint16_t i = 0; i < bsTriShape->GetNumVertices(); i++) {
-			Vector3 target = bsTriShape->vertData[i].vert - root;
-			target.x *= scale.x;
-			target.y *= scale.y;
-			target.z *= scale.z;
-			diff[i] = bsTriShape->vertData[i].vert - target;
-
-			if (mask) {
-				float maskFactor = 1.0f;
-				if (mask->find(i) != mask->end()) {
-					maskFactor = 1.0f - (*mask)[i];
-					diff[i] *= maskFactor;
-					target = bsTriShape->vertData[i].vert - root + diff[i];
-				}
-			}
-			bsTriShape->vertData[i].vert = target;
+			const Vector3& v = verts[m.first];
+			targets[m.first] = v - root + (v - targets[m.first]) * (1.0f - m.second);
 		}
 	}
+
+	nif.SetVertsForShape(shape, targets);
 }
 
-void NifFile::RotateShape(NiShape* shape, const Vector3& angle, std::unordered_map<uint16_t, float>* mask) {
-	if (!shape)
-		return;
+void NifFile::OffsetShape(NiShape* shape, const Vector3& offset, std::unordered_map<uint32_t, float>* mask) {
+	TransformShape(shape, OffsetMatrix(offset), MaskToWeights(mask), false);
+}
 
-	Vector3 root;
-	GetRootTranslation(root);
+void NifFile::OffsetShape(NiShape* shape, const Vector3& offset, std::unordered_map<uint16_t, float>* mask) {
+	TransformShape(shape, OffsetMatrix(offset), MaskToWeights(mask), false);
+}
 
-	if (auto geomData = GetGeometryData(shape)) {
-		if (!geomData)
-			return;
+void NifFile::ScaleShape(NiShape* shape, const Vector3& scale, std::unordered_map<uint32_t, float>* mask) {
+	TransformShapeFromRoot(*this, shape, ScaleMatrix(scale), mask);
+}
 
-		std::unordered_map<uint16_t, Vector3> diff;
-		for (uint16_t i = 0; i < geomData->GetNumVertices(); i++) {
-			Vector3 target = geomData->vertices[i] - root;
-			Matrix4 mat;
-			mat.Rotate(angle.x * DEG2RAD, Vector3(1.0f, 0.0f, 0.0f));
-			mat.Rotate(angle.y * DEG2RAD, Vector3(0.0f, 1.0f, 0.0f));
-			mat.Rotate(angle.z * DEG2RAD, Vector3(0.0f, 0.0f, 1.0f));
-			target = mat * target;
-			diff[i] = geomData->vertices[i] - target;
-
-			if (mask) {
-				float maskFactor = 1.0f;
-				if (mask->find(i) != mask->end()) {
-					maskFactor = 1.0f - (*mask)[i];
-					diff[i] *= maskFactor;
-					target = geomData->vertices[i] - root + diff[i];
-				}
-			}
-			geomData->vertices[i] = target;
-		}
-	}
-	else if (shape->HasType<BSTriShape>()) {
-		auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
-		if (!bsTriShape)
-			return;
+void NifFile::ScaleShape(NiShape* shape, const Vector3& scale, std::unordered_map<uint16_t, float>* mask) {
+	TransformShapeFromRoot(*this, shape, ScaleMatrix(scale), mask);
+}
 
-		std::unordered_map<uint16_t, Vector3> diff;
-		for (uint16_t i = 0; i < bsTriShape->GetNumVertices(); i++) {
-			Vector3 target = bsTriShape->vertData[i].vert - root;
-			Matrix4 mat;
-			mat.Rotate(angle.x * DEG2RAD, Vector3(1.0f, 0.0f, 0.0f));
-			mat.Rotate(angle.y * DEG2RAD, Vector3(0.0f, 1.0f, 0.0f));
-			mat.Rotate(angle.z * DEG2RAD, Vector3(0.0f, 0.0f, 1.0f));
-			target = mat * target;
-			diff[i] = bsTriShape->vertData[i].vert - target;
-
-			if (mask) {
-				float maskFactor = 1.0f;
-				if (mask->find(i) != mask->end()) {
-					maskFactor = 1.0f - (*mask)[i];
-					diff[i] *= maskFactor;
-					target = bsTriShape->vertData[i].vert - root + diff[i];
-				}
-			}
-			bsTriShape->vertData[i].vert = target;
-		}
-	}
+void NifFile::RotateShape(NiShape* shape, const Vector3& angle, std::unordered_map<uint32_t, float>* mask) {
+	TransformShapeFromRoot(*this, shape, RotationMatrix(angle), mask);
+}
+
+void NifFile::RotateShape(NiShape* shape, const Vector3& angle, std::unordered_map<uint16_t, float>* mask) {
+	TransformShapeFromRoot(*this, shape, RotationMatrix(angle), mask);
 }
 
 NiAlphaProperty* NifFile::GetAlphaProperty(NiShape* shape) const {
@@ -4299,12 +5512,17 @@ void NifFile::RemoveEmptyPartitions(NiShape* shape) {
 }
 
 bool NifFile::DeleteVertsForShape(NiShape* shape, const std::vector<uint16_t>& indices) {
+	return DeleteVertsForShape(shape, std::vector<uint32_t>(indices.begin(), indices.end()));
+}
+
+bool NifFile::DeleteVertsForShape(NiShape* shape, const std::vector<uint32_t>& indices) {
 	if (indices.empty())
 		return false;
 
 	if (!shape)
 		return false;
 
+	shape->InvalidateGeometryCache();
 	bool allVertsDeleted = false;
 
 	auto geomData = hdr.GetBlock<NiTriBasedGeomData>(shape->DataRef());
@@ -4335,12 +5553,6 @@ bool NifFile::DeleteVertsForShape(NiShape* shape, const std::vector<uint16_t>& i
 			return false;
 		}
 
-		// Vertex indices are 16-bit; meshes beyond that limit can't be indexed safely,
-		// so the deletion is skipped entirely rather than applied partially.
-		if (meshData->vertices.size() > std::numeric_limits<uint16_t>::max()) {
-			return false;
-		}
-
 		meshData->notifyVerticesDelete(indices);
 		if (meshData->vertices.empty() || meshData->tris.empty()) {
 			// Deleted all verts or tris
@@ -4375,10 +5587,8 @@ bool NifFile::DeleteVertsForShape(NiShape* shape, const std::vector<uint16_t>& i
 			auto integersData = integersExtraData->integersData;
 			std::sort(integersData.begin(), integersData.end());
 
-			uint16_t highestRemoved = indices.back();
-
-			// 32-bit to avoid wrapping around to zero for a highest removed index of 65535
-			uint32_t mapSize = static_cast<uint32_t>(highestRemoved) + 1;
+			uint32_t highestRemoved = indices.back();
+			uint32_t mapSize = highestRemoved + 1;
 			std::vector<int> indexCollapse = GenerateIndexCollapseMap(indices, mapSize);
 
 			for (uint32_t i = integersData.size() - 1; i != NIF_NPOS; i--) {
@@ -4400,12 +5610,411 @@ bool NifFile::DeleteVertsForShape(NiShape* shape, const std::vector<uint16_t>& i
 	return allVertsDeleted;
 }
 
+bool NifFile::ReorderVertices(NiShape* shape, const std::vector<int>& vertMap) {
+	auto verts = GetVertsForShape(shape);
+	if (!verts || verts->size() != vertMap.size())
+		return false;
+
+	// The map has to be a permutation, vertices can't be merged or dropped here
+	std::vector<bool> used(vertMap.size(), false);
+	for (int index : vertMap) {
+		if (index < 0 || static_cast<size_t>(index) >= used.size() || used[static_cast<size_t>(index)])
+			return false;
+
+		used[static_cast<size_t>(index)] = true;
+	}
+
+	shape->InvalidateGeometryCache();
+
+	auto geomData = hdr.GetBlock<NiGeometryData>(shape->DataRef());
+	if (geomData)
+		geomData->notifyVerticesReorder(vertMap);
+
+	auto bsTriShape = dynamic_cast<BSTriShape*>(shape);
+	if (bsTriShape)
+		bsTriShape->notifyVerticesReorder(vertMap);
+
+	auto bsGeometry = dynamic_cast<BSGeometry*>(shape);
+	if (bsGeometry) {
+		// Only the currently selected mesh is affected
+		auto meshData = dynamic_cast<BSGeometryMeshData*>(bsGeometry->GetGeomData());
+		if (meshData)
+			meshData->notifyVerticesReorder(vertMap);
+	}
+
+	auto skinInst = hdr.GetBlock<NiSkinInstance>(shape->SkinInstanceRef());
+	if (skinInst) {
+		auto skinData = hdr.GetBlock(skinInst->dataRef);
+		if (skinData)
+			skinData->notifyVerticesReorder(vertMap);
+
+		auto skinPartition = hdr.GetBlock(skinInst->skinPartitionRef);
+		if (skinPartition)
+			skinPartition->notifyVerticesReorder(vertMap);
+	}
+
+	auto controller = hdr.GetBlock<NiTimeController>(shape->controllerRef);
+	while (controller) {
+		auto geomMorpher = dynamic_cast<NiGeomMorpherController*>(controller);
+		if (geomMorpher) {
+			auto morphData = hdr.GetBlock(geomMorpher->dataRef);
+			if (morphData)
+				morphData->notifyVerticesReorder(vertMap);
+		}
+
+		controller = hdr.GetBlock(controller->nextControllerRef);
+	}
+
+	for (auto& extraDataRef : shape->extraDataRefs) {
+		auto integersExtraData = hdr.GetBlock<NiIntegersExtraData>(extraDataRef);
+		if (integersExtraData && integersExtraData->name == "LOCKEDNORM") {
+			for (auto& val : integersExtraData->integersData)
+				if (val < vertMap.size())
+					val = static_cast<uint32_t>(vertMap[val]);
+		}
+	}
+
+	return true;
+}
+
+bool NifFile::OptimizeVertexFetch(NiShape* shape) {
+	auto verts = GetVertsForShape(shape);
+	if (!verts)
+		return false;
+
+	std::vector<Triangle> tris;
+	if (!shape->GetTriangles(tris))
+		return false;
+
+	return ReorderVertices(shape, GenerateVertexFetchMap(tris, static_cast<uint32_t>(verts->size())));
+}
+
+std::shared_ptr<const TriangleBVH> NifFile::GetShapeBVH(NiShape* shape, const MatTransform& transform) {
+	if (!shape)
+		return nullptr;
+
+	auto verts = GetVertsForShape(shape);
+	if (!verts)
+		return nullptr;
+
+	auto bvh = shape->GetCachedBVH();
+	if (bvh && bvh->GetNumVertices() == verts->size() && bvh->GetNumTriangles() == shape->GetNumTriangles()) {
+		const MatTransform& cached = bvh->GetTransform();
+		if (cached.translation == transform.translation && cached.rotation == transform.rotation
+			&& cached.scale == transform.scale)
+			return bvh;
+	}
+
+	std::vector<Triangle> tris;
+	shape->GetTriangles(tris);
+
+	bvh = std::make_shared<TriangleBVH>(*verts, tris, transform);
+	shape->SetCachedBVH(bvh);
+	return bvh;
+}
+
+std::shared_ptr<const MeshTopology> NifFile::GetShapeTopology(NiShape* shape) {
+	if (!shape)
+		return nullptr;
+
+	auto verts = GetVertsForShape(shape);
+	if (!verts)
+		return nullptr;
+
+	auto topology = shape->GetCachedTopology();
+	if (topology && topology->GetNumVertices() == verts->size()
+		&& topology->GetNumTriangles() == shape->GetNumTriangles())
+		return topology;
+
+	std::vector<Triangle> tris;
+	shape->GetTriangles(tris);
+
+	topology = std::make_shared<MeshTopology>(verts->size(), tris);
+	shape->SetCachedTopology(topology);
+	return topology;
+}
+
+// Simplifies the triangles once per ratio of the full triangle count, each level based on the previous one.
+// The topology of the triangles (or nullptr) is used for the first level.
+static std::vector<std::vector<Triangle>> SimplifyLevels(const std::vector<Vector3>& verts,
+														 const std::vector<Triangle>& tris,
+														 const SimplifyAttributes& attributes,
+														 const std::vector<float>& ratios,
+														 const float maxError,
+														 const MeshTopology* topology = nullptr) {
+	std::vector<std::vector<Triangle>> levels;
+	levels.reserve(ratios.size());
+
+	const float numTris = static_cast<float>(tris.size());
+	for (float ratio : ratios) {
+		const auto targetCount = static_cast<uint32_t>(std::clamp(ratio, 0.0f, 1.0f) * numTris);
+		const std::vector<Triangle>& previous = levels.empty() ? tris : levels.back();
+		auto lodTris = SimplifyTriangles(verts,
+										 previous,
+										 targetCount,
+										 maxError,
+										 &attributes,
+										 nullptr,
+										 levels.empty() ? topology : nullptr);
+		if (lodTris.empty())
+			break;
+
+		levels.push_back(std::move(lodTris));
+	}
+
+	return levels;
+}
+
+SimplifyAttributes NifFile::GetSimplifyAttributes(NiShape* shape) const {
+	SimplifyAttributes attributes;
+
+	std::vector<Vector3> verts;
+	if (!GetVertsForShape(shape, verts))
+		return attributes;
+
+	const size_t numVerts = verts.size();
+
+	std::vector<Vector2> uvs;
+	if (GetUvsForShape(shape, uvs) && uvs.size() == numVerts) {
+		std::vector<float> u(numVerts);
+		std::vector<float> v(numVerts);
+		for (size_t i = 0; i < numVerts; i++) {
+			u[i] = uvs[i].u;
+			v[i] = uvs[i].v;
+		}
+
+		attributes.Add(std::move(u), 0.5f);
+		attributes.Add(std::move(v), 0.5f);
+	}
+
+	std::vector<Color4> colors;
+	if (GetColorsForShape(shape, colors) && colors.size() == numVerts) {
+		std::vector<float> channels[4];
+		for (auto& channel : channels)
+			channel.resize(numVerts);
+
+		for (size_t i = 0; i < numVerts; i++) {
+			channels[0][i] = colors[i].r;
+			channels[1][i] = colors[i].g;
+			channels[2][i] = colors[i].b;
+			channels[3][i] = colors[i].a;
+		}
+
+		for (auto& channel : channels)
+			attributes.Add(std::move(channel), 0.5f);
+	}
+
+	// Bone weights are sparse, as a vertex only has a few of the bones
+	std::vector<int> boneIDs;
+	const uint32_t numBones = GetShapeBoneIDList(shape, boneIDs);
+	std::vector<std::vector<SimplifyAttributes::SparseValue>> vertBoneWeights(numBones > 0 ? numVerts : 0);
+	for (uint32_t bone = 0; bone < numBones; bone++) {
+		std::unordered_map<uint16_t, float> weights;
+		if (GetShapeBoneWeights(shape, bone, weights) == 0)
+			continue;
+
+		for (auto& [vertIndex, weight] : weights)
+			if (vertIndex < numVerts && weight != 0.0f)
+				vertBoneWeights[vertIndex].push_back({bone, weight});
+	}
+
+	if (numBones > 0)
+		attributes.SetSparse(std::move(vertBoneWeights), 1.0f);
+
+	return attributes;
+}
+
+std::vector<std::vector<Triangle>> NifFile::GenerateLODTriangles(NiShape* shape,
+																 const std::vector<float>& ratios,
+																 const float maxError) const {
+	std::vector<std::vector<Triangle>> levels;
+
+	std::vector<Vector3> verts;
+	if (!GetVertsForShape(shape, verts))
+		return levels;
+
+	std::vector<Triangle> tris;
+	if (!shape->GetTriangles(tris) || tris.empty())
+		return levels;
+
+	// A cached topology is reused if it still matches
+	const SimplifyAttributes attributes = GetSimplifyAttributes(shape);
+	const std::shared_ptr<const MeshTopology> topology = shape->GetCachedTopology();
+	return SimplifyLevels(verts, tris, attributes, ratios, maxError, topology.get());
+}
+
+uint32_t NifFile::GenerateLODsForShapes(const std::vector<NiShape*>& shapes,
+										const std::vector<float>& ratios,
+										const float maxError) {
+	struct LODInput {
+		NiShape* shape = nullptr;
+		const BSGeometryMeshData* meshData = nullptr;
+		std::shared_ptr<const MeshTopology> topology;
+		SimplifyAttributes attributes;
+		std::vector<std::vector<Triangle>> levels;
+	};
+
+	// Shape data is gathered first, as reading it is not thread safe
+	std::vector<LODInput> inputs;
+	for (auto shape : shapes) {
+		if (!shape)
+			continue;
+
+		// Shared or packed mesh data is read in place and only unpacked below to store the levels
+		auto meshData = dynamic_cast<const BSGeometryMeshData*>(ReadGeometryData(shape));
+		if (!meshData || meshData->tris.empty())
+			continue;
+
+		LODInput& input = inputs.emplace_back();
+		input.shape = shape;
+		input.meshData = meshData;
+		input.topology = GetShapeTopology(shape);
+		input.attributes = GetSimplifyAttributes(shape);
+	}
+
+	ParallelFor(inputs.size(), 1, [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			LODInput& input = inputs[i];
+			input.levels = SimplifyLevels(input.meshData->vertices,
+										  input.meshData->tris,
+										  input.attributes,
+										  ratios,
+										  maxError,
+										  input.topology.get());
+		}
+	});
+
+	uint32_t count = 0;
+	for (auto& input : inputs) {
+		if (input.levels.empty())
+			continue;
+
+		auto meshData = static_cast<BSGeometryMeshData*>(input.shape->GetGeomData());
+		meshData->lods = std::move(input.levels);
+		meshData->nLODS = static_cast<uint32_t>(meshData->lods.size());
+		count++;
+	}
+
+	return count;
+}
+
+// Number of base values diffed against all targets at a time, so that the block stays in the cache
+constexpr size_t DiffBlockSize = 4096;
+
+// Calculates the differences of the base data to all targets block by block.
+// "diffFunc(base, target, out, count)" writes the raw differences, which are then compacted to the values
+// with any component of at least EPSILON.
+template<typename T, typename DiffFunc>
+static void CalcSparseDiffs(const std::vector<T>& base,
+							const std::vector<const std::vector<T>*>& targets,
+							DiffFunc diffFunc,
+							SparseDiffData& outDiffData) {
+	std::vector<std::vector<uint32_t>> targetIndices(targets.size());
+	std::vector<std::vector<Vector3>> targetDiffs(targets.size());
+	std::vector<Vector3> blockDiffs(std::min(DiffBlockSize, base.size()));
+
+	for (size_t first = 0; first < base.size(); first += DiffBlockSize) {
+		const size_t count = std::min(DiffBlockSize, base.size() - first);
+
+		for (size_t t = 0; t < targets.size(); t++) {
+			diffFunc(base.data() + first, targets[t]->data() + first, blockDiffs.data(), count);
+
+			auto& indices = targetIndices[t];
+			auto& diffs = targetDiffs[t];
+			for (size_t i = 0; i < count; i++) {
+				if (blockDiffs[i].IsZero(true))
+					continue;
+
+				indices.push_back(static_cast<uint32_t>(first + i));
+				diffs.push_back(blockDiffs[i]);
+			}
+		}
+	}
+
+	outDiffData.Clear();
+	if (targets.size() == 1) {
+		outDiffData.indices = std::move(targetIndices[0]);
+		outDiffData.diffs = std::move(targetDiffs[0]);
+		outDiffData.offsets.push_back(static_cast<uint32_t>(outDiffData.indices.size()));
+		return;
+	}
+
+	size_t total = 0;
+	for (auto& indices : targetIndices)
+		total += indices.size();
+
+	outDiffData.offsets.reserve(targets.size() + 1);
+	outDiffData.indices.reserve(total);
+	outDiffData.diffs.reserve(total);
+
+	for (size_t t = 0; t < targets.size(); t++) {
+		auto& indices = targetIndices[t];
+		auto& diffs = targetDiffs[t];
+		outDiffData.indices.insert(outDiffData.indices.end(), indices.begin(), indices.end());
+		outDiffData.diffs.insert(outDiffData.diffs.end(), diffs.begin(), diffs.end());
+		outDiffData.offsets.push_back(static_cast<uint32_t>(outDiffData.indices.size()));
+	}
+}
+
+// Plain loops over whole blocks that the compiler can vectorize
+static void DiffPositions(
+	const Vector3* base, const Vector3* target, Vector3* out, const size_t count, const float scale) {
+	for (size_t i = 0; i < count; i++) {
+		out[i].x = target[i].x * scale - base[i].x;
+		out[i].y = target[i].y * scale - base[i].y;
+		out[i].z = target[i].z * scale - base[i].z;
+	}
+}
+
+static void DiffUVs(
+	const Vector2* base, const Vector2* target, Vector3* out, const size_t count, const float scale) {
+	for (size_t i = 0; i < count; i++) {
+		out[i].x = (target[i].u - base[i].u) * scale;
+		out[i].y = (target[i].v - base[i].v) * scale;
+		out[i].z = 0.0f;
+	}
+}
+
+// Copies the sparse differences of the first target to a map
+template<typename IndexType>
+static void SparseDiffsToMap(const SparseDiffData& diffData,
+							 std::unordered_map<IndexType, Vector3>& outDiffData) {
+	outDiffData.reserve(diffData.indices.size());
+	for (size_t i = 0; i < diffData.indices.size(); i++)
+		if (diffData.indices[i] <= std::numeric_limits<IndexType>::max())
+			outDiffData[static_cast<IndexType>(diffData.indices[i])] = diffData.diffs[i];
+}
+
 int NifFile::CalcShapeDiff(NiShape* shape,
 						   const std::vector<Vector3>* targetData,
 						   std::unordered_map<uint16_t, Vector3>& outDiffData,
 						   float scale) {
 	outDiffData.clear();
 
+	SparseDiffData diffData;
+	int result = CalcShapeDiff(shape, targetData, diffData, scale);
+	SparseDiffsToMap(diffData, outDiffData);
+	return result;
+}
+
+int NifFile::CalcShapeDiff(NiShape* shape,
+						   const std::vector<Vector3>* targetData,
+						   std::unordered_map<uint32_t, Vector3>& outDiffData,
+						   float scale) {
+	outDiffData.clear();
+
+	SparseDiffData diffData;
+	int result = CalcShapeDiff(shape, targetData, diffData, scale);
+	SparseDiffsToMap(diffData, outDiffData);
+	return result;
+}
+
+int NifFile::CalcShapeDiff(NiShape* shape,
+						   const std::vector<Vector3>* targetData,
+						   std::vector<Vector3>& outDiffData,
+						   float scale) {
+	outDiffData.clear();
+
 	const std::vector<Vector3>* myData = GetVertsForShape(shape);
 	if (!myData)
 		return 1;
@@ -4416,21 +6025,46 @@ int NifFile::CalcShapeDiff(NiShape* shape,
 	if (myData->size() != targetData->size())
 		return 3;
 
-	for (uint16_t i = 0; i < static_cast<uint16_t>(myData->size()); i++) {
-		auto& target = targetData->at(i);
-		auto& src = myData->at(i);
+	outDiffData.resize(myData->size());
+	DiffPositions(myData->data(), targetData->data(), outDiffData.data(), myData->size(), scale);
 
-		Vector3 v;
-		v.x = (target.x * scale) - src.x;
-		v.y = (target.y * scale) - src.y;
-		v.z = (target.z * scale) - src.z;
+	for (auto& diff : outDiffData)
+		if (diff.IsZero(true))
+			diff.Zero();
 
-		if (v.IsZero(true))
-			continue;
+	return 0;
+}
+
+int NifFile::CalcShapeDiff(NiShape* shape,
+						   const std::vector<Vector3>* targetData,
+						   SparseDiffData& outDiffData,
+						   float scale) {
+	return CalcShapeDiffs(shape, {targetData}, outDiffData, scale);
+}
+
+int NifFile::CalcShapeDiffs(NiShape* shape,
+							const std::vector<const std::vector<Vector3>*>& targetData,
+							SparseDiffData& outDiffData,
+							float scale) {
+	outDiffData.Clear();
+
+	const std::vector<Vector3>* myData = GetVertsForShape(shape);
+	if (!myData)
+		return 1;
 
-		outDiffData[i] = v;
+	for (auto& target : targetData) {
+		if (!target)
+			return 2;
+
+		if (myData->size() != target->size())
+			return 3;
 	}
 
+	auto diffFunc = [scale](const Vector3* base, const Vector3* target, Vector3* out, size_t count) {
+		DiffPositions(base, target, out, count, scale);
+	};
+
+	CalcSparseDiffs(*myData, targetData, diffFunc, outDiffData);
 	return 0;
 }
 
@@ -4440,6 +6074,30 @@ int NifFile::CalcUVDiff(NiShape* shape,
 						float scale) {
 	outDiffData.clear();
 
+	SparseDiffData diffData;
+	int result = CalcUVDiff(shape, targetData, diffData, scale);
+	SparseDiffsToMap(diffData, outDiffData);
+	return result;
+}
+
+int NifFile::CalcUVDiff(NiShape* shape,
+						const std::vector<Vector2>* targetData,
+						std::unordered_map<uint32_t, Vector3>& outDiffData,
+						float scale) {
+	outDiffData.clear();
+
+	SparseDiffData diffData;
+	int result = CalcUVDiff(shape, targetData, diffData, scale);
+	SparseDiffsToMap(diffData, outDiffData);
+	return result;
+}
+
+int NifFile::CalcUVDiff(NiShape* shape,
+						const std::vector<Vector2>* targetData,
+						std::vector<Vector3>& outDiffData,
+						float scale) {
+	outDiffData.clear();
+
 	const std::vector<Vector2>* myData = GetUvsForShape(shape);
 	if (!myData)
 		return 1;
@@ -4450,17 +6108,46 @@ int NifFile::CalcUVDiff(NiShape* shape,
 	if (myData->size() != targetData->size())
 		return 3;
 
-	for (uint16_t i = 0; i < static_cast<uint16_t>(myData->size()); i++) {
-		Vector3 v;
-		v.x = (targetData->at(i).u - myData->at(i).u) * scale;
-		v.y = (targetData->at(i).v - myData->at(i).v) * scale;
+	outDiffData.resize(myData->size());
+	DiffUVs(myData->data(), targetData->data(), outDiffData.data(), myData->size(), scale);
 
-		if (v.IsZero(true))
-			continue;
+	for (auto& diff : outDiffData)
+		if (diff.IsZero(true))
+			diff.Zero();
+
+	return 0;
+}
+
+int NifFile::CalcUVDiff(NiShape* shape,
+						const std::vector<Vector2>* targetData,
+						SparseDiffData& outDiffData,
+						float scale) {
+	return CalcUVDiffs(shape, {targetData}, outDiffData, scale);
+}
+
+int NifFile::CalcUVDiffs(NiShape* shape,
+						 const std::vector<const std::vector<Vector2>*>& targetData,
+						 SparseDiffData& outDiffData,
+						 float scale) {
+	outDiffData.Clear();
+
+	const std::vector<Vector2>* myData = GetUvsForShape(shape);
+	if (!myData)
+		return 1;
+
+	for (auto& target : targetData) {
+		if (!target)
+			return 2;
 
-		outDiffData[i] = v;
+		if (myData->size() != target->size())
+			return 3;
 	}
 
+	auto diffFunc = [scale](const Vector2* base, const Vector2* target, Vector3* out, size_t count) {
+		DiffUVs(base, target, out, count, scale);
+	};
+
+	CalcSparseDiffs(*myData, targetData, diffFunc, outDiffData);
 	return 0;
 }
 
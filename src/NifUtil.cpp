@@ -5,8 +5,12 @@ See the included GPLv3 LICENSE file
 */
 
 #include "NifUtil.hpp"
+#include "MeshTopology.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <limits>
 
 namespace nifly {
 
@@ -43,6 +47,23 @@ std::unique_ptr<std::istream> GetBinaryInputFileStream(const std::filesystem::pa
 	return nullptr;
 }
 
+bool ReadBinaryFile(const std::filesystem::path& path, std::vector<char>& outData) {
+	std::error_code error;
+	const auto fileSize = std::filesystem::file_size(path, error);
+	if (error)
+		return false;
+
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file)
+		return false;
+
+	outData.resize(static_cast<size_t>(fileSize));
+	if (!outData.empty())
+		file.read(outData.data(), static_cast<std::streamsize>(outData.size()));
+
+	return static_cast<size_t>(file.gcount()) == outData.size();
+}
+
 std::unique_ptr<std::ostream> GetBinaryOutputFileStream(const std::filesystem::path& path) {
 	auto fileStream = std::make_unique<std::ofstream>(path, std::ios::out | std::ios::binary);
 	if (fileStream && !fileStream->fail())
@@ -51,4 +72,370 @@ std::unique_ptr<std::ostream> GetBinaryOutputFileStream(const std::filesystem::p
 	return nullptr;
 }
 
+static uint32_t CalcVertexCount(Span<const Triangle> tris) {
+	uint32_t numVerts = 0;
+	for (const Triangle& t : tris)
+		numVerts = std::max(numVerts, static_cast<uint32_t>(std::max({t.p1, t.p2, t.p3})) + 1);
+
+	return numVerts;
+}
+
+std::vector<uint32_t> GenerateVertexCacheOrder(Span<const Triangle> tris, const uint32_t cacheSize) {
+	const uint32_t numTris = static_cast<uint32_t>(tris.size());
+	std::vector<uint32_t> order;
+	order.reserve(numTris);
+	if (numTris == 0)
+		return order;
+
+	const uint32_t maxCache = std::max(cacheSize, 4u);
+	const uint32_t numVerts = CalcVertexCount(tris);
+
+	// Triangles using each vertex. The first vertLive[v] entries of a vertex are the ones not drawn yet.
+	std::vector<uint32_t> vertStart(numVerts + 1, 0);
+	for (const Triangle& t : tris) {
+		++vertStart[t.p1 + 1u];
+		++vertStart[t.p2 + 1u];
+		++vertStart[t.p3 + 1u];
+	}
+
+	for (uint32_t v = 0; v < numVerts; ++v)
+		vertStart[v + 1] += vertStart[v];
+
+	std::vector<uint32_t> vertTris(vertStart[numVerts]);
+	std::vector<uint32_t> vertLive(numVerts, 0);
+	for (uint32_t t = 0; t < numTris; ++t) {
+		for (const uint16_t v : {tris[t].p1, tris[t].p2, tris[t].p3})
+			vertTris[vertStart[v] + vertLive[v]++] = t;
+	}
+
+	// Score of a vertex at each cache position. The last triangle's vertices get a fixed score
+	// so that the next triangle doesn't prefer reusing its edge too much.
+	std::vector<float> cacheScores(maxCache);
+	for (uint32_t i = 0; i < maxCache; ++i) {
+		if (i < 3)
+			cacheScores[i] = 0.75f;
+		else
+			cacheScores[i] = std::pow(1.0f - static_cast<float>(i - 3) / static_cast<float>(maxCache - 3),
+									  1.5f);
+	}
+
+	std::vector<int32_t> cachePos(numVerts, -1);
+	auto calcVertexScore = [&](const uint32_t v) {
+		if (vertLive[v] == 0)
+			return -1.0f;
+
+		// Vertices with few triangles left are boosted to get rid of lone triangles early
+		float score = 2.0f / std::sqrt(static_cast<float>(vertLive[v]));
+		if (cachePos[v] >= 0)
+			score += cacheScores[static_cast<uint32_t>(cachePos[v])];
+
+		return score;
+	};
+
+	std::vector<float> vertScores(numVerts);
+	for (uint32_t v = 0; v < numVerts; ++v)
+		vertScores[v] = calcVertexScore(v);
+
+	auto calcTriangleScore = [&](const uint32_t t) {
+		return vertScores[tris[t].p1] + vertScores[tris[t].p2] + vertScores[tris[t].p3];
+	};
+
+	uint32_t best = 0;
+	float bestScore = -1.0f;
+	for (uint32_t t = 0; t < numTris; ++t) {
+		const float score = calcTriangleScore(t);
+		if (score > bestScore) {
+			bestScore = score;
+			best = t;
+		}
+	}
+
+	std::vector<bool> drawn(numTris, false);
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	cache.reserve(maxCache + 3);
+	newCache.reserve(maxCache + 3);
+	uint32_t nextUndrawn = 0;
+
+	for (;;) {
+		drawn[best] = true;
+		order.push_back(best);
+
+		const uint32_t corners[3] = {tris[best].p1, tris[best].p2, tris[best].p3};
+		for (const uint32_t v : corners) {
+			uint32_t* list = &vertTris[vertStart[v]];
+			for (uint32_t i = 0; i < vertLive[v]; ++i) {
+				if (list[i] == best) {
+					std::swap(list[i], list[vertLive[v] - 1]);
+					--vertLive[v];
+					break;
+				}
+			}
+		}
+
+		if (order.size() == numTris)
+			break;
+
+		// Move the vertices of the triangle to the front of the cache
+		newCache.clear();
+		for (const uint32_t v : corners)
+			if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+				newCache.push_back(v);
+
+		for (const uint32_t v : cache)
+			if (v != corners[0] && v != corners[1] && v != corners[2])
+				newCache.push_back(v);
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(newCache.size()); ++i)
+			cachePos[newCache[i]] = i < maxCache ? static_cast<int32_t>(i) : -1;
+
+		// Only the scores of cached and evicted vertices changed
+		for (const uint32_t v : newCache)
+			vertScores[v] = calcVertexScore(v);
+
+		bestScore = -1.0f;
+		best = numTris;
+		for (const uint32_t v : newCache) {
+			for (uint32_t i = vertStart[v]; i < vertStart[v] + vertLive[v]; ++i) {
+				const uint32_t t = vertTris[i];
+				const float score = calcTriangleScore(t);
+				if (score > bestScore) {
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+
+		if (newCache.size() > maxCache)
+			newCache.resize(maxCache);
+		cache.swap(newCache);
+
+		// Nothing in the cache has triangles left, continue with the next triangle in input order
+		if (best == numTris) {
+			while (drawn[nextUndrawn])
+				++nextUndrawn;
+			best = nextUndrawn;
+		}
+	}
+
+	return order;
+}
+
+std::vector<int> GenerateVertexFetchMap(Span<const Triangle> tris, const uint32_t numVerts) {
+	std::vector<int> indexMap(numVerts, -1);
+	int nextIndex = 0;
+	for (const Triangle& t : tris) {
+		for (const uint16_t v : {t.p1, t.p2, t.p3})
+			if (v < numVerts && indexMap[v] == -1)
+				indexMap[v] = nextIndex++;
+	}
+
+	for (int& index : indexMap)
+		if (index == -1)
+			index = nextIndex++;
+
+	return indexMap;
+}
+
+float CalcCacheMissRatio(Span<const Triangle> tris, const uint32_t cacheSize) {
+	if (tris.empty())
+		return 0.0f;
+
+	// A vertex is in the FIFO cache if fewer than cacheSize misses happened since it was added
+	std::vector<uint32_t> addedAt(CalcVertexCount(tris), 0);
+	uint32_t misses = 0;
+	for (const Triangle& t : tris) {
+		for (const uint16_t v : {t.p1, t.p2, t.p3}) {
+			if (misses + cacheSize - addedAt[v] >= cacheSize) {
+				++misses;
+				addedAt[v] = misses + cacheSize;
+			}
+		}
+	}
+
+	return static_cast<float>(misses) / static_cast<float>(tris.size());
+}
+
+std::vector<std::vector<uint16_t>> GenerateStripsFromTriangles(Span<const Triangle> tris,
+															   const bool joinStrips,
+															   const uint32_t cacheSize) {
+	std::vector<std::vector<uint16_t>> strips;
+	const uint32_t numTris = static_cast<uint32_t>(tris.size());
+	if (numTris == 0)
+		return strips;
+
+	const MeshTopology topology(CalcVertexCount(tris), tris);
+
+	auto isDegenerate = [](const Triangle& t) { return t.p1 == t.p2 || t.p2 == t.p3 || t.p3 == t.p1; };
+
+	// Triangles that are already part of a strip, and the triangles of the strip being tried
+	std::vector<bool> used(numTris, false);
+	std::vector<uint32_t> trialStamp(numTris, 0);
+	uint32_t trial = 0;
+
+	// Finds a free triangle across edge a-b whose third vertex c gives the same winding as "makeTriangle(c)"
+	auto findAcross = [&](const uint16_t a, const uint16_t b, uint16_t& outVertex, auto&& makeTriangle) {
+		const uint32_t edge = topology.FindEdge(a, b);
+		if (edge == MeshTopology::npos)
+			return MeshTopology::npos;
+
+		for (const uint32_t t : topology.GetEdgeTriangles(edge)) {
+			if (used[t] || trialStamp[t] == trial || isDegenerate(tris[t]))
+				continue;
+
+			const Triangle& tri = tris[t];
+			uint16_t c = tri.p3;
+			if (tri.p1 != a && tri.p1 != b)
+				c = tri.p1;
+			else if (tri.p2 != a && tri.p2 != b)
+				c = tri.p2;
+
+			// Same winding if the expected triangle is a rotation of the actual one
+			Triangle expected = makeTriangle(c);
+			Triangle actual = tri;
+			expected.rot();
+			actual.rot();
+			if (expected == actual) {
+				outVertex = c;
+				return t;
+			}
+		}
+
+		return MeshTopology::npos;
+	};
+
+	// Grows a strip from the start triangle, beginning with the given corner
+	std::vector<uint16_t> strip;
+	std::vector<uint32_t> stripTris;
+	auto growStrip = [&](const uint32_t start, const int corner) {
+		++trial;
+		strip.clear();
+		stripTris.clear();
+
+		const Triangle& t = tris[start];
+		strip.push_back(t[corner]);
+		strip.push_back(t[(corner + 1) % 3]);
+		strip.push_back(t[(corner + 2) % 3]);
+		stripTris.push_back(start);
+		trialStamp[start] = trial;
+
+		constexpr size_t maxLength = std::numeric_limits<uint16_t>::max();
+		while (strip.size() < maxLength) {
+			const uint16_t a = strip[strip.size() - 2];
+			const uint16_t b = strip.back();
+			const bool even = (strip.size() & 1) == 0;
+
+			uint16_t c = 0;
+			const uint32_t next = findAcross(a, b, c, [&](const uint16_t v) {
+				return even ? Triangle(a, b, v) : Triangle(a, v, b);
+			});
+			if (next == MeshTopology::npos)
+				break;
+
+			strip.push_back(c);
+			stripTris.push_back(next);
+			trialStamp[next] = trial;
+		}
+
+		// Grows backward two points at a time, so the winding of the strip triangles stays the same
+		std::vector<uint16_t> front;
+		while (strip.size() + front.size() + 2 <= maxLength) {
+			const uint16_t s0 = front.empty() ? strip[0] : front[front.size() - 1];
+			const uint16_t s1 = front.empty() ? strip[1] : front[front.size() - 2];
+
+			uint16_t d1 = 0;
+			const uint32_t t1 = findAcross(s0, s1, d1, [&](const uint16_t v) { return Triangle(v, s1, s0); });
+			if (t1 == MeshTopology::npos)
+				break;
+
+			trialStamp[t1] = trial;
+
+			uint16_t d2 = 0;
+			const uint32_t t2 = findAcross(d1, s0, d2, [&](const uint16_t v) { return Triangle(v, d1, s0); });
+			if (t2 == MeshTopology::npos) {
+				trialStamp[t1] = 0;
+				break;
+			}
+
+			trialStamp[t2] = trial;
+			front.push_back(d1);
+			front.push_back(d2);
+			stripTris.push_back(t1);
+			stripTris.push_back(t2);
+		}
+
+		strip.insert(strip.begin(), front.rbegin(), front.rend());
+	};
+
+	// Strips start at the free triangles in vertex cache order, from the corner giving the longest strip
+	std::vector<uint16_t> bestStrip;
+	std::vector<uint32_t> bestStripTris;
+	for (const uint32_t start : GenerateVertexCacheOrder(tris, cacheSize)) {
+		if (used[start] || isDegenerate(tris[start]))
+			continue;
+
+		bestStrip.clear();
+		for (int corner = 0; corner < 3; corner++) {
+			growStrip(start, corner);
+			if (strip.size() > bestStrip.size()) {
+				bestStrip.swap(strip);
+				bestStripTris.swap(stripTris);
+			}
+		}
+
+		for (const uint32_t t : bestStripTris)
+			used[t] = true;
+
+		strips.push_back(bestStrip);
+	}
+
+	if (!joinStrips || strips.size() < 2)
+		return strips;
+
+	// Joins the strips with degenerate triangles. An extra vertex keeps the winding of an odd length strip.
+	std::vector<std::vector<uint16_t>> joined(1);
+	for (auto& s : strips) {
+		std::vector<uint16_t>& current = joined.back();
+		if (current.empty()) {
+			current = std::move(s);
+			continue;
+		}
+
+		const size_t extra = 2 + (current.size() & 1);
+		if (current.size() + extra + s.size() > std::numeric_limits<uint16_t>::max()) {
+			joined.push_back(std::move(s));
+			continue;
+		}
+
+		if (current.size() & 1)
+			current.push_back(current.back());
+
+		current.push_back(current.back());
+		current.push_back(s.front());
+		current.insert(current.end(), s.begin(), s.end());
+	}
+
+	return joined;
+}
+
+bool CountStripTriangles(const std::vector<std::vector<uint16_t>>& strips, uint16_t& outNumTriangles) {
+	if (strips.size() > std::numeric_limits<uint16_t>::max())
+		return false;
+
+	size_t numTriangles = 0;
+	for (auto& strip : strips) {
+		if (strip.size() > std::numeric_limits<uint16_t>::max())
+			return false;
+
+		if (strip.size() > 2)
+			numTriangles += strip.size() - 2;
+	}
+
+	if (numTriangles > std::numeric_limits<uint16_t>::max())
+		return false;
+
+	outNumTriangles = static_cast<uint16_t>(numTriangles);
+	return true;
+}
+
 } // namespace nifly
\ No newline at end of file
@@ -207,31 +207,261 @@ MatTransform CalcMedianMatTransform(const std::vector<MatTransform>& ts) {
 	res.scale = CalcMedianOfFloats(scales);
 	return res;
 }
+
+// Both kernels keep the matrix in locals and have no branches in the loop bodies,
+// so that the compiler can vectorize them.
+void TransformPoints(Span<Vector3> points, const Matrix4& transform, Span<const float> weights) {
+	const float m00 = transform[0], m01 = transform[1], m02 = transform[2], tx = transform[3];
+	const float m10 = transform[4], m11 = transform[5], m12 = transform[6], ty = transform[7];
+	const float m20 = transform[8], m21 = transform[9], m22 = transform[10], tz = transform[11];
+
+	Vector3* p = points.data();
+	const size_t count = points.size();
+	const size_t numWeighted = std::min(count, weights.size());
+	const float* w = weights.data();
+
+	// Weighted points move by their offset (M - I) * p + t times the weight.
+	// A pure translation then moves them by exactly t times the weight.
+	const float a00 = m00 - 1.0f, a11 = m11 - 1.0f, a22 = m22 - 1.0f;
+	for (size_t i = 0; i < numWeighted; i++) {
+		const float x = p[i].x, y = p[i].y, z = p[i].z;
+		p[i].x = x + (a00 * x + m01 * y + m02 * z + tx) * w[i];
+		p[i].y = y + (m10 * x + a11 * y + m12 * z + ty) * w[i];
+		p[i].z = z + (m20 * x + m21 * y + a22 * z + tz) * w[i];
+	}
+
+	for (size_t i = numWeighted; i < count; i++) {
+		const float x = p[i].x, y = p[i].y, z = p[i].z;
+		p[i].x = m00 * x + m01 * y + m02 * z + tx;
+		p[i].y = m10 * x + m11 * y + m12 * z + ty;
+		p[i].z = m20 * x + m21 * y + m22 * z + tz;
+	}
+}
+
+void TransformDirections(Span<Vector3> dirs, const Matrix3& transform, Span<const float> weights) {
+	const float m00 = transform[0][0], m01 = transform[0][1], m02 = transform[0][2];
+	const float m10 = transform[1][0], m11 = transform[1][1], m12 = transform[1][2];
+	const float m20 = transform[2][0], m21 = transform[2][1], m22 = transform[2][2];
+
+	Vector3* d = dirs.data();
+	const size_t count = dirs.size();
+	const float* w = weights.data();
+	const size_t numWeighted = std::min(count, weights.size());
+
+	// Zero length directions stay zero
+	auto normalize = [&](const size_t i, const float x, const float y, const float z) {
+		const float lengthSq = x * x + y * y + z * z;
+		const float invLength = lengthSq > 0.0f ? 1.0f / std::sqrt(lengthSq) : 0.0f;
+		d[i].x = x * invLength;
+		d[i].y = y * invLength;
+		d[i].z = z * invLength;
+	};
+
+	const float a00 = m00 - 1.0f, a11 = m11 - 1.0f, a22 = m22 - 1.0f;
+	for (size_t i = 0; i < numWeighted; i++) {
+		const float x = d[i].x, y = d[i].y, z = d[i].z;
+		normalize(i,
+				  x + (a00 * x + m01 * y + m02 * z) * w[i],
+				  y + (m10 * x + a11 * y + m12 * z) * w[i],
+				  z + (m20 * x + m21 * y + a22 * z) * w[i]);
+	}
+
+	for (size_t i = numWeighted; i < count; i++) {
+		const float x = d[i].x, y = d[i].y, z = d[i].z;
+		normalize(i, m00 * x + m01 * y + m02 * z, m10 * x + m11 * y + m12 * z, m20 * x + m21 * y + m22 * z);
+	}
+}
 } // namespace nifly
 
 
 using namespace nifly;
 
-BoundingSphere::BoundingSphere(const std::vector<Vector3>& vertices) {
-	if (vertices.empty())
+namespace {
+// Lets Miniball read the coordinates of Vector3 arrays in place
+struct Vector3CoordAccessor {
+	typedef const Vector3* Pit;
+	typedef const float* Cit;
+
+	Cit operator()(Pit it) const { return &it->x; }
+};
+
+// Eigenvectors (columns of "vectors") of a symmetric 3x3 matrix with cyclic Jacobi rotations
+void SymmetricEigenvectors(double (&a)[3][3], double (&vectors)[3][3]) {
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			vectors[i][j] = i == j ? 1.0 : 0.0;
+
+	for (int sweep = 0; sweep < 16; sweep++) {
+		const double offDiagonal = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+		if (offDiagonal < 1e-20)
+			break;
+
+		for (int p = 0; p < 2; p++) {
+			for (int q = p + 1; q < 3; q++) {
+				if (a[p][q] == 0.0)
+					continue;
+
+				const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				const double sign = theta >= 0.0 ? 1.0 : -1.0;
+				const double t = sign / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+				const double c = 1.0 / std::sqrt(t * t + 1.0);
+				const double sn = t * c;
+
+				for (int k = 0; k < 3; k++) {
+					const double akp = a[k][p];
+					const double akq = a[k][q];
+					a[k][p] = c * akp - sn * akq;
+					a[k][q] = sn * akp + c * akq;
+				}
+				for (int k = 0; k < 3; k++) {
+					const double apk = a[p][k];
+					const double aqk = a[q][k];
+					a[p][k] = c * apk - sn * aqk;
+					a[q][k] = sn * apk + c * aqk;
+				}
+				for (int k = 0; k < 3; k++) {
+					const double vkp = vectors[k][p];
+					const double vkq = vectors[k][q];
+					vectors[k][p] = c * vkp - sn * vkq;
+					vectors[k][q] = sn * vkp + c * vkq;
+				}
+			}
+		}
+	}
+}
+} // namespace
+
+BoundingSphere::BoundingSphere(Span<const Vector3> points, const BoundsMethod method) {
+	if (points.empty())
 		return;
 
-	// Convert vertices to list of coordinates
-	std::list<std::vector<float>> lp;
-	for (auto vertice : vertices) {
-		lp.push_back({vertice.x, vertice.y, vertice.z});
+	if (method == BoundsMethod::Exact) {
+		Miniball::Miniball<Vector3CoordAccessor> mb(3, points.begin(), points.end());
+
+		const float* pCenter = mb.center();
+		center.x = pCenter[0];
+		center.y = pCenter[1];
+		center.z = pCenter[2];
+
+		radius = std::sqrt(mb.squared_radius());
+		return;
 	}
 
-	Miniball::Miniball<Miniball::CoordAccessor<std::list<std::vector<float>>::const_iterator,
-											   std::vector<float>::const_iterator>>
-		mb(3, lp.begin(), lp.end());
+	// Start from the most distant pair of extremal points along the axes
+	size_t minIndex[3]{};
+	size_t maxIndex[3]{};
+	for (size_t i = 1; i < points.size(); i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			if (points[i][axis] < points[minIndex[axis]][axis])
+				minIndex[axis] = i;
+			if (points[i][axis] > points[maxIndex[axis]][axis])
+				maxIndex[axis] = i;
+		}
+	}
 
-	const float* pCenter = mb.center();
-	center.x = pCenter[0];
-	center.y = pCenter[1];
-	center.z = pCenter[2];
+	int bestAxis = 0;
+	float bestDistSq = -1.0f;
+	for (int axis = 0; axis < 3; axis++) {
+		const float distSq = points[minIndex[axis]].DistanceSquaredTo(points[maxIndex[axis]]);
+		if (distSq > bestDistSq) {
+			bestDistSq = distSq;
+			bestAxis = axis;
+		}
+	}
+
+	center = (points[minIndex[bestAxis]] + points[maxIndex[bestAxis]]) * 0.5f;
+	radius = std::sqrt(bestDistSq) * 0.5f;
+
+	// Grow the sphere just enough to include each point outside of it
+	float radiusSq = radius * radius;
+	for (const Vector3& p : points) {
+		const float distSq = center.DistanceSquaredTo(p);
+		if (distSq <= radiusSq)
+			continue;
+
+		const float dist = std::sqrt(distSq);
+		const float newRadius = (radius + dist) * 0.5f;
+		center += (p - center) * ((newRadius - radius) / dist);
+		radius = newRadius;
+		radiusSq = radius * radius;
+	}
+
+	// Absorb rounding of the center updates
+	radius *= 1.0f + FLT_EPSILON * 4.0f;
+}
+
+BoundingBox::BoundingBox(Span<const Vector3> points) {
+	// Two interleaved accumulators keep the min/max dependency chains short
+	BoundingBox other;
+	size_t i = 0;
+	for (; i + 1 < points.size(); i += 2) {
+		Add(points[i]);
+		other.Add(points[i + 1]);
+	}
+
+	if (i < points.size())
+		Add(points[i]);
+
+	if (other.IsValid()) {
+		Add(other.min);
+		Add(other.max);
+	}
+}
+
+OrientedBoundingBox::OrientedBoundingBox(Span<const Vector3> points) {
+	const BoundingBox box(points);
+	if (!box.IsValid())
+		return;
+
+	center = box.Center();
+	halfExtent = box.HalfExtent();
+
+	// Covariance of the points around their mean
+	double mean[3]{};
+	for (const Vector3& p : points) {
+		mean[0] += p.x;
+		mean[1] += p.y;
+		mean[2] += p.z;
+	}
+
+	const double invCount = 1.0 / static_cast<double>(points.size());
+	for (double& m : mean)
+		m *= invCount;
+
+	double covariance[3][3]{};
+	for (const Vector3& p : points) {
+		const double d[3] = {p.x - mean[0], p.y - mean[1], p.z - mean[2]};
+		for (int i = 0; i < 3; i++)
+			for (int j = i; j < 3; j++)
+				covariance[i][j] += d[i] * d[j];
+	}
+
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < i; j++)
+			covariance[i][j] = covariance[j][i];
+
+	double vectors[3][3];
+	SymmetricEigenvectors(covariance, vectors);
+
+	Matrix3 axes;
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			axes[i][j] = static_cast<float>(vectors[i][j]);
+
+	// Extent of the points along the principal axes
+	const Matrix3 toBox = axes.Transpose();
+	BoundingBox local;
+	for (const Vector3& p : points)
+		local.Add(toBox * p);
+
+	const Vector3 localExtent = local.HalfExtent();
+	const float localVolume = localExtent.x * localExtent.y * localExtent.z;
+	if (localVolume >= halfExtent.x * halfExtent.y * halfExtent.z)
+		return;
 
-	radius = std::sqrt(mb.squared_radius());
+	center = axes * local.Center();
+	halfExtent = localExtent;
+	rotation = axes;
 }
 
 float Matrix3::Determinant() const {
@@ -0,0 +1,210 @@
+/*
+nifly
+C++ NIF library for the Gamebryo/NetImmerse File Format
+See the included GPLv3 LICENSE file
+*/
+
+#include "PackedStreams.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace nifly {
+
+namespace {
+// Same as std::round (halfway cases away from zero) for values in the int32_t range.
+// Truncating and comparing the exact remainder avoids the library call, so loops using it can be vectorized.
+inline int32_t RoundToInt(const float value) {
+	const auto whole = static_cast<int32_t>(value);
+	const float frac = value - static_cast<float>(whole);
+	return whole + (frac >= 0.5f) - (frac <= -0.5f);
+}
+
+inline int32_t RoundToInt(const double value) {
+	const auto whole = static_cast<int32_t>(value);
+	const double frac = value - static_cast<double>(whole);
+	return whole + (frac >= 0.5) - (frac <= -0.5);
+}
+
+// Only 1024 values are possible per UDEC3 channel
+const std::array<float, 1024>& GetUDEC3Table() {
+	static const std::array<float, 1024> table = [] {
+		std::array<float, 1024> values{};
+		for (uint32_t i = 0; i < 1024; i++)
+			values[i] = static_cast<float>((i / 511.5) - 1.0);
+		return values;
+	}();
+	return table;
+}
+
+inline uint32_t PackUDEC3Channel(const float value) {
+	return static_cast<uint32_t>(RoundToInt((value + 1.0) * 511.5)) & 1023;
+}
+
+inline float HalfToFloat(const uint16_t half) {
+	const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+	const uint32_t bits = half & 0x7FFFu;
+
+	uint32_t fbits;
+	if (bits >= 0x7C00) {
+		// Infinity and NaN (with payload)
+		fbits = 0x7F800000 | ((bits & 0x3FF) << 13);
+	}
+	else if (bits >= 0x400) {
+		// Normal numbers only need the exponent rebased
+		fbits = (bits << 13) + (112u << 23);
+	}
+	else {
+		// Subnormals and zero are exact multiples of 2^-24
+		const float value = static_cast<float>(bits) * 5.9604645e-8f;
+		std::memcpy(&fbits, &value, sizeof(float));
+	}
+
+	fbits |= sign;
+
+	float result;
+	std::memcpy(&result, &fbits, sizeof(float));
+	return result;
+}
+
+inline uint16_t FloatToHalf(const float value) {
+	uint32_t fbits;
+	std::memcpy(&fbits, &value, sizeof(float));
+
+	const uint32_t sign = (fbits >> 16) & 0x8000;
+	fbits &= 0x7FFFFFFF;
+
+	// Round to nearest even from the guard bit and the sticky bits below it
+	auto round = [](const uint32_t bits, const uint32_t guard, const uint32_t sticky) {
+		return bits + (guard & (sticky | bits));
+	};
+
+	uint32_t half;
+	if (fbits >= 0x7F800000) {
+		// Infinity and NaN (quiet, with the top of the payload)
+		half = 0x7C00 | (fbits > 0x7F800000 ? (0x200 | ((fbits >> 13) & 0x3FF)) : 0);
+	}
+	else if (fbits >= 0x47800000) {
+		// Overflow to infinity
+		half = 0x7C00;
+	}
+	else if (fbits >= 0x38800000) {
+		const uint32_t bits = (((fbits >> 23) - 112) << 10) | ((fbits >> 13) & 0x3FF);
+		half = round(bits, (fbits >> 12) & 1, (fbits & 0xFFF) != 0);
+	}
+	else if (fbits >= 0x33000000) {
+		// Subnormal half
+		const uint32_t shift = 125 - (fbits >> 23);
+		const uint32_t mantissa = (fbits & 0x7FFFFF) | 0x800000;
+		half = round(mantissa >> (shift + 1), (mantissa >> shift) & 1, (mantissa & ((1u << shift) - 1)) != 0);
+	}
+	else {
+		// Underflow to zero
+		half = 0;
+	}
+
+	return static_cast<uint16_t>(sign | half);
+}
+} // namespace
+
+void UnpackPositions(Span<const int16_t> packed,
+					 const float scale,
+					 const float posScale,
+					 Span<Vector3> outVerts) {
+	const size_t count = std::min(packed.size() / 3, outVerts.size());
+	const int16_t* in = packed.data();
+	Vector3* out = outVerts.data();
+
+	// Same order of operations in double precision as unpacking one value at a time
+	auto unpack = [scale, posScale](const int16_t val) {
+		const double divisor = val < 0 ? 32768.0 : 32767.0;
+		return static_cast<float>((val / divisor) * scale * posScale);
+	};
+
+	for (size_t i = 0; i < count; i++) {
+		out[i].x = unpack(in[i * 3]);
+		out[i].y = unpack(in[i * 3 + 1]);
+		out[i].z = unpack(in[i * 3 + 2]);
+	}
+}
+
+void PackPositions(Span<const Vector3> verts,
+				   const float scale,
+				   const float posScale,
+				   Span<int16_t> outPacked) {
+	const size_t count = std::min(verts.size(), outPacked.size() / 3);
+	const Vector3* in = verts.data();
+	int16_t* out = outPacked.data();
+	const float fullScale = scale * posScale;
+
+	auto pack = [fullScale](const float component) {
+		const float range = component < 0 ? 32768.0f : 32767.0f;
+		return static_cast<int16_t>(RoundToInt((component / fullScale) * range));
+	};
+
+	for (size_t i = 0; i < count; i++) {
+		out[i * 3] = pack(in[i].x);
+		out[i * 3 + 1] = pack(in[i].y);
+		out[i * 3 + 2] = pack(in[i].z);
+	}
+}
+
+void UnpackUDEC3(Span<const uint32_t> packed, Span<Vector3> outVecs, Span<uint8_t> outW) {
+	const size_t count = std::min(packed.size(), outVecs.size());
+	const auto& table = GetUDEC3Table();
+
+	for (size_t i = 0; i < count; i++) {
+		const uint32_t data = packed[i];
+		outVecs[i].x = table[data & 1023];
+		outVecs[i].y = table[(data >> 10) & 1023];
+		outVecs[i].z = table[(data >> 20) & 1023];
+	}
+
+	const size_t countW = std::min(count, outW.size());
+	for (size_t i = 0; i < countW; i++)
+		outW[i] = static_cast<uint8_t>((packed[i] >> 30) & 3);
+}
+
+void PackUDEC3(Span<const Vector3> vecs, Span<const uint8_t> w, Span<uint32_t> outPacked) {
+	const size_t count = std::min(vecs.size(), outPacked.size());
+	const Vector3* in = vecs.data();
+	uint32_t* out = outPacked.data();
+
+	for (size_t i = 0; i < count; i++)
+		out[i] = PackUDEC3Channel(in[i].x) | (PackUDEC3Channel(in[i].y) << 10)
+				 | (PackUDEC3Channel(in[i].z) << 20) | (static_cast<uint32_t>(1) << 30);
+
+	const size_t countW = std::min(count, w.size());
+	for (size_t i = 0; i < countW; i++)
+		out[i] = (out[i] & 0x3FFFFFFF) | (static_cast<uint32_t>(w[i] & 3) << 30);
+}
+
+void UnpackHalfs(Span<const uint16_t> packed, Span<float> outValues) {
+	const size_t count = std::min(packed.size(), outValues.size());
+	for (size_t i = 0; i < count; i++)
+		outValues[i] = HalfToFloat(packed[i]);
+}
+
+void PackHalfs(Span<const float> values, Span<uint16_t> outPacked) {
+	const size_t count = std::min(values.size(), outPacked.size());
+	for (size_t i = 0; i < count; i++)
+		outPacked[i] = FloatToHalf(values[i]);
+}
+
+void UnpackHalfUVs(Span<const uint16_t> packed, Span<Vector2> outUVs) {
+	const size_t count = std::min(packed.size() / 2, outUVs.size());
+	for (size_t i = 0; i < count; i++) {
+		outUVs[i].u = HalfToFloat(packed[i * 2]);
+		outUVs[i].v = HalfToFloat(packed[i * 2 + 1]);
+	}
+}
+
+void PackHalfUVs(Span<const Vector2> uvs, Span<uint16_t> outPacked) {
+	const size_t count = std::min(uvs.size(), outPacked.size() / 2);
+	for (size_t i = 0; i < count; i++) {
+		outPacked[i * 2] = FloatToHalf(uvs[i].u);
+		outPacked[i * 2 + 1] = FloatToHalf(uvs[i].v);
+	}
+}
+} // namespace nifly
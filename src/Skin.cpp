@@ -7,6 +7,7 @@ See the included GPLv3 LICENSE file
 #include "Skin.hpp"
 #include "NifUtil.hpp"
 
+#include <algorithm>
 #include <unordered_map>
 
 using namespace nifly;
@@ -71,14 +72,12 @@ void NiSkinData::GetChildIndices(std::vector<uint32_t>& indices) {
 	indices.push_back(skinPartitionRef.index);
 }
 
-void NiSkinData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void NiSkinData::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	if (vertIndices.empty())
 		return;
 
-	uint16_t highestRemoved = vertIndices.back();
-
-	// 32-bit to avoid wrapping around to zero for a highest removed index of 65535
-	uint32_t mapSize = static_cast<uint32_t>(highestRemoved) + 1;
+	uint32_t highestRemoved = vertIndices.back();
+	uint32_t mapSize = highestRemoved + 1;
 	std::vector<int> indexCollapse = GenerateIndexCollapseMap(vertIndices, mapSize);
 
 	NiObject::notifyVerticesDelete(vertIndices);
@@ -100,6 +99,13 @@ void NiSkinData::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices)
 	}
 }
 
+void NiSkinData::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	for (auto& b : bones)
+		for (auto& vw : b.vertexWeights)
+			if (vw.index < vertMap.size())
+				vw.index = static_cast<uint16_t>(vertMap[vw.index]);
+}
+
 
 void NiSkinPartition::Sync(NiStreamReversible& stream) {
 	stream.Sync(numPartitions);
@@ -131,9 +137,17 @@ void NiSkinPartition::Sync(NiStreamReversible& stream) {
 
 			vertData.resize(numVertices);
 
+			// Writing only reads the vertices, so shared ones are written from a copy instead of detaching
+			const bool writing = stream.GetMode() == NiStreamReversible::Mode::Writing;
+			const bool writeCopies = writing && vertData.IsShared();
+			BSVertexData vertexCopy;
+
 			uint32_t vertexMainSize = vertexDesc.GetVertexMainSize();
 			for (uint32_t i = 0; i < numVertices; i++) {
-				auto& vertex = vertData[i];
+				if (writeCopies)
+					vertexCopy = vertData.Get()[i];
+
+				auto& vertex = writeCopies ? vertexCopy : vertData[i];
 				if (HasVertices() && vertexMainSize <= 16) {
 					if (IsFullPrecision()) {
 						// Full precision (vert + bitangentX = 16 bytes)
@@ -205,8 +219,14 @@ void NiSkinPartition::Sync(NiStreamReversible& stream) {
 	if (stream.GetMode() == NiStreamReversible::Mode::Writing)
 		PrepareVertexMapsAndTriangles();
 
+	const bool writeCopies = stream.GetMode() == NiStreamReversible::Mode::Writing && partitions.IsShared();
+	PartitionBlock partitionCopy;
+
 	for (uint32_t p = 0; p < numPartitions; p++) {
-		auto& partition = partitions[p];
+		if (writeCopies)
+			partitionCopy = partitions.Get()[p];
+
+		auto& partition = writeCopies ? partitionCopy : partitions[p];
 		stream.Sync(partition.numVertices);
 		stream.Sync(partition.numTriangles);
 		stream.Sync(partition.numBones);
@@ -265,7 +285,7 @@ void NiSkinPartition::Sync(NiStreamReversible& stream) {
 	}
 }
 
-void NiSkinPartition::notifyVerticesDelete(const std::vector<uint16_t>& vertIndices) {
+void NiSkinPartition::notifyVerticesDelete(const std::vector<uint32_t>& vertIndices) {
 	if (vertIndices.empty())
 		return;
 
@@ -335,6 +355,27 @@ void NiSkinPartition::notifyVerticesDelete(const std::vector<uint16_t>& vertIndi
 	}
 }
 
+void NiSkinPartition::notifyVerticesReorder(const std::vector<int>& vertMap) {
+	for (auto& p : partitions) {
+		for (uint16_t& i : p.vertexMap)
+			if (i < vertMap.size())
+				i = static_cast<uint16_t>(vertMap[i]);
+
+		// Mapped triangles and strips index into vertexMap and stay valid
+		if (!bMappedIndices) {
+			ApplyMapToTriangles(p.triangles, vertMap);
+			for (auto& strip : p.strips)
+				for (uint16_t& i : strip)
+					if (i < vertMap.size())
+						i = static_cast<uint16_t>(vertMap[i]);
+		}
+
+		ApplyMapToTriangles(p.trueTriangles, vertMap);
+	}
+
+	ApplyIndexMapToVector(vertData, vertMap);
+}
+
 void NiSkinPartition::DeletePartitions(const std::vector<uint32_t>& partInds) {
 	if (partInds.empty())
 		return;
@@ -379,6 +420,33 @@ bool NiSkinPartition::PartitionBlock::ConvertStripsToTriangles() {
 	return true;
 }
 
+bool NiSkinPartition::PartitionBlock::ConvertTrianglesToStrips(const bool joinStrips) {
+	if (numStrips != 0 || triangles.empty())
+		return false;
+
+	// The degenerate triangles joining strips count too and can go over the limit
+	auto newStrips = GenerateStripsFromTriangles(triangles, joinStrips);
+	uint16_t numStripTriangles = 0;
+	if (!CountStripTriangles(newStrips, numStripTriangles)) {
+		if (!joinStrips)
+			return false;
+
+		newStrips = GenerateStripsFromTriangles(triangles);
+		if (!CountStripTriangles(newStrips, numStripTriangles))
+			return false;
+	}
+
+	hasFaces = true;
+	strips = std::move(newStrips);
+	numStrips = static_cast<uint16_t>(strips.size());
+	stripLengths.resize(strips.size());
+	for (size_t i = 0; i < strips.size(); i++)
+		stripLengths[i] = static_cast<uint16_t>(strips[i].size());
+
+	numTriangles = numStripTriangles;
+	return true;
+}
+
 bool NiSkinPartition::ConvertStripsToTriangles() {
 	bool triangulated = false;
 	for (PartitionBlock& p : partitions) {
@@ -388,6 +456,17 @@ bool NiSkinPartition::ConvertStripsToTriangles() {
 	return triangulated;
 }
 
+bool NiSkinPartition::ConvertTrianglesToStrips(const bool joinStrips) {
+	PrepareVertexMapsAndTriangles();
+
+	bool stripified = false;
+	for (PartitionBlock& p : partitions) {
+		if (p.ConvertTrianglesToStrips(joinStrips))
+			stripified = true;
+	}
+	return stripified;
+}
+
 void NiSkinPartition::PartitionBlock::GenerateTrueTrianglesFromMappedTriangles() {
 	if (vertexMap.empty() || triangles.empty()) {
 		trueTriangles.clear();
@@ -470,6 +549,13 @@ void NiSkinPartition::PrepareTrueTriangles() {
 }
 
 void NiSkinPartition::PrepareVertexMapsAndTriangles() {
+	// Only detach shared partitions if one of them is missing data
+	const auto isPrepared = [](const PartitionBlock& p) {
+		return !p.vertexMap.empty() && !p.triangles.empty();
+	};
+	if (std::all_of(partitions.cbegin(), partitions.cend(), isPrepared))
+		return;
+
 	for (PartitionBlock& p : partitions) {
 		if (p.vertexMap.empty())
 			p.GenerateVertexMapFromTrueTriangles();
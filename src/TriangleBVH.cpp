@@ -0,0 +1,526 @@
+/*
+nifly
+C++ NIF library for the Gamebryo/NetImmerse File Format
+See the included GPLv3 LICENSE file
+*/
+
+#include "TriangleBVH.hpp"
+#include "NifUtil.hpp"
+
+#include <array>
+
+namespace nifly {
+
+namespace {
+constexpr uint32_t maxLeafSize = 4;
+constexpr uint32_t sahBinCount = 12;
+// Below this depth, nodes are split by SAH. Deeper nodes are split in halves to bound the depth.
+constexpr uint32_t maxSahDepth = 48;
+
+void GrowBounds(Vector3& mn, Vector3& mx, const Vector3& p) {
+	mn.x = std::min(mn.x, p.x);
+	mn.y = std::min(mn.y, p.y);
+	mn.z = std::min(mn.z, p.z);
+	mx.x = std::max(mx.x, p.x);
+	mx.y = std::max(mx.y, p.y);
+	mx.z = std::max(mx.z, p.z);
+}
+
+float HalfSurfaceArea(const Vector3& mn, const Vector3& mx) {
+	if (mx.x < mn.x)
+		return 0.0f;
+
+	const Vector3 d = mx - mn;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+float BoxDistanceSquared(const Vector3& mn, const Vector3& mx, const Vector3& p) {
+	const float dx = std::max({mn.x - p.x, 0.0f, p.x - mx.x});
+	const float dy = std::max({mn.y - p.y, 0.0f, p.y - mx.y});
+	const float dz = std::max({mn.z - p.z, 0.0f, p.z - mx.z});
+	return dx * dx + dy * dy + dz * dz;
+}
+
+// Distance along the ray to where it enters the box, or FLT_MAX if it misses the box within maxDistance
+float RayBoxDistance(const Vector3& mn,
+					 const Vector3& mx,
+					 const Vector3& origin,
+					 const Vector3& invDir,
+					 const float maxDistance) {
+	float tMin = 0.0f;
+	float tMax = maxDistance;
+	for (int axis = 0; axis < 3; axis++) {
+		float t1 = (mn[axis] - origin[axis]) * invDir[axis];
+		float t2 = (mx[axis] - origin[axis]) * invDir[axis];
+		if (t1 > t2)
+			std::swap(t1, t2);
+
+		// NaN from 0 * inf (origin on a slab plane of a flat ray) keeps the current range
+		tMin = t1 > tMin ? t1 : tMin;
+		tMax = t2 < tMax ? t2 : tMax;
+		if (tMin > tMax)
+			return FLT_MAX;
+	}
+
+	return tMin;
+}
+} // namespace
+
+struct TriangleBVH::BuildInput {
+	std::vector<Vector3> centroids;
+	std::vector<Vector3> mins;
+	std::vector<Vector3> maxs;
+};
+
+TriangleBVH::TriangleBVH(const std::vector<Vector3>& inVerts,
+						 const std::vector<Triangle>& inTris,
+						 const MatTransform& inTransform)
+	: transform(inTransform)
+	, numTriangles(inTris.size()) {
+	verts.resize(inVerts.size());
+	for (size_t i = 0; i < inVerts.size(); i++)
+		verts[i] = transform.ApplyTransform(inVerts[i]);
+
+	const size_t numVerts = verts.size();
+	BuildInput input;
+	input.centroids.resize(inTris.size());
+	input.mins.resize(inTris.size(), Vector3(FLT_MAX, FLT_MAX, FLT_MAX));
+	input.maxs.resize(inTris.size(), Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+
+	triIndices.reserve(inTris.size());
+	for (uint32_t i = 0; i < static_cast<uint32_t>(inTris.size()); i++) {
+		const Triangle& t = inTris[i];
+		if (t.p1 >= numVerts || t.p2 >= numVerts || t.p3 >= numVerts)
+			continue;
+
+		for (const uint16_t v : {t.p1, t.p2, t.p3})
+			GrowBounds(input.mins[i], input.maxs[i], verts[v]);
+
+		input.centroids[i] = (input.mins[i] + input.maxs[i]) * 0.5f;
+		triIndices.push_back(i);
+	}
+
+	if (triIndices.empty())
+		return;
+
+	nodes.reserve(triIndices.size() * 2 / maxLeafSize + 1);
+	Build(input, 0, static_cast<uint32_t>(triIndices.size()), 0);
+
+	tris.resize(triIndices.size());
+	for (size_t i = 0; i < triIndices.size(); i++)
+		tris[i] = inTris[triIndices[i]];
+}
+
+uint32_t TriangleBVH::Build(const BuildInput& input,
+							const uint32_t begin,
+							const uint32_t end,
+							uint32_t depth) {
+	const auto nodeIndex = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+
+	Vector3 mn(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vector3 mx(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	Vector3 centerMin = mn;
+	Vector3 centerMax = mx;
+	for (uint32_t i = begin; i < end; i++) {
+		const uint32_t ti = triIndices[i];
+		GrowBounds(mn, mx, input.mins[ti]);
+		GrowBounds(mn, mx, input.maxs[ti]);
+		GrowBounds(centerMin, centerMax, input.centroids[ti]);
+	}
+
+	nodes[nodeIndex].min = mn;
+	nodes[nodeIndex].max = mx;
+
+	const uint32_t count = end - begin;
+	if (count <= maxLeafSize) {
+		nodes[nodeIndex].index = begin;
+		nodes[nodeIndex].count = count;
+		return nodeIndex;
+	}
+
+	const Vector3 centerExtent = centerMax - centerMin;
+	int axis = 0;
+	if (centerExtent.y > centerExtent.x && centerExtent.y >= centerExtent.z)
+		axis = 1;
+	else if (centerExtent.z > centerExtent.x && centerExtent.z > centerExtent.y)
+		axis = 2;
+
+	uint32_t mid = begin;
+	if (centerExtent[axis] > 0.0f && depth < maxSahDepth) {
+		// Binned SAH along the axis with the largest centroid extent
+		struct Bin {
+			Vector3 min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+			Vector3 max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			uint32_t count = 0;
+		};
+
+		std::array<Bin, sahBinCount> bins;
+		const float binScale = static_cast<float>(sahBinCount) / centerExtent[axis];
+		auto binOf = [&](const uint32_t ti) {
+			const auto b = static_cast<uint32_t>((input.centroids[ti][axis] - centerMin[axis]) * binScale);
+			return std::min(b, sahBinCount - 1);
+		};
+
+		for (uint32_t i = begin; i < end; i++) {
+			const uint32_t ti = triIndices[i];
+			Bin& bin = bins[binOf(ti)];
+			GrowBounds(bin.min, bin.max, input.mins[ti]);
+			GrowBounds(bin.min, bin.max, input.maxs[ti]);
+			bin.count++;
+		}
+
+		// Cost of the left side of the split after each bin
+		std::array<float, sahBinCount - 1> leftCosts{};
+		Vector3 sweepMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		Vector3 sweepMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		uint32_t sweepCount = 0;
+		for (uint32_t b = 0; b + 1 < sahBinCount; b++) {
+			if (bins[b].count > 0) {
+				GrowBounds(sweepMin, sweepMax, bins[b].min);
+				GrowBounds(sweepMin, sweepMax, bins[b].max);
+			}
+			sweepCount += bins[b].count;
+			leftCosts[b] = HalfSurfaceArea(sweepMin, sweepMax) * static_cast<float>(sweepCount);
+		}
+
+		// Sweep the right side and keep the cheapest split
+		float bestCost = FLT_MAX;
+		uint32_t bestBin = 0;
+		sweepMin = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+		sweepMax = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		sweepCount = 0;
+		for (uint32_t b = sahBinCount - 1; b > 0; b--) {
+			if (bins[b].count > 0) {
+				GrowBounds(sweepMin, sweepMax, bins[b].min);
+				GrowBounds(sweepMin, sweepMax, bins[b].max);
+			}
+			sweepCount += bins[b].count;
+
+			const float rightCost = HalfSurfaceArea(sweepMin, sweepMax) * static_cast<float>(sweepCount);
+			if (leftCosts[b - 1] + rightCost < bestCost) {
+				bestCost = leftCosts[b - 1] + rightCost;
+				bestBin = b;
+			}
+		}
+
+		auto split = std::partition(triIndices.begin() + begin,
+									triIndices.begin() + end,
+									[&](const uint32_t ti) { return binOf(ti) < bestBin; });
+		mid = static_cast<uint32_t>(split - triIndices.begin());
+	}
+
+	if (mid == begin || mid == end) {
+		// All centroids in one place or past the SAH depth: split in halves
+		mid = begin + count / 2;
+		std::nth_element(triIndices.begin() + begin,
+						 triIndices.begin() + mid,
+						 triIndices.begin() + end,
+						 [&](const uint32_t a, const uint32_t b) {
+							 return input.centroids[a][axis] < input.centroids[b][axis];
+						 });
+	}
+
+	depth++;
+	Build(input, begin, mid, depth);
+	nodes[nodeIndex].index = Build(input, mid, end, depth);
+	return nodeIndex;
+}
+
+void TriangleBVH::ClosestPointOnTriangle(const Vector3& point, const uint32_t tri, BVHHit& hit) const {
+	// Voronoi regions of the triangle's features (Real-Time Collision Detection, 5.1.5)
+	const Triangle& t = tris[tri];
+	const Vector3& a = verts[t.p1];
+	const Vector3& b = verts[t.p2];
+	const Vector3& c = verts[t.p3];
+
+	const Vector3 ab = b - a;
+	const Vector3 ac = c - a;
+	const Vector3 ap = point - a;
+
+	float u = 0.0f;
+	float v = 0.0f;
+
+	const float d1 = ab.dot(ap);
+	const float d2 = ac.dot(ap);
+	const Vector3 bp = point - b;
+	const float d3 = ab.dot(bp);
+	const float d4 = ac.dot(bp);
+	const Vector3 cp = point - c;
+	const float d5 = ab.dot(cp);
+	const float d6 = ac.dot(cp);
+
+	const float vc = d1 * d4 - d3 * d2;
+	const float vb = d5 * d2 - d1 * d6;
+	const float va = d3 * d6 - d5 * d4;
+
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		// Vertex a
+	}
+	else if (d3 >= 0.0f && d4 <= d3) {
+		u = 1.0f;
+	}
+	else if (d6 >= 0.0f && d5 <= d6) {
+		v = 1.0f;
+	}
+	else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		u = d1 / (d1 - d3);
+	}
+	else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		v = d2 / (d2 - d6);
+	}
+	else if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		v = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		u = 1.0f - v;
+	}
+	else {
+		const float denom = va + vb + vc;
+		if (denom != 0.0f) {
+			u = vb / denom;
+			v = vc / denom;
+		}
+	}
+
+	hit.point = a + ab * u + ac * v;
+	hit.distance = point.DistanceSquaredTo(hit.point);
+	hit.triangle = triIndices[tri];
+	hit.u = u;
+	hit.v = v;
+}
+
+bool TriangleBVH::IntersectTriangle(const Vector3& origin,
+									const Vector3& direction,
+									const uint32_t tri,
+									const float maxDistance,
+									BVHHit& hit) const {
+	// Möller-Trumbore, accepting both sides
+	const Triangle& t = tris[tri];
+	const Vector3& a = verts[t.p1];
+	const Vector3 ab = verts[t.p2] - a;
+	const Vector3 ac = verts[t.p3] - a;
+
+	const Vector3 pvec = direction.cross(ac);
+	const float det = ab.dot(pvec);
+	if (det == 0.0f)
+		return false;
+
+	const float invDet = 1.0f / det;
+	const Vector3 tvec = origin - a;
+	const float u = tvec.dot(pvec) * invDet;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	const Vector3 qvec = tvec.cross(ab);
+	const float v = direction.dot(qvec) * invDet;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	const float dist = ac.dot(qvec) * invDet;
+	if (dist < 0.0f || dist > maxDistance)
+		return false;
+
+	hit.triangle = triIndices[tri];
+	hit.distance = dist;
+	hit.point = origin + direction * dist;
+	hit.u = u;
+	hit.v = v;
+	return true;
+}
+
+bool TriangleBVH::ClosestPoint(const Vector3& point, BVHHit& hit, const float maxDistance) const {
+	hit = BVHHit();
+	if (nodes.empty())
+		return false;
+
+	float bestDistSq = maxDistance < FLT_MAX ? maxDistance * maxDistance : FLT_MAX;
+
+	std::array<uint32_t, maxStackSize> stack;
+	size_t stackSize = 0;
+	if (BoxDistanceSquared(nodes[0].min, nodes[0].max, point) <= bestDistSq)
+		stack[stackSize++] = 0;
+
+	BVHHit candidate;
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+		if (BoxDistanceSquared(node.min, node.max, point) > bestDistSq)
+			continue;
+
+		if (node.count > 0) {
+			for (uint32_t i = node.index; i < node.index + node.count; i++) {
+				ClosestPointOnTriangle(point, i, candidate);
+				if (candidate.distance <= bestDistSq) {
+					bestDistSq = candidate.distance;
+					hit = candidate;
+				}
+			}
+			continue;
+		}
+
+		// Push the farther child first so that the nearer one is searched first
+		const auto first = static_cast<uint32_t>(&node - nodes.data()) + 1;
+		const uint32_t second = node.index;
+		const float firstDistSq = BoxDistanceSquared(nodes[first].min, nodes[first].max, point);
+		const float secondDistSq = BoxDistanceSquared(nodes[second].min, nodes[second].max, point);
+		if (firstDistSq <= secondDistSq) {
+			if (secondDistSq <= bestDistSq)
+				stack[stackSize++] = second;
+			if (firstDistSq <= bestDistSq)
+				stack[stackSize++] = first;
+		}
+		else {
+			if (firstDistSq <= bestDistSq)
+				stack[stackSize++] = first;
+			if (secondDistSq <= bestDistSq)
+				stack[stackSize++] = second;
+		}
+	}
+
+	if (!hit.IsValid())
+		return false;
+
+	hit.distance = std::sqrt(hit.distance);
+	return true;
+}
+
+bool TriangleBVH::Raycast(const Vector3& origin,
+						  const Vector3& direction,
+						  BVHHit& hit,
+						  const float maxDistance) const {
+	hit = BVHHit();
+	if (nodes.empty())
+		return false;
+
+	const Vector3 invDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	float bestDist = maxDistance;
+
+	std::array<uint32_t, maxStackSize> stack;
+	size_t stackSize = 0;
+	if (RayBoxDistance(nodes[0].min, nodes[0].max, origin, invDir, bestDist) != FLT_MAX)
+		stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+		if (RayBoxDistance(node.min, node.max, origin, invDir, bestDist) == FLT_MAX)
+			continue;
+
+		if (node.count > 0) {
+			for (uint32_t i = node.index; i < node.index + node.count; i++)
+				if (IntersectTriangle(origin, direction, i, bestDist, hit))
+					bestDist = hit.distance;
+			continue;
+		}
+
+		const auto first = static_cast<uint32_t>(&node - nodes.data()) + 1;
+		const uint32_t second = node.index;
+		const Node& firstNode = nodes[first];
+		const Node& secondNode = nodes[second];
+		const float firstDist = RayBoxDistance(firstNode.min, firstNode.max, origin, invDir, bestDist);
+		const float secondDist = RayBoxDistance(secondNode.min, secondNode.max, origin, invDir, bestDist);
+		if (firstDist <= secondDist) {
+			if (secondDist != FLT_MAX)
+				stack[stackSize++] = second;
+			if (firstDist != FLT_MAX)
+				stack[stackSize++] = first;
+		}
+		else {
+			if (firstDist != FLT_MAX)
+				stack[stackSize++] = first;
+			if (secondDist != FLT_MAX)
+				stack[stackSize++] = second;
+		}
+	}
+
+	return hit.IsValid();
+}
+
+bool TriangleBVH::IntersectsSegment(const Vector3& start, const Vector3& end) const {
+	BVHHit hit;
+	return Raycast(start, end - start, hit, 1.0f);
+}
+
+void TriangleBVH::OverlapSphere(const Vector3& center,
+								const float radius,
+								std::vector<uint32_t>& outTris) const {
+	outTris.clear();
+	if (nodes.empty())
+		return;
+
+	const float radiusSq = radius * radius;
+
+	std::array<uint32_t, maxStackSize> stack;
+	size_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	BVHHit candidate;
+	while (stackSize > 0) {
+		const uint32_t nodeIndex = stack[--stackSize];
+		const Node& node = nodes[nodeIndex];
+		if (BoxDistanceSquared(node.min, node.max, center) > radiusSq)
+			continue;
+
+		if (node.count > 0) {
+			for (uint32_t i = node.index; i < node.index + node.count; i++) {
+				ClosestPointOnTriangle(center, i, candidate);
+				if (candidate.distance <= radiusSq)
+					outTris.push_back(candidate.triangle);
+			}
+			continue;
+		}
+
+		stack[stackSize++] = node.index;
+		stack[stackSize++] = nodeIndex + 1;
+	}
+
+	std::sort(outTris.begin(), outTris.end());
+}
+
+void TriangleBVH::ClosestPoints(const std::vector<Vector3>& points,
+								std::vector<BVHHit>& hits,
+								const float maxDistance,
+								const bool parallel) const {
+	hits.resize(points.size());
+	auto queryRange = [&](const size_t begin, const size_t end) {
+		for (size_t q = begin; q < end; q++)
+			ClosestPoint(points[q], hits[q], maxDistance);
+	};
+
+	if (parallel)
+		ParallelFor(points.size(), 256, queryRange);
+	else
+		queryRange(0, points.size());
+}
+
+void TriangleBVH::Raycasts(const std::vector<Vector3>& origins,
+						   const std::vector<Vector3>& directions,
+						   std::vector<BVHHit>& hits,
+						   const float maxDistance,
+						   const bool parallel) const {
+	const size_t count = std::min(origins.size(), directions.size());
+	hits.resize(count);
+	auto queryRange = [&](const size_t begin, const size_t end) {
+		for (size_t q = begin; q < end; q++)
+			Raycast(origins[q], directions[q], hits[q], maxDistance);
+	};
+
+	if (parallel)
+		ParallelFor(count, 256, queryRange);
+	else
+		queryRange(0, count);
+}
+
+void TriangleBVH::OverlapSpheres(const std::vector<Vector3>& centers,
+								 const float radius,
+								 std::vector<std::vector<uint32_t>>& outTris,
+								 const bool parallel) const {
+	outTris.resize(centers.size());
+	auto queryRange = [&](const size_t begin, const size_t end) {
+		for (size_t q = begin; q < end; q++)
+			OverlapSphere(centers[q], radius, outTris[q]);
+	};
+
+	if (parallel)
+		ParallelFor(centers.size(), 256, queryRange);
+	else
+		queryRange(0, centers.size());
+}
+} // namespace nifly
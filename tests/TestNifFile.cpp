@@ -5,7 +5,10 @@
 
 #include <NifFile.hpp>
 #include <NifUtil.hpp>
+#include <KDMatcher.hpp>
+#include <PackedStreams.hpp>
 #include <Particles.hpp>
+#include <bhk.hpp>
 
 #include <fstream>
 #include <sstream>
@@ -145,6 +148,36 @@ TEST_CASE("Load and save skinned file (SE)", "[NifFile]") {
 	REQUIRE(CompareBinaryFiles(fileOutput, fileExpected));
 }
 
+TEST_CASE("Memory usage of skinned file (SE)", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_Skinned_SE";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	std::map<std::string, size_t> usageByType;
+	const size_t usage = nif.GetMemoryUsage(&usageByType);
+
+	size_t blockUsage = 0;
+	for (auto& [type, typeUsage] : usageByType)
+		blockUsage += typeUsage;
+
+	REQUIRE(blockUsage > 0);
+	REQUIRE(usage > blockUsage);
+	REQUIRE(usageByType.count("NiSkinPartition") == 1);
+
+	// Vertex data of the partitions is owned by the block and must be accounted for
+	NiSkinPartition* skinPart = nullptr;
+	for (uint32_t i = 0; !skinPart && i < nif.GetHeader().GetNumBlocks(); i++)
+		skinPart = nif.GetHeader().GetBlock<NiSkinPartition>(i);
+
+	REQUIRE(skinPart != nullptr);
+	REQUIRE(skinPart->GetMemoryUsage() > skinPart->vertData.size() * sizeof(BSVertexData));
+
+	nif.Clear();
+	REQUIRE(nif.GetMemoryUsage() < blockUsage);
+}
+
 TEST_CASE("Load and save skinned, dynamic file (SE)", "[NifFile]") {
 	constexpr auto fileName = "TestNifFile_Skinned_Dynamic_SE";
 	const auto[fileInput, fileOutput, fileExpected] = GetFileTuple(fileName, nifSuffix);
@@ -189,6 +222,115 @@ TEST_CASE("Load and save furniture file (SE)", "[NifFile]") {
 	REQUIRE(CompareBinaryFiles(fileOutput, fileExpected));
 }
 
+TEST_CASE("Copied file shares collision data until modified (SE)", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_Furniture_Col_SE";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto& hdr = nif.GetHeader();
+	uint32_t dataIndex = NIF_NPOS;
+	for (uint32_t i = 0; i < hdr.GetNumBlocks(); i++) {
+		auto data = hdr.GetBlock<bhkCompressedMeshShapeData>(i);
+		if (data && !data->chunks.empty()) {
+			dataIndex = i;
+			break;
+		}
+	}
+	REQUIRE(dataIndex != NIF_NPOS);
+
+	NifFile nifCopy(nif);
+	auto data = hdr.GetBlock<bhkCompressedMeshShapeData>(dataIndex);
+	auto dataCopy = nifCopy.GetHeader().GetBlock<bhkCompressedMeshShapeData>(dataIndex);
+	REQUIRE(dataCopy != nullptr);
+	REQUIRE(data->chunks.IsShared());
+
+	// Saving reads the shared data without detaching it
+	std::stringstream copyOutput;
+	REQUIRE(nifCopy.Save(copyOutput) == 0);
+	REQUIRE(data->chunks.IsShared());
+
+	// Modifying the copy detaches its data and leaves the original untouched
+	const Vector4 translation = static_cast<const NiSyncVector<bhkCMSDChunk>&>(data->chunks)[0].translation;
+	dataCopy->chunks[0].translation.x += 1.0f;
+
+	REQUIRE(!data->chunks.IsShared());
+	REQUIRE(!dataCopy->chunks.IsShared());
+	REQUIRE(data->chunks[0].translation.x == translation.x);
+	REQUIRE(dataCopy->chunks[0].translation.x == translation.x + 1.0f);
+	REQUIRE(data->chunks[0].verts.size() == dataCopy->chunks[0].verts.size());
+}
+
+TEST_CASE("Copied shapes share geometry data until modified", "[NifFile]") {
+	SECTION("BSTriShape and NiSkinPartition (SE)") {
+		const auto fileInput = std::get<0>(GetFileTuple("TestNifFile_Skinned_SE", nifSuffix));
+
+		NifFile nif;
+		REQUIRE(nif.Load(fileInput) == 0);
+
+		auto shape = dynamic_cast<BSTriShape*>(nif.GetShapes()[0]);
+		REQUIRE(shape);
+
+		auto copy = dynamic_cast<BSTriShape*>(nif.CloneShape(shape, "Copy"));
+		REQUIRE(copy);
+		REQUIRE(shape->vertData.IsShared());
+		REQUIRE(shape->triangles.IsShared());
+		REQUIRE(shape->vertData.Get().data() == copy->vertData.Get().data());
+
+		NifFile nifCopy(nif);
+		auto skinPartition = nif.GetHeader().GetBlock<NiSkinPartition>(
+			nif.GetHeader().GetBlock<NiSkinInstance>(shape->SkinInstanceRef())->skinPartitionRef);
+		REQUIRE(skinPartition);
+		REQUIRE(skinPartition->partitions.IsShared());
+
+		// Saving reads the shared data without detaching it
+		std::stringstream copyOutput;
+		REQUIRE(nifCopy.Save(copyOutput) == 0);
+		REQUIRE(shape->vertData.IsShared());
+		REQUIRE(skinPartition->partitions.IsShared());
+
+		// Modifying the copy detaches its data and leaves the original untouched
+		const Vector3 vert = shape->vertData.Get()[0].vert;
+		copy->vertData[0].vert.x += 1.0f;
+
+		REQUIRE(copy->vertData.Get().data() != shape->vertData.Get().data());
+		REQUIRE(shape->vertData.Get()[0].vert == vert);
+		REQUIRE(copy->vertData.Get()[0].vert.x == vert.x + 1.0f);
+		REQUIRE(copy->triangles == shape->triangles);
+	}
+
+	SECTION("NiTriShapeData (LE)") {
+		const auto fileInput = std::get<0>(GetFileTuple("TestNifFile_Optimize_LE_to_SE", nifSuffix));
+
+		NifFile nif;
+		REQUIRE(nif.Load(fileInput) == 0);
+
+		auto shape = nif.GetShapes()[0];
+		auto geomData = nif.GetHeader().GetBlock<NiTriShapeData>(shape->DataRef());
+		REQUIRE(geomData);
+
+		NifFile nifCopy(nif);
+		auto geomDataCopy = nifCopy.GetHeader().GetBlock<NiTriShapeData>(shape->DataRef());
+		REQUIRE(geomDataCopy);
+		REQUIRE(geomData->vertices.IsShared());
+		REQUIRE(geomData->uvSets.IsShared());
+
+		std::stringstream copyOutput;
+		REQUIRE(nifCopy.Save(copyOutput) == 0);
+		REQUIRE(geomData->vertices.IsShared());
+		REQUIRE(geomData->normals.IsShared());
+
+		const Vector3 vert = geomData->vertices.Get()[0];
+		geomDataCopy->vertices[0].x += 1.0f;
+
+		REQUIRE(!geomData->vertices.IsShared());
+		REQUIRE(geomData->vertices.Get()[0] == vert);
+		REQUIRE(geomDataCopy->vertices.Get()[0].x == vert.x + 1.0f);
+		REQUIRE(geomData->normals.IsShared());
+	}
+}
+
 TEST_CASE("Load and save file with loose blocks (SE)", "[NifFile]") {
 	constexpr auto fileName = "TestNifFile_LooseBlocks_SE";
 	const auto [fileInput, fileOutput, fileExpected] = GetFileTuple(fileName, nifSuffix);
@@ -279,6 +421,26 @@ TEST_CASE("Load, optimize (SE to LE) and save file", "[NifFile]") {
 	REQUIRE(CompareBinaryFiles(fileOutput, fileExpected));
 }
 
+TEST_CASE("Load, optimize with parallel tangents and save file", "[NifFile]") {
+	// Parallel tangent generation must produce the same files as the serial one
+	for (const auto& [fileName, targetVersion] : {std::make_pair("TestNifFile_Optimize_LE_to_SE", NiVersion::getSSE()),
+												  std::make_pair("TestNifFile_Optimize_SE_to_LE", NiVersion::getSK())}) {
+		const auto [fileInput, fileOutput, fileExpected] = GetFileTuple(fileName, nifSuffix);
+		const std::string fileOutputParallel = folderOutput + "/" + fileName + "_ParallelTangents" + nifSuffix;
+
+		OptOptions options;
+		options.targetVersion = targetVersion;
+		options.parallelTangents = true;
+
+		NifFile nif;
+		REQUIRE(nif.Load(fileInput) == 0);
+		nif.OptimizeFor(options);
+		REQUIRE(nif.Save(fileOutputParallel) == 0);
+
+		REQUIRE(CompareBinaryFiles(fileOutputParallel, fileExpected));
+	}
+}
+
 TEST_CASE("Load and save file with ordered node (SE)", "[NifFile]") {
 	constexpr auto fileName = "TestNifFile_OrderedNode_SE";
 	const auto [fileInput, fileOutput, fileExpected] = GetFileTuple(fileName, nifSuffix);
@@ -381,6 +543,346 @@ TEST_CASE("Load and save file (SF)", "[NifFile]") {
 	REQUIRE(CompareBinaryFiles(fileOutput, fileExpected));
 }
 
+TEST_CASE("Keep external mesh data packed until accessed (SF)", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_SF";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	NifFile nifDecoded;
+	REQUIRE(nifDecoded.Load(fileInput) == 0);
+
+	auto shapes = nif.GetShapes();
+	auto shapesDecoded = nifDecoded.GetShapes();
+	REQUIRE(!shapes.empty());
+	REQUIRE(shapes.size() == shapesDecoded.size());
+
+	for (size_t si = 0; si < shapes.size(); si++) {
+		auto bsGeom = dynamic_cast<BSGeometry*>(shapes[si]);
+		REQUIRE(bsGeom != nullptr);
+
+		// Packed mesh bytes are written back unchanged
+		std::string meshPathStr = nif.GetExternalGeometryPathRefs(bsGeom)[0].get();
+		const auto meshFileInput = std::get<0>(GetFileTuple(meshPathStr.c_str(), meshSuffix));
+		auto meshStream = GetBinaryInputFileStream(std::filesystem::u8path(meshFileInput));
+		REQUIRE(meshStream);
+		std::stringstream meshInput;
+		meshInput << meshStream->rdbuf();
+		meshStream.reset();
+
+		const std::string meshBytes = meshInput.str();
+		REQUIRE(nif.LoadExternalShapeData(bsGeom, meshInput, 0, true));
+
+		auto mesh = bsGeom->SelectMesh(0);
+		REQUIRE(mesh->meshData.IsPacked());
+		REQUIRE(mesh->meshData.vertices.empty());
+		bsGeom->ReleaseMesh();
+
+		// Reading decodes the data without unpacking the mesh
+		REQUIRE(bsGeom->GetNumVertices() > 0);
+		REQUIRE(bsGeom->GetMeshData(0)->vertices.size() == bsGeom->GetMeshData(0)->nVertices);
+		REQUIRE(mesh->meshData.IsPacked());
+		REQUIRE(mesh->meshData.vertices.empty());
+
+		std::stringstream meshOutput;
+		REQUIRE(nif.SaveExternalShapeData(bsGeom, meshOutput, 0));
+		REQUIRE(meshOutput.str() == meshBytes);
+
+		// First access decodes the same data as a regular load
+		LoadAllExternalMeshData(nifDecoded, shapesDecoded[si]);
+
+		auto meshData = dynamic_cast<BSGeometryMeshData*>(bsGeom->GetGeomData());
+		auto meshDataDecoded = dynamic_cast<BSGeometryMeshData*>(shapesDecoded[si]->GetGeomData());
+		REQUIRE(meshData != nullptr);
+		REQUIRE(meshDataDecoded != nullptr);
+		REQUIRE(!meshData->IsPacked());
+		REQUIRE(meshData->nVertices == meshDataDecoded->nVertices);
+		REQUIRE(meshData->vertices == meshDataDecoded->vertices);
+		REQUIRE(meshData->tris.size() == meshDataDecoded->tris.size());
+		REQUIRE(meshData->skinWeights.size() == meshDataDecoded->skinWeights.size());
+	}
+}
+
+TEST_CASE("Keep vertex data packed until accessed", "[NifFile]") {
+	NifLoadOptions packedOptions;
+	packedOptions.keepPacked = true;
+
+	NifSaveOptions saveOptions;
+	saveOptions.optimize = false;
+	saveOptions.sortBlocks = false;
+
+	SECTION("BSTriShape (FO4)") {
+		const auto fileInput = std::get<0>(GetFileTuple("TestNifFile_Static_FO4", nifSuffix));
+
+		NifFile nifDecoded;
+		REQUIRE(nifDecoded.Load(fileInput) == 0);
+
+		std::stringstream decodedOutput;
+		REQUIRE(nifDecoded.Save(decodedOutput, saveOptions) == 0);
+
+		NifFile nif;
+		REQUIRE(nif.Load(fileInput, packedOptions) == 0);
+
+		auto shapes = nif.GetShapes();
+		auto shapesDecoded = nifDecoded.GetShapes();
+		REQUIRE(!shapes.empty());
+		REQUIRE(shapes.size() == shapesDecoded.size());
+
+		for (auto s : shapes) {
+			auto shape = dynamic_cast<BSTriShape*>(s);
+			REQUIRE(shape);
+			REQUIRE(shape->IsPacked());
+			REQUIRE(!shape->vertData.IsLoaded());
+		}
+
+		// Untouched vertex data is written back byte for byte
+		std::stringstream packedOutput;
+		REQUIRE(nif.Save(packedOutput, saveOptions) == 0);
+		REQUIRE(packedOutput.str() == decodedOutput.str());
+
+		// Reading decodes the same data as a regular load and keeps it packed
+		for (size_t si = 0; si < shapes.size(); si++) {
+			auto shape = dynamic_cast<BSTriShape*>(shapes[si]);
+			auto shapeDecoded = dynamic_cast<BSTriShape*>(shapesDecoded[si]);
+			REQUIRE(shapeDecoded);
+
+			REQUIRE(shape->UpdateRawVertices() == shapeDecoded->UpdateRawVertices());
+			REQUIRE(shape->UpdateRawNormals() == shapeDecoded->UpdateRawNormals());
+			REQUIRE(shape->vertData.IsLoaded());
+			REQUIRE(shape->IsPacked());
+		}
+
+		packedOutput.str("");
+		REQUIRE(nif.Save(packedOutput, saveOptions) == 0);
+		REQUIRE(packedOutput.str() == decodedOutput.str());
+
+		// Changing the vertices packs them again
+		auto shape = dynamic_cast<BSTriShape*>(shapes[0]);
+		const Vector3 vert = shape->vertData.Get()[0].vert;
+		shape->vertData[0].vert.x += 1.0f;
+		REQUIRE(!shape->IsPacked());
+
+		packedOutput.str("");
+		REQUIRE(nif.Save(packedOutput, saveOptions) == 0);
+		REQUIRE(packedOutput.str() != decodedOutput.str());
+
+		NifFile reloaded;
+		REQUIRE(reloaded.Load(packedOutput) == 0);
+
+		auto shapeReloaded = dynamic_cast<BSTriShape*>(reloaded.GetShapes()[0]);
+		REQUIRE(shapeReloaded);
+		const Vector3 vertReloaded = shapeReloaded->vertData.Get()[0].vert;
+		const float expectedX = vert.x + 1.0f;
+		REQUIRE(std::fabs(vertReloaded.x - expectedX) <= std::fabs(expectedX) * 1e-3f);
+		REQUIRE(vertReloaded.y == vert.y);
+	}
+
+	SECTION("Internal BSGeometry mesh (SF)") {
+		const auto fileInput = std::get<2>(GetFileTuple("TestNifFile_ToInternalMesh_SF", nifSuffix));
+
+		std::ifstream in(fileInput, std::ios::in | std::ios::binary);
+		REQUIRE(in);
+
+		std::stringstream original;
+		original << in.rdbuf();
+		in.close();
+
+		NifFile nifDecoded;
+		std::stringstream loadDecoded(original.str());
+		REQUIRE(nifDecoded.Load(loadDecoded) == 0);
+
+		NifFile nif;
+		std::stringstream loadPacked(original.str());
+		REQUIRE(nif.Load(loadPacked, packedOptions) == 0);
+
+		auto shapes = nif.GetShapes();
+		auto shapesDecoded = nifDecoded.GetShapes();
+		REQUIRE(!shapes.empty());
+		REQUIRE(shapes.size() == shapesDecoded.size());
+
+		for (size_t si = 0; si < shapes.size(); si++) {
+			auto bsGeom = dynamic_cast<BSGeometry*>(shapes[si]);
+			REQUIRE(bsGeom);
+			REQUIRE(bsGeom->HasInternalGeomData());
+
+			auto mesh = bsGeom->SelectMesh(0);
+			REQUIRE(mesh);
+			REQUIRE(mesh->meshData.IsPacked());
+			bsGeom->ReleaseMesh();
+
+			// Reading decodes the same data as a regular load without unpacking the mesh
+			REQUIRE(bsGeom->GetMeshData(0)->vertices == shapesDecoded[si]->GetGeomData()->vertices);
+			REQUIRE(mesh->meshData.IsPacked());
+		}
+
+		std::stringstream packedOutput;
+		REQUIRE(nif.Save(packedOutput) == 0);
+		REQUIRE(packedOutput.str() == original.str());
+	}
+}
+
+TEST_CASE("Load all external mesh data in parallel (SF)", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_SF";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nifSerial;
+	REQUIRE(nifSerial.Load(fileInput) == 0);
+	for (auto& s : nifSerial.GetShapes())
+		LoadAllExternalMeshData(nifSerial, s);
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+	REQUIRE(nif.LoadAllExternalShapeData(std::filesystem::u8path(folderInput)).empty());
+
+	auto shapes = nif.GetShapes();
+	auto shapesSerial = nifSerial.GetShapes();
+	REQUIRE(shapes.size() == shapesSerial.size());
+
+	for (size_t si = 0; si < shapes.size(); si++) {
+		auto bsGeom = dynamic_cast<BSGeometry*>(shapes[si]);
+		auto bsGeomSerial = dynamic_cast<BSGeometry*>(shapesSerial[si]);
+		REQUIRE(bsGeom != nullptr);
+		REQUIRE(bsGeom->MeshCount() == bsGeomSerial->MeshCount());
+
+		for (uint8_t mi = 0; mi < bsGeom->MeshCount(); mi++) {
+			auto& meshData = bsGeom->GetMesh(mi)->meshData;
+			auto& meshDataSerial = bsGeomSerial->GetMesh(mi)->meshData;
+			REQUIRE(!meshData.vertices.empty());
+			REQUIRE(meshData.vertices == meshDataSerial.vertices);
+			REQUIRE(meshData.normals == meshDataSerial.normals);
+			REQUIRE(meshData.tris == meshDataSerial.tris);
+			REQUIRE(meshData.skinWeights.size() == meshDataSerial.skinWeights.size());
+		}
+	}
+
+	// Kept packed, the data is the file as it is
+	NifFile nifPacked;
+	REQUIRE(nifPacked.Load(fileInput) == 0);
+	REQUIRE(nifPacked.LoadAllExternalShapeData(std::filesystem::u8path(folderInput), {}, true).empty());
+	auto packedGeom = dynamic_cast<BSGeometry*>(nifPacked.GetShapes()[0]);
+	REQUIRE(packedGeom->GetMesh(0)->meshData.IsPacked());
+
+	// Missing and truncated files are reported per mesh, the others still load
+	std::vector<char> meshFile;
+	REQUIRE(ReadBinaryFile(std::filesystem::u8path(folderInput) / "TestNifFile_SF.mesh", meshFile));
+	const auto truncatedPath = std::filesystem::u8path(folderOutput) / "TestNifFile_Truncated_SF.mesh";
+	{
+		std::ofstream truncated(truncatedPath, std::ios::binary);
+		truncated.write(meshFile.data(), static_cast<std::streamsize>(meshFile.size() / 2));
+	}
+
+	auto loadWithErrors = [&](const std::filesystem::path& meshPath) {
+		NifFile nifErrors;
+		REQUIRE(nifErrors.Load(fileInput) == 0);
+
+		auto resolver = [&meshPath](const std::string&) { return meshPath; };
+		auto errors = nifErrors.LoadAllExternalShapeData(resolver);
+		REQUIRE(errors.size() == 1);
+		REQUIRE(errors[0].meshName == nifErrors.GetExternalGeometryPathRefs(errors[0].shape)[0].get());
+		REQUIRE(errors[0].path == meshPath);
+		REQUIRE(!errors[0].message.empty());
+
+		// Partially read data isn't kept
+		auto errorGeom = dynamic_cast<BSGeometry*>(errors[0].shape);
+		REQUIRE(errorGeom != nullptr);
+		REQUIRE(errorGeom->GetMesh(errors[0].meshIndex)->meshData.vertices.empty());
+	};
+
+	loadWithErrors(truncatedPath);
+	loadWithErrors(std::filesystem::u8path(folderInput) / "missing.mesh");
+}
+
+TEST_CASE("Share external mesh data through a cache (SF)", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_SF";
+	const auto [fileInput, fileOutput, fileExpected] = GetFileTuple(fileName, nifSuffix);
+	const auto rootDir = std::filesystem::u8path(folderInput);
+
+	ExternalMeshCache cache;
+
+	NifFile nif1;
+	REQUIRE(nif1.Load(fileInput) == 0);
+	REQUIRE(nif1.LoadAllExternalShapeData(rootDir, {}, false, true, &cache).empty());
+
+	NifFile nif2;
+	REQUIRE(nif2.Load(fileInput) == 0);
+	REQUIRE(nif2.LoadAllExternalShapeData(rootDir, {}, false, true, &cache).empty());
+
+	REQUIRE(cache.GetCount() == 1);
+	REQUIRE(cache.GetMisses() == 1);
+	REQUIRE(cache.GetHits() == 1);
+	REQUIRE(cache.GetSize() > 0);
+
+	auto geom1 = dynamic_cast<BSGeometry*>(nif1.GetShapes()[0]);
+	auto geom2 = dynamic_cast<BSGeometry*>(nif2.GetShapes()[0]);
+	REQUIRE(geom1->GetMesh(0)->meshData.IsShared());
+	REQUIRE(geom1->GetMeshData(0) == geom2->GetMeshData(0));
+	REQUIRE(!geom1->GetMeshData(0)->vertices.empty());
+
+	// Reading keeps the data shared
+	REQUIRE(nif1.GetVertsForShape(geom1) == &geom1->GetMeshData(0)->vertices.Get());
+	std::vector<Vector3> verts;
+	REQUIRE(nif1.GetVertsForShape(geom1, verts));
+	REQUIRE(verts == geom1->GetMeshData(0)->vertices);
+	std::vector<Triangle> tris;
+	REQUIRE(geom1->GetTriangles(tris));
+	REQUIRE(nif1.GetShapeTopology(geom1));
+	REQUIRE(!nif1.GenerateLODTriangles(geom1, {0.5f}).empty());
+	REQUIRE(geom1->GetMesh(0)->meshData.IsShared());
+
+	// Editing takes a private copy, the other file still uses the shared data
+	const Vector3 firstVert = geom1->GetMeshData(0)->vertices[0];
+	nif1.OffsetShape(geom1, Vector3(0.0f, 0.0f, 1.0f));
+	REQUIRE(!geom1->GetMesh(0)->meshData.IsShared());
+	REQUIRE(geom1->GetMeshData(0)->vertices[0] == firstVert + Vector3(0.0f, 0.0f, 1.0f));
+	REQUIRE(geom2->GetMesh(0)->meshData.IsShared());
+	REQUIRE(geom2->GetMeshData(0)->vertices[0] == firstVert);
+
+	// Saving shared data gives the same file
+	const auto meshOutput = std::filesystem::u8path(folderOutput) / "TestNifFile_Cached_SF.mesh";
+	{
+		std::ofstream meshFile(meshOutput, std::ios::binary);
+		REQUIRE(nif2.SaveExternalShapeData(geom2, meshFile, 0));
+	}
+	const auto meshExpected = std::filesystem::u8path(std::get<2>(GetFileTuple(fileName, meshSuffix)));
+	REQUIRE(CompareBinaryFiles(meshOutput, meshExpected));
+	REQUIRE(geom2->GetMesh(0)->meshData.IsShared());
+
+	// Least recently used data is dropped first.
+	// Copies would share their vertices and count half of them, so the entries are made separately.
+	auto makeEntry = []() {
+		auto data = std::make_shared<BSGeometryMeshData>();
+		data->vertices.resize(100);
+		return data;
+	};
+	auto small = makeEntry();
+	const size_t entrySize = sizeof(BSGeometryMeshData) + small->GetHeapUsage();
+
+	ExternalMeshCache lru(entrySize * 2);
+	REQUIRE(lru.Insert("a", small) == small);
+	REQUIRE(lru.Insert("b", makeEntry()) != small);
+	REQUIRE(lru.Find("a") == small);
+	lru.Insert("c", makeEntry());
+	REQUIRE(lru.GetCount() == 2);
+	REQUIRE(lru.Find("b") == nullptr);
+	REQUIRE(lru.Find("a") == small);
+	REQUIRE(lru.Insert("a", std::make_shared<BSGeometryMeshData>()) == small);
+	REQUIRE(lru.GetSize() == entrySize * 2);
+
+	lru.SetCapacity(entrySize);
+	REQUIRE(lru.GetCount() == 1);
+	REQUIRE(lru.Find("a") == small);
+
+	bool loaded = false;
+	auto loadedData = lru.FindOrLoad("d", [&]() {
+		loaded = true;
+		return std::make_shared<const BSGeometryMeshData>();
+	});
+	REQUIRE(loaded);
+	REQUIRE(loadedData != nullptr);
+	REQUIRE(lru.Find("d") == loadedData);
+}
+
 TEST_CASE("BSGeometry bone weights are normalized (SF)", "[NifFile]") {
 	constexpr auto fileName = "TestNifFile_SF";
 	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
@@ -444,6 +946,11 @@ TEST_CASE("Delete vertices for shape (SF)", "[NifFile]") {
 
 		const bool hadMeshlets = meshData->HasMeshlets();
 		const bool hadWeights = !meshData->skinWeights.empty();
+		std::vector<BSGeometryMeshData::BoneWeight> secondVertWeights;
+		if (hadWeights) {
+			auto vw = meshData->GetVertexWeights(1);
+			secondVertWeights.assign(vw.begin(), vw.end());
+		}
 		const bool hadColors = !meshData->vColors.empty();
 		const bool hadNormals = meshData->normals.size() == vertCountBefore;
 		const bool hadTangents = meshData->tangents.size() == vertCountBefore;
@@ -461,8 +968,18 @@ TEST_CASE("Delete vertices for shape (SF)", "[NifFile]") {
 		REQUIRE(meshData->vertices.size() == vertCountAfter);
 		REQUIRE(s->GetNumVertices() == vertCountAfter);
 
-		if (hadWeights)
-			REQUIRE(meshData->skinWeights.size() == vertCountAfter);
+		if (hadWeights) {
+			REQUIRE(meshData->GetSkinWeightVertexCount() == vertCountAfter);
+			REQUIRE(meshData->skinWeights.size() == vertCountAfter * meshData->nWeightsPerVert);
+
+			// The first vertex was deleted, so the second one moved to its slot
+			auto vw = meshData->GetVertexWeights(0);
+			REQUIRE(vw.size() == secondVertWeights.size());
+			for (size_t i = 0; i < vw.size(); i++) {
+				REQUIRE(vw[i].boneIndex == secondVertWeights[i].boneIndex);
+				REQUIRE(vw[i].weight == secondVertWeights[i].weight);
+			}
+		}
 
 		if (hadColors)
 			REQUIRE(meshData->vColors.size() == vertCountAfter);
@@ -498,6 +1015,1679 @@ TEST_CASE("Delete vertices for shape (SF)", "[NifFile]") {
 	}
 }
 
+TEST_CASE("Edit vertices beyond 16-bit indices (SF)", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_SF";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto shapes = nif.GetShapes();
+	REQUIRE(!shapes.empty());
+
+	auto shape = shapes[0];
+	LoadAllExternalMeshData(nif, shape);
+
+	auto meshData = dynamic_cast<BSGeometryMeshData*>(shape->GetGeomData());
+	REQUIRE(meshData != nullptr);
+
+	// Grow the vertex list past the 16-bit range
+	const uint32_t firstExtra = static_cast<uint32_t>(meshData->vertices.size());
+	for (uint32_t i = 0; i < 70000; i++)
+		meshData->vertices.emplace_back(static_cast<float>(i), 0.0f, 0.0f);
+
+	const uint32_t highIndex = firstExtra + 69990;
+	REQUIRE(highIndex > 65535);
+
+	const Vector3 firstVert = meshData->vertices[0];
+	const Vector3 highVert = meshData->vertices[highIndex];
+
+	// Fully masked vertices don't move
+	std::unordered_map<uint32_t, float> mask{{highIndex, 1.0f}};
+	nif.OffsetShape(shape, Vector3(0.0f, 0.0f, 1.0f), &mask);
+	REQUIRE(meshData->vertices[0] == firstVert + Vector3(0.0f, 0.0f, 1.0f));
+	REQUIRE(meshData->vertices[highIndex] == highVert);
+	REQUIRE(meshData->vertices.back().z == 1.0f);
+
+	std::vector<Vector3> target = meshData->vertices;
+	target[highIndex].y += 2.0f;
+
+	std::unordered_map<uint32_t, Vector3> diff;
+	REQUIRE(nif.CalcShapeDiff(shape, &target, diff) == 0);
+	REQUIRE(diff.size() == 1);
+	REQUIRE(diff[highIndex] == Vector3(0.0f, 2.0f, 0.0f));
+
+	// Delete vertices above the 16-bit range
+	const size_t vertCount = meshData->vertices.size();
+	REQUIRE(!nif.DeleteVertsForShape(shape, std::vector<uint32_t>{highIndex - 1, highIndex}));
+	REQUIRE(meshData->vertices.size() == vertCount - 2);
+	REQUIRE(meshData->nVertices == static_cast<uint32_t>(vertCount - 2));
+	REQUIRE(meshData->vertices[highIndex - 1].x == static_cast<float>(69991));
+}
+
+TEST_CASE("Parallel ranges rethrow on the calling thread", "[NifFile]") {
+	constexpr size_t count = 100000;
+	std::vector<uint8_t> visited(count, 0);
+
+	auto run = [&](const size_t throwAt) {
+		ParallelFor(count, 1, [&](const size_t begin, const size_t end) {
+			for (size_t i = begin; i < end; i++)
+				visited[i] = 1;
+
+			if (throwAt >= begin && throwAt < end)
+				throw std::runtime_error("range failed");
+		});
+	};
+
+	// Thrown on a worker thread or on the calling thread, all ranges still finish before rethrowing
+	for (const size_t throwAt : {count - 1, size_t(0)}) {
+		std::fill(visited.begin(), visited.end(), uint8_t(0));
+		REQUIRE_THROWS_AS(run(throwAt), std::runtime_error);
+		REQUIRE(std::count(visited.begin(), visited.end(), uint8_t(1)) == count);
+	}
+
+	std::fill(visited.begin(), visited.end(), uint8_t(0));
+	REQUIRE_NOTHROW(run(count));
+	REQUIRE(std::count(visited.begin(), visited.end(), uint8_t(1)) == count);
+}
+
+TEST_CASE("Transform shapes with null, 16-bit and 32-bit masks", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_Static_SE";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto shape = nif.GetShapes()[0];
+	const std::vector<Vector3> verts = *nif.GetVertsForShape(shape);
+	REQUIRE(verts.size() > 2);
+
+	// A literal nullptr picks neither typed mask overload
+	nif.OffsetShape(shape, Vector3(0.0f, 0.0f, 1.0f), nullptr);
+	nif.ScaleShape(shape, Vector3(1.0f, 1.0f, 1.0f), nullptr);
+	nif.RotateShape(shape, Vector3(0.0f, 0.0f, 0.0f), nullptr);
+	REQUIRE(nif.GetVertsForShape(shape)->at(0) == verts[0] + Vector3(0.0f, 0.0f, 1.0f));
+
+	// Both index widths mask the same vertices
+	std::unordered_map<uint16_t, float> mask16{{1, 1.0f}};
+	std::unordered_map<uint32_t, float> mask32{{1, 1.0f}};
+	nif.OffsetShape(shape, Vector3(0.0f, 0.0f, 1.0f), &mask16);
+	nif.OffsetShape(shape, Vector3(0.0f, 0.0f, 1.0f), &mask32);
+	REQUIRE(nif.GetVertsForShape(shape)->at(0) == verts[0] + Vector3(0.0f, 0.0f, 3.0f));
+	REQUIRE(nif.GetVertsForShape(shape)->at(1) == verts[1] + Vector3(0.0f, 0.0f, 1.0f));
+
+	// Masked vertices of scaled shapes end up at v - root + (v - target) * (1 - mask)
+	Vector3 root;
+	nif.GetRootTranslation(root);
+	const std::vector<Vector3> offsetVerts = *nif.GetVertsForShape(shape);
+	const Vector3 scale(2.0f, 0.5f, 3.0f);
+	std::unordered_map<uint32_t, float> scaleMask{{1, 0.25f}};
+	nif.ScaleShape(shape, scale, &scaleMask);
+	REQUIRE(nif.GetVertsForShape(shape)->at(0) == (offsetVerts[0] - root).ComponentMultiply(scale));
+	const Vector3 target = (offsetVerts[1] - root).ComponentMultiply(scale);
+	REQUIRE(nif.GetVertsForShape(shape)->at(1) == offsetVerts[1] - root + (offsetVerts[1] - target) * 0.75f);
+
+	// A braced list of indices picks the 32-bit overload
+	REQUIRE(!nif.DeleteVertsForShape(shape, {0}));
+	REQUIRE(nif.GetVertsForShape(shape)->size() == verts.size() - 1);
+}
+
+TEST_CASE("Match coincident vertices of more than 65535 points", "[NifFile]") {
+	constexpr uint32_t numUnique = 35000;
+	std::vector<Vector3> points;
+	for (uint32_t i = 0; i < numUnique * 2; i++) {
+		const uint32_t p = i % numUnique;
+		points.emplace_back(static_cast<float>(p % 300), static_cast<float>(p / 300), i < numUnique ? 0.0f : 1e-6f);
+	}
+
+	SpatialHashMatcher<uint32_t> matcher(points.data(), static_cast<uint32_t>(points.size()));
+	REQUIRE(matcher.matches.size() == numUnique);
+	for (auto& matchset : matcher.matches) {
+		REQUIRE(matchset.size() == 2);
+		REQUIRE(matchset[1] == matchset[0] + numUnique);
+	}
+}
+
+TEST_CASE("Weld coincident vertices", "[NifFile]") {
+	// Two quads sharing an edge through separate vertices, plus a near duplicate within epsilon
+	std::vector<Vector3> verts = {Vector3(0.0f, 0.0f, 0.0f),
+								  Vector3(1.0f, 0.0f, 0.0f),
+								  Vector3(0.0f, 1.0f, 0.0f),
+								  Vector3(1.0f, 1.0f, 0.0f),
+								  Vector3(1.0f, 0.0f, 0.0f),
+								  Vector3(2.0f, 0.0f, 0.0f),
+								  Vector3(1.00001f, 1.0f, 0.0f),
+								  Vector3(2.0f, 1.0f, 0.0f)};
+	std::vector<Triangle> tris = {Triangle(0, 1, 2), Triangle(1, 3, 2), Triangle(4, 5, 6), Triangle(5, 7, 6), Triangle(1, 4, 3)};
+	std::vector<Vector2> uvs;
+	std::vector<float> ids;
+	for (uint16_t i = 0; i < verts.size(); i++) {
+		uvs.emplace_back(static_cast<float>(i), 0.0f);
+		ids.push_back(static_cast<float>(i));
+	}
+
+	SpatialHashMatcher<uint16_t> matcher16(verts.data(), static_cast<uint16_t>(verts.size()), 0.001f);
+	REQUIRE(matcher16.matches.size() == 2);
+
+	// Outside of the epsilon, only the exact duplicates are welded
+	std::vector<Vector3> exactVerts = verts;
+	std::vector<Triangle> exactTris = tris;
+	REQUIRE(WeldVertices(exactVerts, exactTris, 0.000001f) == 1);
+	REQUIRE(exactVerts.size() == 7);
+
+	// Zero epsilon welds exact duplicates
+	exactVerts = verts;
+	exactTris = tris;
+	REQUIRE(WeldVertices(exactVerts, exactTris, 0.0f) == 1);
+	REQUIRE(exactVerts.size() == 7);
+
+	// Points at the origin derive a zero epsilon, very large coordinates don't overflow the cells
+	const std::vector<Vector3> originPoints(3, Vector3());
+	REQUIRE(SpatialHashMatcher<uint32_t>(originPoints.data(), 3).matches.size() == 1);
+	const std::vector<Vector3> farPoints = {Vector3(1e30f, -1e30f, 0.0f),
+											Vector3(-1e30f, 1e30f, 0.0f),
+											Vector3(1e30f, -1e30f, 0.0f)};
+	const SpatialHashMatcher<uint32_t> farMatcher(farPoints.data(), 3, 0.0001f);
+	REQUIRE(farMatcher.matches.size() == 1);
+	REQUIRE(farMatcher.matches[0] == std::vector<uint32_t>{0, 2});
+
+	REQUIRE(WeldVertices(verts, tris, 0.001f, uvs, ids) == 2);
+	REQUIRE(verts.size() == 6);
+	REQUIRE(uvs.size() == 6);
+	REQUIRE(ids == std::vector<float>{0.0f, 1.0f, 2.0f, 3.0f, 5.0f, 7.0f});
+
+	// Degenerate triangle (1, 4, 3) is removed, the second quad now uses the welded vertices
+	REQUIRE(tris.size() == 4);
+	REQUIRE(tris[2].p1 == 1);
+	REQUIRE(tris[2].p2 == 4);
+	REQUIRE(tris[2].p3 == 3);
+	REQUIRE(tris[3].p1 == 4);
+	REQUIRE(tris[3].p2 == 5);
+	REQUIRE(tris[3].p3 == 3);
+}
+
+TEST_CASE("Optimize triangle order for the vertex cache", "[NifFile]") {
+	// Grid of 40x40 quads with its triangles shuffled
+	constexpr uint16_t gridSize = 41;
+	std::vector<Triangle> tris;
+	for (uint16_t y = 0; y + 1 < gridSize; y++) {
+		for (uint16_t x = 0; x + 1 < gridSize; x++) {
+			const auto i = static_cast<uint16_t>(y * gridSize + x);
+			tris.emplace_back(i, static_cast<uint16_t>(i + 1), static_cast<uint16_t>(i + gridSize));
+			tris.emplace_back(static_cast<uint16_t>(i + 1),
+							  static_cast<uint16_t>(i + gridSize + 1),
+							  static_cast<uint16_t>(i + gridSize));
+		}
+	}
+
+	uint32_t seed = 777;
+	for (size_t i = tris.size() - 1; i > 0; i--) {
+		seed = seed * 1664525u + 1013904223u;
+		std::swap(tris[i], tris[(seed >> 8) % (i + 1)]);
+	}
+
+	const std::vector<uint32_t> order = GenerateVertexCacheOrder(tris);
+	REQUIRE(order.size() == tris.size());
+
+	std::vector<Triangle> orderedTris;
+	std::vector<bool> used(tris.size(), false);
+	for (uint32_t t : order) {
+		REQUIRE_FALSE(used[t]);
+		used[t] = true;
+		orderedTris.push_back(tris[t]);
+	}
+
+	REQUIRE(CalcCacheMissRatio(tris) > 1.5f);
+	REQUIRE(CalcCacheMissRatio(orderedTris) < 0.8f);
+
+	constexpr auto fileName = "TestNifFile_Skinned_SE";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	for (auto& shape : nif.GetShapes()) {
+		std::vector<Triangle> shapeTris;
+		REQUIRE(shape->GetTriangles(shapeTris));
+
+		auto skinInst = nif.GetHeader().GetBlock<NiSkinInstance>(shape->SkinInstanceRef());
+		REQUIRE(skinInst);
+		auto skinPart = nif.GetHeader().GetBlock(skinInst->skinPartitionRef);
+		REQUIRE(skinPart);
+
+		auto sortedTris = [](std::vector<Triangle> list) {
+			for (auto& t : list)
+				t.rot();
+			std::sort(list.begin(), list.end());
+			return list;
+		};
+
+		std::vector<std::vector<Triangle>> partTris;
+		for (auto& part : skinPart->partitions)
+			partTris.push_back(sortedTris(part.trueTriangles));
+
+		const float missRatio = CalcCacheMissRatio(shapeTris);
+		REQUIRE(nif.OptimizeVertexCache(shape));
+
+		std::vector<Triangle> newTris;
+		REQUIRE(shape->GetTriangles(newTris));
+		REQUIRE(sortedTris(newTris) == sortedTris(shapeTris));
+		REQUIRE(CalcCacheMissRatio(newTris) <= missRatio);
+
+		// Partitions keep their triangles and triParts follows the new order
+		REQUIRE(skinPart->triParts.size() == newTris.size());
+		for (size_t pi = 0; pi < skinPart->partitions.size(); pi++) {
+			auto& part = skinPart->partitions[pi];
+			REQUIRE(sortedTris(part.trueTriangles) == partTris[pi]);
+			REQUIRE(part.triangles.size() == part.trueTriangles.size());
+			REQUIRE(part.numTriangles == part.trueTriangles.size());
+		}
+
+		for (size_t i = 0; i < newTris.size(); i++) {
+			auto& part = skinPart->partitions[static_cast<size_t>(skinPart->triParts[i])];
+			REQUIRE(std::find(part.trueTriangles.begin(), part.trueTriangles.end(), newTris[i])
+					!= part.trueTriangles.end());
+		}
+	}
+}
+
+TEST_CASE("Generate triangle strips", "[NifFile]") {
+	auto sortedTris = [](std::vector<Triangle> list) {
+		for (auto& t : list)
+			t.rot();
+		std::sort(list.begin(), list.end());
+		return list;
+	};
+
+	// Grid of 64x64 quads with a degenerate triangle
+	constexpr uint16_t gridSize = 65;
+	std::vector<Triangle> tris;
+	for (uint16_t y = 0; y + 1 < gridSize; y++) {
+		for (uint16_t x = 0; x + 1 < gridSize; x++) {
+			const auto i = static_cast<uint16_t>(y * gridSize + x);
+			tris.emplace_back(i, static_cast<uint16_t>(i + 1), static_cast<uint16_t>(i + gridSize));
+			tris.emplace_back(static_cast<uint16_t>(i + 1),
+							  static_cast<uint16_t>(i + gridSize + 1),
+							  static_cast<uint16_t>(i + gridSize));
+		}
+	}
+
+	const std::vector<Triangle> gridTris = tris;
+	tris.emplace_back(3, 3, 4);
+
+	const auto strips = GenerateStripsFromTriangles(tris);
+	REQUIRE(sortedTris(GenerateTrianglesFromStrips(strips)) == sortedTris(gridTris));
+
+	// Strips run across whole rows
+	REQUIRE(strips.size() <= gridSize - 1);
+
+	const auto joined = GenerateStripsFromTriangles(tris, true);
+	REQUIRE(joined.size() == 1);
+	REQUIRE(sortedTris(GenerateTrianglesFromStrips(joined)) == sortedTris(gridTris));
+
+	// Triangles with the opposite winding of their neighbors still keep their own winding
+	std::vector<Triangle> mixed{{0, 1, 2}, {1, 2, 3}, {2, 3, 4}, {5, 4, 3}};
+	const auto mixedStrips = GenerateStripsFromTriangles(mixed);
+	REQUIRE(sortedTris(GenerateTrianglesFromStrips(mixedStrips)) == sortedTris(mixed));
+
+	REQUIRE(GenerateStripsFromTriangles(std::vector<Triangle>()).empty());
+
+	// Triangle counts of strips past 16 bits are refused instead of wrapping around
+	uint16_t numStripTriangles = 0;
+	REQUIRE(CountStripTriangles(joined, numStripTriangles));
+	REQUIRE(numStripTriangles == joined[0].size() - 2);
+
+	const std::vector<std::vector<uint16_t>> longStrips(2, std::vector<uint16_t>(40000));
+	REQUIRE_FALSE(CountStripTriangles(longStrips, numStripTriangles));
+	REQUIRE_FALSE(CountStripTriangles({std::vector<uint16_t>(70000)}, numStripTriangles));
+
+	NiTriStripsData stripsData;
+	REQUIRE(stripsData.SetStrips(joined));
+	REQUIRE_FALSE(stripsData.SetStrips(longStrips));
+	REQUIRE(stripsData.stripsInfo.points == joined);
+}
+
+TEST_CASE("Stripify shapes for Oblivion", "[NifFile]") {
+	const auto fileInput = std::get<0>(GetFileTuple("TestNifFile_Skinned_OB", nifSuffix));
+	const auto fileOutput = std::get<1>(GetFileTuple("TestNifFile_Stripify_OB", nifSuffix));
+
+	auto sortedTris = [](std::vector<Triangle> list) {
+		for (auto& t : list)
+			t.rot();
+		std::sort(list.begin(), list.end());
+		return list;
+	};
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto shape = nif.GetShapes()[0];
+	REQUIRE(shape->HasType<NiTriShape>());
+
+	const std::string shapeName = shape->name.get();
+	std::vector<Triangle> tris;
+	REQUIRE(shape->GetTriangles(tris));
+
+	// Partitions are stripified from their triangle lists
+	auto skinInst = nif.GetHeader().GetBlock<NiSkinInstance>(shape->SkinInstanceRef());
+	REQUIRE(skinInst);
+	auto skinPart = nif.GetHeader().GetBlock(skinInst->skinPartitionRef);
+	REQUIRE(skinPart);
+	REQUIRE(skinPart->ConvertStripsToTriangles());
+
+	std::vector<std::vector<Triangle>> partTris;
+	for (auto& part : skinPart->partitions)
+		partTris.push_back(sortedTris(part.triangles));
+
+	OptOptions options;
+	options.targetVersion = NiVersion::getOB();
+	options.stripify = true;
+
+	OptResult result = nif.OptimizeFor(options);
+	REQUIRE_FALSE(result.versionMismatch);
+	REQUIRE(result.shapesStripified.size() == 1);
+	REQUIRE(result.shapesStripified[0] == shapeName);
+
+	shape = nif.FindBlockByName<NiShape>(shapeName);
+	REQUIRE(shape);
+	REQUIRE(shape->HasType<NiTriStrips>());
+
+	std::vector<Triangle> stripTris;
+	REQUIRE(shape->GetTriangles(stripTris));
+	REQUIRE(sortedTris(stripTris) == sortedTris(tris));
+
+	// Joined into one strip per partition, counting the degenerate triangles like game files do
+	for (size_t pi = 0; pi < skinPart->partitions.size(); pi++) {
+		auto& part = skinPart->partitions[pi];
+		REQUIRE(part.numStrips == 1);
+		REQUIRE(part.numTriangles == part.strips[0].size() - 2);
+		REQUIRE(sortedTris(GenerateTrianglesFromStrips(part.strips)) == partTris[pi]);
+	}
+
+	REQUIRE(nif.Save(fileOutput) == 0);
+
+	NifFile reloaded;
+	REQUIRE(reloaded.Load(fileOutput) == 0);
+
+	auto reloadedShape = reloaded.FindBlockByName<NiShape>(shapeName);
+	REQUIRE(reloadedShape);
+	REQUIRE(reloadedShape->HasType<NiTriStrips>());
+
+	std::vector<Triangle> reloadedTris;
+	REQUIRE(reloadedShape->GetTriangles(reloadedTris));
+	REQUIRE(sortedTris(reloadedTris) == sortedTris(tris));
+
+	// Other versions still can't be stripified
+	options.targetVersion = NiVersion::getSK();
+	REQUIRE(nif.OptimizeFor(options).versionMismatch);
+}
+
+TEST_CASE("Reorder vertices to first use order", "[NifFile]") {
+	const auto fileNames = {"TestNifFile_Skinned_Dynamic_SE", "TestNifFile_Skinned_OB", "TestNifFile_Morph_MW"};
+	for (auto fileName : fileNames) {
+		const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+		NifFile nif;
+		REQUIRE(nif.Load(fileInput) == 0);
+
+		for (auto& shape : nif.GetShapes()) {
+			const std::vector<Vector3> verts = *nif.GetVertsForShape(shape);
+			std::vector<Vector2> uvs;
+			nif.GetUvsForShape(shape, uvs);
+			std::vector<Triangle> tris;
+			REQUIRE(shape->GetTriangles(tris));
+
+			std::unordered_map<uint16_t, float> weights;
+			nif.GetShapeBoneWeights(shape, 0, weights);
+
+			auto morpher = nif.GetHeader().GetBlock<NiGeomMorpherController>(shape->controllerRef);
+			auto morphData = morpher ? nif.GetHeader().GetBlock(morpher->dataRef) : nullptr;
+			const std::vector<Morph> morphs = morphData ? morphData->GetMorphs() : std::vector<Morph>();
+
+			std::vector<int> badMap(verts.size(), 0);
+			REQUIRE_FALSE(nif.ReorderVertices(shape, badMap));
+
+			const auto numVerts = static_cast<uint32_t>(verts.size());
+			const std::vector<int> vertMap = GenerateVertexFetchMap(tris, numVerts);
+			REQUIRE(nif.OptimizeVertexFetch(shape));
+
+			auto newIndex = [&vertMap](uint16_t i) { return static_cast<size_t>(vertMap[i]); };
+
+			const std::vector<Vector3>& newVerts = *nif.GetVertsForShape(shape);
+			std::vector<Vector2> newUvs;
+			nif.GetUvsForShape(shape, newUvs);
+			for (uint16_t i = 0; i < verts.size(); i++) {
+				REQUIRE(newVerts[newIndex(i)] == verts[i]);
+				REQUIRE(newUvs[newIndex(i)].u == uvs[i].u);
+				REQUIRE(newUvs[newIndex(i)].v == uvs[i].v);
+			}
+
+			// Triangles are renumbered and now use the vertices in increasing order
+			std::vector<Triangle> newTris;
+			REQUIRE(shape->GetTriangles(newTris));
+			REQUIRE(newTris.size() == tris.size());
+
+			uint16_t nextIndex = 0;
+			for (size_t t = 0; t < tris.size(); t++) {
+				REQUIRE(newTris[t].p1 == newIndex(tris[t].p1));
+				REQUIRE(newTris[t].p2 == newIndex(tris[t].p2));
+				REQUIRE(newTris[t].p3 == newIndex(tris[t].p3));
+
+				for (uint16_t v : {newTris[t].p1, newTris[t].p2, newTris[t].p3}) {
+					REQUIRE(v <= nextIndex);
+					if (v == nextIndex)
+						nextIndex++;
+				}
+			}
+
+			std::unordered_map<uint16_t, float> newWeights;
+			nif.GetShapeBoneWeights(shape, 0, newWeights);
+			REQUIRE(newWeights.size() == weights.size());
+			for (auto& [index, weight] : weights)
+				REQUIRE(newWeights[static_cast<uint16_t>(newIndex(index))] == weight);
+
+			if (morphData) {
+				const std::vector<Morph> newMorphs = morphData->GetMorphs();
+				for (size_t m = 0; m < morphs.size(); m++)
+					for (uint16_t i = 0; i < morphs[m].vectors.size(); i++)
+						REQUIRE(newMorphs[m].vectors[newIndex(i)] == morphs[m].vectors[i]);
+			}
+
+			// Partition vertex maps point to the same vertices as before
+			auto skinInst = nif.GetHeader().GetBlock<NiSkinInstance>(shape->SkinInstanceRef());
+			auto skinPart = skinInst ? nif.GetHeader().GetBlock(skinInst->skinPartitionRef) : nullptr;
+			if (skinPart) {
+				std::set<Triangle> triSet;
+				for (Triangle t : newTris) {
+					t.rot();
+					triSet.insert(t);
+				}
+
+				for (auto part : skinPart->partitions) {
+					if (skinPart->bMappedIndices)
+						part.GenerateTrueTrianglesFromMappedTriangles();
+
+					for (Triangle t : part.trueTriangles) {
+						t.rot();
+						REQUIRE(triSet.count(t) == 1);
+					}
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE("Build spatially coherent meshlets", "[NifFile]") {
+	// Grid of 60x60 quads with its triangles shuffled
+	constexpr uint16_t gridSize = 61;
+	BSGeometryMeshData meshData;
+	for (uint16_t y = 0; y < gridSize; y++)
+		for (uint16_t x = 0; x < gridSize; x++)
+			meshData.vertices.emplace_back(static_cast<float>(x), static_cast<float>(y), 0.0f);
+
+	for (uint16_t y = 0; y + 1 < gridSize; y++) {
+		for (uint16_t x = 0; x + 1 < gridSize; x++) {
+			const auto i = static_cast<uint16_t>(y * gridSize + x);
+			meshData.tris.emplace_back(i, static_cast<uint16_t>(i + 1), static_cast<uint16_t>(i + gridSize));
+			meshData.tris.emplace_back(static_cast<uint16_t>(i + 1),
+									   static_cast<uint16_t>(i + gridSize + 1),
+									   static_cast<uint16_t>(i + gridSize));
+		}
+	}
+
+	uint32_t seed = 4242;
+	for (size_t i = meshData.tris.size() - 1; i > 0; i--) {
+		seed = seed * 1664525u + 1013904223u;
+		std::swap(meshData.tris[i], meshData.tris[(seed >> 8) % (i + 1)]);
+	}
+
+	auto sortedTris = [](std::vector<Triangle> list) {
+		std::sort(list.begin(), list.end());
+		return list;
+	};
+
+	auto boundsRadiusSum = [](const BSGeometryMeshData& data) {
+		float sum = 0.0f;
+		for (auto& bounds : data.meshletBounds)
+			sum += bounds.radius;
+		return sum;
+	};
+
+	const std::vector<Triangle> tris = meshData.tris;
+	meshData.GenerateMeshlets(64, 84);
+	const float indexOrderRadius = boundsRadiusSum(meshData);
+	REQUIRE(meshData.tris == tris);
+
+	meshData.GenerateSpatialMeshlets(64, 84);
+	REQUIRE(sortedTris(meshData.tris) == sortedTris(tris));
+
+	// A given topology of the triangles gives the same meshlets
+	BSGeometryMeshData topologyMeshData = meshData;
+	topologyMeshData.tris = tris;
+	const MeshTopology topology(topologyMeshData.vertices.size(), tris);
+	topologyMeshData.GenerateSpatialMeshlets(64, 84, &topology);
+	REQUIRE(topologyMeshData.tris == meshData.tris);
+	REQUIRE(meshData.meshletList.size() == meshData.cullDataList.size());
+	REQUIRE(meshData.meshletList.size() == meshData.meshletBounds.size());
+	REQUIRE(boundsRadiusSum(meshData) * 4.0f < indexOrderRadius);
+
+	// Meshlets cover the reordered triangles in sequence and respect the limits
+	uint32_t nextTri = 0;
+	uint32_t nextVert = 0;
+	for (size_t m = 0; m < meshData.meshletList.size(); m++) {
+		auto& meshlet = meshData.meshletList[m];
+		REQUIRE(meshlet.primOffset == nextTri);
+		REQUIRE(meshlet.vertOffset == nextVert);
+		REQUIRE(meshlet.primCount <= 84);
+		REQUIRE(meshlet.vertCount <= 64);
+
+		std::set<uint16_t> verts;
+		for (uint32_t t = meshlet.primOffset; t < meshlet.primOffset + meshlet.primCount; t++) {
+			verts.insert({meshData.tris[t].p1, meshData.tris[t].p2, meshData.tris[t].p3});
+
+			// The flat grid faces up, so every meshlet gets a cone along +Z with no spread
+			auto& bounds = meshData.meshletBounds[m];
+			REQUIRE(bounds.coneAxis == Vector3(0.0f, 0.0f, 1.0f));
+			REQUIRE(bounds.coneCutoff == 0.0f);
+			REQUIRE(meshData.vertices[meshData.tris[t].p1].DistanceTo(bounds.center) <= bounds.radius);
+		}
+
+		REQUIRE(verts.size() == meshlet.vertCount);
+		nextTri += meshlet.primCount;
+		nextVert += meshlet.vertCount;
+	}
+
+	REQUIRE(nextTri == meshData.tris.size());
+
+	// Reordering vertices rebuilds spatial meshlets with the same builder and limits
+	const size_t spatialCount = meshData.meshletList.size();
+	std::vector<int> vertMap(meshData.vertices.size());
+	for (size_t i = 0; i < vertMap.size(); i++)
+		vertMap[i] = static_cast<int>(vertMap.size() - 1 - i);
+
+	meshData.notifyVerticesReorder(vertMap);
+	REQUIRE(meshData.meshletList.size() == spatialCount);
+	REQUIRE(boundsRadiusSum(meshData) * 4.0f < indexOrderRadius);
+	for (auto& meshlet : meshData.meshletList)
+		REQUIRE(meshlet.primCount <= 84);
+}
+
+TEST_CASE("Simplify triangles for LOD levels", "[NifFile]") {
+	// Flat grid of 20x20 quads, split into two UV islands by a seam along the center column
+	constexpr uint16_t gridSize = 21;
+	constexpr uint16_t seamX = gridSize / 2;
+	std::vector<Vector3> verts;
+	for (uint16_t y = 0; y < gridSize; y++)
+		for (uint16_t x = 0; x < gridSize; x++)
+			verts.emplace_back(static_cast<float>(x), static_cast<float>(y), 0.0f);
+
+	// Copies of the seam vertices used by the right island
+	const auto firstCopy = static_cast<uint16_t>(verts.size());
+	for (uint16_t y = 0; y < gridSize; y++)
+		verts.push_back(verts[static_cast<size_t>(y * gridSize + seamX)]);
+
+	auto isCopy = [firstCopy](const uint16_t v) { return v >= firstCopy; };
+
+	std::vector<Triangle> tris;
+	for (uint16_t y = 0; y + 1 < gridSize; y++) {
+		for (uint16_t x = 0; x + 1 < gridSize; x++) {
+			const auto i = static_cast<uint16_t>(y * gridSize + x);
+			Triangle t1(i, static_cast<uint16_t>(i + 1), static_cast<uint16_t>(i + gridSize));
+			Triangle t2(static_cast<uint16_t>(i + 1),
+						static_cast<uint16_t>(i + gridSize + 1),
+						static_cast<uint16_t>(i + gridSize));
+			if (x >= seamX)
+				for (Triangle* t : {&t1, &t2})
+					for (int c = 0; c < 3; c++)
+						if ((*t)[c] % gridSize == seamX)
+							(*t)[c] = static_cast<uint16_t>(firstCopy + (*t)[c] / gridSize);
+
+			tris.push_back(t1);
+			tris.push_back(t2);
+		}
+	}
+
+	auto usesVertex = [](const std::vector<Triangle>& list, const uint16_t v) {
+		return std::any_of(list.begin(), list.end(), [v](const Triangle& t) { return t.HasVertex(v); });
+	};
+
+	const auto targetCount = static_cast<uint32_t>(tris.size() / 10);
+	float error = -1.0f;
+	auto lodTris = SimplifyTriangles(verts, tris, targetCount, 0.01f, nullptr, &error);
+	REQUIRE(!lodTris.empty());
+	REQUIRE(lodTris.size() <= targetCount);
+	REQUIRE(error >= 0.0f);
+	REQUIRE(error <= 0.01f);
+
+	for (const Triangle& t : lodTris) {
+		REQUIRE(t.p1 < verts.size());
+		REQUIRE(t.p2 < verts.size());
+		REQUIRE(t.p3 < verts.size());
+		REQUIRE(t.p1 != t.p2);
+		REQUIRE(t.p2 != t.p3);
+		REQUIRE(t.p3 != t.p1);
+
+		// Triangles stay on their side of the seam and use the seam vertices of their side
+		const float minX = std::min({verts[t.p1].x, verts[t.p2].x, verts[t.p3].x});
+		const float maxX = std::max({verts[t.p1].x, verts[t.p2].x, verts[t.p3].x});
+		REQUIRE((maxX <= seamX || minX >= seamX));
+		for (int c = 0; c < 3; c++)
+			if (verts[t[c]].x == seamX)
+				REQUIRE(isCopy(t[c]) == (maxX > seamX));
+	}
+
+	// The outline and the ends of the seam are kept
+	REQUIRE(usesVertex(lodTris, 0));
+	REQUIRE(usesVertex(lodTris, gridSize - 1));
+	REQUIRE(usesVertex(lodTris, static_cast<uint16_t>(gridSize * gridSize - 1)));
+	REQUIRE(usesVertex(lodTris, seamX));
+	REQUIRE(usesVertex(lodTris, firstCopy));
+
+	// Seam vertices collapse along the seam, both copies together
+	uint32_t seamVertCount = 0;
+	for (uint16_t y = 0; y < gridSize; y++) {
+		const bool left = usesVertex(lodTris, static_cast<uint16_t>(y * gridSize + seamX));
+		REQUIRE(left == usesVertex(lodTris, static_cast<uint16_t>(firstCopy + y)));
+		if (left)
+			seamVertCount++;
+	}
+
+	REQUIRE(seamVertCount >= 2);
+	REQUIRE(seamVertCount < gridSize);
+
+	// A topology of the triangles gives the same result
+	const MeshTopology topology(verts.size(), tris);
+	REQUIRE(SimplifyTriangles(verts, tris, targetCount, 0.01f, nullptr, nullptr, &topology) == lodTris);
+
+	// A vertex with a differing attribute value is kept as well
+	const auto marked = static_cast<uint16_t>(5 * gridSize + 5);
+	SimplifyAttributes attributes;
+	std::vector<float> markers(verts.size(), 0.0f);
+	markers[marked] = 1.0f;
+	attributes.Add(std::move(markers), 1.0f);
+
+	lodTris = SimplifyTriangles(verts, tris, targetCount, 0.01f, &attributes);
+	REQUIRE(lodTris.size() <= targetCount);
+	REQUIRE(usesVertex(lodTris, marked));
+
+	// Sparse values work the same, like a bone weighting a single vertex
+	SimplifyAttributes sparseAttributes;
+	std::vector<std::vector<SimplifyAttributes::SparseValue>> sparseMarkers(verts.size());
+	sparseMarkers[marked].push_back({3, 1.0f});
+	sparseAttributes.SetSparse(std::move(sparseMarkers), 1.0f);
+	REQUIRE(sparseAttributes.sparseStart.size() == verts.size() + 1);
+
+	lodTris = SimplifyTriangles(verts, tris, targetCount, 0.01f, &sparseAttributes);
+	REQUIRE(lodTris.size() <= targetCount);
+	REQUIRE(usesVertex(lodTris, marked));
+}
+
+TEST_CASE("Generate LOD levels for shapes (SF)", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_SF";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto shapes = nif.GetShapes();
+	REQUIRE(!shapes.empty());
+
+	for (auto& s : shapes)
+		LoadAllExternalMeshData(nif, s);
+
+	const std::vector<float> ratios = {0.5f, 0.25f};
+	REQUIRE(nif.GenerateLODsForShapes(shapes, ratios) == shapes.size());
+
+	for (auto& s : shapes) {
+		auto* meshData = dynamic_cast<BSGeometryMeshData*>(s->GetGeomData());
+		REQUIRE(meshData != nullptr);
+		REQUIRE(!meshData->lods.empty());
+		REQUIRE(meshData->nLODS == meshData->lods.size());
+
+		size_t previousCount = meshData->tris.size();
+		for (auto& lod : meshData->lods) {
+			REQUIRE(!lod.empty());
+			REQUIRE(lod.size() <= previousCount);
+			for (const Triangle& t : lod)
+				REQUIRE(std::max({t.p1, t.p2, t.p3}) < meshData->vertices.size());
+
+			previousCount = lod.size();
+		}
+
+		REQUIRE(meshData->lods[0].size() < meshData->tris.size());
+		REQUIRE(nif.GenerateLODTriangles(s, ratios) == meshData->lods);
+	}
+}
+
+TEST_CASE("Triangle BVH queries match brute force", "[NifFile]") {
+	// Bumpy grid of 30x30 quads
+	constexpr uint16_t gridSize = 31;
+	std::vector<Vector3> verts;
+	for (uint16_t y = 0; y < gridSize; y++)
+		for (uint16_t x = 0; x < gridSize; x++)
+			verts.emplace_back(static_cast<float>(x),
+							   static_cast<float>(y),
+							   std::sin(static_cast<float>(x) * 0.5f)
+								   * std::cos(static_cast<float>(y) * 0.3f));
+
+	std::vector<Triangle> tris;
+	for (uint16_t y = 0; y + 1 < gridSize; y++) {
+		for (uint16_t x = 0; x + 1 < gridSize; x++) {
+			const auto i = static_cast<uint16_t>(y * gridSize + x);
+			tris.emplace_back(i, static_cast<uint16_t>(i + 1), static_cast<uint16_t>(i + gridSize));
+			tris.emplace_back(static_cast<uint16_t>(i + 1),
+							  static_cast<uint16_t>(i + gridSize + 1),
+							  static_cast<uint16_t>(i + gridSize));
+		}
+	}
+
+	MatTransform transform;
+	transform.translation = Vector3(5.0f, -3.0f, 2.0f);
+	transform.scale = 2.0f;
+	TriangleBVH bvh(verts, tris, transform);
+	REQUIRE(bvh.GetNumTriangles() == tris.size());
+	REQUIRE(bvh.GetNumNodes() > 1);
+
+	// Single triangle trees as the brute force reference
+	std::vector<TriangleBVH> singles;
+	for (const Triangle& t : tris)
+		singles.emplace_back(verts, std::vector<Triangle>{t}, transform);
+
+	uint32_t seed = 777;
+	auto next = [&seed](const float range) {
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24) * range;
+	};
+
+	std::vector<Vector3> points;
+	std::vector<Vector3> directions;
+	for (int i = 0; i < 300; i++) {
+		points.emplace_back(next(70.0f), next(70.0f) - 6.0f, next(20.0f) - 8.0f);
+		directions.emplace_back(next(2.0f) - 1.0f, next(2.0f) - 1.0f, next(2.0f) - 1.0f);
+	}
+
+	std::vector<BVHHit> closest;
+	bvh.ClosestPoints(points, closest);
+	std::vector<BVHHit> rayHits;
+	bvh.Raycasts(points, directions, rayHits);
+	std::vector<std::vector<uint32_t>> overlaps;
+	bvh.OverlapSpheres(points, 3.0f, overlaps);
+
+	uint32_t rayHitCount = 0;
+	for (size_t q = 0; q < points.size(); q++) {
+		float bestDist = FLT_MAX;
+		float bestRayDist = FLT_MAX;
+		std::vector<uint32_t> inSphere;
+		for (uint32_t t = 0; t < static_cast<uint32_t>(singles.size()); t++) {
+			BVHHit hit;
+			REQUIRE(singles[t].ClosestPoint(points[q], hit));
+			bestDist = std::min(bestDist, hit.distance);
+			if (hit.distance <= 3.0f)
+				inSphere.push_back(t);
+			if (singles[t].Raycast(points[q], directions[q], hit))
+				bestRayDist = std::min(bestRayDist, hit.distance);
+		}
+
+		REQUIRE(closest[q].IsValid());
+		REQUIRE(closest[q].distance == bestDist);
+		REQUIRE(closest[q].point.DistanceTo(points[q]) - closest[q].distance <= 1e-3f);
+		REQUIRE(overlaps[q] == inSphere);
+
+		if (bestRayDist == FLT_MAX) {
+			REQUIRE(!rayHits[q].IsValid());
+			continue;
+		}
+
+		rayHitCount++;
+		REQUIRE(rayHits[q].IsValid());
+		REQUIRE(rayHits[q].distance == bestRayDist);
+		REQUIRE(bvh.IntersectsSegment(points[q], points[q] + directions[q] * (bestRayDist * 1.01f)));
+		REQUIRE(!bvh.IntersectsSegment(points[q], points[q] + directions[q] * (bestRayDist * 0.99f)));
+	}
+
+	REQUIRE(rayHitCount > 0);
+
+	BVHHit hit;
+	REQUIRE(!bvh.ClosestPoint(Vector3(0.0f, 0.0f, 100.0f), hit, 1.0f));
+}
+
+TEST_CASE("Shape BVH is cached until the geometry changes", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_Static_SE";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto shape = nif.GetShapes().front();
+	auto bvh = nif.GetShapeBVH(shape);
+	REQUIRE(bvh);
+	REQUIRE(nif.GetShapeBVH(shape) == bvh);
+
+	// Rays from outside the bounds towards the center hit the shape
+	const BoundingSphere bounds = shape->GetBounds();
+	const Vector3 origin = bounds.center + Vector3(0.0f, 0.0f, bounds.radius * 2.0f);
+	BVHHit hit;
+	REQUIRE(bvh->Raycast(origin, bounds.center - origin, hit));
+
+	// A different transform rebuilds it
+	MatTransform transform = nif.GetShapeTransformToGlobal(shape);
+	transform.translation += Vector3(1.0f, 2.0f, 3.0f);
+	auto movedBVH = nif.GetShapeBVH(shape, transform);
+	REQUIRE(movedBVH != bvh);
+	REQUIRE(nif.GetShapeBVH(shape, transform) == movedBVH);
+
+	nif.OffsetShape(shape, Vector3(0.0f, 0.0f, 10.0f));
+	auto offsetBVH = nif.GetShapeBVH(shape, transform);
+	REQUIRE(offsetBVH != movedBVH);
+
+	// The previous tree stays usable for whoever still holds it
+	BVHHit offsetHit;
+	REQUIRE(movedBVH->ClosestPoint(transform.ApplyTransform(bounds.center), hit));
+	REQUIRE(offsetBVH->ClosestPoint(transform.ApplyTransform(bounds.center), offsetHit));
+	REQUIRE(hit.distance != offsetHit.distance);
+
+	// Moving a single vertex keeps the counts, but still invalidates the cache
+	nif.MoveVertex(shape, Vector3(0.0f, 0.0f, 100.0f), 0);
+	REQUIRE(!shape->GetCachedBVH());
+	REQUIRE(nif.GetShapeBVH(shape, transform) != offsetBVH);
+}
+
+TEST_CASE("Mesh topology adjacency and components", "[NifFile]") {
+	// Two triangles sharing an edge, a separate triangle, a degenerate one and one with invalid indices
+	const std::vector<Triangle> tris{{0, 1, 2}, {2, 1, 3}, {4, 5, 6}, {4, 4, 5}, {0, 1, 9}};
+	const MeshTopology topology(8, tris);
+
+	REQUIRE(topology.GetNumVertices() == 8);
+	REQUIRE(topology.GetNumTriangles() == 5);
+	REQUIRE(topology.GetNumEdges() == 8);
+
+	const uint32_t shared = topology.FindEdge(2, 1);
+	REQUIRE(shared != MeshTopology::npos);
+	REQUIRE(topology.FindEdge(1, 2) == shared);
+	REQUIRE(topology.FindEdge(0, 3) == MeshTopology::npos);
+	REQUIRE(topology.FindEdge(0, 9) == MeshTopology::npos);
+	REQUIRE(topology.GetEdge(shared).p1 == 1);
+	REQUIRE(topology.GetEdge(shared).p2 == 2);
+
+	const auto sharedTris = topology.GetEdgeTriangles(shared);
+	REQUIRE(sharedTris.size() == 2);
+	REQUIRE(sharedTris[0] == 0);
+	REQUIRE(sharedTris[1] == 1);
+	REQUIRE(!topology.IsBoundaryEdge(shared));
+	REQUIRE(topology.GetTriangleEdges(0)[1] == shared);
+	REQUIRE(topology.GetTriangleEdges(1)[0] == shared);
+
+	// The degenerate triangle uses edge 4-5 twice and has a collapsed edge
+	const uint32_t edge45 = topology.FindEdge(4, 5);
+	REQUIRE(topology.GetEdgeTriangles(edge45).size() == 2);
+	REQUIRE(topology.GetTriangleEdges(3)[0] == MeshTopology::npos);
+	REQUIRE(topology.GetVertexTriangles(4).size() == 2);
+
+	const auto vert1Tris = topology.GetVertexTriangles(1);
+	REQUIRE(vert1Tris.size() == 2);
+	REQUIRE(topology.GetVertexEdges(1).size() == 3);
+	REQUIRE(topology.GetVertexTriangles(7).empty());
+	REQUIRE(topology.GetVertexTriangles(9).empty());
+
+	// Everything but the shared edge is a boundary
+	REQUIRE(topology.GetBoundaryEdges().size() == 6);
+	REQUIRE(topology.GetNonManifoldEdges().empty());
+	REQUIRE(topology.IsBoundaryVertex(0));
+	REQUIRE(!topology.IsBoundaryVertex(7));
+
+	REQUIRE(topology.GetNumComponents() == 2);
+	REQUIRE(topology.GetTriangleComponent(0) == 0);
+	REQUIRE(topology.GetTriangleComponent(1) == 0);
+	REQUIRE(topology.GetTriangleComponent(2) == 1);
+	REQUIRE(topology.GetTriangleComponent(3) == 1);
+	REQUIRE(topology.GetTriangleComponent(4) == MeshTopology::npos);
+	REQUIRE(topology.GetComponentTriangles(1).size() == 2);
+	REQUIRE(topology.GetComponentTriangles(2).empty());
+}
+
+TEST_CASE("Shape topology is cached until the triangles change", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_Static_SE";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto shape = nif.GetShapes().front();
+	auto topology = nif.GetShapeTopology(shape);
+	REQUIRE(topology);
+	REQUIRE(nif.GetShapeTopology(shape) == topology);
+	REQUIRE(topology->GetNumVertices() == shape->GetNumVertices());
+
+	std::vector<Triangle> tris;
+	shape->GetTriangles(tris);
+	REQUIRE(topology->GetNumTriangles() == tris.size());
+
+	// Every triangle is listed by its vertices and edges
+	size_t edgeTriCount = 0;
+	for (uint32_t t = 0; t < tris.size(); t++) {
+		for (int c = 0; c < 3; c++) {
+			const auto vertTris = topology->GetVertexTriangles(tris[t][c]);
+			REQUIRE(std::find(vertTris.begin(), vertTris.end(), t) != vertTris.end());
+
+			const uint32_t e = topology->GetTriangleEdges(t)[static_cast<size_t>(c)];
+			REQUIRE(e == topology->FindEdge(tris[t][c], tris[t][(c + 1) % 3]));
+
+			const auto edgeTris = topology->GetEdgeTriangles(e);
+			REQUIRE(std::find(edgeTris.begin(), edgeTris.end(), t) != edgeTris.end());
+		}
+	}
+
+	for (uint32_t e = 0; e < topology->GetNumEdges(); e++)
+		edgeTriCount += topology->GetEdgeTriangles(e).size();
+	REQUIRE(edgeTriCount == tris.size() * 3);
+
+	size_t compTriCount = 0;
+	for (uint32_t c = 0; c < topology->GetNumComponents(); c++)
+		compTriCount += topology->GetComponentTriangles(c).size();
+	REQUIRE(compTriCount == tris.size());
+
+	// Triangle edits invalidate the cache
+	tris.pop_back();
+	shape->SetTriangles(tris);
+	REQUIRE(!shape->GetCachedTopology());
+
+	auto editedTopology = nif.GetShapeTopology(shape);
+	REQUIRE(editedTopology != topology);
+	REQUIRE(editedTopology->GetNumTriangles() == tris.size());
+	REQUIRE(topology->GetNumTriangles() == tris.size() + 1);
+}
+
+TEST_CASE("Regenerating meshlets invalidates the shape caches (SF)", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_SF";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto geom = dynamic_cast<BSGeometry*>(nif.GetShapes().front());
+	REQUIRE(geom);
+	LoadAllExternalMeshData(nif, geom);
+
+	REQUIRE(nif.GetShapeBVH(geom));
+	REQUIRE(nif.GetShapeTopology(geom));
+
+	// Existing meshlets are kept and the caches with them
+	geom->GenerateMeshlets();
+	REQUIRE(geom->GetCachedBVH());
+	REQUIRE(geom->GetCachedTopology());
+
+	// Spatial meshlets reorder the triangles
+	geom->GenerateMeshlets(64, 64, false, true);
+	REQUIRE(!geom->GetCachedBVH());
+	REQUIRE(!geom->GetCachedTopology());
+
+	// The caches belong to the selected mesh
+	auto topology = nif.GetShapeTopology(geom);
+	REQUIRE(geom->SelectMesh(0));
+	REQUIRE(geom->GetCachedTopology() == topology);
+	geom->AddMesh();
+	REQUIRE(!geom->GetCachedTopology());
+	REQUIRE(nif.GetShapeTopology(geom) != topology);
+	geom->ReleaseMesh();
+	REQUIRE(!geom->GetCachedTopology());
+}
+
+TEST_CASE("Calculate bounding volumes", "[NifFile]") {
+	// Points of a long, rotated box
+	const Matrix3 rotation = Matrix3::MakeRotation(0.5f, 0.3f, 0.2f);
+
+	uint32_t seed = 99;
+	auto next = [&seed](const float range) {
+		seed = seed * 1664525u + 1013904223u;
+		return (static_cast<float>(seed >> 8) / static_cast<float>(1u << 24) - 0.5f) * range;
+	};
+
+	std::vector<Vector3> points;
+	for (int i = 0; i < 2000; i++)
+		points.push_back(rotation * Vector3(next(40.0f), next(8.0f), next(4.0f))
+						 + Vector3(3.0f, -2.0f, 1.0f));
+
+	const BoundingSphere exact(points);
+	const BoundingSphere exactSpan(Span<const Vector3>(points), BoundsMethod::Exact);
+	REQUIRE(exactSpan.center == exact.center);
+	REQUIRE(exactSpan.radius == exact.radius);
+
+	const BoundingSphere fast(points, BoundsMethod::Fast);
+	REQUIRE(fast.radius >= exact.radius);
+	REQUIRE(fast.radius <= exact.radius * 1.25f);
+
+	const BoundingBox box(points);
+	REQUIRE(box.IsValid());
+	REQUIRE(!BoundingBox().IsValid());
+
+	const OrientedBoundingBox obb(points);
+	const Vector3 boxExtent = box.HalfExtent();
+	REQUIRE(obb.halfExtent.x * obb.halfExtent.y * obb.halfExtent.z
+			< boxExtent.x * boxExtent.y * boxExtent.z * 0.5f);
+
+	const Matrix3 toBox = obb.rotation.Transpose();
+	for (const Vector3& p : points) {
+		REQUIRE(exact.center.DistanceTo(p) <= exact.radius * 1.0001f);
+		REQUIRE(fast.center.DistanceTo(p) <= fast.radius);
+
+		REQUIRE(p.x >= box.min.x);
+		REQUIRE(p.y >= box.min.y);
+		REQUIRE(p.z >= box.min.z);
+		REQUIRE(p.x <= box.max.x);
+		REQUIRE(p.y <= box.max.y);
+		REQUIRE(p.z <= box.max.z);
+
+		const Vector3 local = toBox * (p - obb.center);
+		REQUIRE(std::fabs(local.x) <= obb.halfExtent.x * 1.0001f);
+		REQUIRE(std::fabs(local.y) <= obb.halfExtent.y * 1.0001f);
+		REQUIRE(std::fabs(local.z) <= obb.halfExtent.z * 1.0001f);
+	}
+}
+
+TEST_CASE("Save with fast bounds", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_Static_SE";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto shape = nif.GetShapes().front();
+	const std::vector<Vector3> verts = *nif.GetVertsForShape(shape);
+	const BoundingSphere exact(verts);
+	const BoundingSphere fast(verts, BoundsMethod::Fast);
+
+	NifSaveOptions saveOptions;
+	saveOptions.boundsMethod = BoundsMethod::Fast;
+	std::stringstream stream;
+	REQUIRE(nif.Save(stream, saveOptions) == 0);
+	REQUIRE(shape->GetBounds().center == fast.center);
+	REQUIRE(shape->GetBounds().radius == fast.radius);
+
+	REQUIRE(nif.Save(stream) == 0);
+	REQUIRE(shape->GetBounds().center == exact.center);
+	REQUIRE(shape->GetBounds().radius == exact.radius);
+}
+
+TEST_CASE("Update multi bounds (SE)", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_MultiBound_SE";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto& hdr = nif.GetHeader();
+	BSMultiBoundOBB* obb = nullptr;
+	for (uint32_t i = 0; i < hdr.GetNumBlocks() && !obb; i++)
+		obb = hdr.GetBlock<BSMultiBoundOBB>(i);
+
+	REQUIRE(obb != nullptr);
+	const Vector3 center = obb->center;
+	const Vector3 size = obb->size;
+
+	// The stored box is axis-aligned around all shapes below the node
+	REQUIRE(nif.UpdateMultiBounds() == 1);
+	REQUIRE(obb->center.DistanceTo(center) < 0.01f);
+	REQUIRE(obb->size.DistanceTo(size) < 0.01f);
+}
+
+TEST_CASE("Transform points and directions with weights", "[NifFile]") {
+	std::vector<Vector3> points{Vector3(1.0f, 2.0f, 3.0f),
+								Vector3(-4.0f, 5.0f, 0.5f),
+								Vector3(7.0f, 0.0f, -2.0f)};
+	const std::vector<Vector3> original = points;
+
+	// Pure translations move the points by exactly the offset times the weight
+	Matrix4 offset;
+	offset[3] = 0.25f;
+	offset[7] = -1.0f;
+	offset[11] = 3.0f;
+	const std::vector<float> weights{0.0f, 0.5f};
+	TransformPoints(points, offset, weights);
+	REQUIRE(points[0] == original[0]);
+	REQUIRE(points[1] == original[1] + Vector3(0.125f, -0.5f, 1.5f));
+	REQUIRE(points[2] == original[2] + Vector3(0.25f, -1.0f, 3.0f));
+
+	points = original;
+	Matrix4 rotation;
+	rotation.Rotate(90.0f * DEG2RAD, Vector3(0.0f, 0.0f, 1.0f));
+	rotation[3] = 1.0f;
+	TransformPoints(points, rotation);
+	for (size_t i = 0; i < points.size(); i++)
+		REQUIRE(points[i].DistanceTo(rotation * original[i]) < EPSILON);
+
+	std::vector<Vector3> dirs{Vector3(1.0f, 0.0f, 0.0f), Vector3(1.0f, 0.0f, 0.0f), Vector3()};
+	const Matrix3 rotation3(Vector3(0.0f, -1.0f, 0.0f), Vector3(1.0f, 0.0f, 0.0f), Vector3(0.0f, 0.0f, 1.0f));
+	TransformDirections(dirs, rotation3, std::vector<float>{0.5f});
+	REQUIRE(FloatsAreNearlyEqual(dirs[0].length(), 1.0f));
+	REQUIRE(dirs[0].DistanceTo((Vector3(1.0f, 0.0f, 0.0f) + rotation3 * Vector3(1.0f, 0.0f, 0.0f)) / 2.0f
+							   / std::sqrt(0.5f))
+			< EPSILON);
+	REQUIRE(dirs[1].DistanceTo(rotation3 * Vector3(1.0f, 0.0f, 0.0f)) < EPSILON);
+	REQUIRE(dirs[2] == Vector3());
+}
+
+TEST_CASE("Transform shapes (SE)", "[NifFile]") {
+	constexpr auto fileName = "TestNifFile_Static_SE";
+	const auto fileInput = std::get<0>(GetFileTuple(fileName, nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto shapes = nif.GetShapes();
+	REQUIRE(!shapes.empty());
+
+	auto shape = shapes[0];
+	std::vector<Vector3> verts;
+	REQUIRE(nif.GetVertsForShape(shape, verts));
+	REQUIRE(verts.size() > 2);
+
+	auto normalsPtr = nif.GetNormalsForShape(shape);
+	REQUIRE(normalsPtr != nullptr);
+	const std::vector<Vector3> normals = *normalsPtr;
+
+	Matrix4 mat;
+	mat.Rotate(90.0f * DEG2RAD, Vector3(0.0f, 0.0f, 1.0f));
+	mat[3] = 10.0f;
+
+	// The first vertex is masked, the second one moves half the way
+	const std::vector<float> weights{0.0f, 0.5f};
+	nif.TransformShape(shape, mat, weights);
+
+	std::vector<Vector3> newVerts;
+	REQUIRE(nif.GetVertsForShape(shape, newVerts));
+	REQUIRE(newVerts[0] == verts[0]);
+	REQUIRE(newVerts[1].DistanceTo((verts[1] + mat * verts[1]) / 2.0f) < 0.001f);
+	for (size_t i = 2; i < verts.size(); i++)
+		REQUIRE(newVerts[i].DistanceTo(mat * verts[i]) < 0.001f);
+
+	// Normals are packed in 8 bits per component
+	const std::vector<Vector3> newNormals = *nif.GetNormalsForShape(shape);
+	const Matrix3 rotation(Vector3(mat[0], mat[1], mat[2]),
+						   Vector3(mat[4], mat[5], mat[6]),
+						   Vector3(mat[8], mat[9], mat[10]));
+	for (size_t i = 2; i < normals.size(); i++)
+		REQUIRE(newNormals[i].DistanceTo(rotation * normals[i]) < 0.03f);
+
+	// Batch version with a translation, unweighted
+	std::vector<std::vector<Vector3>> before;
+	for (auto& s : shapes) {
+		nif.GetVertsForShape(s, verts);
+		before.push_back(verts);
+	}
+
+	Matrix4 offset;
+	offset[11] = -2.0f;
+	nif.TransformShapes(shapes, offset);
+
+	for (size_t s = 0; s < shapes.size(); s++) {
+		REQUIRE(nif.GetVertsForShape(shapes[s], verts));
+		REQUIRE(verts.size() == before[s].size());
+		for (size_t i = 0; i < verts.size(); i++)
+			REQUIRE(verts[i] == before[s][i] + Vector3(0.0f, 0.0f, -2.0f));
+	}
+
+	// Scaling from the root without a mask
+	Vector3 root;
+	nif.GetRootTranslation(root);
+	const Vector3 scale(2.0f, 1.0f, 0.5f);
+	nif.GetVertsForShape(shape, verts);
+	nif.ScaleShape(shape, scale);
+	REQUIRE(nif.GetVertsForShape(shape, newVerts));
+	for (size_t i = 0; i < verts.size(); i++)
+		REQUIRE(newVerts[i].DistanceTo((verts[i] - root).ComponentMultiply(scale)) < 0.001f);
+}
+
+TEST_CASE("Merge shapes with equal properties (SE)", "[NifFile]") {
+	NifFile nif;
+	nif.Create(NiVersion::getSSE());
+
+	const std::vector<Vector3> verts{
+		{0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}};
+	const std::vector<Triangle> tris{{0, 1, 2}, {0, 2, 3}};
+	const std::vector<Vector3> normals(verts.size(), Vector3(0.0f, 0.0f, 1.0f));
+	std::vector<Vector2> uvs{{0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 1.0f}};
+
+	auto shape1 = nif.CreateShapeFromData("Quad1", &verts, &tris, &uvs, &normals);
+
+	// The second quad continues the first one in global and texture space, so two vertices are welded
+	for (auto& uv : uvs)
+		uv.u += 1.0f;
+
+	auto shape2 = nif.CreateShapeFromData("Quad2", &verts, &tris, &uvs, &normals);
+	MatTransform xform;
+	xform.translation = Vector3(1.0f, 0.0f, 0.0f);
+	shape2->SetTransformToParent(xform);
+
+	// A different texture keeps the third quad apart
+	auto shape3 = nif.CreateShapeFromData("Quad3", &verts, &tris, &uvs, &normals);
+	std::string texture = "textures\\other.dds";
+	nif.SetTextureSlot(shape3, texture);
+
+	const auto merged = nif.MergeShapes();
+	REQUIRE(merged.size() == 1);
+	REQUIRE(merged[0] == shape1);
+
+	const auto shapes = nif.GetShapes();
+	REQUIRE(shapes.size() == 2);
+	REQUIRE(std::find(shapes.begin(), shapes.end(), shape3) != shapes.end());
+
+	REQUIRE(shape1->GetNumVertices() == 6);
+	REQUIRE(shape1->GetNumTriangles() == 4);
+
+	std::vector<Vector3> mergedVerts;
+	REQUIRE(nif.GetVertsForShape(shape1, mergedVerts));
+	const Vector3 farCorner(2.0f, 1.0f, 0.0f);
+	REQUIRE(std::find(mergedVerts.begin(), mergedVerts.end(), farCorner) != mergedVerts.end());
+	REQUIRE(shape1->GetBounds().radius > 1.1f);
+
+	// The shader and texture set of the second quad were deleted with it
+	uint32_t numTextureSets = 0;
+	for (uint32_t i = 0; i < nif.GetHeader().GetNumBlocks(); i++)
+		if (nif.GetHeader().GetBlock<BSShaderTextureSet>(i))
+			numTextureSets++;
+
+	REQUIRE(numTextureSets == 2);
+}
+
+TEST_CASE("Merge skinned shapes (SE)", "[NifFile]") {
+	const auto fileInput = std::get<0>(GetFileTuple("TestNifFile_Skinned_SE", nifSuffix));
+	const auto fileOutput = std::get<1>(GetFileTuple("TestNifFile_Merge_Skinned_SE", nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto shape = nif.GetShapes()[0];
+	const uint16_t numVerts = shape->GetNumVertices();
+	const uint32_t numTris = shape->GetNumTriangles();
+
+	std::vector<std::string> bones;
+	nif.GetShapeBoneList(shape, bones);
+
+	NiVector<BSDismemberSkinInstance::PartitionInfo> partInfos;
+	std::vector<int> triParts;
+	REQUIRE(nif.GetShapePartitions(shape, partInfos, triParts));
+
+	// A copy has the same skin space, bones and vertices, so all vertices are welded
+	auto copy = nif.CloneShape(shape, "Copy");
+	REQUIRE(copy);
+
+	const auto merged = nif.MergeShapes({shape, copy});
+	REQUIRE(merged.size() == 1);
+	REQUIRE(shape->GetNumVertices() == numVerts);
+	REQUIRE(shape->GetNumTriangles() == numTris * 2);
+
+	std::vector<std::string> mergedBones;
+	nif.GetShapeBoneList(shape, mergedBones);
+	REQUIRE(mergedBones == bones);
+
+	NiVector<BSDismemberSkinInstance::PartitionInfo> mergedPartInfos;
+	std::vector<int> mergedTriParts;
+	REQUIRE(nif.GetShapePartitions(shape, mergedPartInfos, mergedTriParts));
+	REQUIRE(mergedPartInfos.size() == partInfos.size());
+	REQUIRE(mergedTriParts.size() == triParts.size() * 2);
+	for (size_t i = 0; i < triParts.size(); i++)
+		REQUIRE(mergedTriParts[i + triParts.size()] == mergedTriParts[i]);
+
+	REQUIRE(nif.Save(fileOutput) == 0);
+
+	NifFile reloaded;
+	REQUIRE(reloaded.Load(fileOutput) == 0);
+	REQUIRE(reloaded.GetShapes().size() == nif.GetShapes().size());
+}
+
+TEST_CASE("Split skinned shape (SE)", "[NifFile]") {
+	const auto fileInput = std::get<0>(GetFileTuple("TestNifFile_Skinned_SE", nifSuffix));
+	const auto fileOutput = std::get<1>(GetFileTuple("TestNifFile_Split_Skinned_SE", nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	const size_t numShapes = nif.GetShapes().size();
+	auto shape = nif.GetShapes()[0];
+	const uint32_t numTris = shape->GetNumTriangles();
+	REQUIRE(numTris > 40);
+
+	std::vector<std::string> bones;
+	nif.GetShapeBoneList(shape, bones);
+
+	const size_t maxVerts = 60;
+	const size_t maxTris = 40;
+	const auto parts = nif.SplitShape(shape, maxVerts, maxTris);
+	REQUIRE(parts.size() > 1);
+	REQUIRE(parts[0] == shape);
+	REQUIRE(nif.GetShapes().size() == numShapes + parts.size() - 1);
+
+	uint32_t partTris = 0;
+	for (auto& part : parts) {
+		REQUIRE(part->GetNumVertices() <= maxVerts);
+		REQUIRE(part->GetNumTriangles() <= maxTris);
+		partTris += part->GetNumTriangles();
+
+		std::vector<std::string> partBones;
+		nif.GetShapeBoneList(part, partBones);
+		REQUIRE(partBones == bones);
+
+		// Every triangle still belongs to a partition of the part
+		NiVector<BSDismemberSkinInstance::PartitionInfo> partInfos;
+		std::vector<int> triParts;
+		REQUIRE(nif.GetShapePartitions(part, partInfos, triParts));
+		REQUIRE(triParts.size() == part->GetNumTriangles());
+		for (auto& p : triParts)
+			REQUIRE((p >= 0 && static_cast<size_t>(p) < partInfos.size()));
+	}
+
+	REQUIRE(partTris == numTris);
+
+	REQUIRE(nif.Save(fileOutput) == 0);
+
+	NifFile reloaded;
+	REQUIRE(reloaded.Load(fileOutput) == 0);
+	REQUIRE(reloaded.GetShapes().size() == nif.GetShapes().size());
+}
+
+TEST_CASE("Calculate shape and UV diffs in dense and sparse form", "[NifFile]") {
+	const auto fileInput = std::get<0>(GetFileTuple("TestNifFile_Static_SE", nifSuffix));
+
+	NifFile nif;
+	REQUIRE(nif.Load(fileInput) == 0);
+
+	auto shape = nif.GetShapes()[0];
+	const auto verts = *nif.GetVertsForShape(shape);
+	const auto uvs = *nif.GetUvsForShape(shape);
+
+	// Every third vertex moves in the first target, every fifth in the second
+	std::vector<Vector3> target1 = verts;
+	std::vector<Vector3> target2 = verts;
+	std::vector<Vector2> uvTarget = uvs;
+	for (size_t i = 0; i < verts.size(); i++) {
+		if (i % 3 == 0)
+			target1[i] += Vector3(1.0f, 0.0f, -2.0f);
+		if (i % 5 == 0)
+			target2[i].y += 0.5f;
+		if (i % 2 == 0)
+			uvTarget[i].u += 0.25f;
+	}
+
+	std::unordered_map<uint32_t, Vector3> mapDiff;
+	REQUIRE(nif.CalcShapeDiff(shape, &target1, mapDiff) == 0);
+
+	std::vector<Vector3> denseDiff;
+	REQUIRE(nif.CalcShapeDiff(shape, &target1, denseDiff) == 0);
+	REQUIRE(denseDiff.size() == verts.size());
+
+	SparseDiffData sparseDiff;
+	REQUIRE(nif.CalcShapeDiff(shape, &target1, sparseDiff) == 0);
+	REQUIRE(sparseDiff.GetTargetCount() == 1);
+	REQUIRE(sparseDiff.indices.size() == mapDiff.size());
+	REQUIRE(sparseDiff.indices.size() == (verts.size() + 2) / 3);
+
+	for (size_t i = 0; i < sparseDiff.indices.size(); i++) {
+		const uint32_t index = sparseDiff.indices[i];
+		REQUIRE(index % 3 == 0);
+		REQUIRE(mapDiff[index] == sparseDiff.diffs[i]);
+		REQUIRE(denseDiff[index] == sparseDiff.diffs[i]);
+	}
+
+	for (size_t i = 0; i < denseDiff.size(); i++)
+		if (i % 3 != 0)
+			REQUIRE(denseDiff[i].IsZero());
+
+	// The batch form has one row per target, matching the single target form
+	SparseDiffData batchDiff;
+	REQUIRE(nif.CalcShapeDiffs(shape, {&target1, &verts, &target2}, batchDiff) == 0);
+	REQUIRE(batchDiff.GetTargetCount() == 3);
+	REQUIRE(batchDiff.offsets[1] == sparseDiff.indices.size());
+	REQUIRE(batchDiff.offsets[2] == batchDiff.offsets[1]);
+	REQUIRE(batchDiff.offsets[3] - batchDiff.offsets[2] == (verts.size() + 4) / 5);
+	REQUIRE(std::equal(sparseDiff.indices.begin(), sparseDiff.indices.end(), batchDiff.indices.begin()));
+
+	for (uint32_t i = batchDiff.offsets[2]; i < batchDiff.offsets[3]; i++) {
+		REQUIRE(batchDiff.indices[i] % 5 == 0);
+		REQUIRE(std::fabs(batchDiff.diffs[i].y - 0.5f) < EPSILON);
+	}
+
+	std::vector<Vector3> wrongSize(verts.size() + 1);
+	REQUIRE(nif.CalcShapeDiffs(shape, {&target1, &wrongSize}, batchDiff) == 3);
+	REQUIRE(batchDiff.GetTargetCount() == 0);
+
+	std::unordered_map<uint32_t, Vector3> uvMapDiff;
+	REQUIRE(nif.CalcUVDiff(shape, &uvTarget, uvMapDiff, 2.0f) == 0);
+
+	SparseDiffData uvDiff;
+	REQUIRE(nif.CalcUVDiffs(shape, {&uvTarget, &uvs}, uvDiff, 2.0f) == 0);
+	REQUIRE(uvDiff.GetTargetCount() == 2);
+	REQUIRE(uvDiff.offsets[1] == uvMapDiff.size());
+	REQUIRE(uvDiff.offsets[2] == uvDiff.offsets[1]);
+	for (uint32_t i = 0; i < uvDiff.offsets[1]; i++) {
+		REQUIRE(std::fabs(uvDiff.diffs[i].x - 0.5f) < EPSILON);
+		REQUIRE(uvMapDiff[uvDiff.indices[i]] == uvDiff.diffs[i]);
+	}
+}
+
+TEST_CASE("Packed vertex streams match the scalar conversion", "[NifFile]") {
+	NiHeader hdr;
+	hdr.SetVersion(NiVersion::getSF());
+
+	auto sameBits = [](const float a, const float b) {
+		return std::memcmp(&a, &b, sizeof(float)) == 0 || (std::isnan(a) && std::isnan(b));
+	};
+
+	// Every half value
+	std::vector<uint16_t> halfs(0x10000);
+	for (uint32_t i = 0; i < 0x10000; i++)
+		halfs[i] = static_cast<uint16_t>(i);
+
+	std::stringstream halfData(std::string(reinterpret_cast<const char*>(halfs.data()), halfs.size() * 2));
+	NiIStream halfStream(&halfData, &hdr);
+	NiStreamReversible halfReader(&halfStream, nullptr, NiStreamReversible::Mode::Reading);
+
+	std::vector<float> unpackedHalfs(halfs.size());
+	UnpackHalfs(halfs, unpackedHalfs);
+	for (uint32_t i = 0; i < 0x10000; i++) {
+		float value = 0.0f;
+		halfReader.SyncHalf(value);
+		REQUIRE(sameBits(unpackedHalfs[i], value));
+	}
+
+	// Floats spread over all bit patterns, plus values at and around rounding boundaries
+	std::vector<float> floats;
+	for (uint64_t bits = 0; bits <= 0xFFFFFFFF; bits += 65521) {
+		float value;
+		const auto bits32 = static_cast<uint32_t>(bits);
+		std::memcpy(&value, &bits32, sizeof(float));
+		floats.push_back(value);
+	}
+	for (const float f : unpackedHalfs)
+		if (!std::isnan(f))
+			for (const float d : {f, std::nextafter(f, 1e10f), std::nextafter(f, -1e10f)})
+				floats.push_back(d);
+
+	std::stringstream packedData;
+	NiOStream packedStream(&packedData, &hdr);
+	NiStreamReversible halfWriter(nullptr, &packedStream, NiStreamReversible::Mode::Writing);
+	for (float f : floats)
+		halfWriter.SyncHalf(f);
+
+	std::vector<uint16_t> packedHalfs(floats.size());
+	PackHalfs(floats, packedHalfs);
+	const std::string expectedHalfs = packedData.str();
+	REQUIRE(expectedHalfs.size() == packedHalfs.size() * 2);
+	REQUIRE(std::memcmp(expectedHalfs.data(), packedHalfs.data(), expectedHalfs.size()) == 0);
+
+	// Normals and tangents across the whole range
+	std::vector<Vector3> vecs;
+	std::vector<uint8_t> ws;
+	for (int i = -1100; i <= 1100; i++) {
+		const float f = static_cast<float>(i) / 1100.0f;
+		vecs.emplace_back(f, -f * 0.999f, std::nextafter(f, 0.0f));
+		ws.push_back(static_cast<uint8_t>(i & 3));
+	}
+
+	std::stringstream udecData;
+	NiOStream udecStream(&udecData, &hdr);
+	NiStreamReversible udecWriter(nullptr, &udecStream, NiStreamReversible::Mode::Writing);
+	for (size_t i = 0; i < vecs.size(); i++)
+		udecWriter.SyncUDEC3(vecs[i], ws[i]);
+
+	std::vector<uint32_t> packedVecs(vecs.size());
+	PackUDEC3(vecs, ws, packedVecs);
+	const std::string expectedVecs = udecData.str();
+	REQUIRE(std::memcmp(expectedVecs.data(), packedVecs.data(), expectedVecs.size()) == 0);
+
+	NiIStream udecInStream(&udecData, &hdr);
+	NiStreamReversible udecReader(&udecInStream, nullptr, NiStreamReversible::Mode::Reading);
+	std::vector<Vector3> unpackedVecs(vecs.size());
+	std::vector<uint8_t> unpackedWs(vecs.size());
+	UnpackUDEC3(packedVecs, unpackedVecs, unpackedWs);
+	for (size_t i = 0; i < vecs.size(); i++) {
+		Vector3 vec;
+		uint8_t w = 0;
+		udecReader.SyncUDEC3(vec, w);
+		REQUIRE(sameBits(unpackedVecs[i].x, vec.x));
+		REQUIRE(sameBits(unpackedVecs[i].y, vec.y));
+		REQUIRE(sameBits(unpackedVecs[i].z, vec.z));
+		REQUIRE(unpackedWs[i] == w);
+	}
+
+	// Positions, compared to the per-value formulas used before
+	constexpr float scale = 1.75f;
+	constexpr float havokScale = 69.969f;
+
+	std::vector<int16_t> positions;
+	for (int32_t i = -32768; i <= 32767; i++)
+		positions.push_back(static_cast<int16_t>(i));
+	positions.resize(positions.size() / 3 * 3);
+
+	std::vector<Vector3> verts(positions.size() / 3);
+	UnpackPositions(positions, scale, havokScale, verts);
+	for (size_t i = 0; i < positions.size(); i++) {
+		const int16_t val = positions[i];
+		const auto expected = static_cast<float>(val < 0 ? (val / 32768.0) * scale * havokScale
+														  : (val / 32767.0) * scale * havokScale);
+		REQUIRE(sameBits(verts[i / 3][static_cast<int>(i % 3)], expected));
+	}
+
+	std::vector<int16_t> repacked(positions.size());
+	PackPositions(verts, scale, havokScale, repacked);
+	for (size_t i = 0; i < positions.size(); i++) {
+		const float component = verts[i / 3][static_cast<int>(i % 3)];
+		const auto expected = static_cast<int16_t>(
+			std::round((component / (scale * havokScale)) * (component < 0 ? 32768.0f : 32767.0f)));
+		REQUIRE(repacked[i] == expected);
+		REQUIRE(repacked[i] == positions[i]);
+	}
+}
+
+TEST_CASE("Flat KD tree queries match brute force", "[NifFile]") {
+	// Deterministic pseudo-random point cloud with duplicates
+	std::vector<Vector3> points;
+	uint32_t seed = 12345;
+	auto next = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24) * 100.0f;
+	};
+
+	for (uint32_t i = 0; i < 5000; i++)
+		points.emplace_back(next(), next(), next());
+	for (uint32_t i = 0; i < 100; i++)
+		points.push_back(points[i * 7]);
+
+	std::vector<Vector3> queries;
+	for (uint32_t i = 0; i < 200; i++)
+		queries.emplace_back(next(), next(), next());
+	queries.push_back(points[42]);
+
+	kd_flat_tree<uint32_t> tree(points.data(), static_cast<uint32_t>(points.size()));
+	REQUIRE(tree.size() == points.size());
+
+	constexpr uint32_t k = 8;
+	constexpr float radius = 6.0f;
+
+	std::vector<kd_query_result<uint32_t>> knn;
+	std::vector<std::vector<kd_query_result<uint32_t>>> inRadius;
+	tree.kd_knn_batch(queries.data(), queries.size(), k, knn);
+	tree.kd_radius_batch(queries.data(), queries.size(), radius, inRadius);
+
+	std::vector<kd_query_result<uint32_t>> knnSerial;
+	tree.kd_knn_batch(queries.data(), queries.size(), k, knnSerial, false);
+	REQUIRE(knnSerial.size() == knn.size());
+
+	for (size_t q = 0; q < queries.size(); q++) {
+		std::vector<float> distances;
+		for (auto& p : points)
+			distances.push_back(queries[q].DistanceTo(p));
+
+		std::vector<float> sorted = distances;
+		std::sort(sorted.begin(), sorted.end());
+
+		for (uint32_t i = 0; i < k; i++) {
+			const auto& result = knn[q * k + i];
+			REQUIRE(result.v == &points[result.vertex_index]);
+			REQUIRE(result.distance == sorted[i]);
+			REQUIRE(knnSerial[q * k + i].vertex_index == result.vertex_index);
+		}
+
+		const auto numInRadius = std::count_if(distances.begin(), distances.end(), [&](float d) { return d <= radius; });
+		REQUIRE(inRadius[q].size() == static_cast<size_t>(numInRadius));
+		for (size_t i = 1; i < inRadius[q].size(); i++)
+			REQUIRE(inRadius[q][i - 1].distance <= inRadius[q][i].distance);
+	}
+
+	// Exact hit finds the point and its duplicate
+	std::vector<kd_query_result<uint32_t>> nearest;
+	REQUIRE(tree.kd_knn(points[42], 2, nearest) == 2);
+	REQUIRE(nearest[0].distance == 0.0f);
+	REQUIRE(nearest[1].distance == 0.0f);
+
+	// Fewer points than requested
+	kd_flat_tree<uint16_t> smallTree(points.data(), 3);
+	std::vector<kd_query_result<uint16_t>> smallResult;
+	REQUIRE(smallTree.kd_knn(queries[0], 5, smallResult) == 3);
+	smallTree.kd_knn_batch(queries.data(), 2, 5, smallResult);
+	REQUIRE(smallResult.size() == 10);
+	REQUIRE(smallResult[4].v == nullptr);
+	REQUIRE(smallResult[5].v != nullptr);
+}
+
+TEST_CASE("Recalculate normals with smoothing threshold (SF)", "[NifFile]") {
+	// Two quads folded by 90 degrees along x = 0, sharing the edge through separate, coincident vertices
+	BSGeometryMeshData meshData;
+	meshData.vertices = {Vector3(0.0f, 0.0f, 0.0f),
+						 Vector3(0.0f, 1.0f, 0.0f),
+						 Vector3(1.0f, 0.0f, 0.0f),
+						 Vector3(1.0f, 1.0f, 0.0f),
+						 Vector3(0.0f, 0.0f, 0.0f),
+						 Vector3(0.0f, 1.0f, 0.0f),
+						 Vector3(0.0f, 0.0f, 1.0f),
+						 Vector3(0.0f, 1.0f, 1.0f)};
+	meshData.tris = {Triangle(0, 2, 1), Triangle(1, 2, 3), Triangle(4, 6, 5), Triangle(5, 6, 7)};
+
+	// Vertex count beyond the 16-bit range
+	for (uint32_t i = 0; i < 70000; i++)
+		meshData.vertices.emplace_back(100.0f + static_cast<float>(i), 0.0f, 0.0f);
+
+	const Vector3 up(0.0f, 0.0f, 1.0f);
+	const Vector3 side(-1.0f, 0.0f, 0.0f);
+	Vector3 seam = up + side;
+	seam.Normalize();
+
+	meshData.RecalcNormals(true, 60.0f);
+	REQUIRE(meshData.normals.size() == meshData.vertices.size());
+	REQUIRE(meshData.nNormals == static_cast<uint32_t>(meshData.vertices.size()));
+	REQUIRE(meshData.normals[0].IsNearlyEqualTo(up));
+	REQUIRE(meshData.normals[4].IsNearlyEqualTo(side));
+	REQUIRE(meshData.normals[7].IsNearlyEqualTo(side));
+
+	meshData.RecalcNormals(true, 100.0f);
+	REQUIRE(meshData.normals[0].IsNearlyEqualTo(seam));
+	REQUIRE(meshData.normals[4].IsNearlyEqualTo(seam));
+	REQUIRE(meshData.normals[3].IsNearlyEqualTo(up));
+	REQUIRE(meshData.normals[7].IsNearlyEqualTo(side));
+
+	meshData.RecalcNormals(false);
+	REQUIRE(meshData.normals[0].IsNearlyEqualTo(up));
+}
+
 TEST_CASE("Load external and save as internal mesh data (SF)", "[NifFile]") {
 	constexpr auto fileName = "TestNifFile_ToInternalMesh_SF";
 	const auto [fileInput, fileOutput, fileExpected] = GetFileTuple(fileName, nifSuffix);
@@ -647,6 +2837,56 @@ TEST_CASE("Load and save animation sequence file (MW)", "[NifFile]") {
 	CheckMorrowindFile("TestNifFile_Sequence_MW", kfSuffix);
 }
 
+TEST_CASE("Animation key group storage", "[NifFile]") {
+	NiAnimationKeyGroup<Vector3> group;
+	group.SetInterpolationType(QUADRATIC_KEY);
+
+	for (int i = 0; i < 4; i++) {
+		NiAnimationKey<Vector3> key;
+		key.time = static_cast<float>(i);
+		key.value = Vector3(1.0f, 2.0f, static_cast<float>(i));
+		key.forward = Vector3(0.5f, 0.0f, 0.0f);
+		key.backward = Vector3(-0.5f, 0.0f, 0.0f);
+		group.AddKey(key);
+	}
+
+	REQUIRE(group.GetNumKeys() == 4);
+	REQUIRE(group.GetTimes().size() == 4);
+	REQUIRE(group.GetValues()[3].z == 3.0f);
+	REQUIRE(group.GetForwardTangents().size() == 4);
+	REQUIRE(group.GetTBCs().empty());
+
+	// Write and read back the group
+	NiHeader hdr;
+	hdr.SetVersion(NiVersion::getSSE());
+
+	std::stringstream data;
+	NiOStream ostream(&data, &hdr);
+	NiStreamReversible writer(nullptr, &ostream, NiStreamReversible::Mode::Writing);
+	group.Sync(writer);
+	REQUIRE(data.str().size() == 8 + 4 * (4 + 3 * 12));
+
+	NiAnimationKeyGroup<Vector3> loaded;
+	NiIStream istream(&data, &hdr);
+	NiStreamReversible reader(&istream, nullptr, NiStreamReversible::Mode::Reading);
+	loaded.Sync(reader);
+
+	REQUIRE(loaded.GetNumKeys() == 4);
+	REQUIRE(loaded.GetInterpolationType() == QUADRATIC_KEY);
+	REQUIRE(loaded.GetKey(2).value == Vector3(1.0f, 2.0f, 2.0f));
+	REQUIRE(loaded.GetKey(2).backward == Vector3(-0.5f, 0.0f, 0.0f));
+
+	// Linear keys don't keep any tangents
+	loaded.SetInterpolationType(LINEAR_KEY);
+	REQUIRE(loaded.GetForwardTangents().empty());
+	REQUIRE(loaded.GetBackwardTangents().empty());
+	REQUIRE(loaded.GetValues().size() == 4);
+
+	loaded.RemoveKey(0);
+	REQUIRE(loaded.GetNumKeys() == 3);
+	REQUIRE(loaded.GetTimes()[0] == 1.0f);
+}
+
 TEST_CASE("Save unmodified file without changes (MW)", "[NifFile]") {
 	// Every file of the game has to be written back byte for byte when nothing is changed
 	for (auto fileName : {"TestNifFile_Static_MW",
@@ -29,6 +29,11 @@ target("nifly", function()
 
     -- add flags
     add_cxxflags("cl::/Zc:inline", "cl::/bigobj")
+
+    -- link thread library
+    if is_plat("linux", "bsd") then
+        add_syslinks("pthread", { public = true })
+    end
 end)
 
 if has_config("tests") then